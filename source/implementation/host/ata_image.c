@@ -0,0 +1,161 @@
+// ata_image.c - ATA drives backed by disk image files
+//
+// Implements the ata_* calls blockdev.c makes, so the ATA block device
+// backend and everything above it run unchanged on the host. There is no
+// bus master, so requests always take the synchronous PIO path.
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <unistd.h>
+#include "host.h"
+#include "filesystem.h"
+
+#define IMAGE_SECTOR_SIZE 512
+
+typedef struct {
+    int fd;
+    uint64_t sectors;
+} AtaImage;
+
+static AtaImage images[HOST_ATA_SLOTS] = {{-1, 0}, {-1, 0}, {-1, 0}, {-1, 0}};
+
+static AtaImage *image(int controller, int drive) {
+    int slot = controller * 2 + drive;
+    if (controller < 0 || controller > 1 || drive < 0 || drive > 1 || images[slot].fd < 0) {
+        return 0;
+    }
+    return &images[slot];
+}
+
+uint64_t ata_image_attach(int controller, int drive, const char *path, uint64_t sectors) {
+    if (controller < 0 || controller > 1 || drive < 0 || drive > 1) {
+        return 0;
+    }
+    ata_image_detach(controller, drive);
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return 0;
+    }
+    if (sectors != 0 && ftruncate(fd, (off_t)(sectors * IMAGE_SECTOR_SIZE)) != 0) {
+        close(fd);
+        return 0;
+    }
+    if (sectors == 0) {
+        off_t size = lseek(fd, 0, SEEK_END);
+        sectors = size > 0 ? (uint64_t)size / IMAGE_SECTOR_SIZE : 0;
+    }
+    if (sectors == 0) {
+        close(fd);
+        return 0;
+    }
+
+    AtaImage *slot = &images[controller * 2 + drive];
+    slot->fd = fd;
+    slot->sectors = sectors;
+    return sectors;
+}
+
+void ata_image_detach(int controller, int drive) {
+    AtaImage *slot = image(controller, drive);
+    if (slot != 0) {
+        close(slot->fd);
+        slot->fd = -1;
+        slot->sectors = 0;
+    }
+}
+
+// Whole transfers or nothing, like the drive reporting an error
+static int transfer(AtaImage *slot, uint64_t lba, uint32_t count, uint8_t *buffer, int write) {
+    if (slot == 0 || lba + count > slot->sectors) {
+        return -1;
+    }
+
+    size_t length = (size_t)count * IMAGE_SECTOR_SIZE;
+    off_t offset = (off_t)(lba * IMAGE_SECTOR_SIZE);
+    while (length > 0) {
+        ssize_t done = write ? pwrite(slot->fd, buffer, length, offset) : pread(slot->fd, buffer, length, offset);
+        if (done <= 0) {
+            return -1;
+        }
+        buffer += done;
+        offset += done;
+        length -= (size_t)done;
+    }
+    return 0;
+}
+
+int ata_read_sectors_disk(int controller, int drive, uint32_t lba, uint32_t count, uint8_t *buffer) {
+    return transfer(image(controller, drive), lba, count, buffer, 0);
+}
+
+int ata_write_sectors_disk(int controller, int drive, uint32_t lba, uint32_t count, const uint8_t *buffer) {
+    return transfer(image(controller, drive), lba, count, (uint8_t *)buffer, 1);
+}
+
+int ata_read_sector_disk(int controller, int drive, uint32_t lba, uint8_t *buffer) {
+    return ata_read_sectors_disk(controller, drive, lba, 1, buffer);
+}
+
+int ata_write_sector_disk(int controller, int drive, uint32_t lba, const uint8_t *buffer) {
+    return ata_write_sectors_disk(controller, drive, lba, 1, buffer);
+}
+
+// The host page cache plays the drive's write cache; syncing it to the
+// backing disk would only add noise to the timings
+int ata_flush_disk(int controller, int drive) {
+    return image(controller, drive) != 0 ? 0 : -1;
+}
+
+int ata_dma_available(int controller) {
+    (void)controller;
+    return 0;
+}
+
+int ata_dma_irq_available(int controller) {
+    (void)controller;
+    return 0;
+}
+
+int ata_dma_rw_supported(int controller, int drive) {
+    (void)controller;
+    (void)drive;
+    return 0;
+}
+
+int ata_dma_start_rw(int controller, int drive, uint64_t lba, uint32_t count, uint8_t *buffer, int write) {
+    (void)controller;
+    (void)drive;
+    (void)lba;
+    (void)count;
+    (void)buffer;
+    (void)write;
+    return -1;
+}
+
+int ata_dma_poll(int controller) {
+    (void)controller;
+    return -1;
+}
+
+int ata_dma_wait(int controller) {
+    (void)controller;
+    return -1;
+}
+
+// Punching holes makes discarded sectors read back as zeros
+int ata_trim_supported(int controller, int drive) {
+    return image(controller, drive) != 0;
+}
+
+int ata_trim_disk(int controller, int drive, uint64_t lba, uint64_t count) {
+    AtaImage *slot = image(controller, drive);
+    if (slot == 0 || lba + count > slot->sectors) {
+        return -1;
+    }
+    return fallocate(slot->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t)(lba * IMAGE_SECTOR_SIZE),
+                     (off_t)(count * IMAGE_SECTOR_SIZE)) == 0 ? 0 : -1;
+}
+
+int ata_trim_zeroes(int controller, int drive) {
+    return ata_trim_supported(controller, drive);
+}
@@ -0,0 +1,371 @@
+// bench.c - Host benchmark runner for the freestanding modules
+//
+// Every case runs a few untimed warmup repetitions, then a timed series;
+// the summary is per operation so cases of different sizes compare.
+// A case that reports an error fails the run, so a broken build cannot
+// pass for a fast one.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host.h"
+#include "memory.h"
+#include "memory_allocator.h"
+#include "blockdev.h"
+#include "partition.h"
+
+#define BENCH_DEFAULT_WARMUP 3
+#define BENCH_DEFAULT_REPS   20
+#define BENCH_MAX_REPS       10000
+
+#define BENCH_BUFFER_SIZE    (1024 * 1024)
+#define BENCH_SMALL_COPY     4096
+#define BENCH_STRING_LENGTH  64
+
+#define BENCH_ALLOC_COUNT    4096
+#define BENCH_ALLOC_MAX      4096
+
+// Room for an ext4 and a FAT32 partition past the GPT
+#define BENCH_IMAGE_SECTORS  (256ULL * 1024 * 1024 / 512)
+#define BENCH_PART_SECTORS   (64ULL * 1024 * 1024 / 512)
+#define BENCH_EXT4_LBA       2048
+#define BENCH_FAT32_LBA      (BENCH_EXT4_LBA + BENCH_PART_SECTORS)
+
+typedef struct {
+    const char *name;
+    int (*setup)(void);  // Once before warmup; NULL if none
+    int (*run)(void);    // One repetition; -1 on failure
+    uint64_t ops;        // Operations per repetition
+    uint64_t bytes;      // Bytes processed per repetition, 0 if meaningless
+} BenchCase;
+
+typedef struct {
+    double min;
+    double median;
+    double mean;
+    double stddev;
+    double max;
+} BenchSummary;
+
+static uint8_t source_buffer[BENCH_BUFFER_SIZE + 64] __attribute__((aligned(64)));
+static uint8_t dest_buffer[BENCH_BUFFER_SIZE + 64] __attribute__((aligned(64)));
+static char bench_string[BENCH_STRING_LENGTH + 1];
+static char bench_string_copy[BENCH_STRING_LENGTH + 1];
+static void *blocks[BENCH_ALLOC_COUNT];
+
+static const char *image_path = "bench.img";
+static BlockDevice disk;
+static PartitionMap map;
+
+// The compiler must not drop work whose result is otherwise unused
+static volatile uint64_t sink;
+
+static uint64_t rng_state;
+
+static uint64_t bench_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static int fill_buffers(void) {
+    for (size_t i = 0; i < sizeof(source_buffer); i++) {
+        source_buffer[i] = (uint8_t)(i * 31 + 7);
+    }
+    memory_copy(dest_buffer, source_buffer, sizeof(dest_buffer));
+    for (int i = 0; i < BENCH_STRING_LENGTH; i++) {
+        bench_string[i] = (char)('a' + i % 26);
+    }
+    bench_string[BENCH_STRING_LENGTH] = '\0';
+    memory_copy(bench_string_copy, bench_string, sizeof(bench_string));
+    return 0;
+}
+
+// Memory kernels
+
+static int run_copy_small(void) {
+    for (int i = 0; i < BENCH_BUFFER_SIZE / BENCH_SMALL_COPY; i++) {
+        memory_copy(dest_buffer + i * BENCH_SMALL_COPY, source_buffer + i * BENCH_SMALL_COPY, BENCH_SMALL_COPY);
+    }
+    return 0;
+}
+
+static int run_copy_large(void) {
+    memory_copy(dest_buffer, source_buffer, BENCH_BUFFER_SIZE);
+    return 0;
+}
+
+// Overlapping by one byte in both directions
+static int run_move_overlap(void) {
+    memory_move(dest_buffer + 1, dest_buffer, BENCH_BUFFER_SIZE);
+    memory_move(dest_buffer, dest_buffer + 1, BENCH_BUFFER_SIZE);
+    return 0;
+}
+
+static int run_set(void) {
+    memory_set(dest_buffer, 0x5A, BENCH_BUFFER_SIZE);
+    return 0;
+}
+
+static int run_zero(void) {
+    memory_zero(dest_buffer, BENCH_BUFFER_SIZE);
+    return 0;
+}
+
+static int setup_compare(void) {
+    memory_copy(dest_buffer, source_buffer, BENCH_BUFFER_SIZE);
+    return 0;
+}
+
+// Equal buffers, so the whole length is scanned
+static int run_compare(void) {
+    sink += memory_compare(dest_buffer, source_buffer, BENCH_BUFFER_SIZE);
+    return 0;
+}
+
+static int run_is_zero(void) {
+    memory_zero(dest_buffer, BENCH_BUFFER_SIZE);
+    sink += memory_is_zero(dest_buffer, BENCH_BUFFER_SIZE);
+    return 0;
+}
+
+// Kernel string.c; <string.h> only supplies the prototypes
+static int run_strlen(void) {
+    for (int i = 0; i < 1000; i++) {
+        sink += strlen(bench_string);
+    }
+    return 0;
+}
+
+static int run_strcmp(void) {
+    for (int i = 0; i < 1000; i++) {
+        sink += strcmp(bench_string, bench_string_copy);
+    }
+    return 0;
+}
+
+// Heap allocator; every repetition starts from a fresh pool
+
+static int run_alloc_churn(void) {
+    memory_allocator_init();
+    rng_state = 0x9E3779B97F4A7C15ULL;
+
+    for (int i = 0; i < BENCH_ALLOC_COUNT; i++) {
+        blocks[i] = allocate(16 + bench_random() % BENCH_ALLOC_MAX);
+        if (blocks[i] == NULL) {
+            return -1;
+        }
+    }
+    for (int i = 0; i < BENCH_ALLOC_COUNT; i += 2) {
+        free(blocks[i]);
+    }
+    for (int i = 0; i < BENCH_ALLOC_COUNT; i += 2) {
+        blocks[i] = allocate(16 + bench_random() % BENCH_ALLOC_MAX);
+        if (blocks[i] == NULL) {
+            return -1;
+        }
+    }
+    for (int i = 0; i < BENCH_ALLOC_COUNT; i++) {
+        free(blocks[i]);
+    }
+    return 0;
+}
+
+// Small holes at the front of the list that later, larger requests
+// have to walk past
+static int run_alloc_fragmented(void) {
+    memory_allocator_init();
+
+    for (int i = 0; i < BENCH_ALLOC_COUNT; i++) {
+        blocks[i] = allocate(64);
+        if (blocks[i] == NULL) {
+            return -1;
+        }
+    }
+    for (int i = 1; i < BENCH_ALLOC_COUNT; i += 2) {
+        free(blocks[i]);
+    }
+    for (int i = 1; i < BENCH_ALLOC_COUNT; i += 2) {
+        blocks[i] = allocate(256);
+        if (blocks[i] == NULL) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Partition formatters against the image file
+
+static int setup_disk(void) {
+    uint64_t sectors = ata_image_attach(0, 0, image_path, BENCH_IMAGE_SECTORS);
+    if (sectors == 0) {
+        fprintf(stderr, "bench: cannot create disk image %s\n", image_path);
+        return -1;
+    }
+    blockdev_init_ata(&disk, 0, 0, sectors);
+    memory_allocator_init();
+    return 0;
+}
+
+static int run_init_gpt(void) {
+    if (partition_map_init_gpt(&disk, &map) != 0) {
+        return -1;
+    }
+    if (partition_map_add(&disk, &map, BENCH_EXT4_LBA, BENCH_PART_SECTORS, 0x83) != 0 ||
+        partition_map_add(&disk, &map, BENCH_FAT32_LBA, BENCH_PART_SECTORS, FAT32_PARTITION_TYPE) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static int run_format_fat32(void) {
+    return format_fat32(&disk, BENCH_FAT32_LBA, BENCH_PART_SECTORS);
+}
+
+static int run_format_ext4(void) {
+    return format_ext4(&disk, BENCH_EXT4_LBA, BENCH_PART_SECTORS);
+}
+
+static const BenchCase cases[] = {
+    {"memory_copy/4k", fill_buffers, run_copy_small, BENCH_BUFFER_SIZE / BENCH_SMALL_COPY, BENCH_BUFFER_SIZE},
+    {"memory_copy/1m", fill_buffers, run_copy_large, 1, BENCH_BUFFER_SIZE},
+    {"memory_move/overlap", fill_buffers, run_move_overlap, 2, 2 * BENCH_BUFFER_SIZE},
+    {"memory_set/1m", NULL, run_set, 1, BENCH_BUFFER_SIZE},
+    {"memory_zero/1m", NULL, run_zero, 1, BENCH_BUFFER_SIZE},
+    {"memory_compare/1m", setup_compare, run_compare, 1, BENCH_BUFFER_SIZE},
+    {"memory_is_zero/1m", NULL, run_is_zero, 1, BENCH_BUFFER_SIZE},
+    {"strlen/64", fill_buffers, run_strlen, 1000, 1000 * BENCH_STRING_LENGTH},
+    {"strcmp/64", fill_buffers, run_strcmp, 1000, 1000 * BENCH_STRING_LENGTH},
+    {"allocator/churn", NULL, run_alloc_churn, 3 * BENCH_ALLOC_COUNT, 0},
+    {"allocator/fragmented", NULL, run_alloc_fragmented, BENCH_ALLOC_COUNT * 3 / 2, 0},
+    {"partition/init_gpt", setup_disk, run_init_gpt, 1, 0},
+    {"partition/format_fat32", setup_disk, run_format_fat32, 1, 0},
+    {"partition/format_ext4", setup_disk, run_format_ext4, 1, 0},
+};
+
+#define BENCH_CASES (sizeof(cases) / sizeof(cases[0]))
+
+static int compare_samples(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Per-operation figures from `reps` repetition times
+static void summarize(uint64_t *samples, int reps, uint64_t ops, BenchSummary *summary) {
+    qsort(samples, reps, sizeof(samples[0]), compare_samples);
+
+    double sum = 0;
+    for (int i = 0; i < reps; i++) {
+        sum += samples[i];
+    }
+    double mean = sum / reps;
+    double variance = 0;
+    for (int i = 0; i < reps; i++) {
+        variance += (samples[i] - mean) * (samples[i] - mean);
+    }
+    variance = reps > 1 ? variance / (reps - 1) : 0;
+
+    double median = reps % 2 ? samples[reps / 2] : (samples[reps / 2 - 1] + samples[reps / 2]) / 2.0;
+    summary->min = (double)samples[0] / ops;
+    summary->median = median / ops;
+    summary->mean = mean / ops;
+    summary->stddev = sqrt(variance) / ops;
+    summary->max = (double)samples[reps - 1] / ops;
+}
+
+static int run_case(const BenchCase *bench, int warmup, int reps) {
+    static uint64_t samples[BENCH_MAX_REPS];
+    BenchSummary summary;
+
+    if (bench->setup != NULL && bench->setup() != 0) {
+        printf("%-24s setup failed\n", bench->name);
+        return -1;
+    }
+    for (int i = 0; i < warmup; i++) {
+        if (bench->run() != 0) {
+            printf("%-24s failed\n", bench->name);
+            return -1;
+        }
+    }
+    for (int i = 0; i < reps; i++) {
+        uint64_t start = host_time_ns();
+        int result = bench->run();
+        samples[i] = host_time_ns() - start;
+        if (result != 0) {
+            printf("%-24s failed\n", bench->name);
+            return -1;
+        }
+    }
+
+    summarize(samples, reps, bench->ops, &summary);
+    printf("%-24s %12.1f %12.1f %10.1f%% %12.1f %12.1f", bench->name, summary.median, summary.mean,
+           summary.mean > 0 ? 100.0 * summary.stddev / summary.mean : 0.0, summary.min, summary.max);
+    if (bench->bytes != 0 && summary.median > 0) {
+        printf(" %10.1f", (double)bench->bytes / bench->ops / summary.median * 1e9 / (1024 * 1024));
+    }
+    printf("\n");
+    return 0;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s [-w warmup] [-r repetitions] [-i image] [-v] [-l] [filter]\n", program);
+}
+
+int main(int argc, char **argv) {
+    int warmup = BENCH_DEFAULT_WARMUP;
+    int reps = BENCH_DEFAULT_REPS;
+    const char *filter = NULL;
+    int list = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            warmup = (int)strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            reps = (int)strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            image_path = argv[++i];
+        } else if (strcmp(argv[i], "-v") == 0) {
+            host_verbose = 1;
+        } else if (strcmp(argv[i], "-l") == 0) {
+            list = 1;
+        } else if (argv[i][0] != '-' && filter == NULL) {
+            filter = argv[i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (warmup < 0 || reps < 1 || reps > BENCH_MAX_REPS) {
+        fprintf(stderr, "bench: repetitions must be 1-%d and warmup at least 0\n", BENCH_MAX_REPS);
+        return 2;
+    }
+
+    if (list) {
+        for (size_t i = 0; i < BENCH_CASES; i++) {
+            printf("%s\n", cases[i].name);
+        }
+        return 0;
+    }
+
+    printf("%d warmup, %d timed repetitions; times in ns per operation\n", warmup, reps);
+    printf("%-24s %12s %12s %11s %12s %12s %10s\n", "Benchmark", "Median", "Mean", "Stddev", "Min", "Max", "MiB/s");
+
+    int failed = 0, ran = 0;
+    for (size_t i = 0; i < BENCH_CASES; i++) {
+        if (filter != NULL && strstr(cases[i].name, filter) == NULL) {
+            continue;
+        }
+        ran++;
+        if (run_case(&cases[i], warmup, reps) != 0) {
+            failed++;
+        }
+    }
+    ata_image_detach(0, 0);
+
+    if (ran == 0) {
+        fprintf(stderr, "bench: no benchmark matches '%s'\n", filter);
+        return 2;
+    }
+    return failed ? 1 : 0;
+}
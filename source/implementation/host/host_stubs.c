@@ -0,0 +1,146 @@
+// host_stubs.c - Kernel services the hosted modules call into
+//
+// Console and log output go to stderr, and the "physical memory" behind
+// memory_allocator_init() is an ordinary heap buffer reached through the
+// same phys_to_virt() arithmetic the kernel uses for its direct map.
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "host.h"
+#include "print.h"
+#include "klog.h"
+#include "pmm.h"
+#include "paging.h"
+#include "timer.h"
+#include "idle.h"
+#include "disktool.h"
+
+// Enough for memory_allocator_init() to settle on its full 100 MB pool
+#define HOST_RAM_BYTES (256ULL * 1024 * 1024)
+
+int host_verbose = 0;
+
+static uint8_t *host_ram = NULL;
+
+uint64_t host_time_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+void print_char(char character) {
+    if (host_verbose) {
+        fputc(character, stderr);
+    }
+}
+
+void print_str(char *string) {
+    if (host_verbose) {
+        fputs(string, stderr);
+    }
+}
+
+void print_newline() {
+    print_char('\n');
+}
+
+void print_int(uint64_t num) {
+    if (host_verbose) {
+        fprintf(stderr, "%llu", (unsigned long long)num);
+    }
+}
+
+void print_dec(uint64_t number) {
+    print_int(number);
+}
+
+void print_hex(unsigned int number) {
+    if (host_verbose) {
+        fprintf(stderr, "0x%X", number);
+    }
+}
+
+void print_hex_digit(unsigned char digit) {
+    print_char((digit < 10) ? '0' + digit : 'A' + (digit - 10));
+}
+
+void klog(int level, const char *message) {
+    if (host_verbose) {
+        fprintf(stderr, "[%s] %s\n", klog_level_name(level), message);
+    }
+}
+
+void klog_value(int level, const char *message, uint64_t value) {
+    if (host_verbose) {
+        fprintf(stderr, "[%s] %s %llu\n", klog_level_name(level), message, (unsigned long long)value);
+    }
+}
+
+void klogf(int level, const char *format, ...) {
+    if (!host_verbose) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "[%s] ", klog_level_name(level));
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+const char *klog_level_name(int level) {
+    static const char *names[] = {"error", "warning", "info", "debug"};
+    return level >= KLOG_ERROR && level <= KLOG_DEBUG ? names[level] : "?";
+}
+
+void pmm_get_stats(PmmStats *stats) {
+    stats->total_frames = HOST_RAM_BYTES / PMM_FRAME_SIZE;
+    stats->free_frames = stats->total_frames;
+    stats->ignored_frames = 0;
+    stats->regions = 1;
+}
+
+// Always the same buffer, so every memory_allocator_init() starts a fresh
+// pool over it; the returned "physical" address is whatever phys_to_virt()
+// turns back into the buffer
+uint64_t pmm_alloc_contiguous(uint64_t frames, uint64_t limit) {
+    (void)limit;
+    if (frames * PMM_FRAME_SIZE > HOST_RAM_BYTES) {
+        return 0;
+    }
+    if (host_ram == NULL) {
+        host_ram = aligned_alloc(PMM_FRAME_SIZE, HOST_RAM_BYTES);
+        if (host_ram == NULL) {
+            return 0;
+        }
+    }
+    return (uint64_t)(uintptr_t)host_ram - DIRECT_MAP_BASE;
+}
+
+// Heap buffers are ordinary memory; DMA is never offered anyway
+int paging_phys_contiguous(const void *virt, uint64_t size) {
+    (void)virt;
+    (void)size;
+    return 1;
+}
+
+uint64_t timer_tsc_khz(void) {
+    return 1000000;
+}
+
+void idle_wait(uint64_t flags, uint64_t deadline_tsc) {
+    (void)flags;
+    (void)deadline_tsc;
+}
+
+// No disktool on the host; partition code only asks it for display names
+BlockDevice *disktool_get_device(int disk_index) {
+    (void)disk_index;
+    return NULL;
+}
+
+struct PartitionMap *disktool_get_partition_map(int disk_index) {
+    (void)disk_index;
+    return NULL;
+}
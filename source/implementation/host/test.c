@@ -0,0 +1,455 @@
+// test.c - Host unit tests for the freestanding modules
+//
+// Each check compares a module against a byte-by-byte reference or reads
+// what it wrote back off the disk image. Every failure is reported with
+// its line, and any failure makes the exit status nonzero.
+#include <stdio.h>
+#include "host.h"
+#include "memory.h"
+#include "string.h"
+#include "memory_allocator.h"
+#include "blockdev.h"
+#include "partition.h"
+#include "journal.h"
+#include "crc32.h"
+
+#define TEST_BUFFER_SIZE  1024
+#define TEST_MAX_LENGTH   300  // Past every unrolled and vector path
+#define TEST_MAX_OFFSET   16
+
+// Same layout as the benchmark disk: ext4, then FAT32, on a GPT disk
+#define TEST_IMAGE_SECTORS (256ULL * 1024 * 1024 / 512)
+#define TEST_PART_SECTORS  (64ULL * 1024 * 1024 / 512)
+#define TEST_EXT4_LBA      2048
+#define TEST_FAT32_LBA     (TEST_EXT4_LBA + TEST_PART_SECTORS)
+
+#define CHECK(condition) check((condition), #condition, __LINE__)
+
+static uint8_t buffer_a[TEST_BUFFER_SIZE];
+static uint8_t buffer_b[TEST_BUFFER_SIZE];
+static uint8_t expected[TEST_BUFFER_SIZE];
+static uint8_t sector[512 * GPT_ENTRY_SECTORS];
+
+static const char *image_path = "test.img";
+static BlockDevice disk;
+static PartitionMap map;
+
+static unsigned checks = 0;
+static unsigned failures = 0;
+
+// Counts a check and reports it if it failed; returns whether it passed
+static int check(int passed, const char *condition, int line) {
+    checks++;
+    if (!passed) {
+        failures++;
+        fprintf(stderr, "test.c:%d: check failed: %s\n", line, condition);
+    }
+    return passed;
+}
+
+static void fill_pattern(uint8_t *buffer, size_t length, uint8_t seed) {
+    for (size_t i = 0; i < length; i++) {
+        buffer[i] = (uint8_t)(seed + i * 7);
+    }
+}
+
+static int bytes_equal(const uint8_t *a, const uint8_t *b, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (a[i] != b[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static uint16_t read16(const uint8_t *bytes) {
+    return bytes[0] | (uint16_t)bytes[1] << 8;
+}
+
+static uint32_t read32(const uint8_t *bytes) {
+    return read16(bytes) | (uint32_t)read16(bytes + 2) << 16;
+}
+
+// Memory functions, across lengths and alignments
+
+static void test_memory_copy(void) {
+    for (size_t offset = 0; offset < TEST_MAX_OFFSET; offset++) {
+        for (size_t length = 0; length <= TEST_MAX_LENGTH; length++) {
+            fill_pattern(buffer_a, TEST_BUFFER_SIZE, 1);
+            fill_pattern(buffer_b, TEST_BUFFER_SIZE, 100);
+            for (size_t i = 0; i < TEST_BUFFER_SIZE; i++) {
+                expected[i] = buffer_b[i];
+            }
+            for (size_t i = 0; i < length; i++) {
+                expected[offset + i] = buffer_a[3 + i];
+            }
+
+            void *result = memory_copy(buffer_b + offset, buffer_a + 3, length);
+            if (!CHECK(result == buffer_b + offset) || !CHECK(bytes_equal(buffer_b, expected, TEST_BUFFER_SIZE))) {
+                fprintf(stderr, "  memory_copy offset %zu length %zu\n", offset, length);
+                return;
+            }
+        }
+    }
+}
+
+static void test_memory_move(void) {
+    for (size_t shift = 1; shift < TEST_MAX_OFFSET * 2; shift++) {
+        for (size_t length = 0; length <= TEST_MAX_LENGTH; length++) {
+            // Forward overlap: destination above the source
+            fill_pattern(buffer_a, TEST_BUFFER_SIZE, 5);
+            fill_pattern(expected, TEST_BUFFER_SIZE, 5);
+            for (size_t i = 0; i < length; i++) {
+                expected[16 + shift + i] = (uint8_t)(5 + (16 + i) * 7);
+            }
+            memory_move(buffer_a + 16 + shift, buffer_a + 16, length);
+            if (!CHECK(bytes_equal(buffer_a, expected, TEST_BUFFER_SIZE))) {
+                fprintf(stderr, "  memory_move up by %zu, length %zu\n", shift, length);
+                return;
+            }
+
+            // Backward overlap: destination below the source
+            fill_pattern(buffer_a, TEST_BUFFER_SIZE, 9);
+            fill_pattern(expected, TEST_BUFFER_SIZE, 9);
+            for (size_t i = 0; i < length; i++) {
+                expected[16 + i] = (uint8_t)(9 + (16 + shift + i) * 7);
+            }
+            memory_move(buffer_a + 16, buffer_a + 16 + shift, length);
+            if (!CHECK(bytes_equal(buffer_a, expected, TEST_BUFFER_SIZE))) {
+                fprintf(stderr, "  memory_move down by %zu, length %zu\n", shift, length);
+                return;
+            }
+        }
+    }
+}
+
+static void test_memory_set(void) {
+    for (size_t offset = 0; offset < TEST_MAX_OFFSET; offset++) {
+        for (size_t length = 0; length <= TEST_MAX_LENGTH; length++) {
+            fill_pattern(buffer_a, TEST_BUFFER_SIZE, 3);
+            fill_pattern(expected, TEST_BUFFER_SIZE, 3);
+            for (size_t i = 0; i < length; i++) {
+                expected[offset + i] = 0xA5;
+            }
+
+            // Only the low byte of the value counts
+            void *result = memory_set(buffer_a + offset, 0x1A5, length);
+            if (!CHECK(result == buffer_a + offset) || !CHECK(bytes_equal(buffer_a, expected, TEST_BUFFER_SIZE))) {
+                fprintf(stderr, "  memory_set offset %zu length %zu\n", offset, length);
+                return;
+            }
+
+            for (size_t i = 0; i < length; i++) {
+                expected[offset + i] = 0;
+            }
+            memory_zero(buffer_a + offset, length);
+            if (!CHECK(bytes_equal(buffer_a, expected, TEST_BUFFER_SIZE)) ||
+                !CHECK(memory_is_zero(buffer_a + offset, length))) {
+                fprintf(stderr, "  memory_zero offset %zu length %zu\n", offset, length);
+                return;
+            }
+        }
+    }
+}
+
+static void test_memory_compare(void) {
+    fill_pattern(buffer_a, TEST_BUFFER_SIZE, 11);
+    fill_pattern(buffer_b, TEST_BUFFER_SIZE, 11);
+    CHECK(memory_compare(buffer_a, buffer_b, TEST_BUFFER_SIZE) == 0);
+    CHECK(memory_compare(buffer_a, buffer_b, 0) == 0);
+
+    // The first difference decides, compared as unsigned bytes
+    for (size_t position = 0; position < TEST_MAX_LENGTH; position++) {
+        buffer_a[position] = 0x80;
+        buffer_b[position] = 0x7F;
+        buffer_b[position + 1] = buffer_a[position + 1] + 1;
+        if (!CHECK(memory_compare(buffer_a, buffer_b, TEST_MAX_LENGTH + 1) > 0) ||
+            !CHECK(memory_compare(buffer_b, buffer_a, TEST_MAX_LENGTH + 1) < 0) ||
+            !CHECK(memory_compare(buffer_a, buffer_b, position) == 0)) {
+            fprintf(stderr, "  memory_compare difference at %zu\n", position);
+            return;
+        }
+        buffer_a[position] = buffer_b[position] = (uint8_t)position;
+        buffer_b[position + 1] = buffer_a[position + 1];
+    }
+}
+
+static void test_memory_find_swap(void) {
+    memory_set(buffer_a, 0x11, TEST_BUFFER_SIZE);
+    buffer_a[200] = 0xFF;
+    buffer_a[300] = 0xFF;
+    CHECK(memory_find(buffer_a + 1, 0xFF, 400) == buffer_a + 200);
+    CHECK(memory_find(buffer_a + 1, 0xFF, 199) == NULL);
+
+    fill_pattern(buffer_a, TEST_MAX_LENGTH, 1);
+    fill_pattern(buffer_b, TEST_MAX_LENGTH, 2);
+    memory_swap(buffer_a, buffer_b, TEST_MAX_LENGTH);
+    fill_pattern(expected, TEST_MAX_LENGTH, 2);
+    CHECK(bytes_equal(buffer_a, expected, TEST_MAX_LENGTH));
+    fill_pattern(expected, TEST_MAX_LENGTH, 1);
+    CHECK(bytes_equal(buffer_b, expected, TEST_MAX_LENGTH));
+}
+
+// String functions
+
+static void test_strings(void) {
+    char text[TEST_MAX_LENGTH + TEST_MAX_OFFSET + 1];
+    for (int offset = 0; offset < TEST_MAX_OFFSET; offset++) {
+        for (int length = 0; length < TEST_MAX_LENGTH; length++) {
+            for (int i = 0; i < length; i++) {
+                text[offset + i] = 'a' + i % 26;
+            }
+            text[offset + length] = '\0';
+            if (!CHECK(strlen(text + offset) == length)) {
+                fprintf(stderr, "  strlen offset %d length %d\n", offset, length);
+                return;
+            }
+        }
+    }
+
+    CHECK(strcmp("", "") == 0);
+    CHECK(strcmp("kernel", "kernel") == 0);
+    CHECK(strcmp("kernel", "kernem") < 0);
+    CHECK(strcmp("kernem", "kernel") > 0);
+    CHECK(strcmp("kern", "kernel") < 0);
+    CHECK(strcmp("kernel", "kern") > 0);
+    CHECK(strcmp("\x80", "\x7F") > 0);
+}
+
+// Heap: first fit, splitting large blocks and merging freed neighbours
+
+static void test_allocator(void) {
+    memory_allocator_init();
+
+    uint8_t *a = allocate(64);
+    uint8_t *b = allocate(128);
+    uint8_t *c = allocate(32);
+    if (!CHECK(a != NULL && b != NULL && c != NULL)) {
+        return;
+    }
+
+    // Each allocation splits the pool, so the blocks sit back to back
+    size_t header = b - a - 64;
+    CHECK(header > 0 && header <= 64);
+    CHECK(c == b + 128 + header);
+
+    memory_set(a, 0x11, 64);
+    memory_set(b, 0x22, 128);
+    memory_set(c, 0x33, 32);
+    CHECK(memory_find(a, 0x22, 64) == NULL && memory_find(c, 0x22, 32) == NULL);
+
+    // A freed block is reused first fit, and split again when larger
+    free(b);
+    uint8_t *d = allocate(48);
+    CHECK(d == b);
+    uint8_t *e = allocate(128 - 48 - header);
+    CHECK(e == b + 48 + header);
+    free(d);
+    free(e);
+
+    // Freeing a and b merges them into one block that fits both and a header
+    free(a);
+    uint8_t *f = allocate(64 + 128 + header);
+    CHECK(f == a);
+    CHECK((uint8_t *)allocate(1) > c);
+
+    free(f);
+    free(c);
+    free(NULL);
+    memory_allocator_init();
+}
+
+// Partitioning and formatting, read back from the disk image
+
+static void test_gpt(void) {
+    PartitionMap loaded;
+
+    if (!CHECK(partition_map_init_gpt(&disk, &map) == 0) ||
+        !CHECK(partition_map_add(&disk, &map, TEST_EXT4_LBA, TEST_PART_SECTORS, 0x83) == 0) ||
+        !CHECK(partition_map_add(&disk, &map, TEST_FAT32_LBA, TEST_PART_SECTORS, FAT32_PARTITION_TYPE) == 0)) {
+        return;
+    }
+
+    // Protective MBR: one 0xEE entry covering the disk
+    CHECK(blockdev_read(&disk, 0, 1, sector) == 0);
+    CHECK(sector[PARTITION_TABLE_OFFSET + 4] == MBR_TYPE_GPT_PROTECTIVE);
+    CHECK(read32(sector + PARTITION_TABLE_OFFSET + 8) == 1);
+    CHECK(sector[510] == 0x55 && sector[511] == 0xAA);
+
+    // Primary and backup headers, each pointing at the other
+    for (int backup = 0; backup <= 1; backup++) {
+        uint64_t lba = backup ? TEST_IMAGE_SECTORS - 1 : 1;
+        GptHeader header;
+        CHECK(blockdev_read(&disk, lba, 1, sector) == 0);
+        memory_copy(&header, sector, sizeof(header));
+
+        CHECK(header.signature == GPT_SIGNATURE);
+        CHECK(header.header_size == GPT_HEADER_SIZE);
+        CHECK(header.my_lba == lba);
+        CHECK(header.alternate_lba == (backup ? 1 : TEST_IMAGE_SECTORS - 1));
+        CHECK(header.num_entries == GPT_MAX_ENTRIES && header.entry_size == GPT_ENTRY_SIZE);
+        CHECK(header.first_usable_lba <= TEST_EXT4_LBA);
+        CHECK(header.last_usable_lba >= TEST_FAT32_LBA + TEST_PART_SECTORS - 1);
+
+        uint32_t stored = header.header_crc32;
+        header.header_crc32 = 0;
+        CHECK(crc32_le(0, &header, GPT_HEADER_SIZE) == stored);
+
+        CHECK(blockdev_read(&disk, header.entries_lba, GPT_ENTRY_SECTORS, sector) == 0);
+        CHECK(crc32_le(0, sector, GPT_MAX_ENTRIES * GPT_ENTRY_SIZE) == header.entries_crc32);
+
+        GptEntry entries[2];
+        memory_copy(entries, sector, sizeof(entries));
+        CHECK(entries[0].first_lba == TEST_EXT4_LBA);
+        CHECK(entries[0].last_lba == TEST_EXT4_LBA + TEST_PART_SECTORS - 1);
+        CHECK(entries[1].first_lba == TEST_FAT32_LBA);
+        CHECK(entries[1].last_lba == TEST_FAT32_LBA + TEST_PART_SECTORS - 1);
+        CHECK(memory_is_zero(sector + 2 * GPT_ENTRY_SIZE, (GPT_MAX_ENTRIES - 2) * GPT_ENTRY_SIZE));
+    }
+
+    // Parsing the table back gives the same partitions
+    if (CHECK(partition_map_load(&disk, &loaded) == 0)) {
+        CHECK(loaded.scheme == PARTITION_SCHEME_GPT && !loaded.gpt_from_backup);
+        CHECK(loaded.count == 2);
+        CHECK(loaded.entries[0].lba_first == TEST_EXT4_LBA && loaded.entries[0].type == 0x83);
+        CHECK(loaded.entries[1].lba_first == TEST_FAT32_LBA && loaded.entries[1].type == FAT32_PARTITION_TYPE);
+        CHECK(loaded.entries[1].sector_count == TEST_PART_SECTORS);
+    }
+}
+
+// Read-only devices refuse every kind of write and keep their contents
+static void test_read_only(void) {
+    BlockRequest request = {1, TEST_FAT32_LBA, 1, sector, 0};
+
+    fill_pattern(sector, 512, 42);
+    CHECK(blockdev_write(&disk, TEST_FAT32_LBA, 1, sector) == 0);
+
+    disk.flags |= BLOCKDEV_READ_ONLY;
+    memory_zero(sector, 512);
+    CHECK(blockdev_write(&disk, TEST_FAT32_LBA, 1, sector) != 0);
+    CHECK(blockdev_submit(&disk, &request) != 0 && request.status == -1);
+    CHECK(!blockdev_can_discard(&disk));
+    CHECK(blockdev_discard(&disk, TEST_FAT32_LBA, 1) != 0);
+    CHECK(format_fat32(&disk, TEST_FAT32_LBA, TEST_PART_SECTORS) != 0);
+
+    CHECK(blockdev_read(&disk, TEST_FAT32_LBA, 1, sector) == 0);
+    fill_pattern(expected, 512, 42);
+    CHECK(bytes_equal(sector, expected, 512));
+    disk.flags &= ~BLOCKDEV_READ_ONLY;
+}
+
+// Ranges the 32-bit formatters cannot address are refused, not wrapped
+// onto the start of the disk
+static void test_format_range(void) {
+    uint64_t wrapped = (1ULL << 32) + TEST_FAT32_LBA;
+    uint32_t count = map.count;
+
+    memory_zero(sector, 512);
+    CHECK(blockdev_write(&disk, TEST_FAT32_LBA, 1, sector) == 0);
+    CHECK(blockdev_write(&disk, TEST_EXT4_LBA + 2, 1, sector) == 0);
+
+    CHECK(partition_check_format_range(FORMAT_MAX_SECTOR - TEST_PART_SECTORS, TEST_PART_SECTORS) == 0);
+    CHECK(partition_check_format_range(FORMAT_MAX_SECTOR - TEST_PART_SECTORS + 1, TEST_PART_SECTORS) != 0);
+    CHECK(format_fat32(&disk, wrapped, TEST_PART_SECTORS) != 0);
+    CHECK(format_ext4(&disk, (1ULL << 32) + TEST_EXT4_LBA, TEST_PART_SECTORS) != 0);
+    CHECK(create_fat32_partition(&disk, &map, wrapped, TEST_PART_SECTORS) != 0);
+    CHECK(create_ext4_partition(&disk, &map, wrapped, TEST_PART_SECTORS) != 0);
+    CHECK(map.count == count);
+
+    CHECK(blockdev_read(&disk, TEST_FAT32_LBA, 1, sector) == 0);
+    CHECK(memory_is_zero(sector, 512));
+    CHECK(blockdev_read(&disk, TEST_EXT4_LBA + 2, 1, sector) == 0);
+    CHECK(memory_is_zero(sector, 512));
+}
+
+static void test_fat32(void) {
+    if (!CHECK(format_fat32(&disk, TEST_FAT32_LBA, TEST_PART_SECTORS) == 0)) {
+        return;
+    }
+
+    CHECK(blockdev_read(&disk, TEST_FAT32_LBA, 1, sector) == 0);
+    CHECK(sector[0] == 0xEB && sector[1] == 0x58 && sector[2] == 0x90);
+    CHECK(memory_compare(sector + 3, "MSWIN4.1", 8) == 0);
+    CHECK(read16(sector + 11) == 512);         // Bytes per sector
+    CHECK(sector[13] == 8);                    // Sectors per cluster
+    CHECK(read16(sector + 14) == 32);          // Reserved sectors
+    CHECK(sector[16] == 2);                    // FATs
+    CHECK(sector[21] == 0xF8);                 // Media
+    CHECK(read32(sector + 28) == TEST_FAT32_LBA);    // Hidden sectors
+    CHECK(read32(sector + 32) == TEST_PART_SECTORS); // Total sectors
+
+    // The FATs and data area must fit, and a cluster needs 4 bytes of FAT
+    uint32_t fat_sectors = read32(sector + 36);
+    uint32_t clusters = (TEST_PART_SECTORS - 32 - 2 * fat_sectors) / 8;
+    CHECK(fat_sectors > 0 && 32 + 2 * fat_sectors < TEST_PART_SECTORS);
+    CHECK((uint64_t)fat_sectors * 128 >= clusters + 2);
+
+    CHECK(read32(sector + 44) == 2);           // Root cluster
+    CHECK(memory_compare(sector + 82, "FAT32   ", 8) == 0);
+    CHECK(sector[510] == 0x55 && sector[511] == 0xAA);
+
+    for (int copy = 0; copy < 2; copy++) {
+        CHECK(blockdev_read(&disk, TEST_FAT32_LBA + 32 + copy * fat_sectors, 1, sector) == 0);
+        CHECK(read32(sector) == 0x0FFFFFF8);
+        CHECK(read32(sector + 4) == 0x0FFFFFFF);
+        CHECK(read32(sector + 8) == 0x0FFFFFFF);
+        CHECK(memory_is_zero(sector + 12, 500));
+    }
+}
+
+static void test_ext4(void) {
+    Ext4Superblock sb;
+
+    // Too small for an ext4 filesystem
+    CHECK(format_ext4(&disk, TEST_EXT4_LBA, 16 * 1024 * 1024 / 512) != 0);
+    if (!CHECK(format_ext4(&disk, TEST_EXT4_LBA, TEST_PART_SECTORS) == 0)) {
+        return;
+    }
+
+    CHECK(blockdev_read(&disk, TEST_EXT4_LBA + 2, 2, sector) == 0);
+    memory_copy(&sb, sector, sizeof(sb));
+    CHECK(sb.s_magic == 0xEF53);
+    CHECK(sb.s_log_block_size == 2);           // 4 KiB blocks
+    CHECK(sb.s_blocks_count_lo == TEST_PART_SECTORS / 8 && sb.s_blocks_count_hi == 0);
+    CHECK(sb.s_first_data_block == 0);
+    CHECK(sb.s_blocks_per_group == 32768);
+    CHECK(sb.s_inodes_count == sb.s_inodes_per_group); // A single group
+    CHECK(sb.s_free_blocks_count_lo < sb.s_blocks_count_lo);
+    CHECK(sb.s_free_inodes_count < sb.s_inodes_count);
+    CHECK(sb.s_first_ino == 11);
+
+    // 64 MiB is enough for the internal journal
+    CHECK(sb.s_feature_compat & EXT4_FEATURE_COMPAT_HAS_JOURNAL);
+    CHECK(sb.s_journal_inum == EXT4_JOURNAL_INO);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        image_path = argv[1];
+    }
+
+    test_memory_copy();
+    test_memory_move();
+    test_memory_set();
+    test_memory_compare();
+    test_memory_find_swap();
+    test_strings();
+    test_allocator();
+
+    uint64_t sectors = ata_image_attach(0, 0, image_path, TEST_IMAGE_SECTORS);
+    if (sectors == 0) {
+        fprintf(stderr, "test: cannot create disk image %s\n", image_path);
+        return 1;
+    }
+    blockdev_init_ata(&disk, 0, 0, sectors);
+    memory_allocator_init();
+    test_gpt();
+    test_format_range();
+    test_read_only();
+    test_fat32();
+    test_ext4();
+    ata_image_detach(0, 0);
+
+    printf("%u checks, %u failed\n", checks, failures);
+    return failures == 0 ? 0 : 1;
+}
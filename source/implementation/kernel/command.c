@@ -0,0 +1,157 @@
+#include "command.h"
+#include "print.h"
+#include "string.h"
+#include "console.h"
+#include "klog.h"
+
+#define COMMAND_MAX_PER_SHELL 64
+
+// Provided by the linker script around the .commands section
+extern const Command __commands_start[];
+extern const Command __commands_end[];
+
+static const Command *tables[COMMAND_SHELL_COUNT][COMMAND_MAX_PER_SHELL];
+static int table_sizes[COMMAND_SHELL_COUNT];
+
+int shell_color = PRINT_COLOR_BLACK;
+
+// Compares a command name with the first `length` bytes of `name`
+static int compare_name(const char *command_name, const char *name, int length)
+{
+    int result = strncmp(command_name, name, length);
+    if (result == 0 && command_name[length] != '\0')
+    {
+        return 1; // `name` is a proper prefix, so it sorts first
+    }
+    return result;
+}
+
+void command_init(void)
+{
+    for (const Command *command = __commands_start; command < __commands_end; command++)
+    {
+        if (command->shell >= COMMAND_SHELL_COUNT)
+        {
+            klogf(KLOG_ERROR, "command: %s has unknown shell %u, not registered", command->name, command->shell);
+            continue;
+        }
+        if (table_sizes[command->shell] == COMMAND_MAX_PER_SHELL)
+        {
+            klogf(KLOG_ERROR, "command: shell %u is full (%d commands), %s not registered",
+                  command->shell, COMMAND_MAX_PER_SHELL, command->name);
+            continue;
+        }
+
+        // Insertion sort; tables are small and built once
+        const Command **table = tables[command->shell];
+        int size = table_sizes[command->shell];
+        int i = size;
+        while (i > 0 && strcmp(table[i - 1]->name, command->name) > 0)
+        {
+            i--;
+        }
+        if (i > 0 && strcmp(table[i - 1]->name, command->name) == 0)
+        {
+            // command_find() would pick either one depending on the table size
+            klogf(KLOG_ERROR, "command: %s is defined twice in shell %u, second one not registered",
+                  command->name, command->shell);
+            continue;
+        }
+        for (int j = size; j > i; j--)
+        {
+            table[j] = table[j - 1];
+        }
+        table[i] = command;
+        table_sizes[command->shell] = size + 1;
+    }
+}
+
+const Command *command_find(uint32_t shell, const char *name, int length)
+{
+    if (shell >= COMMAND_SHELL_COUNT)
+    {
+        return NULL;
+    }
+
+    int low = 0;
+    int high = table_sizes[shell] - 1;
+    while (low <= high)
+    {
+        int middle = (low + high) / 2;
+        int result = compare_name(tables[shell][middle]->name, name, length);
+        if (result == 0)
+        {
+            return tables[shell][middle];
+        }
+        if (result < 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    return NULL;
+}
+
+static void print_usage(const Command *command)
+{
+    print_str("Usage: ");
+    print_str((char *)command->name);
+    if (command->usage[0] != '\0')
+    {
+        print_str(" ");
+        print_str((char *)command->usage);
+    }
+    print_newline();
+}
+
+int command_dispatch(uint32_t shell, char *line)
+{
+    int length = 0;
+    while (line[length] != '\0' && line[length] != ' ')
+    {
+        length++;
+    }
+
+    const Command *command = command_find(shell, line, length);
+    if (command == NULL)
+    {
+        return -1;
+    }
+
+    char *args = line + length;
+    while (*args == ' ')
+    {
+        args++;
+    }
+
+    if ((command->args == COMMAND_ARGS_NONE && *args != '\0') ||
+        (command->args == COMMAND_ARGS_REQUIRED && *args == '\0'))
+    {
+        print_usage(command);
+        return 0;
+    }
+
+    command->handler(args);
+    return 0;
+}
+
+void command_print_help(uint32_t shell)
+{
+    for (int i = 0; i < table_sizes[shell]; i++)
+    {
+        const Command *command = tables[shell][i];
+        print_str(" - ");
+        print_str((char *)command->name);
+        if (command->usage[0] != '\0')
+        {
+            print_str(" ");
+            print_str((char *)command->usage);
+        }
+        print_str(": ");
+        print_str((char *)command->help);
+        print_newline();
+    }
+}
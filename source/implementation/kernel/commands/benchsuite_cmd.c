@@ -0,0 +1,324 @@
+#include "print.h"
+#include "kprintf.h"
+#include "serial.h"
+#include "string.h"
+#include "timer.h"
+#include "histogram.h"
+#include "memory.h"
+#include "memory_allocator.h"
+#include "blockdev.h"
+#include "partition.h"
+#include "disktool.h"
+#include "command.h"
+
+#define BENCHSUITE_VERSION 1
+#define BENCHSUITE_WARMUP 2
+#define BENCHSUITE_REPS 20
+
+#define BENCHSUITE_BUFFER_SIZE (1024 * 1024)
+#define BENCHSUITE_SMALL_COPY 4096
+#define BENCHSUITE_ALLOC_COUNT 1024
+#define BENCHSUITE_ALLOC_MAX 2048
+#define BENCHSUITE_CONSOLE_LINES 100
+#define BENCHSUITE_LINE_CHARS 80
+
+// The disk cases write here and need a disk without a partition table
+#define BENCHSUITE_DISK_TRANSFER 128 // Sectors, 64 KiB
+#define BENCHSUITE_DISK_TRANSFERS 16
+#define BENCHSUITE_PART_LBA 2048
+#define BENCHSUITE_PART_SECTORS (64ULL * 1024 * 1024 / SECTOR_SIZE)
+#define BENCHSUITE_DISK_SECTORS (BENCHSUITE_PART_LBA + BENCHSUITE_PART_SECTORS)
+
+typedef struct
+{
+    const char *name;
+    int (*run)(void); // One repetition; -1 on failure
+    uint32_t ops;     // Operations per repetition
+    uint64_t bytes;   // Bytes per repetition, 0 if meaningless
+    int needs_disk;
+} BenchsuiteCase;
+
+static uint8_t *source_buffer;
+static uint8_t *dest_buffer;
+static void *blocks[BENCHSUITE_ALLOC_COUNT];
+static BlockDevice *disk;
+static uint64_t rng_state;
+
+static uint64_t benchsuite_random(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static int run_copy_small(void)
+{
+    for (int i = 0; i < BENCHSUITE_BUFFER_SIZE / BENCHSUITE_SMALL_COPY; i++)
+    {
+        memory_copy(dest_buffer + i * BENCHSUITE_SMALL_COPY, source_buffer + i * BENCHSUITE_SMALL_COPY,
+                    BENCHSUITE_SMALL_COPY);
+    }
+    return 0;
+}
+
+static int run_copy_large(void)
+{
+    memory_copy(dest_buffer, source_buffer, BENCHSUITE_BUFFER_SIZE);
+    return 0;
+}
+
+static int run_move_overlap(void)
+{
+    memory_move(dest_buffer + 1, dest_buffer, BENCHSUITE_BUFFER_SIZE - 1);
+    memory_move(dest_buffer, dest_buffer + 1, BENCHSUITE_BUFFER_SIZE - 1);
+    return 0;
+}
+
+static int run_set(void)
+{
+    memory_set(dest_buffer, 0x5A, BENCHSUITE_BUFFER_SIZE);
+    return 0;
+}
+
+static int run_zero(void)
+{
+    memory_zero(dest_buffer, BENCHSUITE_BUFFER_SIZE);
+    return 0;
+}
+
+// Equal buffers, so the whole length is scanned
+static int run_compare(void)
+{
+    memory_copy(dest_buffer, source_buffer, BENCHSUITE_BUFFER_SIZE);
+    return memory_compare(dest_buffer, source_buffer, BENCHSUITE_BUFFER_SIZE) == 0 ? 0 : -1;
+}
+
+// The live heap cannot be reset, so every block is freed again and the
+// pool ends each repetition the way it started
+static int run_alloc_churn(void)
+{
+    int result = 0;
+    rng_state = 0x9E3779B97F4A7C15ULL;
+
+    for (int i = 0; i < BENCHSUITE_ALLOC_COUNT; i++)
+    {
+        blocks[i] = allocate(16 + benchsuite_random() % BENCHSUITE_ALLOC_MAX);
+    }
+    for (int i = 0; i < BENCHSUITE_ALLOC_COUNT; i += 2)
+    {
+        free(blocks[i]);
+        blocks[i] = allocate(16 + benchsuite_random() % BENCHSUITE_ALLOC_MAX);
+    }
+    for (int i = 0; i < BENCHSUITE_ALLOC_COUNT; i++)
+    {
+        if (blocks[i] == NULL)
+        {
+            result = -1;
+        }
+        free(blocks[i]);
+    }
+    return result;
+}
+
+static int run_console(void)
+{
+    char line[BENCHSUITE_LINE_CHARS];
+    for (int i = 0; i < BENCHSUITE_LINE_CHARS - 1; i++)
+    {
+        line[i] = ' ' + 1 + (i % 94);
+    }
+    line[BENCHSUITE_LINE_CHARS - 1] = '\0';
+
+    for (int i = 0; i < BENCHSUITE_CONSOLE_LINES; i++)
+    {
+        print_str(line);
+        print_newline();
+    }
+    print_flush(); // The last frame is part of the measured cost
+    return 0;
+}
+
+static int run_disk_read(void)
+{
+    for (int i = 0; i < BENCHSUITE_DISK_TRANSFERS; i++)
+    {
+        uint64_t lba = BENCHSUITE_PART_LBA + (uint64_t)i * BENCHSUITE_DISK_TRANSFER;
+        if (blockdev_read(disk, lba, BENCHSUITE_DISK_TRANSFER, dest_buffer) != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int run_disk_write(void)
+{
+    for (int i = 0; i < BENCHSUITE_DISK_TRANSFERS; i++)
+    {
+        uint64_t lba = BENCHSUITE_PART_LBA + (uint64_t)i * BENCHSUITE_DISK_TRANSFER;
+        if (blockdev_write(disk, lba, BENCHSUITE_DISK_TRANSFER, source_buffer) != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int run_format_fat32(void)
+{
+    return format_fat32(disk, BENCHSUITE_PART_LBA, BENCHSUITE_PART_SECTORS);
+}
+
+static int run_format_ext4(void)
+{
+    return format_ext4(disk, BENCHSUITE_PART_LBA, BENCHSUITE_PART_SECTORS);
+}
+
+static const BenchsuiteCase cases[] = {
+    {"memory_copy/4k", run_copy_small, BENCHSUITE_BUFFER_SIZE / BENCHSUITE_SMALL_COPY, BENCHSUITE_BUFFER_SIZE, 0},
+    {"memory_copy/1m", run_copy_large, 1, BENCHSUITE_BUFFER_SIZE, 0},
+    {"memory_move/overlap", run_move_overlap, 2, 2 * (BENCHSUITE_BUFFER_SIZE - 1), 0},
+    {"memory_set/1m", run_set, 1, BENCHSUITE_BUFFER_SIZE, 0},
+    {"memory_zero/1m", run_zero, 1, BENCHSUITE_BUFFER_SIZE, 0},
+    {"memory_compare/1m", run_compare, 1, BENCHSUITE_BUFFER_SIZE, 0},
+    {"allocator/churn", run_alloc_churn, BENCHSUITE_ALLOC_COUNT * 3, 0, 0},
+    {"console/line", run_console, BENCHSUITE_CONSOLE_LINES, BENCHSUITE_CONSOLE_LINES * BENCHSUITE_LINE_CHARS, 0},
+    {"disk/pio_read_64k", run_disk_read, BENCHSUITE_DISK_TRANSFERS,
+     BENCHSUITE_DISK_TRANSFERS * BENCHSUITE_DISK_TRANSFER * SECTOR_SIZE, 1},
+    {"disk/pio_write_64k", run_disk_write, BENCHSUITE_DISK_TRANSFERS,
+     BENCHSUITE_DISK_TRANSFERS * BENCHSUITE_DISK_TRANSFER * SECTOR_SIZE, 1},
+    {"partition/format_fat32", run_format_fat32, 1, 0, 1},
+    {"partition/format_ext4", run_format_ext4, 1, 0, 1},
+};
+
+#define BENCHSUITE_CASES (sizeof(cases) / sizeof(cases[0]))
+
+// One JSON object per line on COM1 only, so the console keeps the table
+static void emit_json(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+static void emit_json(const char *format, ...)
+{
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    kvsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    serial_write_str(line);
+    serial_write_char('\n');
+}
+
+// Warmup, then BENCHSUITE_REPS timed repetitions; figures are per repetition
+static int run_case(const BenchsuiteCase *bench)
+{
+    Histogram hist;
+    histogram_reset(&hist);
+
+    for (int i = 0; i < BENCHSUITE_WARMUP + BENCHSUITE_REPS; i++)
+    {
+        uint64_t start = timer_tsc();
+        int result = bench->run();
+        uint64_t cycles = timer_tsc() - start;
+        if (result != 0)
+        {
+            kprintf("%-24s failed\n", bench->name);
+            emit_json("{\"bench\":\"%s\",\"error\":\"failed\"}", bench->name);
+            return -1;
+        }
+        if (i >= BENCHSUITE_WARMUP)
+        {
+            histogram_record(&hist, cycles);
+        }
+    }
+
+    uint64_t median = timer_tsc_to_ns(histogram_percentile(&hist, 500));
+    uint64_t mean = timer_tsc_to_ns(histogram_mean(&hist));
+    kprintf("%-24s %12lu %12lu %12lu %12lu\n", bench->name, median, mean, timer_tsc_to_ns(hist.min),
+            timer_tsc_to_ns(hist.max));
+    emit_json("{\"bench\":\"%s\",\"reps\":%d,\"ops\":%u,\"bytes\":%lu,\"median_ns\":%lu,\"mean_ns\":%lu,"
+              "\"p99_ns\":%lu,\"min_ns\":%lu,\"max_ns\":%lu}",
+              bench->name, BENCHSUITE_REPS, bench->ops, bench->bytes, median, mean,
+              timer_tsc_to_ns(histogram_percentile(&hist, 990)), timer_tsc_to_ns(hist.min),
+              timer_tsc_to_ns(hist.max));
+    return 0;
+}
+
+// Only a disk with no partition table and room for the test partition
+static BlockDevice *scratch_disk(char *args)
+{
+    if (*args == '\0')
+    {
+        return NULL;
+    }
+    int index = (int)strtoul(args, NULL, 10);
+    BlockDevice *dev = disktool_get_device(index);
+    PartitionMap *map = disktool_get_partition_map(index);
+    if (dev == NULL || map == NULL)
+    {
+        kprintf("benchsuite: no disk %d\n", index);
+        return NULL;
+    }
+    if (map->scheme != PARTITION_SCHEME_NONE)
+    {
+        kprintf("benchsuite: %s has a partition table; the disk cases need a blank scratch disk\n", dev->name);
+        return NULL;
+    }
+    if (dev->sector_count < BENCHSUITE_DISK_SECTORS)
+    {
+        kprintf("benchsuite: %s is smaller than %llu MiB\n", dev->name, (BENCHSUITE_DISK_SECTORS * SECTOR_SIZE) >> 20);
+        return NULL;
+    }
+    return dev;
+}
+
+// benchsuite [scratch disk]
+static void benchsuite_cmd(char *args)
+{
+    disk = scratch_disk(args);
+    source_buffer = allocate(BENCHSUITE_BUFFER_SIZE);
+    dest_buffer = allocate(BENCHSUITE_BUFFER_SIZE);
+    if (source_buffer == NULL || dest_buffer == NULL)
+    {
+        print_str("benchsuite: cannot allocate the buffers");
+        print_newline();
+        free(source_buffer);
+        free(dest_buffer);
+        return;
+    }
+    for (uint32_t i = 0; i < BENCHSUITE_BUFFER_SIZE; i++)
+    {
+        source_buffer[i] = (uint8_t)(i * 31 + 7);
+    }
+
+    emit_json("{\"suite\":\"benchsuite\",\"version\":%d,\"tsc_khz\":%lu,\"warmup\":%d,\"reps\":%d,\"disk\":\"%s\"}",
+              BENCHSUITE_VERSION, timer_tsc_khz(), BENCHSUITE_WARMUP, BENCHSUITE_REPS,
+              disk != NULL ? disk->name : "");
+    kprintf("%d repetitions after %d warmup, ns per repetition:\n", BENCHSUITE_REPS, BENCHSUITE_WARMUP);
+    kprintf("%-24s %12s %12s %12s %12s\n", "Benchmark", "Median", "Mean", "Min", "Max");
+
+    int failed = 0, skipped = 0;
+    for (uint32_t i = 0; i < BENCHSUITE_CASES; i++)
+    {
+        if (cases[i].needs_disk && disk == NULL)
+        {
+            skipped++;
+            continue;
+        }
+        if (run_case(&cases[i]) != 0)
+        {
+            failed++;
+        }
+    }
+    free(source_buffer);
+    free(dest_buffer);
+
+    if (skipped != 0)
+    {
+        kprintf("%d disk cases skipped; give a blank scratch disk to run them\n", skipped);
+    }
+    emit_json("{\"suite_end\":\"benchsuite\",\"failed\":%d,\"skipped\":%d}", failed, skipped);
+}
+
+COMMAND(COMMAND_SHELL_KERNEL, benchsuite, "benchsuite", "[scratch disk]",
+        "Run the benchmark suite, sending JSON lines over serial; overwrites the disk", COMMAND_ARGS_OPTIONAL,
+        benchsuite_cmd);
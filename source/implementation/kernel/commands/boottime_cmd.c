@@ -0,0 +1,39 @@
+#include "kprintf.h"
+#include "timer.h"
+#include "boottime.h"
+#include "command.h"
+
+static void print_ms(uint64_t ticks)
+{
+    uint64_t us = timer_tsc_to_us(ticks);
+    kprintf("%8lu.%lu", us / 1000, (us % 1000) / 100);
+}
+
+// Each mark ends a phase; the first one covers everything since reset
+static void boottime_cmd(char *args)
+{
+    (void)args;
+    int count = boot_mark_count();
+    uint64_t previous = 0;
+
+    kprintf("%-20s %10s %10s\n", "Phase", "Took (ms)", "At (ms)");
+    for (int i = 0; i < count; i++)
+    {
+        const BootMark *mark = boot_mark_get(i);
+        kprintf("%-20s ", mark->phase);
+        print_ms(mark->tsc - previous);
+        kprintf(" ");
+        print_ms(mark->tsc);
+        kprintf("\n");
+        previous = mark->tsc;
+    }
+    if (count >= 2)
+    {
+        uint64_t start = boot_mark_get(0)->tsc;
+        kprintf("Kernel boot took %lu ms from start, %lu ms from reset\n",
+                timer_tsc_to_us(previous - start) / 1000, timer_tsc_to_us(previous) / 1000);
+    }
+}
+
+COMMAND(COMMAND_SHELL_KERNEL, boottime, "boottime", "", "Show how long each boot phase took", COMMAND_ARGS_NONE,
+        boottime_cmd);
@@ -0,0 +1,126 @@
+#include "print.h"
+#include "timer.h"
+#include "serial.h"
+#include "fbcon.h"
+#include "command.h"
+
+#define CONBENCH_LINES 2000
+#define CONBENCH_LINE_CHARS 80 // 79 characters plus the newline
+
+typedef struct
+{
+    int backend;
+    int batched;
+    uint64_t elapsed_us;
+} ConbenchResult;
+
+static const char *backend_name(int backend)
+{
+    return (backend == PRINT_BACKEND_FRAMEBUFFER) ? "framebuffer" : "vga text";
+}
+
+// Scrolls CONBENCH_LINES full lines through the console
+static uint64_t conbench_run(int batched)
+{
+    char line[CONBENCH_LINE_CHARS];
+    for (int i = 0; i < CONBENCH_LINE_CHARS - 1; i++)
+    {
+        line[i] = ' ' + 1 + (i % 94); // Every printable glyph but space
+    }
+    line[CONBENCH_LINE_CHARS - 1] = '\0';
+
+    uint64_t start = timer_tsc();
+    for (int i = 0; i < CONBENCH_LINES; i++)
+    {
+        print_str(line);
+        print_newline();
+        if (!batched)
+        {
+            print_flush(); // What every line used to cost
+        }
+    }
+    print_flush();
+    return timer_elapsed_us(start);
+}
+
+static uint64_t chars_per_second(uint64_t elapsed_us)
+{
+    if (elapsed_us == 0)
+    {
+        elapsed_us = 1;
+    }
+    return (uint64_t)CONBENCH_LINES * CONBENCH_LINE_CHARS * 1000000 / elapsed_us;
+}
+
+static void conbench_cmd(char *args)
+{
+    (void)args;
+    ConbenchResult results[4];
+    int count = 0;
+    int original = print_get_backend();
+
+    for (int backend = PRINT_BACKEND_VGA_TEXT; backend <= PRINT_BACKEND_FRAMEBUFFER; backend++)
+    {
+        if (print_set_backend(backend) != 0)
+        {
+            continue;
+        }
+        for (int batched = 0; batched <= 1; batched++)
+        {
+            results[count].backend = backend;
+            results[count].batched = batched;
+            results[count].elapsed_us = conbench_run(batched);
+            count++;
+        }
+    }
+    print_set_backend(original);
+
+    print_str("Console benchmark: ");
+    print_int(CONBENCH_LINES);
+    print_str(" lines of ");
+    print_int(CONBENCH_LINE_CHARS);
+    print_str(" characters");
+    print_newline();
+    if (fbcon_available())
+    {
+        uint32_t width, height;
+        fbcon_resolution(&width, &height);
+        print_str("Framebuffer: ");
+        print_int(width);
+        print_str("x");
+        print_int(height);
+        print_newline();
+    }
+    else
+    {
+        print_str("No framebuffer; only the text-mode path was measured");
+        print_newline();
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        uint64_t cps = chars_per_second(results[i].elapsed_us);
+        print_str("  ");
+        print_str((char *)backend_name(results[i].backend));
+        print_str(results[i].batched ? ", batched flush: " : ", flush per line: ");
+        print_int(cps);
+        print_str(" chars/s (");
+        print_int(results[i].elapsed_us / 1000);
+        print_str(" ms)");
+        print_newline();
+
+        serial_write_str("conbench backend=");
+        serial_write_str(results[i].backend == PRINT_BACKEND_FRAMEBUFFER ? "fb" : "vga");
+        serial_write_str(results[i].batched ? " flush=batched" : " flush=line");
+        serial_write_str(" lines=");
+        serial_write_dec(CONBENCH_LINES);
+        serial_write_str(" us=");
+        serial_write_dec(results[i].elapsed_us);
+        serial_write_str(" cps=");
+        serial_write_dec(cps);
+        serial_write_char('\n');
+    }
+}
+
+COMMAND(COMMAND_SHELL_KERNEL, conbench, "conbench", "", "Measure console throughput (text mode vs framebuffer)",
+        COMMAND_ARGS_NONE, conbench_cmd);
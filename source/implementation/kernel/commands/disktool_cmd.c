@@ -2,6 +2,7 @@
 #include "console.h"
 #include "string.h"
 #include "disktool.h"
+#include "command.h"
 
 // Helper function to parse filesystem type from command
 FileSystemType parse_fs_type(const char *fs_str)
@@ -13,18 +14,203 @@ FileSystemType parse_fs_type(const char *fs_str)
     return FS_FAT32; // Default to FAT32
 }
 
-void start_disktool(int color)
+// Parses "[fat32|ext4] [--discard]" in any order; the filesystem defaults to `fs_type`
+static FileSystemType parse_format_args(char *args, FileSystemType fs_type, int *discard)
 {
+    *discard = 0;
+    while (*args != '\0')
+    {
+        while (*args == ' ')
+            args++;
+        char *end = strchr(args, ' ');
+        if (end)
+        {
+            *end = '\0';
+        }
+        if (strcmp(args, "--discard") == 0)
+        {
+            *discard = 1;
+        }
+        else if (*args != '\0')
+        {
+            fs_type = parse_fs_type(args);
+        }
+        if (!end)
+        {
+            break;
+        }
+        args = end + 1;
+    }
+    return fs_type;
+}
+
+static int disktool_exit = 0;
+
+static void help_cmd(char *args)
+{
+    (void)args;
+    print_str("etyOS Kernel Disk tool commands:");
+    print_newline();
+    command_print_help(COMMAND_SHELL_DISKTOOL);
+    print_set_color(PRINT_COLOR_LIGHT_GRAY, shell_color);
+    print_str("Warning: remove all partitions from disk before formatting it");
+    print_set_color(PRINT_COLOR_WHITE, shell_color);
+    print_newline();
+}
+
+static void listdisks_cmd(char *args)
+{
+    (void)args;
+    list_disks();
+}
+
+static void update_cmd(char *args)
+{
+    (void)args;
+    init_disktool();
+}
+
+static void format_cmd(char *args)
+{
+    int discard;
+    FileSystemType fs_type = parse_format_args(args, FS_EXT4, &discard);
+    format_disk(fs_type, discard);
+}
+
+static void formatpart_cmd(char *args)
+{
+    int discard;
+    int part_num = strtoul(args, &args, 10);
+    FileSystemType fs_type = parse_format_args(args, FS_EXT4, &discard);
+    format_partition(part_num, fs_type, discard);
+}
+
+static void selectdisk_cmd(char *args)
+{
+    int disk_num = strtoul(args, NULL, 10);
+    if (select_disk(disk_num) == 0)
+    {
+        print_str("Disk selected successfully.");
+        print_newline();
+    }
+}
+
+static void newpart_cmd(char *args)
+{
+    char *size_str = args;
+    char *fs_str = strchr(size_str, ' ');
+    FileSystemType fs_type = FS_FAT32;
+
+    if (fs_str)
+    {
+        *fs_str = '\0'; // Null terminate size string
+        fs_str++;       // Move to filesystem type
+        fs_type = parse_fs_type(fs_str);
+    }
+
+    uint32_t size_mb = strtoul(size_str, NULL, 10);
+    if (create_partition_mb(size_mb, fs_type) == 0)
+    {
+        print_str("Partition created successfully.");
+        print_newline();
+    }
+}
+
+static void delpart_cmd(char *args)
+{
+    delete_partition(strtoul(args, NULL, 10));
+}
+
+static void journal_cmd(char *args)
+{
+    journal_partition(strtoul(args, NULL, 10));
+}
+
+static void jbench_cmd(char *args)
+{
+    uint32_t ops = 1000;
+    uint32_t batch = 64;
+    int part_num = strtoul(args, &args, 10);
+    if (*args == ' ')
+    {
+        ops = strtoul(args + 1, &args, 10);
+    }
+    if (*args == ' ')
+    {
+        batch = strtoul(args + 1, &args, 10);
+    }
+    benchmark_journal(part_num, ops, batch);
+}
+
+static void bench_cmd(char *args)
+{
+    benchmark_disk(args);
+}
+
+static void clone_cmd(char *args)
+{
+    int src = strtoul(args, &args, 10);
+    while (*args == ' ')
+        args++;
+    int dst = strtoul(args, &args, 10);
+    while (*args == ' ')
+        args++;
+    clone_disks(src, dst, strcmp(args, "sparse") == 0);
+}
+
+static void ramdisk_cmd(char *args)
+{
+    create_ramdisk(strtoul(args, NULL, 10));
+}
+
+static void snapshot_cmd(char *args)
+{
+    snapshot_ramdisk(strtoul(args, NULL, 10));
+}
+
+static void mkgpt_cmd(char *args)
+{
+    (void)args;
+    init_gpt();
+}
+
+static void partinfo_cmd(char *args)
+{
+    (void)args;
+    display_partition_info();
+}
+
+static void exit_cmd(char *args)
+{
+    (void)args;
+    disktool_exit = 1;
+}
+
+static void disktool_cmd(char *args)
+{
+    // "disktool <command>" runs a single command, e.g. from a script
+    if (*args != '\0')
+    {
+        if (command_dispatch(COMMAND_SHELL_DISKTOOL, args) != 0)
+        {
+            print_str("Unknown disktool command: ");
+            print_str(args);
+            print_newline();
+        }
+        return;
+    }
+
     print_str("Welcome to disktool. ");
     print_newline();
     print_str("Type help to get list of all commands");
     print_newline();
     char command[256];
-    while (1)
+    disktool_exit = 0;
+    while (!disktool_exit)
     {
-        print_set_color(PRINT_COLOR_YELLOW, color);
+        print_set_color(PRINT_COLOR_YELLOW, shell_color);
         print_str("disktool > "); // Prompt
-        print_set_color(PRINT_COLOR_WHITE, color);
+        print_set_color(PRINT_COLOR_WHITE, shell_color);
 
         read_input(command, sizeof(command)); // Read user input
         print_newline();
@@ -32,95 +218,36 @@ void start_disktool(int color)
         if (command[0] == '\0')
             continue;
 
-        if (strcmp(command, "help") == 0)
-        {
-            print_str("etyOS Kernel Disk tool commands:");
-            print_newline();
-            print_str(" - listdisks: Show all available disks");
-            print_newline();
-            print_str(" - selectdisk <number>: Select a disk to work with");
-            print_newline();
-            print_str(" - newpart <size_mb> [fat32|ext4]: Create a new partition with size in MB");
-            print_newline();
-            print_str(" - delpart <number>: Delete a partition");
-            print_newline();
-            print_str(" - partinfo: Show partition information and filesystem types");
-            print_newline();
-            print_str(" - format [fat32|ext4]: Format selected disk (defaults to ext4).");
-            print_newline();
-            print_set_color(PRINT_COLOR_LIGHT_GRAY, color);
-            print_str("Warning: remove all partitions from disk before formatting it"); // Prompt
-            print_set_color(PRINT_COLOR_WHITE, color);
-            print_newline();
-            print_str(" - update: Update disks information");
-            print_newline();
-            print_str(" - exit: Exit from disktool");
-            print_newline();
-        }
-        else if (strcmp(command, "listdisks") == 0)
-        {
-            list_disks();
-        }
-        else if (strcmp(command, "update") == 0)
-        {
-            init_disktool();
-        }
-        else if (strcmp(command, "format") == 0)
-        {
-            format_disk(FS_EXT4); // Maintain backward compatibility by defaulting to FAT32
-        }
-        else if (strncmp(command, "format ", 7) == 0)
-        {
-            char *fs_str = command + 7;
-            FileSystemType fs_type = parse_fs_type(fs_str);
-            format_disk(fs_type);
-        }
-        else if (strncmp(command, "selectdisk ", 11) == 0)
-        {
-            int disk_num = strtoul(command + 11, NULL, 10);
-            if (select_disk(disk_num) == 0)
-            {
-                print_str("Disk selected successfully.");
-                print_newline();
-            }
-        }
-        else if (strncmp(command, "newpart ", 8) == 0)
-        {
-            char *size_str = command + 8;
-            char *fs_str = strchr(size_str, ' ');
-            FileSystemType fs_type = FS_FAT32;
-
-            if (fs_str)
-            {
-                *fs_str = '\0'; // Null terminate size string
-                fs_str++;       // Move to filesystem type
-                fs_type = parse_fs_type(fs_str);
-            }
-
-            uint32_t size_mb = strtoul(size_str, NULL, 10);
-            if (create_partition_mb(size_mb, fs_type) == 0)
-            {
-                print_str("Partition created successfully.");
-                print_newline();
-            }
-        }
-        else if (strncmp(command, "delpart ", 8) == 0)
-        {
-            int part_num = strtoul(command + 8, NULL, 10);
-            delete_partition(part_num);
-        }
-        else if (strcmp(command, "partinfo") == 0)
-        {
-            display_partition_info();
-        }
-        else if (strcmp(command, "exit") == 0)
-        {
-            break;
-        }
-        else
+        if (command_dispatch(COMMAND_SHELL_DISKTOOL, command) != 0)
         {
             print_str("Unknown command. Type 'help' for available commands.");
             print_newline();
         }
     }
-}
\ No newline at end of file
+}
+
+#define DISKTOOL_COMMAND(id, usage, help, args) \
+    COMMAND(COMMAND_SHELL_DISKTOOL, disktool_##id, #id, usage, help, args, id##_cmd)
+
+COMMAND(COMMAND_SHELL_KERNEL, disktool, "disktool", "[command]", "Manage and view storage, or run one disktool command",
+        COMMAND_ARGS_OPTIONAL, disktool_cmd);
+
+DISKTOOL_COMMAND(help, "", "Show this help message", COMMAND_ARGS_NONE);
+DISKTOOL_COMMAND(listdisks, "", "Show all available disks", COMMAND_ARGS_NONE);
+DISKTOOL_COMMAND(selectdisk, "<number>", "Select a disk to work with", COMMAND_ARGS_REQUIRED);
+DISKTOOL_COMMAND(newpart, "<size_mb> [fat32|ext4]", "Create a new partition with size in MB", COMMAND_ARGS_REQUIRED);
+DISKTOOL_COMMAND(delpart, "<number>", "Delete a partition", COMMAND_ARGS_REQUIRED);
+DISKTOOL_COMMAND(partinfo, "", "Show partition information and filesystem types", COMMAND_ARGS_NONE);
+DISKTOOL_COMMAND(mkgpt, "", "Replace the partition table with an empty GPT (up to 128 partitions)", COMMAND_ARGS_NONE);
+DISKTOOL_COMMAND(format, "[fat32|ext4] [--discard]",
+                 "Format selected disk (defaults to ext4); --discard trims it (ATA TRIM) first", COMMAND_ARGS_OPTIONAL);
+DISKTOOL_COMMAND(formatpart, "<number> [fat32|ext4] [--discard]", "Format one partition", COMMAND_ARGS_REQUIRED);
+DISKTOOL_COMMAND(journal, "<number>", "Open (and replay) the journal of an ext4 partition", COMMAND_ARGS_REQUIRED);
+DISKTOOL_COMMAND(jbench, "<number> [ops] [batch]", "Metadata ops/s, synchronous vs group commit", COMMAND_ARGS_REQUIRED);
+DISKTOOL_COMMAND(bench, "[read|write|randread|randwrite] [bs=4k] [qd=1] [offset=0] [size=<all>] [runtime=5] [force]",
+                 "Measure IOPS, MB/s and latency percentiles; writes need 'force'", COMMAND_ARGS_OPTIONAL);
+DISKTOOL_COMMAND(clone, "<src> <dst> [sparse]", "Copy a whole disk; 'sparse' skips zero blocks", COMMAND_ARGS_REQUIRED);
+DISKTOOL_COMMAND(ramdisk, "<size_mb>", "Create a RAM-backed disk (listed after the ATA disks)", COMMAND_ARGS_REQUIRED);
+DISKTOOL_COMMAND(snapshot, "<disk>", "Copy-on-write copy of a RAM disk as a new disk", COMMAND_ARGS_REQUIRED);
+DISKTOOL_COMMAND(update, "", "Update disks information", COMMAND_ARGS_NONE);
+DISKTOOL_COMMAND(exit, "", "Exit from disktool", COMMAND_ARGS_NONE);
@@ -0,0 +1,26 @@
+#include "print.h"
+#include "kprintf.h"
+#include "idle.h"
+#include "timer.h"
+#include "command.h"
+
+static void idlestat_cmd(char *args)
+{
+    (void)args;
+    IdleStats stats;
+    idle_get_stats(&stats);
+
+    uint64_t total_us = timer_tsc_to_us(stats.total_tsc);
+    uint64_t idle_us = timer_tsc_to_us(stats.idle_tsc);
+    uint64_t permille = total_us ? idle_us * 1000 / total_us : 0;
+
+    kprintf("Idle: %lu.%lu%% of %lu ms since boot, using %s\n",
+            permille / 10, permille % 10, total_us / 1000, stats.mwait ? "MWAIT" : "HLT");
+    kprintf("  Sleeps: %lu  Average: %lu us\n",
+            stats.sleeps, stats.sleeps ? idle_us / stats.sleeps : 0);
+    kprintf("  Timer deadlines: %lu armed, %lu fired (no periodic tick)\n",
+            stats.deadline_sleeps, timer_deadline_irqs());
+}
+
+COMMAND(COMMAND_SHELL_KERNEL, idlestat, "idlestat", "", "Show how much of the time the CPU spent asleep",
+        COMMAND_ARGS_NONE, idlestat_cmd);
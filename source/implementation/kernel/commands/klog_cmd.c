@@ -0,0 +1,79 @@
+#include "print.h"
+#include "string.h"
+#include "klog.h"
+#include "command.h"
+
+// Prints `value` with at least `width` digits, padding with zeros
+static void print_padded(uint64_t value, int width)
+{
+    char digits[21];
+    int count = 0;
+    do
+    {
+        digits[count++] = '0' + (value % 10);
+        value /= 10;
+    } while (value != 0);
+    while (count < width)
+    {
+        digits[count++] = '0';
+    }
+    while (count > 0)
+    {
+        print_char(digits[--count]);
+    }
+}
+
+static int parse_level(const char *name)
+{
+    for (int level = KLOG_ERROR; level <= KLOG_DEBUG; level++)
+    {
+        if (strcmp(name, klog_level_name(level)) == 0)
+        {
+            return level;
+        }
+    }
+    return -1;
+}
+
+// dmesg [error|warn|info|debug]: records at the given level and above
+static void dmesg_cmd(char *args)
+{
+    int max_level = KLOG_DEBUG;
+    while (*args == ' ')
+    {
+        args++;
+    }
+    if (*args != '\0')
+    {
+        max_level = parse_level(args);
+        if (max_level < 0)
+        {
+            print_str("Usage: dmesg [error|warn|info|debug]");
+            print_newline();
+            return;
+        }
+    }
+
+    KlogRecord record;
+    uint64_t cursor = klog_oldest();
+    while (klog_read(&cursor, &record))
+    {
+        if (record.level > max_level)
+        {
+            continue;
+        }
+        uint64_t us = klog_tsc_to_us(record.tsc);
+        print_str("[");
+        print_int(us / 1000000);
+        print_str(".");
+        print_padded(us % 1000000, 6);
+        print_str("] ");
+        print_str((char *)klog_level_name(record.level));
+        print_str(": ");
+        print_str(record.text);
+        print_newline();
+    }
+}
+
+COMMAND(COMMAND_SHELL_KERNEL, dmesg, "dmesg", "[error|warn|info|debug]",
+        "Show the kernel log, optionally down to a level", COMMAND_ARGS_OPTIONAL, dmesg_cmd);
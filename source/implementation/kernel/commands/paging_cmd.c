@@ -0,0 +1,94 @@
+#include "print.h"
+#include "kprintf.h"
+#include "paging.h"
+#include "pmm.h"
+#include "vmm.h"
+#include "vfs.h"
+#include "command.h"
+
+// End of .bss, from the linker script
+extern char kernel_end[];
+
+static void vminfo_cmd(char *args)
+{
+    (void)args;
+    PagingStats stats;
+    paging_get_stats(&stats);
+
+    kprintf("Kernel image: 0x%llx, %lu KiB including bss\n", KERNEL_VMA, virt_to_phys(kernel_end) >> 10);
+    kprintf("Direct map:   0x%llx, %lu MiB in %s pages\n", DIRECT_MAP_BASE, stats.direct_map_bytes >> 20,
+            stats.direct_map_page_size >= (1ULL << 30) ? "1 GiB" : "2 MiB");
+    kprintf("MMIO window:  0x%llx, %lu KiB used\n", MMIO_BASE, stats.mmio_bytes >> 10);
+    kprintf("Page tables:  %u of %u pool pages\n", stats.tables_used, stats.tables_total);
+    kprintf("Features:     1 GiB pages %s, PAT %s, global pages %s\n", stats.has_1g_pages ? "yes" : "no",
+            stats.has_pat ? "yes" : "no", stats.has_global_pages ? "yes" : "no");
+}
+
+static void vmstat_cmd(char *args)
+{
+    (void)args;
+    PmmStats pmm;
+    pmm_get_stats(&pmm);
+
+    kprintf("Frames: %lu MiB free of %lu MiB in %u ranges\n", (pmm.free_frames * PMM_FRAME_SIZE) >> 20,
+            (pmm.total_frames * PMM_FRAME_SIZE) >> 20, pmm.regions);
+    kprintf("%-12s %5s %10s %10s %10s %8s %8s\n", "Space", "Maps", "Mapped", "Resident", "Minor", "Major", "COW");
+    for (int i = 0; i < vmm_count(); i++)
+    {
+        AddressSpace *space = vmm_get(i);
+        int maps = 0;
+        for (Vma *vma = space->vmas; vma != NULL; vma = vma->next)
+        {
+            maps++;
+        }
+        kprintf("%-12s %5d %8lu K %8lu K %10lu %8lu %8lu%s\n", space->name, maps, space->mapped_bytes >> 10,
+                (space->resident_pages * PAGE_SIZE) >> 10, space->minor_faults, space->major_faults,
+                space->cow_faults, space == vmm_current() ? "  (current)" : "");
+    }
+}
+
+// Maps a file and reads every page through the fault handler
+static void vmtouch_cmd(char *path)
+{
+    VfsFile file;
+    if (vfs_open(path, &file) != 0 || VFS_ISDIR(file.inode->mode) || file.inode->size == 0)
+    {
+        print_str("vmtouch: not a regular file: ");
+        print_str(path);
+        print_newline();
+        if (file.inode != NULL)
+        {
+            vfs_close(&file);
+        }
+        return;
+    }
+
+    AddressSpace *space = vmm_kernel_space();
+    uint64_t size = file.inode->size;
+    const volatile uint8_t *data = vmm_map_file(space, file.inode, 0, size, 0);
+    vfs_close(&file);
+    if (data == NULL)
+    {
+        print_str("vmtouch: cannot map the file");
+        print_newline();
+        return;
+    }
+
+    uint64_t minor = space->minor_faults;
+    uint64_t major = space->major_faults;
+    uint32_t sum = 0;
+    for (uint64_t offset = 0; offset < size; offset += PAGE_SIZE)
+    {
+        sum += data[offset];
+    }
+    kprintf("%lu pages: %lu minor and %lu major faults (checksum %u)\n", (size + PAGE_SIZE - 1) / PAGE_SIZE,
+            space->minor_faults - minor, space->major_faults - major, sum);
+    vmm_unmap(space, (void *)data);
+}
+
+COMMAND(COMMAND_SHELL_KERNEL, vminfo, "vminfo", "", "Show the kernel address space layout and paging features",
+        COMMAND_ARGS_NONE, vminfo_cmd);
+COMMAND(COMMAND_SHELL_KERNEL, vmstat, "vmstat", "", "Show free frames and per-address-space fault counts",
+        COMMAND_ARGS_NONE, vmstat_cmd);
+COMMAND(COMMAND_SHELL_KERNEL, vmtouch, "vmtouch", "<path>", "Map a file and fault in every page", COMMAND_ARGS_REQUIRED,
+        vmtouch_cmd);
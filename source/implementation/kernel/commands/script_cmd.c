@@ -0,0 +1,21 @@
+#include "print.h"
+#include "string.h"
+#include "command.h"
+#include "script.h"
+#include "qemu.h"
+
+static void run_cmd(char *path)
+{
+    script_run_file(path);
+}
+
+// poweroff [status]: leaves QEMU through isa-debug-exit
+static void poweroff_cmd(char *args)
+{
+    qemu_exit((uint8_t)strtoul(args, NULL, 10));
+}
+
+COMMAND(COMMAND_SHELL_KERNEL, run, "run", "<path>", "Run the commands in a script file, timing each one",
+        COMMAND_ARGS_REQUIRED, run_cmd);
+COMMAND(COMMAND_SHELL_KERNEL, poweroff, "poweroff", "[status]", "Exit QEMU with a status (needs isa-debug-exit)",
+        COMMAND_ARGS_OPTIONAL, poweroff_cmd);
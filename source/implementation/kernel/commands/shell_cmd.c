@@ -0,0 +1,76 @@
+#include "print.h"
+#include "string.h"
+#include "command.h"
+#include "filesystem.h"
+#include "partition.h"
+
+static void clear_cmd(char *args)
+{
+    (void)args;
+    print_clear();
+}
+
+static void about_cmd(char *args)
+{
+    (void)args;
+    print_str("etyOS 2.0");
+    print_newline();
+    print_str("Version created: 27.10.2024");
+    print_newline();
+    print_str("Author: Mikhail Karlov");
+    print_newline();
+    print_str("Configuration: x86_64 multiboot2");
+    print_newline();
+}
+
+static void echo_cmd(char *args)
+{
+    print_str(args);
+    print_newline();
+}
+
+static void setcolor_cmd(char *args)
+{
+    int background = strtoul(args, NULL, 10);
+
+    // Validate color inputs
+    if (background >= 0 && background <= 14)
+    {
+        shell_color = background;
+        print_set_color(PRINT_COLOR_WHITE, shell_color);
+        print_clear();
+        print_str("Colors updated.");
+    }
+    else
+    {
+        print_str("Invalid color value. Use numbers between 0 and 14.");
+    }
+    print_newline();
+}
+
+static void checkfs_cmd(char *args)
+{
+    (void)args;
+    check_filesystem();
+}
+
+static void dsks_cmd(char *args)
+{
+    (void)args;
+    display_available_disks();
+}
+
+static void partitions_cmd(char *args)
+{
+    (void)args;
+    display_partitions();
+}
+
+COMMAND(COMMAND_SHELL_KERNEL, clear, "clear", "", "Clear the screen", COMMAND_ARGS_NONE, clear_cmd);
+COMMAND(COMMAND_SHELL_KERNEL, about, "about", "", "Get information about this build", COMMAND_ARGS_NONE, about_cmd);
+COMMAND(COMMAND_SHELL_KERNEL, echo, "echo", "<text>", "Print text back to the console", COMMAND_ARGS_OPTIONAL, echo_cmd);
+COMMAND(COMMAND_SHELL_KERNEL, setcolor, "setcolor", "<background>", "Change the text and background colors",
+        COMMAND_ARGS_REQUIRED, setcolor_cmd);
+COMMAND(COMMAND_SHELL_KERNEL, checkfs, "checkfs", "", "Detect the filesystem on the first disk", COMMAND_ARGS_NONE, checkfs_cmd);
+COMMAND(COMMAND_SHELL_KERNEL, dsks, "dsks", "", "List the ATA devices found at boot", COMMAND_ARGS_NONE, dsks_cmd);
+COMMAND(COMMAND_SHELL_KERNEL, partitions, "partitions", "", "Show all partitions", COMMAND_ARGS_NONE, partitions_cmd);
@@ -0,0 +1,151 @@
+#include "print.h"
+#include "kprintf.h"
+#include "string.h"
+#include "timer.h"
+#include "tlb.h"
+#include "vmm.h"
+#include "command.h"
+
+#define CTXBENCH_DEFAULT_ROUNDS 10000
+#define CTXBENCH_MAX_PAGES 512
+
+// Working sets touched after every switch; 0 measures the bare CR3 load
+static const uint32_t ctxbench_pages[] = {0, 8, 64, 512};
+
+#define CTXBENCH_SIZES (sizeof(ctxbench_pages) / sizeof(ctxbench_pages[0]))
+
+// Both spaces map their buffer at the same address with different
+// contents, so a stale translation shows up as a wrong sum
+static uint64_t measure_switches(AddressSpace *spaces[2], volatile uint8_t *buffer, uint32_t pages, uint32_t rounds,
+                                 int *valid)
+{
+    uint64_t sums[2] = {0, 0};
+    uint64_t start = timer_tsc();
+
+    for (uint32_t i = 0; i < rounds; i++)
+    {
+        for (int s = 0; s < 2; s++)
+        {
+            vmm_switch(spaces[s]);
+            for (uint32_t page = 0; page < pages; page++)
+            {
+                sums[s] += buffer[page * PAGE_SIZE];
+            }
+        }
+    }
+
+    uint64_t cycles = timer_tsc() - start;
+    vmm_switch(vmm_kernel_space());
+    *valid = sums[0] == (uint64_t)rounds * pages && sums[1] == (uint64_t)rounds * pages * 2;
+    return cycles / (2 * (uint64_t)rounds);
+}
+
+// ctxbench [rounds]
+static void ctxbench_cmd(char *args)
+{
+    uint32_t rounds = strtoul(args, NULL, 10);
+    if (rounds == 0)
+    {
+        rounds = CTXBENCH_DEFAULT_ROUNDS;
+    }
+    if (vmm_current() != vmm_kernel_space())
+    {
+        print_str("ctxbench: must run from the kernel address space");
+        print_newline();
+        return;
+    }
+
+    AddressSpace *spaces[2] = {vmm_create("ctxbench-a"), vmm_create("ctxbench-b")};
+    volatile uint8_t *buffers[2] = {NULL, NULL};
+    for (int s = 0; s < 2; s++)
+    {
+        if (spaces[s] != NULL)
+        {
+            buffers[s] = vmm_map_anonymous(spaces[s], CTXBENCH_MAX_PAGES * PAGE_SIZE, VMM_WRITE);
+        }
+    }
+    if (buffers[0] == NULL || buffers[1] != buffers[0])
+    {
+        print_str("ctxbench: cannot create the address spaces");
+        print_newline();
+        for (int s = 0; s < 2; s++)
+        {
+            if (spaces[s] != NULL)
+            {
+                vmm_destroy(spaces[s]);
+            }
+        }
+        return;
+    }
+
+    volatile uint8_t *buffer = buffers[0];
+    for (int s = 0; s < 2; s++)
+    {
+        vmm_switch(spaces[s]);
+        for (uint32_t page = 0; page < CTXBENCH_MAX_PAGES; page++)
+        {
+            buffer[page * PAGE_SIZE] = (uint8_t)(s + 1);
+        }
+    }
+    vmm_switch(vmm_kernel_space());
+
+    int pcid_was_on = tlb_pcid_enabled();
+    int modes = tlb_pcid_supported() ? 2 : 1;
+    uint64_t cycles[2][CTXBENCH_SIZES];
+    int valid = 1;
+
+    for (int mode = 0; mode < modes; mode++)
+    {
+        vmm_set_pcid(mode);
+        for (uint32_t i = 0; i < CTXBENCH_SIZES; i++)
+        {
+            int ok;
+            cycles[mode][i] = measure_switches(spaces, buffer, ctxbench_pages[i], rounds, &ok);
+            valid &= ok;
+        }
+    }
+    vmm_set_pcid(pcid_was_on);
+    vmm_destroy(spaces[0]);
+    vmm_destroy(spaces[1]);
+
+    kprintf("%u round trips between two address spaces, cycles per switch:\n", rounds);
+    kprintf("%12s %12s %12s\n", "Pages", "No PCID", modes == 2 ? "PCID" : "");
+    for (uint32_t i = 0; i < CTXBENCH_SIZES; i++)
+    {
+        if (modes == 2)
+        {
+            kprintf("%12u %12lu %12lu\n", ctxbench_pages[i], cycles[0][i], cycles[1][i]);
+        }
+        else
+        {
+            kprintf("%12u %12lu\n", ctxbench_pages[i], cycles[0][i]);
+        }
+    }
+    if (modes == 1)
+    {
+        print_str("This CPU has no PCIDs; every switch flushes the TLB.");
+        print_newline();
+    }
+    if (!valid)
+    {
+        print_str("ctxbench: an address space read another one's memory (stale TLB entry)");
+        print_newline();
+    }
+}
+
+static void tlbstat_cmd(char *args)
+{
+    (void)args;
+    TlbStats stats;
+    tlb_get_stats(&stats);
+
+    kprintf("PCID: %s, INVPCID: %s\n", stats.pcid_enabled ? "on" : (stats.has_pcid ? "off" : "unsupported"),
+            stats.has_invpcid ? "yes" : "no");
+    kprintf("  Page flushes: %lu  Full flushes: %lu\n", stats.page_flushes, stats.full_flushes);
+    kprintf("  Batches: %lu  Deferred to next switch: %lu\n", stats.batches, stats.deferred);
+}
+
+COMMAND(COMMAND_SHELL_KERNEL, ctxbench, "ctxbench", "[rounds]",
+        "Measure cycles per address space switch with and without PCIDs", COMMAND_ARGS_OPTIONAL, ctxbench_cmd);
+COMMAND(COMMAND_SHELL_KERNEL, tlbstat, "tlbstat", "", "Show PCID support and TLB flush counts", COMMAND_ARGS_NONE,
+        tlbstat_cmd);
@@ -0,0 +1,114 @@
+#include "print.h"
+#include "kprintf.h"
+#include "serial.h"
+#include "string.h"
+#include "timer.h"
+#include "trace.h"
+#include "command.h"
+
+// Splits "category:event" into its parts; events without a category get "kernel"
+static void split_name(const char *name, char *category, size_t size, const char **event)
+{
+    const char *colon = strchr(name, ':');
+    if (colon == NULL || (size_t)(colon - name) >= size)
+    {
+        strcpy(category, "kernel");
+        *event = name;
+        return;
+    }
+    size_t length = colon - name;
+    for (size_t i = 0; i < length; i++)
+    {
+        category[i] = name[i];
+    }
+    category[length] = '\0';
+    *event = colon + 1;
+}
+
+// Chrome trace-event JSON (chrome://tracing, Perfetto) over COM1, one
+// event per line between the opening and closing lines
+static uint64_t dump_trace(void)
+{
+    char line[192];
+    char category[16];
+    uint64_t start = trace_start_tsc();
+    uint64_t events = 0;
+
+    serial_write_str("{\"traceEvents\":[\n");
+    for (int cpu = 0; cpu < TRACE_CPUS; cpu++)
+    {
+        uint64_t cursor = 0;
+        TraceRecord record;
+        while (trace_read(cpu, &cursor, &record))
+        {
+            const char *event;
+            split_name(record.name, category, sizeof(category), &event);
+            uint64_t ns = record.tsc > start ? timer_tsc_to_ns(record.tsc - start) : 0;
+
+            int length = ksnprintf(line, sizeof(line),
+                                   "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%lu.%03lu,\"pid\":1,"
+                                   "\"tid\":%u,\"args\":{\"arg\":%lu}%s}",
+                                   events == 0 ? "" : ",\n", event, category, record.phase, ns / 1000, ns % 1000,
+                                   record.cpu, record.arg, record.phase == TRACE_PHASE_INSTANT ? ",\"s\":\"t\"" : "");
+            if (length >= (int)sizeof(line))
+            {
+                length = sizeof(line) - 1;
+            }
+            serial_write(line, length);
+            events++;
+        }
+    }
+    serial_write_str("\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"tsc_khz\":");
+    serial_write_dec(timer_tsc_khz());
+    serial_write_str("}}\n");
+    serial_flush();
+    return events;
+}
+
+static void trace_status(void)
+{
+    uint64_t total = 0;
+    for (int cpu = 0; cpu < TRACE_CPUS; cpu++)
+    {
+        total += trace_count(cpu);
+    }
+    uint64_t capacity = (uint64_t)TRACE_CPUS * TRACE_RECORDS;
+    kprintf("Tracing %s; %lu events recorded, %lu kept (%d per CPU)\n", trace_enabled ? "on" : "off", total,
+            total < capacity ? total : capacity, TRACE_RECORDS);
+}
+
+// trace on|off|clear|status|dump
+static void trace_cmd(char *args)
+{
+    if (strcmp(args, "on") == 0)
+    {
+        trace_set_enabled(1);
+    }
+    else if (strcmp(args, "off") == 0)
+    {
+        trace_set_enabled(0);
+    }
+    else if (strcmp(args, "clear") == 0)
+    {
+        trace_clear();
+    }
+    else if (strcmp(args, "dump") == 0)
+    {
+        int was_enabled = trace_enabled;
+        trace_set_enabled(0);
+        uint64_t events = dump_trace();
+        trace_set_enabled(was_enabled);
+        kprintf("%lu trace events written to serial\n", events);
+        return;
+    }
+    else if (*args != '\0' && strcmp(args, "status") != 0)
+    {
+        print_str("Usage: trace on|off|clear|status|dump");
+        print_newline();
+        return;
+    }
+    trace_status();
+}
+
+COMMAND(COMMAND_SHELL_KERNEL, trace, "trace", "[on|off|clear|status|dump]",
+        "Record tracepoints and dump them over serial as Chrome trace JSON", COMMAND_ARGS_OPTIONAL, trace_cmd);
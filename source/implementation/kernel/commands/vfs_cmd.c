@@ -0,0 +1,237 @@
+#include "print.h"
+#include "string.h"
+#include "disktool.h"
+#include "vfs.h"
+#include "command.h"
+
+static void print_mode(uint32_t mode)
+{
+    if (VFS_ISDIR(mode))
+    {
+        print_str("dir ");
+    }
+    else if ((mode & VFS_S_IFMT) == VFS_S_IFLNK)
+    {
+        print_str("link");
+    }
+    else
+    {
+        print_str("file");
+    }
+}
+
+// mount <disk> [partition] [path]
+static void mount_cmd(char *args)
+{
+    char *end;
+    int disk_index = strtoul(args, &end, 10);
+    if (end == args)
+    {
+        vfs_list_mounts();
+        return;
+    }
+
+    BlockDevice *dev = disktool_get_device(disk_index);
+    if (dev == NULL)
+    {
+        print_str("Invalid disk index");
+        print_newline();
+        return;
+    }
+
+    uint64_t start_lba = 0;
+    uint64_t sector_count = dev->sector_count;
+    char *path = "/";
+
+    while (*end == ' ')
+        end++;
+    if (*end >= '0' && *end <= '9')
+    {
+        int partition_index = strtoul(end, &end, 10);
+        if (disktool_partition_range(disk_index, partition_index, &start_lba, &sector_count) != 0)
+        {
+            return;
+        }
+        while (*end == ' ')
+            end++;
+    }
+    if (*end != '\0')
+    {
+        path = end;
+    }
+
+    if (vfs_mount(dev, start_lba, sector_count, path) == 0)
+    {
+        vfs_list_mounts();
+    }
+}
+
+static void umount_cmd(char *path)
+{
+    if (vfs_umount(path) == 0)
+    {
+        print_str("Unmounted ");
+        print_str(path);
+        print_newline();
+    }
+}
+
+static void ls_cmd(char *path)
+{
+    VfsFile dir;
+    VfsDirEntry entry;
+
+    if (*path == '\0')
+    {
+        path = "/";
+    }
+
+    if (vfs_open(path, &dir) != 0)
+    {
+        print_str("ls: no such file or directory: ");
+        print_str(path);
+        print_newline();
+        return;
+    }
+
+    int result;
+    while ((result = vfs_readdir(&dir, &entry)) == 1)
+    {
+        print_mode(entry.mode);
+        print_str("  ");
+        print_str(entry.name);
+        print_newline();
+    }
+    if (result < 0)
+    {
+        print_str("ls: cannot read directory");
+        print_newline();
+    }
+    vfs_close(&dir);
+}
+
+// Prints file contents straight from the page cache without copying them out
+static void cat_cmd(char *path)
+{
+    VfsFile file;
+
+    if (vfs_open(path, &file) != 0)
+    {
+        print_str("cat: no such file: ");
+        print_str(path);
+        print_newline();
+        return;
+    }
+    if (VFS_ISDIR(file.inode->mode))
+    {
+        print_str("cat: is a directory");
+        print_newline();
+        vfs_close(&file);
+        return;
+    }
+
+    uint64_t size = file.inode->size;
+    for (uint64_t index = 0; (index << PAGE_SHIFT) < size; index++)
+    {
+        CachePage *page = vfs_get_page(file.inode, index);
+        if (page == NULL)
+        {
+            print_newline();
+            print_str("cat: read error");
+            break;
+        }
+
+        uint64_t length = size - (index << PAGE_SHIFT);
+        if (length > PAGE_SIZE)
+        {
+            length = PAGE_SIZE;
+        }
+        print_write((const char *)page->data, length);
+        page_cache_put(page);
+    }
+    print_newline();
+    vfs_close(&file);
+}
+
+static void stat_cmd(char *path)
+{
+    VfsFile file;
+
+    if (vfs_open(path, &file) != 0)
+    {
+        print_str("stat: no such file or directory: ");
+        print_str(path);
+        print_newline();
+        return;
+    }
+
+    VfsInode *inode = file.inode;
+    print_str("  File: ");
+    print_str(path);
+    print_newline();
+    print_str("  Type: ");
+    print_mode(inode->mode);
+    print_str("  Mode: ");
+    print_hex(inode->mode & 0xFFF);
+    print_str("  Inode: ");
+    print_int(inode->ino);
+    print_newline();
+    print_str("  Size: ");
+    print_int(inode->size);
+    print_str("  Blocks: ");
+    print_int(inode->blocks);
+    print_str("  Links: ");
+    print_int(inode->links);
+    print_newline();
+    print_str("  Modified: ");
+    print_int(inode->mtime);
+    print_str(" (seconds since 1970)");
+    print_newline();
+    print_str("  Cached pages: ");
+    print_int(inode->pages.nr_pages);
+    print_str("  Filesystem: ");
+    print_str((char *)inode->sb->fs_name);
+    print_str(" on ");
+    print_str(inode->sb->dev->name);
+    print_newline();
+    vfs_close(&file);
+}
+
+static void cachestat_cmd(char *args)
+{
+    (void)args;
+    PageCacheStats stats;
+    page_cache_get_stats(&stats);
+
+    uint64_t lookups = stats.hits + stats.misses;
+    print_str("Page cache: ");
+    print_int(stats.pages);
+    print_str("/");
+    print_int(stats.max_pages);
+    print_str(" pages, ");
+    print_int(stats.nodes);
+    print_str(" radix nodes");
+    print_newline();
+    print_str("  Hits: ");
+    print_int(stats.hits);
+    print_str("  Misses: ");
+    print_int(stats.misses);
+    print_str("  Hit ratio: ");
+    print_int(lookups ? (uint32_t)(stats.hits * 100 / lookups) : 0);
+    print_str("%");
+    print_newline();
+    print_str("  Evictions: ");
+    print_int(stats.evictions);
+    print_str("  Read from disk: ");
+    print_int(stats.fill_bytes / 1024);
+    print_str(" KB");
+    print_newline();
+}
+
+COMMAND(COMMAND_SHELL_KERNEL, mount, "mount", "<disk> [partition] [path]",
+        "Mount an ext4 or FAT32 volume (no arguments lists mounts)", COMMAND_ARGS_OPTIONAL, mount_cmd);
+COMMAND(COMMAND_SHELL_KERNEL, umount, "umount", "<path>", "Unmount a volume", COMMAND_ARGS_REQUIRED, umount_cmd);
+COMMAND(COMMAND_SHELL_KERNEL, ls, "ls", "[path]", "List a directory", COMMAND_ARGS_OPTIONAL, ls_cmd);
+COMMAND(COMMAND_SHELL_KERNEL, cat, "cat", "<path>", "Print a file", COMMAND_ARGS_REQUIRED, cat_cmd);
+COMMAND(COMMAND_SHELL_KERNEL, stat, "stat", "<path>", "Show file metadata", COMMAND_ARGS_REQUIRED, stat_cmd);
+COMMAND(COMMAND_SHELL_KERNEL, cachestat, "cachestat", "", "Show page cache statistics", COMMAND_ARGS_NONE, cachestat_cmd);
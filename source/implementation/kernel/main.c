@@ -5,10 +5,46 @@
 #include "filesystem.h"
 #include "disktool.h"
 #include "memory_allocator.h"
+#include "timer.h"
+#include "vfs.h"
+#include "serial.h"
+#include "multiboot2.h"
+#include "initramfs.h"
+#include "fbcon.h"
+#include "interrupts.h"
+#include "klog.h"
+#include "keyboard.h"
+#include "idle.h"
+#include "command.h"
+#include "script.h"
+#include "paging.h"
+#include "pmm.h"
+#include "vmm.h"
+#include "tlb.h"
+#include "boottime.h"
 
-void kernel_main()
+// The TSC readings come from start in main.asm and from longmode_start
+void kernel_main(uint64_t multiboot_info, uint64_t start_tsc, uint64_t longmode_tsc)
 {
-    print_clear();
+    boot_mark_at("firmware and GRUB", start_tsc);
+    boot_mark_at("32-bit setup", longmode_tsc);
+    klog_init();
+    interrupts_init();
+    serial_init();
+
+    // Use the framebuffer GRUB set up, if any; otherwise stay in text mode
+    multiboot2_init(multiboot_info);
+    paging_init();
+    tlb_init();
+    pmm_init();
+    vmm_init();
+    memory_allocator_init();
+    boot_mark("memory setup");
+
+    if (fbcon_init() != 0 || print_set_backend(PRINT_BACKEND_FRAMEBUFFER) != 0)
+    {
+        print_clear();
+    }
     // Fancy border
     print_set_color(PRINT_COLOR_WHITE, PRINT_COLOR_CYAN);
     print_str("================================================");
@@ -31,21 +67,42 @@ void kernel_main()
     print_set_color(PRINT_COLOR_LIGHT_GRAY, PRINT_COLOR_BLACK);
     print_str("Type 'help' for a list of commands.");
     print_newline();
+    boot_mark("console");
 
     
     // Command processing loop
     char command[256];
-    memory_allocator_init();
+    timer_init();
+    boot_mark("timer calibration");
+    idle_init();
+    serial_enable_interrupts();
+    keyboard_init();
+    interrupts_enable();
+
+    // Modules become RAM disks before disktool enumerates devices
+    initramfs_init();
+    boot_mark("initramfs");
 
     init_disktool();
-    int color = PRINT_COLOR_BLACK;
+    boot_mark("disk scan");
+    command_init();
+    boot_mark("command table");
 
-    print_set_color(PRINT_COLOR_WHITE, color);
+    // Headless benchmark runs: execute the boot script, then power off
+    script_run_boot();
+    boot_mark("boot script");
+
+    klogf(KLOG_INFO, "boot: prompt %lu ms after reset, %lu ms after start", timer_tsc_to_us(timer_tsc()) / 1000,
+          timer_elapsed_us(start_tsc) / 1000);
+    print_set_color(PRINT_COLOR_WHITE, shell_color);
     while (1)
     {
-        print_set_color(PRINT_COLOR_LIGHT_GRAY, color);
+        // Warnings and errors logged while the last command ran
+        klog_drain_console();
+
+        print_set_color(PRINT_COLOR_LIGHT_GRAY, shell_color);
         print_str("etyOS Kernel > "); // Prompt
-        print_set_color(PRINT_COLOR_WHITE, color);
+        print_set_color(PRINT_COLOR_WHITE, shell_color);
 
         read_input(command, sizeof(command)); // Read user input
         print_newline();
@@ -53,70 +110,7 @@ void kernel_main()
         if (command[0] == '\0')
             continue;
 
-        // Process command
-        if (strcmp(command, "help") == 0)
-        {
-            show_help(color);
-        }
-        else if (strcmp(command, "disktool") == 0)
-        {
-            start_disktool(color);
-        }
-        else if (strcmp(command, "clear") == 0)
-        {
-            print_clear();
-        }
-        else if (strcmp(command, "dsks") == 0)
-        {
-            display_available_disks();
-        }
-        else if (strcmp(command, "about") == 0)
-        {
-            print_str("etyOS 2.0");
-            print_newline();
-            print_str("Version created: 27.10.2024");
-            print_newline();
-            print_str("Author: Mikhail Karlov");
-            print_newline();
-            print_str("Configuration: x86_64 multiboot2");
-            print_newline();
-        }
-        else if (strcmp(command, "checkfs") == 0)
-        {
-            check_filesystem();
-        }
-        else if (strncmp(command, "echo ", 5) == 0)
-        {
-            print_str(command + 5); // Print the rest of the input after "echo "
-            print_newline();
-        }
-        else if (strcmp(command, "partitions") == 0)
-        {
-            display_partitions();
-        }
-        else if (strncmp(command, "setcolor ", 9) == 0)
-        {
-            // background foreground and background colors
-            int background = strtoul(command + 9, NULL, 10);
-
-            color = background;
-            // Validate color inputs
-            if (background >= 0 && background <= 14)
-            {
-
-                print_set_color(PRINT_COLOR_WHITE, color);
-                print_clear();
-                print_set_color(PRINT_COLOR_WHITE, color);
-                print_clear();
-                print_str("Colors updated.");
-            }
-            else
-            {
-                print_str("Invalid color value. Use numbers between 0 and 14.");
-            }
-            print_newline();
-        }
-        else
+        if (command_dispatch(COMMAND_SHELL_KERNEL, command) != 0)
         {
             print_str("Unknown command: ");
             print_str(command);
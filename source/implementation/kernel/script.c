@@ -0,0 +1,154 @@
+#include "script.h"
+#include "command.h"
+#include "print.h"
+#include "kprintf.h"
+#include "timer.h"
+#include "vfs.h"
+#include "memory_allocator.h"
+#include "multiboot2.h"
+#include "qemu.h"
+#include "string.h"
+#include "memory.h"
+
+#define SCRIPT_FILE_MAX (1024 * 1024)
+
+// Prints a TSC interval as milliseconds with three decimals
+static void print_duration(uint64_t ticks)
+{
+    uint64_t us = timer_tsc_to_us(ticks);
+    kprintf("%lu.%03lu ms", us / 1000, us % 1000);
+}
+
+int script_run(const char *text, uint64_t length)
+{
+    char line[SCRIPT_LINE_MAX];
+    int commands = 0;
+    int failures = 0;
+    uint64_t script_start = timer_tsc();
+    uint64_t position = 0;
+
+    while (position < length)
+    {
+        uint64_t end = position;
+        while (end < length && text[end] != '\n')
+        {
+            end++;
+        }
+
+        // Trim surrounding blanks and a DOS line ending
+        uint64_t first = position;
+        uint64_t last = end;
+        position = end + 1;
+        while (first < last && (text[first] == ' ' || text[first] == '\t'))
+        {
+            first++;
+        }
+        while (last > first && (text[last - 1] == ' ' || text[last - 1] == '\t' || text[last - 1] == '\r'))
+        {
+            last--;
+        }
+        if (first == last || text[first] == '#')
+        {
+            continue;
+        }
+        if (last - first >= SCRIPT_LINE_MAX)
+        {
+            kprintf("script: line too long, skipped\n");
+            failures++;
+            continue;
+        }
+
+        memory_copy(line, text + first, last - first);
+        line[last - first] = '\0';
+        kprintf("> %s\n", line);
+
+        // Handlers may modify the line, so keep the original for the report
+        char name[SCRIPT_LINE_MAX];
+        strcpy(name, line);
+
+        uint64_t start = timer_tsc();
+        int result = command_dispatch(COMMAND_SHELL_KERNEL, line);
+        uint64_t elapsed = timer_tsc() - start;
+
+        commands++;
+        if (result != 0)
+        {
+            kprintf("script: unknown command: %s\n", name);
+            failures++;
+            continue;
+        }
+        print_str("[script] ");
+        print_duration(elapsed);
+        kprintf("  %s\n", name);
+    }
+
+    kprintf("script: %d commands, %d failed, total ", commands, failures);
+    print_duration(timer_tsc() - script_start);
+    print_newline();
+    return failures;
+}
+
+int script_run_file(const char *path)
+{
+    VfsFile file;
+    if (vfs_open(path, &file) != 0)
+    {
+        kprintf("script: cannot open %s\n", path);
+        return -1;
+    }
+
+    uint64_t size = file.inode->size;
+    if (VFS_ISDIR(file.inode->mode) || size > SCRIPT_FILE_MAX)
+    {
+        kprintf("script: %s is not a script\n", path);
+        vfs_close(&file);
+        return -1;
+    }
+
+    char *text = (char *)allocate(size + 1);
+    if (text == NULL)
+    {
+        vfs_close(&file);
+        return -1;
+    }
+    int64_t length = vfs_read(&file, text, size);
+    vfs_close(&file);
+
+    int result = -1;
+    if (length >= 0)
+    {
+        result = script_run(text, (uint64_t)length);
+    }
+    free(text);
+    return result;
+}
+
+void script_run_boot(void)
+{
+    char path[VFS_PATH_MAX];
+    int failures;
+
+    const BootModule *module = multiboot2_find_module("script");
+    if (module != NULL)
+    {
+        print_str("Running boot script module");
+        print_newline();
+        failures = script_run((const char *)module->start, module->size);
+    }
+    else if (multiboot2_cmdline_option("script", path, sizeof(path)) == 0)
+    {
+        kprintf("Running boot script %s\n", path);
+        failures = script_run_file(path);
+    }
+    else
+    {
+        return;
+    }
+
+    char mode[16];
+    if (multiboot2_cmdline_option("batch", mode, sizeof(mode)) == 0 && strcmp(mode, "shell") == 0)
+    {
+        return;
+    }
+    qemu_exit(failures == 0 ? 0 : 1);
+}
@@ -0,0 +1,234 @@
+// blockdev.c
+#include "blockdev.h"
+#include "filesystem.h"
+#include "print.h"
+#include "interrupts.h"
+#include "idle.h"
+#include "timer.h"
+#include "paging.h"
+
+// 28-bit LBA PIO commands cannot address anything beyond this sector
+#define ATA_LBA28_LIMIT (1ULL << 28)
+
+// Upper bound on one sleep in blockdev_wait(), in case an interrupt is lost
+#define BLOCKDEV_IDLE_RECHECK_US 10000
+
+// The request whose DMA command currently owns each channel
+static BlockRequest *ata_inflight[2];
+
+// Completes the channel's in-flight DMA request before anything else uses the channel
+static void ata_drain(int controller) {
+    BlockRequest *req = ata_inflight[controller];
+    if (req != 0) {
+        req->status = ata_dma_wait(controller);
+        ata_inflight[controller] = 0;
+    }
+}
+
+static int ata_dev_read(BlockDevice *dev, uint64_t lba, uint32_t count, uint8_t *buffer) {
+    ata_drain(dev->controller);
+    if (lba + count > ATA_LBA28_LIMIT) {
+        return -1;
+    }
+    return ata_read_sectors_disk(dev->controller, dev->drive, (uint32_t)lba, count, buffer);
+}
+
+static int ata_dev_write(BlockDevice *dev, uint64_t lba, uint32_t count, const uint8_t *buffer) {
+    ata_drain(dev->controller);
+    if (lba + count > ATA_LBA28_LIMIT) {
+        return -1;
+    }
+    return ata_write_sectors_disk(dev->controller, dev->drive, (uint32_t)lba, count, buffer);
+}
+
+static int ata_dev_flush(BlockDevice *dev) {
+    ata_drain(dev->controller);
+    return ata_flush_disk(dev->controller, dev->drive);
+}
+
+static int ata_dev_discard(BlockDevice *dev, uint64_t lba, uint64_t count) {
+    ata_drain(dev->controller);
+    return ata_trim_disk(dev->controller, dev->drive, lba, count);
+}
+
+// DMA when the drive and controller allow it, otherwise a synchronous PIO transfer
+static int ata_dev_submit(BlockDevice *dev, BlockRequest *req) {
+    // Buffers DMA cannot reach (e.g. VMM memory) take the PIO path instead
+    if (!ata_dma_rw_supported(dev->controller, dev->drive) || req->count > ATA_DMA_MAX_SECTORS ||
+        !paging_phys_contiguous(req->buffer, (uint64_t)req->count * 512)) {
+        req->status = req->write ? ata_dev_write(dev, req->lba, req->count, req->buffer)
+                                 : ata_dev_read(dev, req->lba, req->count, req->buffer);
+        return 0;
+    }
+
+    ata_drain(dev->controller);
+    if (ata_dma_start_rw(dev->controller, dev->drive, req->lba, req->count, req->buffer, req->write) != 0) {
+        req->status = -1;
+        return -1;
+    }
+    req->status = BLOCKREQ_PENDING;
+    ata_inflight[dev->controller] = req;
+    return 0;
+}
+
+static void ata_dev_poll(BlockDevice *dev, BlockRequest *req) {
+    if (ata_inflight[dev->controller] != req) {
+        return;
+    }
+    int result = ata_dma_poll(dev->controller);
+    if (result != 1) {
+        req->status = result;
+        ata_inflight[dev->controller] = 0;
+    }
+}
+
+static const BlockDeviceOps ata_ops = {
+    .read = ata_dev_read,
+    .write = ata_dev_write,
+    .flush = ata_dev_flush,
+    .submit = ata_dev_submit,
+    .poll = ata_dev_poll,
+};
+
+// Picked for drives that advertise TRIM behind a bus-master capable controller
+static const BlockDeviceOps ata_trim_ops = {
+    .read = ata_dev_read,
+    .write = ata_dev_write,
+    .flush = ata_dev_flush,
+    .discard = ata_dev_discard,
+    .submit = ata_dev_submit,
+    .poll = ata_dev_poll,
+};
+
+void blockdev_init_ata(BlockDevice *dev, int controller, int drive, uint64_t sector_count) {
+    static const char *names[4] = {"hda", "hdb", "hdc", "hdd"};
+    const char *name = names[(controller & 1) * 2 + (drive & 1)];
+
+    for (int i = 0; i < BLOCKDEV_NAME_LEN; i++) {
+        dev->name[i] = name[i];
+        if (name[i] == '\0') {
+            break;
+        }
+    }
+    dev->sector_count = sector_count;
+    dev->ops = ata_trim_supported(controller, drive) ? &ata_trim_ops : &ata_ops;
+    dev->controller = controller;
+    dev->drive = drive;
+    dev->private_data = 0;
+    dev->flags = ata_trim_zeroes(controller, drive) ? BLOCKDEV_DISCARD_ZEROES : 0;
+    if (ata_dma_irq_available(controller)) {
+        dev->flags |= BLOCKDEV_IRQ_COMPLETION;
+    }
+    dev->label_generation++;
+}
+
+int blockdev_read(BlockDevice *dev, uint64_t lba, uint32_t count, uint8_t *buffer) {
+    if (dev->sector_count != 0 && lba + count > dev->sector_count) {
+        print_str("Error: read beyond end of device");
+        print_newline();
+        return -1;
+    }
+    return dev->ops->read(dev, lba, count, buffer);
+}
+
+// Cached partition maps are rebuilt after anything rewrites a table
+static void blockdev_touch_label(BlockDevice *dev, uint64_t lba, uint64_t count) {
+    if (lba < BLOCKDEV_LABEL_SECTORS ||
+        (dev->sector_count != 0 && lba + count > dev->sector_count - BLOCKDEV_LABEL_SECTORS)) {
+        dev->label_generation++;
+    }
+}
+
+// Refuses to modify a read-only device
+static int blockdev_check_writable(BlockDevice *dev) {
+    if (dev->flags & BLOCKDEV_READ_ONLY) {
+        print_str("Error: ");
+        print_str(dev->name);
+        print_str(" is read-only");
+        print_newline();
+        return -1;
+    }
+    return 0;
+}
+
+int blockdev_write(BlockDevice *dev, uint64_t lba, uint32_t count, const uint8_t *buffer) {
+    if (blockdev_check_writable(dev) != 0) {
+        return -1;
+    }
+    if (dev->sector_count != 0 && lba + count > dev->sector_count) {
+        print_str("Error: write beyond end of device");
+        print_newline();
+        return -1;
+    }
+    blockdev_touch_label(dev, lba, count);
+    return dev->ops->write(dev, lba, count, buffer);
+}
+
+int blockdev_flush(BlockDevice *dev) {
+    return dev->ops->flush ? dev->ops->flush(dev) : 0;
+}
+
+int blockdev_can_discard(BlockDevice *dev) {
+    return dev->ops->discard != 0 && !(dev->flags & BLOCKDEV_READ_ONLY);
+}
+
+int blockdev_discard(BlockDevice *dev, uint64_t lba, uint64_t count) {
+    if (dev->ops->discard == 0 || blockdev_check_writable(dev) != 0) {
+        return -1;
+    }
+    if (dev->sector_count != 0 && (lba > dev->sector_count || count > dev->sector_count - lba)) {
+        print_str("Error: discard beyond end of device");
+        print_newline();
+        return -1;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    blockdev_touch_label(dev, lba, count);
+    return dev->ops->discard(dev, lba, count);
+}
+
+int blockdev_submit(BlockDevice *dev, BlockRequest *req) {
+    if (req->write && blockdev_check_writable(dev) != 0) {
+        req->status = -1;
+        return -1;
+    }
+    if (dev->sector_count != 0 && req->lba + req->count > dev->sector_count) {
+        print_str("Error: request beyond end of device");
+        print_newline();
+        req->status = -1;
+        return -1;
+    }
+    if (req->write) {
+        blockdev_touch_label(dev, req->lba, req->count);
+    }
+    if (dev->ops->submit) {
+        return dev->ops->submit(dev, req);
+    }
+    req->status = req->write ? dev->ops->write(dev, req->lba, req->count, req->buffer)
+                             : dev->ops->read(dev, req->lba, req->count, req->buffer);
+    return 0;
+}
+
+int blockdev_poll(BlockDevice *dev, BlockRequest *req) {
+    if (req->status == BLOCKREQ_PENDING && dev->ops->poll) {
+        dev->ops->poll(dev, req);
+    }
+    return req->status == BLOCKREQ_PENDING;
+}
+
+int blockdev_wait(BlockDevice *dev, BlockRequest *req) {
+    while (1) {
+        uint64_t flags = irq_save();
+        if (!blockdev_poll(dev, req)) {
+            irq_restore(flags);
+            return req->status;
+        }
+        if (dev->flags & BLOCKDEV_IRQ_COMPLETION) {
+            idle_wait(flags, timer_tsc() + BLOCKDEV_IDLE_RECHECK_US * timer_tsc_khz() / 1000);
+        } else {
+            irq_restore(flags);
+            asm volatile("pause");
+        }
+    }
+}
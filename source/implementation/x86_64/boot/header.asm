@@ -9,7 +9,24 @@ header_start:
 	; checksum
 	dd 0x100000000 - (0xe85250d6 + 0 + (header_end - header_start))
 
+	; framebuffer tag: optional, 1024x768 with 32 bits per pixel preferred;
+	; fbcon also drives the 24, 16 and 15-bit modes GRUB may pick instead
+	align 8
+	dw 5
+	dw 1
+	dd 20
+	dd 1024
+	dd 768
+	dd 32
+
+	; module alignment tag: load modules on page boundaries
+	align 8
+	dw 6
+	dw 0
+	dd 8
+
 	; end tag
+	align 8
 	dw 0
 	dw 0
 	dd 8
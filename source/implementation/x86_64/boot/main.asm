@@ -1,17 +1,38 @@
 global start
+global multiboot_info
+global boot_tsc_start
+global boot_tsc_longmode
 extern longmode_start
 
-section .data
+; Everything in this file runs before paging, so it is linked at its
+; physical address (see linker.ld); the rest of the kernel lives at -2 GiB
+section .boot.data progbits alloc noexec write align=4
 ; Error messages
 ERR_PREFIX:    db 'etyOS2 Kernel Load Error: ', 0
 MULTIBOOT_ERR: db 'Multiboot check failed', 0
 CPUID_ERR:     db 'CPUID not supported', 0
 LONGMODE_ERR:  db 'Long mode not supported', 0
 
-section .text
+; Physical address of the multiboot2 boot information structure
+multiboot_info: dd 0
+
+; Time-stamp counter when GRUB jumped to start and when long mode was up;
+; handed to kernel_main() as its first boot phase markers
+align 8
+boot_tsc_start:    dq 0
+boot_tsc_longmode: dq 0
+
+section .boot.text progbits alloc exec nowrite align=16
 bits 32
 start:
+    mov esi, eax         ; Multiboot magic, before rdtsc clobbers eax
+    rdtsc
+    mov [boot_tsc_start], eax
+    mov [boot_tsc_start + 4], edx
+    mov eax, esi
+
     mov esp, stack_top
+    mov [multiboot_info], ebx ; Boot information address, before cpuid clobbers ebx
 
     call check_multiboot
     call check_cpuid
@@ -19,6 +40,7 @@ start:
 
     call setup_page_tables
     call enable_paging
+    call enable_sse
 
     lgdt [gdt64.pointer]
     jmp gdt64.code_segment:longmode_start
@@ -71,10 +93,32 @@ setup_page_tables:
     mov eax, page_table_l3
     or eax, 0b11 ; present, writable
     mov [page_table_l4], eax
-    
+
+    ; The last PML4 entry covers the top 512 GiB; entries 510 and 511 of
+    ; its PDPT map physical 0-2 GiB at the kernel's link address,
+    ; 0xFFFFFFFF80000000, reusing the first two identity page directories
+    mov eax, page_table_l3_high
+    or eax, 0b11
+    mov [page_table_l4 + 511 * 8], eax
     mov eax, page_table_l2
+    or eax, 0b11
+    mov [page_table_l3_high + 510 * 8], eax
+    add eax, 4096
+    mov [page_table_l3_high + 511 * 8], eax
+    
+    ; Four page directories identity map the first 4 GiB, so physical
+    ; pointers from the boot loader stay usable; paging_init() adds the
+    ; direct map of all memory
+    mov ecx, 0
+.map_l3:
+    mov eax, ecx
+    shl eax, 12
+    add eax, page_table_l2
     or eax, 0b11 ; present, writable
-    mov [page_table_l3], eax
+    mov [page_table_l3 + ecx * 8], eax
+    inc ecx
+    cmp ecx, 4
+    jne .map_l3
 
     mov ecx, 0 ; counter
 .loop:
@@ -84,7 +128,7 @@ setup_page_tables:
     mov [page_table_l2 + ecx * 8], eax
 
     inc ecx ; increment counter
-    cmp ecx, 512 ; checks if the whole table is mapped
+    cmp ecx, 512 * 4 ; checks if all four tables are mapped
     jne .loop ; if not, continue
 
     ret
@@ -112,6 +156,20 @@ enable_paging:
 
     ret
 
+; SSE/SSE2 are architectural in long mode, but the OS has to opt in
+; before compiler-generated or hand-vectorized code may use XMM registers
+enable_sse:
+    mov eax, cr0
+    and eax, ~(1 << 2)   ; clear EM (no x87 emulation)
+    or eax, 1 << 1       ; set MP
+    mov cr0, eax
+
+    mov eax, cr4
+    or eax, (1 << 9) | (1 << 10) ; OSFXSR, OSXMMEXCPT
+    mov cr4, eax
+
+    ret
+
 error:
     push eax             ; Save error code
     call display_error
@@ -170,19 +228,22 @@ print_string:
     pop eax
     ret
 
-section .bss
+section .boot.bss nobits alloc noexec write align=4096
 align 4096
 page_table_l4:
     resb 4096
 page_table_l3:
     resb 4096
-page_table_l2:
+page_table_l3_high:
     resb 4096
-stack_bottom:
+page_table_l2:
     resb 4096 * 4
+; Only used until longmode_start switches to the kernel stack
+stack_bottom:
+    resb 4096
 stack_top:
 
-section .rodata
+section .boot.rodata progbits alloc noexec nowrite align=8
 gdt64:
     dq 0 ; zero entry
 .code_segment: equ $ - gdt64
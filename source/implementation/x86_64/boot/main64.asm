@@ -1,7 +1,11 @@
 global longmode_start
 extern kernel_main
+extern multiboot_info
+extern boot_tsc_start
+extern boot_tsc_longmode
 
-section .text
+; Still running at the physical address the 32-bit code jumped to
+section .boot.text progbits alloc exec nowrite align=16
 bits 64
 
 longmode_start:
@@ -12,9 +16,34 @@ longmode_start:
     mov fs, ax
     mov gs, ax
     mov ss, ax
-   
-    ; Call kernel_main (64-bit C kernel function)
+
+    rdtsc
+    shl rdx, 32
+    or rax, rdx
+    mov [boot_tsc_longmode], rax
+
+    ; Continue at the kernel's link address in the higher half
+    mov rax, higher_half_start
+    jmp rax
+
+section .text
+bits 64
+
+higher_half_start:
+    mov rsp, kernel_stack_top
+
+    ; Call kernel_main (64-bit C kernel function) with the boot information
+    ; address and the time-stamp counter readings taken on the way here
+    mov edi, [multiboot_info]
+    mov rsi, [boot_tsc_start]
+    mov rdx, [boot_tsc_longmode]
     call kernel_main
 
     ; Halt the CPU after kernel_main returns (shouldn't happen normally)
     hlt
+
+section .bss
+align 16
+kernel_stack:
+    resb 4096 * 4
+kernel_stack_top:
@@ -0,0 +1,30 @@
+// boottime.c - Boot phase markers
+#include "boottime.h"
+#include "timer.h"
+
+static BootMark marks[BOOT_MAX_MARKS];
+static int mark_count = 0;
+
+void boot_mark(const char *phase) {
+    boot_mark_at(phase, timer_tsc());
+}
+
+void boot_mark_at(const char *phase, uint64_t tsc) {
+    if (mark_count == BOOT_MAX_MARKS) {
+        return;
+    }
+    marks[mark_count].phase = phase;
+    marks[mark_count].tsc = tsc;
+    mark_count++;
+}
+
+int boot_mark_count(void) {
+    return mark_count;
+}
+
+const BootMark *boot_mark_get(int index) {
+    if (index < 0 || index >= mark_count) {
+        return 0;
+    }
+    return &marks[index];
+}
@@ -0,0 +1,77 @@
+// crc32.c
+#include "crc32.h"
+
+#define CRC32_BE_POLY 0x04C11DB7
+#define CRC32_LE_POLY 0xEDB88320
+
+static uint32_t crc32_be_table[256];
+static int crc32_be_ready = 0;
+static uint32_t crc32_le_table[256];
+static int crc32_le_ready = 0;
+
+static void crc32_be_init_table(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i << 24;
+        for (int bit = 0; bit < 8; bit++) {
+            c = (c & 0x80000000) ? (c << 1) ^ CRC32_BE_POLY : (c << 1);
+        }
+        crc32_be_table[i] = c;
+    }
+    crc32_be_ready = 1;
+}
+
+/**
+ * crc32_be - Table-driven MSB-first CRC32.
+ *
+ * @param crc: Running CRC value (seed with ~0 for jbd2).
+ * @param data: Bytes to checksum.
+ * @param length: Number of bytes.
+ *
+ * @return: The updated CRC.
+ */
+uint32_t crc32_be(uint32_t crc, const void* data, size_t length) {
+    const uint8_t* p = (const uint8_t*)data;
+
+    if (!crc32_be_ready) {
+        crc32_be_init_table();
+    }
+
+    while (length-- > 0) {
+        crc = (crc << 8) ^ crc32_be_table[((crc >> 24) ^ *p++) & 0xFF];
+    }
+    return crc;
+}
+
+static void crc32_le_init_table(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int bit = 0; bit < 8; bit++) {
+            c = (c & 1) ? (c >> 1) ^ CRC32_LE_POLY : (c >> 1);
+        }
+        crc32_le_table[i] = c;
+    }
+    crc32_le_ready = 1;
+}
+
+/**
+ * crc32_le - Table-driven LSB-first CRC32.
+ *
+ * @param crc: 0 for a new checksum, or a previous result to continue it.
+ * @param data: Bytes to checksum.
+ * @param length: Number of bytes.
+ *
+ * @return: The updated CRC.
+ */
+uint32_t crc32_le(uint32_t crc, const void* data, size_t length) {
+    const uint8_t* p = (const uint8_t*)data;
+
+    if (!crc32_le_ready) {
+        crc32_le_init_table();
+    }
+
+    crc = ~crc;
+    while (length-- > 0) {
+        crc = (crc >> 8) ^ crc32_le_table[(crc ^ *p++) & 0xFF];
+    }
+    return ~crc;
+}
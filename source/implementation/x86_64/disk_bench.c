@@ -0,0 +1,339 @@
+// disk_bench.c
+#include "disk_bench.h"
+#include "histogram.h"
+#include "memory.h"
+#include "memory_allocator.h"
+#include "print.h"
+#include "serial.h"
+#include "string.h"
+#include "timer.h"
+
+#define BENCH_SECTOR_SIZE 512
+
+typedef struct {
+    uint64_t lba;
+    uint8_t *buffer;
+} BenchRequest;
+
+static const char *pattern_names[] = {"read", "write", "randread", "randwrite"};
+
+static uint64_t bench_rng_state;
+
+static uint64_t bench_random(void) {
+    bench_rng_state ^= bench_rng_state << 13;
+    bench_rng_state ^= bench_rng_state >> 7;
+    bench_rng_state ^= bench_rng_state << 17;
+    return bench_rng_state;
+}
+
+void disk_bench_defaults(DiskBenchConfig *config) {
+    config->pattern = BENCH_RANDREAD;
+    config->block_size = 4096;
+    config->queue_depth = 1;
+    config->offset_lba = 0;
+    config->region_sectors = 0;
+    config->runtime_ms = 5000;
+}
+
+// Parses a number with an optional k/m/g suffix (powers of 1024)
+static int parse_size(const char *str, uint64_t *value) {
+    char *end;
+    uint64_t result = strtoul(str, &end, 10);
+    if (end == str) {
+        return -1;
+    }
+    if (*end == 'k' || *end == 'K') {
+        result <<= 10;
+        end++;
+    } else if (*end == 'm' || *end == 'M') {
+        result <<= 20;
+        end++;
+    } else if (*end == 'g' || *end == 'G') {
+        result <<= 30;
+        end++;
+    }
+    if (*end != '\0') {
+        return -1;
+    }
+    *value = result;
+    return 0;
+}
+
+static int option_is(const char *option, const char *key, const char **value) {
+    while (*key) {
+        if (*option++ != *key++) {
+            return 0;
+        }
+    }
+    if (*option != '=') {
+        return 0;
+    }
+    *value = option + 1;
+    return 1;
+}
+
+int disk_bench_parse(char *args, DiskBenchConfig *config, int *force) {
+    *force = 0;
+    while (*args != '\0') {
+        while (*args == ' ') {
+            args++;
+        }
+        if (*args == '\0') {
+            break;
+        }
+        char *end = strchr(args, ' ');
+        if (end) {
+            *end = '\0';
+        }
+
+        const char *value;
+        uint64_t number;
+        int ok = 1;
+        if (strcmp(args, "force") == 0) {
+            *force = 1;
+        } else if (strcmp(args, "read") == 0) {
+            config->pattern = BENCH_READ;
+        } else if (strcmp(args, "write") == 0) {
+            config->pattern = BENCH_WRITE;
+        } else if (strcmp(args, "randread") == 0) {
+            config->pattern = BENCH_RANDREAD;
+        } else if (strcmp(args, "randwrite") == 0) {
+            config->pattern = BENCH_RANDWRITE;
+        } else if (option_is(args, "bs", &value)) {
+            ok = parse_size(value, &number) == 0 && number >= BENCH_SECTOR_SIZE &&
+                 number <= DISK_BENCH_MAX_BLOCK_SIZE && number % BENCH_SECTOR_SIZE == 0;
+            config->block_size = (uint32_t)number;
+        } else if (option_is(args, "qd", &value)) {
+            ok = parse_size(value, &number) == 0 && number >= 1 && number <= DISK_BENCH_MAX_QUEUE_DEPTH;
+            config->queue_depth = (uint32_t)number;
+        } else if (option_is(args, "offset", &value)) {
+            ok = parse_size(value, &number) == 0;
+            config->offset_lba = number / BENCH_SECTOR_SIZE;
+        } else if (option_is(args, "size", &value)) {
+            ok = parse_size(value, &number) == 0;
+            config->region_sectors = number / BENCH_SECTOR_SIZE;
+        } else if (option_is(args, "runtime", &value)) {
+            ok = parse_size(value, &number) == 0 && number >= 1;
+            config->runtime_ms = (uint32_t)(number * 1000);
+        } else {
+            ok = 0;
+        }
+
+        if (!ok) {
+            print_str("bench: bad option: ");
+            print_str(args);
+            print_newline();
+            return -1;
+        }
+        if (!end) {
+            break;
+        }
+        args = end + 1;
+    }
+    return 0;
+}
+
+// Insertion sort by LBA; batches are at most DISK_BENCH_MAX_QUEUE_DEPTH long
+static void sort_requests(BenchRequest *requests, uint32_t count) {
+    for (uint32_t i = 1; i < count; i++) {
+        BenchRequest request = requests[i];
+        uint32_t j = i;
+        while (j > 0 && requests[j - 1].lba > request.lba) {
+            requests[j] = requests[j - 1];
+            j--;
+        }
+        requests[j] = request;
+    }
+}
+
+static void print_latency(char *label, uint64_t ns) {
+    print_str(label);
+    if (ns >= 10000000) {
+        print_int(ns / 1000000);
+        print_str(" ms");
+    } else {
+        print_int(ns / 1000);
+        print_str(" us");
+    }
+}
+
+static void serial_key(const char *key, uint64_t value) {
+    serial_write_char(' ');
+    serial_write_str(key);
+    serial_write_char('=');
+    serial_write_dec(value);
+}
+
+/**
+ * disk_bench_run - fio-style load generator.
+ *
+ * The ATA backend is synchronous, so queue depth is modelled the way a
+ * block layer elevator would see it: `queue_depth` requests are generated,
+ * sorted by LBA, adjacent ones are merged into a single transfer, and each
+ * request's latency runs from batch submission to the completion of the
+ * transfer that carried it. With qd=1 this is plain per-I/O latency.
+ */
+int disk_bench_run(BlockDevice *dev, const DiskBenchConfig *config) {
+    uint32_t bs_sectors = config->block_size / BENCH_SECTOR_SIZE;
+    uint32_t qd = config->queue_depth;
+    int is_write = (config->pattern == BENCH_WRITE || config->pattern == BENCH_RANDWRITE);
+    int is_random = (config->pattern == BENCH_RANDREAD || config->pattern == BENCH_RANDWRITE);
+
+    if (config->offset_lba >= dev->sector_count) {
+        print_str("bench: offset beyond end of device");
+        print_newline();
+        return -1;
+    }
+    uint64_t region = config->region_sectors;
+    if (region == 0 || region > dev->sector_count - config->offset_lba) {
+        region = dev->sector_count - config->offset_lba;
+    }
+    uint64_t slots = region / bs_sectors;
+    if (slots == 0) {
+        print_str("bench: region smaller than the block size");
+        print_newline();
+        return -1;
+    }
+
+    uint8_t *buffers = (uint8_t *)allocate((size_t)config->block_size * qd);
+    Histogram *latency = (Histogram *)allocate(sizeof(Histogram));
+    if (buffers == NULL || latency == NULL) {
+        print_str("bench: out of memory");
+        print_newline();
+        free(buffers);
+        free(latency);
+        return -1;
+    }
+    for (uint32_t i = 0; i < config->block_size * qd; i++) {
+        buffers[i] = (uint8_t)(i * 31 + 7); // Non-zero so no layer can treat it as a hole
+    }
+    histogram_reset(latency);
+
+    BenchRequest requests[DISK_BENCH_MAX_QUEUE_DEPTH];
+    uint64_t next_slot = 0;
+    uint64_t ios = 0;
+    uint64_t transfers = 0;
+    int failed = 0;
+    bench_rng_state = timer_tsc() | 1;
+
+    uint64_t deadline_ticks = (uint64_t)config->runtime_ms * timer_tsc_khz();
+    uint64_t start = timer_tsc();
+    while (!failed && timer_tsc() - start < deadline_ticks) {
+        for (uint32_t i = 0; i < qd; i++) {
+            uint64_t slot;
+            if (is_random) {
+                slot = bench_random() % slots;
+            } else {
+                slot = next_slot;
+                next_slot = (next_slot + 1) % slots;
+            }
+            requests[i].lba = config->offset_lba + slot * bs_sectors;
+        }
+        sort_requests(requests, qd);
+        for (uint32_t i = 0; i < qd; i++) {
+            requests[i].buffer = buffers + (size_t)i * config->block_size;
+        }
+
+        uint64_t submitted = timer_tsc();
+        uint32_t i = 0;
+        while (i < qd) {
+            // Merge requests that continue the previous one on disk and in memory
+            uint32_t run = 1;
+            while (i + run < qd && requests[i + run].lba == requests[i].lba + (uint64_t)run * bs_sectors) {
+                run++;
+            }
+            int result = is_write
+                ? blockdev_write(dev, requests[i].lba, run * bs_sectors, requests[i].buffer)
+                : blockdev_read(dev, requests[i].lba, run * bs_sectors, requests[i].buffer);
+            if (result != 0) {
+                failed = 1;
+                break;
+            }
+            uint64_t latency_ns = timer_tsc_to_ns(timer_tsc() - submitted);
+            for (uint32_t k = 0; k < run; k++) {
+                histogram_record(latency, latency_ns);
+            }
+            ios += run;
+            transfers++;
+            i += run;
+        }
+    }
+    if (is_write) {
+        blockdev_flush(dev);
+    }
+    uint64_t elapsed_us = timer_elapsed_us(start);
+    if (elapsed_us == 0) {
+        elapsed_us = 1;
+    }
+
+    uint64_t iops = ios * 1000000 / elapsed_us;
+    uint64_t kb_per_s = ios * config->block_size / 1024 * 1000000 / elapsed_us;
+
+    if (failed) {
+        print_newline();
+        print_str("bench: I/O error, partial results follow");
+        print_newline();
+    }
+    print_str(dev->name);
+    print_str(": ");
+    print_str((char *)pattern_names[config->pattern]);
+    print_str(" bs=");
+    print_int(config->block_size);
+    print_str(" qd=");
+    print_int(qd);
+    print_str(" region=");
+    print_int(region / 2048);
+    print_str(" MB");
+    print_newline();
+    print_str("  ios=");
+    print_int(ios);
+    print_str(" transfers=");
+    print_int(transfers);
+    print_str(" runtime=");
+    print_int(elapsed_us / 1000);
+    print_str(" ms");
+    print_newline();
+    print_str("  IOPS=");
+    print_int(iops);
+    print_str("  BW=");
+    print_int(kb_per_s / 1024);
+    print_str(".");
+    print_int((kb_per_s % 1024) * 10 / 1024);
+    print_str(" MB/s");
+    print_newline();
+    print_latency("  lat min=", ios ? latency->min : 0);
+    print_latency(" avg=", histogram_mean(latency));
+    print_latency(" max=", latency->max);
+    print_newline();
+    print_latency("  p50=", histogram_percentile(latency, 500));
+    print_latency(" p90=", histogram_percentile(latency, 900));
+    print_latency(" p99=", histogram_percentile(latency, 990));
+    print_latency(" p99.9=", histogram_percentile(latency, 999));
+    print_newline();
+
+    // One line per run for CI: "bench key=value ..."
+    serial_write_str("bench dev=");
+    serial_write_str(dev->name);
+    serial_write_str(" rw=");
+    serial_write_str(pattern_names[config->pattern]);
+    serial_key("bs", config->block_size);
+    serial_key("qd", qd);
+    serial_key("region_bytes", region * BENCH_SECTOR_SIZE);
+    serial_key("runtime_us", elapsed_us);
+    serial_key("ios", ios);
+    serial_key("iops", iops);
+    serial_key("bw_kbps", kb_per_s);
+    serial_key("lat_min_ns", ios ? latency->min : 0);
+    serial_key("lat_mean_ns", histogram_mean(latency));
+    serial_key("lat_p50_ns", histogram_percentile(latency, 500));
+    serial_key("lat_p90_ns", histogram_percentile(latency, 900));
+    serial_key("lat_p99_ns", histogram_percentile(latency, 990));
+    serial_key("lat_p999_ns", histogram_percentile(latency, 999));
+    serial_key("lat_max_ns", latency->max);
+    serial_key("errors", failed);
+    serial_write_char('\n');
+
+    free(buffers);
+    free(latency);
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,240 @@
+// disk_clone.c
+#include "disk_clone.h"
+#include "memory.h"
+#include "memory_allocator.h"
+#include "print.h"
+#include "timer.h"
+
+#define CLONE_SECTOR_SIZE 512
+#define CLONE_PROGRESS_STEPS 10
+
+typedef enum {
+    ZERO_WRITE,                // Zero segments are copied like any other data
+    ZERO_DISCARD,              // ...discarded on the target
+    ZERO_SKIP                  // ...left alone (target already zeroed)
+} ZeroPolicy;
+
+typedef struct {
+    BlockDevice *dst;
+    BlockRequest write;
+    int write_pending;
+    uint64_t discard_lba;      // Zero runs are merged before being discarded
+    uint64_t discard_count;
+    uint64_t written;
+    uint64_t zeroed;
+    int failed;
+} CloneState;
+
+static void clone_wait_write(CloneState *state) {
+    if (state->write_pending) {
+        if (blockdev_wait(state->dst, &state->write) != 0) {
+            state->failed = 1;
+        }
+        state->write_pending = 0;
+    }
+}
+
+static void clone_flush_discard(CloneState *state) {
+    if (state->discard_count != 0) {
+        if (blockdev_discard(state->dst, state->discard_lba, state->discard_count) != 0) {
+            state->failed = 1;
+        }
+        state->discard_count = 0;
+    }
+}
+
+static void clone_write(CloneState *state, uint64_t lba, uint32_t count, uint8_t *data) {
+    clone_wait_write(state);
+    state->write.write = 1;
+    state->write.lba = lba;
+    state->write.count = count;
+    state->write.buffer = data;
+    if (blockdev_submit(state->dst, &state->write) != 0) {
+        state->failed = 1;
+        return;
+    }
+    state->write_pending = 1;
+    state->written += count;
+}
+
+// Writes out one chunk as runs of data and zero segments
+static void clone_emit_chunk(CloneState *state, ZeroPolicy policy, uint64_t lba, uint32_t count, uint8_t *data) {
+    uint32_t offset = 0;
+    while (offset < count && !state->failed) {
+        uint32_t run = 0;
+        int zero = -1;
+        while (offset + run < count) {
+            uint32_t segment = count - offset - run;
+            if (segment > CLONE_SEGMENT_SECTORS) {
+                segment = CLONE_SEGMENT_SECTORS;
+            }
+            int segment_zero = (policy != ZERO_WRITE) &&
+                memory_is_zero(data + (offset + run) * CLONE_SECTOR_SIZE, segment * CLONE_SECTOR_SIZE);
+            if (zero != -1 && segment_zero != zero) {
+                break;
+            }
+            zero = segment_zero;
+            run += segment;
+        }
+
+        if (!zero) {
+            clone_write(state, lba + offset, run, data + offset * CLONE_SECTOR_SIZE);
+        } else {
+            state->zeroed += run;
+            if (policy == ZERO_DISCARD) {
+                if (state->discard_count != 0 && state->discard_lba + state->discard_count != lba + offset) {
+                    clone_flush_discard(state);
+                }
+                if (state->discard_count == 0) {
+                    state->discard_lba = lba + offset;
+                }
+                state->discard_count += run;
+            }
+        }
+        offset += run;
+    }
+}
+
+static void print_rate(uint64_t sectors, uint64_t elapsed_us) {
+    uint64_t kb_per_s = elapsed_us ? sectors / 2 * 1000000 / elapsed_us : 0;
+    print_int(kb_per_s / 1024);
+    print_str(" MB/s");
+}
+
+int disk_clone(BlockDevice *src, BlockDevice *dst, int flags) {
+    if (src == dst) {
+        print_str("Source and target are the same device");
+        print_newline();
+        return -1;
+    }
+    if (dst->sector_count < src->sector_count) {
+        print_str("Target is smaller than the source");
+        print_newline();
+        return -1;
+    }
+
+    ZeroPolicy policy = ZERO_WRITE;
+    if (flags & CLONE_SPARSE) {
+        policy = ZERO_SKIP;
+    } else if (blockdev_can_discard(dst) && (dst->flags & BLOCKDEV_DISCARD_ZEROES)) {
+        policy = ZERO_DISCARD;
+    }
+
+    uint8_t *buffers[2];
+    buffers[0] = (uint8_t *)allocate(CLONE_CHUNK_SECTORS * CLONE_SECTOR_SIZE);
+    buffers[1] = (uint8_t *)allocate(CLONE_CHUNK_SECTORS * CLONE_SECTOR_SIZE);
+    if (buffers[0] == NULL || buffers[1] == NULL) {
+        print_str("Error: out of memory");
+        print_newline();
+        free(buffers[0]);
+        free(buffers[1]);
+        return -1;
+    }
+
+    CloneState state;
+    memory_zero(&state, sizeof(state));
+    state.dst = dst;
+
+    BlockRequest reads[2];
+    memory_zero(reads, sizeof(reads));
+    uint64_t total = src->sector_count;
+    uint64_t chunks = (total + CLONE_CHUNK_SECTORS - 1) / CLONE_CHUNK_SECTORS;
+    uint64_t next_report = 1;
+    uint64_t start = timer_tsc();
+
+    print_str("Cloning ");
+    print_str(src->name);
+    print_str(" -> ");
+    print_str(dst->name);
+    print_str(" (");
+    print_int(total / 2048);
+    print_str(" MB)");
+    print_newline();
+
+    for (uint64_t i = 0; i < chunks && !state.failed; i++) {
+        uint64_t lba = i * CLONE_CHUNK_SECTORS;
+        uint32_t count = (total - lba > CLONE_CHUNK_SECTORS) ? CLONE_CHUNK_SECTORS : (uint32_t)(total - lba);
+        BlockRequest *read = &reads[i & 1];
+
+        if (i == 0) {
+            read->write = 0;
+            read->lba = lba;
+            read->count = count;
+            read->buffer = buffers[0];
+            if (blockdev_submit(src, read) != 0) {
+                state.failed = 1;
+                break;
+            }
+        }
+        if (blockdev_wait(src, read) != 0) {
+            state.failed = 1;
+            break;
+        }
+
+        // The other buffer is free once its last write is done; refill it right away
+        if (i + 1 < chunks) {
+            uint64_t next_lba = lba + CLONE_CHUNK_SECTORS;
+            BlockRequest *next = &reads[(i + 1) & 1];
+            clone_wait_write(&state);
+            next->write = 0;
+            next->lba = next_lba;
+            next->count = (total - next_lba > CLONE_CHUNK_SECTORS) ? CLONE_CHUNK_SECTORS : (uint32_t)(total - next_lba);
+            next->buffer = buffers[(i + 1) & 1];
+            if (blockdev_submit(src, next) != 0) {
+                state.failed = 1;
+                break;
+            }
+        }
+
+        clone_emit_chunk(&state, policy, lba, count, buffers[i & 1]);
+
+        if ((i + 1) * CLONE_PROGRESS_STEPS >= next_report * chunks && i + 1 < chunks) {
+            uint64_t done = lba + count;
+            print_str("  ");
+            print_int(done * 100 / total);
+            print_str("%  ");
+            print_int(done / 2048);
+            print_str(" MB  ");
+            print_rate(done, timer_elapsed_us(start));
+            print_newline();
+            while ((i + 1) * CLONE_PROGRESS_STEPS >= next_report * chunks) {
+                next_report++;
+            }
+        }
+    }
+
+    // Let any read still in flight land before its buffer is freed
+    blockdev_wait(src, &reads[0]);
+    blockdev_wait(src, &reads[1]);
+    clone_wait_write(&state);
+    clone_flush_discard(&state);
+    if (!state.failed && blockdev_flush(dst) != 0) {
+        state.failed = 1;
+    }
+    uint64_t elapsed_us = timer_elapsed_us(start);
+
+    free(buffers[0]);
+    free(buffers[1]);
+
+    if (state.failed) {
+        print_newline();
+        print_str("Clone failed");
+        print_newline();
+        return -1;
+    }
+
+    print_str("Cloned ");
+    print_int(total / 2048);
+    print_str(" MB in ");
+    print_int(elapsed_us / 1000);
+    print_str(" ms (");
+    print_rate(total, elapsed_us);
+    print_str("), ");
+    print_int(state.written / 2048);
+    print_str(" MB written, ");
+    print_int(state.zeroed / 2048);
+    print_str(policy == ZERO_DISCARD ? " MB zero (discarded)" :
+              policy == ZERO_SKIP ? " MB zero (skipped)" : " MB zero");
+    print_newline();
+    return 0;
+}
@@ -3,65 +3,147 @@
 #include "print.h"
 #include "disktool.h"
 #include "port.h"
-
-#define MAX_DISKS 4
+#include "journal.h"
+#include "timer.h"
+#include "memory_allocator.h"
+#include "disk_bench.h"
+#include "disk_clone.h"
+#include "ramdisk.h"
+#include "klog.h"
+#include "kprintf.h"
+
+#define MAX_DISKS (ATA_MAX_DEVICES + RAMDISK_MAX)
 #define MB_TO_SECTORS(mb) ((mb * 1024 * 1024) / SECTOR_SIZE)
 #define ATA_PRIMARY_IO_BASE 0x1F0
 #define ATA_SECONDARY_IO_BASE 0x170
-#define ATA_CMD_IDENTIFY 0xEC
 #define ATA_CMD_READ_SECTORS 0x20
 #define ATA_CMD_WRITE_SECTORS 0x30
 
+// Metadata blocks rewritten by the journal benchmark (group descriptor
+// area); one transaction's worth, so no block repeats within a batch
+#define JBENCH_FIRST_BLOCK 1
+#define JBENCH_HOT_BLOCKS JOURNAL_MAX_TX_BLOCKS
+
 static DiskInfo available_disks[MAX_DISKS];
+static BlockDevice ata_block_devices[ATA_MAX_DEVICES]; // Indexed by controller * 2 + drive
+static PartitionMap partition_maps[MAX_DISKS];
 static int current_disk = -1;
 static int num_disks = 0;
 
+// Copies a RAM disk into the disk list, named after its block device
+static void add_ramdisk_entry(BlockDevice *dev)
+{
+    DiskInfo *disk = &available_disks[num_disks];
+    const char *prefix = "RAM disk ";
+    int j = 0;
+
+    disk->controller = -1;
+    disk->drive = -1;
+    for (int k = 0; prefix[k] != '\0'; ++k)
+    {
+        disk->model[j++] = prefix[k];
+    }
+    for (int k = 0; dev->name[k] != '\0' && j < (int)sizeof(disk->model) - 1; ++k)
+    {
+        disk->model[j++] = dev->name[k];
+    }
+    disk->model[j] = '\0';
+    disk->size_mb = dev->sector_count / (1024 * 1024 / SECTOR_SIZE);
+    disk->device = dev;
+    partition_map_load(dev, &partition_maps[num_disks]);
+    num_disks++;
+}
+
 // Initialize the disk tool and scan for available disks
 void init_disktool()
 {
     num_disks = 0;
     print_str("Analyzing disks...");
     print_newline();
-    uint16_t identify_buffer[256];
 
-    for (int controller = 0; controller < 2; ++controller)
+    ata_probe_devices();
+    for (int i = 0; i < ATA_MAX_DEVICES && num_disks < MAX_DISKS; ++i)
     {
-        uint16_t io_base = (controller == 0) ? ATA_PRIMARY_IO_BASE : ATA_SECONDARY_IO_BASE;
-
-        for (int drive = 0; drive < 2; ++drive)
+        const AtaDevice *device = ata_get_device(i);
+        if (device->type != ATA_DEVICE_ATA)
+            continue;
+
+        DiskInfo *disk = &available_disks[num_disks];
+        disk->controller = device->controller;
+        disk->drive = device->drive;
+        for (int j = 0; j < (int)sizeof(disk->model); ++j)
         {
-            outb(io_base + 6, 0xA0 | (drive << 4));
-            outb(io_base + 7, ATA_CMD_IDENTIFY);
-
-            uint8_t status = inb(io_base + 7);
-            if (status == 0)
-                continue;
+            disk->model[j] = device->model[j];
+        }
+        disk->size_mb = device->sector_count / (1024 * 1024 / SECTOR_SIZE);
+        disk->device = &ata_block_devices[i];
+        blockdev_init_ata(disk->device, device->controller, device->drive, device->sector_count);
 
-            while ((inb(io_base + 7) & 0x80) != 0)
-                ;
+        // Parsed once here; later lookups reuse it until the table is rewritten
+        partition_map_load(disk->device, &partition_maps[num_disks]);
 
-            for (int i = 0; i < 256; ++i)
-            {
-                identify_buffer[i] = inw(io_base);
-            }
+        num_disks++;
+    }
 
-            DiskInfo *disk = &available_disks[num_disks];
-            disk->controller = controller;
-            disk->drive = drive;
+    // RAM disks live on across rescans and are listed after the ATA disks
+    for (int i = 0; i < ramdisk_count() && num_disks < MAX_DISKS; ++i)
+    {
+        add_ramdisk_entry(ramdisk_get(i));
+    }
 
-            read_string_from_identify(identify_buffer, 27, 46, disk->model);
+    klogf(KLOG_INFO, "disktool: %d disks found", num_disks);
+    kprintf("Found %d disks in %lu ms\n\n", num_disks, (uint64_t)ata_probe_time_us() / 1000);
+}
 
-            uint32_t total_sectors = identify_buffer[60] | (identify_buffer[61] << 16);
-            disk->size_mb = (total_sectors * SECTOR_SIZE) / (1024 * 1024);
+// Creates a zeroed RAM disk and adds it to the disk list
+int create_ramdisk(uint32_t size_mb)
+{
+    if (num_disks == MAX_DISKS)
+    {
+        print_str("Disk list is full");
+        print_newline();
+        return -1;
+    }
 
-            num_disks++;
-        }
+    BlockDevice *dev = ramdisk_create(MB_TO_SECTORS((uint64_t)size_mb));
+    if (dev == NULL)
+    {
+        return -1;
     }
-    print_str("Found ");
-    print_dec(num_disks);
-    print_str(" disks");
-    print_newline();
+    add_ramdisk_entry(dev);
+    print_str("Created ");
+    print_str(dev->name);
+    print_str(" as disk ");
+    print_int(num_disks - 1);
     print_newline();
+    return 0;
+}
+
+// Adds a copy-on-write snapshot of a RAM disk to the disk list
+int snapshot_ramdisk(int disk_index)
+{
+    if (disk_index < 0 || disk_index >= num_disks)
+    {
+        print_str("Invalid disk index");
+        print_newline();
+        return -1;
+    }
+    if (num_disks == MAX_DISKS)
+    {
+        print_str("Disk list is full");
+        print_newline();
+        return -1;
+    }
+
+    BlockDevice *dev = ramdisk_snapshot(available_disks[disk_index].device);
+    if (dev == NULL)
+    {
+        return -1;
+    }
+    add_ramdisk_entry(dev);
+    kprintf("Created %s as disk %d, sharing memory with disk %d until either is written\n", dev->name,
+            num_disks - 1, disk_index);
+    return 0;
 }
 
 // List all available disks
@@ -72,14 +154,8 @@ void list_disks()
 
     for (int i = 0; i < num_disks; i++)
     {
-        print_str("[");
-        print_int(i);
-        print_str("] ");
-        print_str(available_disks[i].model);
-        print_str(" (");
-        print_int(available_disks[i].size_mb);
-        print_str(" MB)");
-        print_newline();
+        kprintf("[%d] %s (%lu MB%s)\n", i, available_disks[i].model, available_disks[i].size_mb,
+                (available_disks[i].device->flags & BLOCKDEV_READ_ONLY) ? ", read-only" : "");
     }
 }
 
@@ -118,28 +194,59 @@ int create_partition_mb(uint32_t size_mb, FileSystemType fs_type)
     }
 
     uint32_t sector_count = MB_TO_SECTORS(size_mb);
+    BlockDevice *dev = available_disks[current_disk].device;
+    PartitionMap *map = disktool_get_partition_map(current_disk);
+    uint64_t start_lba;
+    if (map == NULL || partition_map_find_free(map, sector_count, &start_lba) != 0)
+    {
+        print_str("Not enough free space for the partition");
+        print_newline();
+        return -1;
+    }
 
     // Use the appropriate create_partition function based on filesystem type
+    int result = -1;
     if (fs_type == FS_FAT32)
     {
         print_str("FAT32 PARTITION IS NOT RECOMMENDED");
         print_newline();
-        create_fat32_partition(available_disks[current_disk].controller,
-                               available_disks[current_disk].drive,
-                               2048, sector_count);
+        result = create_fat32_partition(dev, map, start_lba, sector_count);
     }
     else if (fs_type == FS_EXT4)
     {
-        create_ext4_partition(available_disks[current_disk].controller,
-                              available_disks[current_disk].drive,
-                              2048, sector_count);
+        result = create_ext4_partition(dev, map, start_lba, sector_count);
     }
-    init_disktool();
-    return 0;
+    return result;
 }
 
-// Format the entire selected disk as a single FAT32 partition
-int format_disk(FileSystemType fs_type)
+// Trims a range before new metadata is laid down; devices without discard are left as they are
+static void discard_range(BlockDevice *dev, uint64_t start_lba, uint64_t sector_count)
+{
+    if (!blockdev_can_discard(dev))
+    {
+        print_str("Device does not support discard, skipping");
+        print_newline();
+        return;
+    }
+
+    uint64_t start = timer_tsc();
+    if (blockdev_discard(dev, start_lba, sector_count) != 0)
+    {
+        print_newline();
+        print_str("Discard failed, formatting anyway");
+        print_newline();
+        return;
+    }
+    print_str("Discarded ");
+    print_int(sector_count / 2048);
+    print_str(" MB in ");
+    print_int(timer_elapsed_us(start) / 1000);
+    print_str(" ms");
+    print_newline();
+}
+
+// Format the entire selected disk as a single partition, optionally trimming it first
+int format_disk(FileSystemType fs_type, int discard)
 {
     if (current_disk == -1)
     {
@@ -148,7 +255,7 @@ int format_disk(FileSystemType fs_type)
         return -1;
     }
 
-    uint32_t total_size_mb = available_disks[current_disk].size_mb;
+    uint64_t total_size_mb = available_disks[current_disk].size_mb;
 
     if (total_size_mb < 32)
     {
@@ -157,23 +264,48 @@ int format_disk(FileSystemType fs_type)
         return -1;
     }
 
-    uint32_t start_lba = 2048; // Standard starting sector for alignment
-    uint32_t sector_count = MB_TO_SECTORS(total_size_mb) - start_lba;
+    BlockDevice *dev = available_disks[current_disk].device;
+    PartitionMap *map = disktool_get_partition_map(current_disk);
+    if (map == NULL)
+    {
+        return -1;
+    }
+    if (map->count != 0)
+    {
+        print_str("Remove all partitions before formatting the disk");
+        print_newline();
+        return -1;
+    }
+
+    // One partition from the first aligned sector to the end of the usable area
+    uint64_t start_lba;
+    if (partition_map_find_free(map, 1, &start_lba) != 0)
+    {
+        print_str("Disk too small");
+        print_newline();
+        return -1;
+    }
+    uint64_t sector_count = map->last_usable + 1 - start_lba;
+    if (partition_check_format_range(start_lba, sector_count) != 0)
+    {
+        return -1;
+    }
+
+    if (discard)
+    {
+        discard_range(dev, start_lba, sector_count);
+    }
 
     // Create the partition and format it
     if (fs_type == FS_FAT32)
     {
         print_str("FAT32 PARTITIONS IS NOT RECOMMENDED");
         print_newline();
-        create_fat32_partition(available_disks[current_disk].controller,
-                               available_disks[current_disk].drive,
-                               2048, sector_count);
+        return create_fat32_partition(dev, map, start_lba, sector_count);
     }
     else if (fs_type == FS_EXT4)
     {
-        create_ext4_partition(available_disks[current_disk].controller,
-                              available_disks[current_disk].drive,
-                              2048, sector_count);
+        return create_ext4_partition(dev, map, start_lba, sector_count);
     }
 
     return 0;
@@ -189,18 +321,17 @@ void display_partition_info()
         return;
     }
 
-    print_str("Disk: ");
-    print_str(available_disks[current_disk].model);
-    print_str(" (");
-    print_int(available_disks[current_disk].size_mb);
-    print_str(" MB)");
-    print_newline();
+    kprintf("Disk: %s (%lu MB)\n", available_disks[current_disk].model, available_disks[current_disk].size_mb);
 
-    display_partitions(); // Use the function from partition.c
+    PartitionMap *map = disktool_get_partition_map(current_disk);
+    if (map != NULL)
+    {
+        display_partition_map(available_disks[current_disk].device, map);
+    }
 }
 
-// Format a specific partition
-int format_partition(int partition_index, FileSystemType fs_type)
+// Format a specific partition, optionally trimming it first
+int format_partition(int partition_index, FileSystemType fs_type, int discard)
 {
     if (current_disk == -1)
     {
@@ -209,38 +340,29 @@ int format_partition(int partition_index, FileSystemType fs_type)
         return -1;
     }
 
-    uint8_t mbr[SECTOR_SIZE];
-    if (ata_read_sector_disk(available_disks[current_disk].controller,
-                             available_disks[current_disk].drive, 0, mbr) != 0)
+    uint64_t start_lba, sector_count;
+    if (disktool_partition_range(current_disk, partition_index, &start_lba, &sector_count) != 0)
     {
-        print_str("Error reading MBR");
-        print_newline();
         return -1;
     }
 
-    PartitionEntry *partition_table = (PartitionEntry *)(mbr + PARTITION_TABLE_OFFSET);
-
-    if (partition_table[partition_index].type == 0x00)
+    // Format using the appropriate function based on filesystem type
+    BlockDevice *dev = available_disks[current_disk].device;
+    if (partition_check_format_range(start_lba, sector_count) != 0)
     {
-        print_str("Partition does not exist");
-        print_newline();
         return -1;
     }
-
-    // Format using the appropriate function based on filesystem type
+    if (discard)
+    {
+        discard_range(dev, start_lba, sector_count);
+    }
     if (fs_type == FS_FAT32)
     {
-        return format_fat32(available_disks[current_disk].controller,
-                            available_disks[current_disk].drive,
-                            partition_table[partition_index].lba_first,
-                            partition_table[partition_index].sector_count);
+        return format_fat32(dev, start_lba, sector_count);
     }
     else if (fs_type == FS_EXT4)
     {
-        return format_ext4(available_disks[current_disk].controller,
-                           available_disks[current_disk].drive,
-                           partition_table[partition_index].lba_first,
-                           partition_table[partition_index].sector_count);
+        return format_ext4(dev, start_lba, sector_count);
     }
     print_str("Unknown partition type");
     print_newline();
@@ -257,46 +379,315 @@ int delete_partition(int partition_index)
         return -1;
     }
 
-    if (partition_index < 0 || partition_index >= 4)
+    PartitionMap *map = disktool_get_partition_map(current_disk);
+    if (map == NULL || partition_index < 0 || partition_index >= (int)map->count)
     {
-        print_str("Invalid partition index");
+        print_str("Partition does not exist");
         print_newline();
         return -1;
     }
 
-    uint8_t mbr[SECTOR_SIZE];
-    if (ata_read_sector_disk(available_disks[current_disk].controller,
-                             available_disks[current_disk].drive, 0, mbr) != 0)
+    if (partition_map_delete(available_disks[current_disk].device, map, partition_index) != 0)
     {
-        print_str("Error reading MBR");
+        print_str("Error writing partition table");
         print_newline();
         return -1;
     }
 
-    PartitionEntry *partition_table = (PartitionEntry *)(mbr + PARTITION_TABLE_OFFSET);
+    print_str("Partition deleted successfully");
+    print_newline();
+    return 0;
+}
 
-    if (partition_table[partition_index].type == 0x00)
+// Returns the block device of a detected disk, or NULL
+BlockDevice *disktool_get_device(int disk_index)
+{
+    if (disk_index < 0 || disk_index >= num_disks)
     {
-        print_str("Partition does not exist");
+        return NULL;
+    }
+    return available_disks[disk_index].device;
+}
+
+// Returns the partition map of a disk, rebuilding it if the table was rewritten
+PartitionMap *disktool_get_partition_map(int disk_index)
+{
+    if (disk_index < 0 || disk_index >= num_disks)
+    {
+        return NULL;
+    }
+    if (partition_map_refresh(available_disks[disk_index].device, &partition_maps[disk_index]) != 0)
+    {
+        return NULL;
+    }
+    return &partition_maps[disk_index];
+}
+
+// Looks up the sector range of a partition in the cached map
+int disktool_partition_range(int disk_index, int partition_index, uint64_t *start_lba, uint64_t *sector_count)
+{
+    if (disk_index < 0 || disk_index >= num_disks)
+    {
+        print_str("Invalid disk index");
         print_newline();
         return -1;
     }
 
-    // Clear the partition entry
-    for (int i = 0; i < sizeof(PartitionEntry); i++)
+    PartitionMap *map = disktool_get_partition_map(disk_index);
+    if (map == NULL)
     {
-        ((uint8_t *)&partition_table[partition_index])[i] = 0;
+        return -1;
     }
+    if (partition_index < 0 || partition_index >= (int)map->count)
+    {
+        print_str("Partition does not exist");
+        print_newline();
+        return -1;
+    }
+
+    *start_lba = map->entries[partition_index].lba_first;
+    *sector_count = map->entries[partition_index].sector_count;
+    return 0;
+}
 
-    if (ata_write_sector_disk(available_disks[current_disk].controller,
-                              available_disks[current_disk].drive, 0, mbr) != 0)
+// Replaces the partition table of the selected disk with an empty GPT
+int init_gpt(void)
+{
+    if (current_disk == -1)
     {
-        print_str("Error writing MBR");
+        print_str("No disk selected");
         print_newline();
         return -1;
     }
 
-    print_str("Partition deleted successfully");
+    if (partition_map_init_gpt(available_disks[current_disk].device, &partition_maps[current_disk]) != 0)
+    {
+        return -1;
+    }
+    print_str("Created an empty GPT (128 entries)");
     print_newline();
     return 0;
-}
\ No newline at end of file
+}
+
+// Looks up the start sector of a partition on the selected disk
+static int partition_start_lba(int partition_index, uint64_t *start_lba)
+{
+    uint64_t sector_count;
+
+    if (current_disk == -1)
+    {
+        print_str("No disk selected");
+        print_newline();
+        return -1;
+    }
+    return disktool_partition_range(current_disk, partition_index, start_lba, &sector_count);
+}
+
+// Opens the journal of an ext4 partition, replaying it if needed
+int journal_partition(int partition_index)
+{
+    uint64_t start_lba;
+    if (partition_start_lba(partition_index, &start_lba) != 0)
+    {
+        return -1;
+    }
+
+    Journal journal;
+    if (journal_load(&journal, available_disks[current_disk].device, start_lba) != 0)
+    {
+        return -1;
+    }
+
+    journal_print_stats(&journal);
+    journal_close(&journal);
+    return 0;
+}
+
+static void print_ops_per_second(char *label, uint32_t ops, uint64_t elapsed_us)
+{
+    print_str(label);
+    print_int(ops);
+    print_str(" ops in ");
+    print_int(elapsed_us / 1000);
+    print_str(" ms = ");
+    print_int(elapsed_us ? (uint32_t)((uint64_t)ops * 1000000 / elapsed_us) : 0);
+    print_str(" ops/s");
+    print_newline();
+}
+
+/**
+ * benchmark_journal - Compares synchronous metadata writes with group commit.
+ *
+ * Each operation rewrites one of a set of metadata blocks with its
+ * current contents, so the benchmark leaves the filesystem unchanged.
+ * The synchronous run writes the block in place and flushes after every
+ * operation; the journaled run batches `batch` operations per transaction
+ * and checkpoints once at the end. Every operation in a transaction
+ * touches a different block, so none is merged away and both runs do the
+ * same work. `batch` is capped at the size of that set.
+ */
+int benchmark_journal(int partition_index, uint32_t ops, uint32_t batch)
+{
+    uint64_t start_lba;
+    if (partition_start_lba(partition_index, &start_lba) != 0)
+    {
+        return -1;
+    }
+    if (ops == 0 || batch == 0)
+    {
+        print_str("Operation and batch counts must be positive");
+        print_newline();
+        return -1;
+    }
+    if (batch > JBENCH_HOT_BLOCKS)
+    {
+        kprintf("Batch limited to %d operations, one per distinct block\n", JBENCH_HOT_BLOCKS);
+        batch = JBENCH_HOT_BLOCKS;
+    }
+
+    BlockDevice *device = available_disks[current_disk].device;
+
+    Journal journal;
+    if (journal_load(&journal, device, start_lba) != 0)
+    {
+        return -1;
+    }
+    if (journal.journal_block < JBENCH_FIRST_BLOCK + JBENCH_HOT_BLOCKS)
+    {
+        print_str("Journal overlaps benchmark blocks");
+        print_newline();
+        journal_close(&journal);
+        return -1;
+    }
+
+    uint32_t bs = journal.block_size;
+    uint32_t spb = journal.sectors_per_block;
+    uint8_t *blocks = (uint8_t *)allocate(JBENCH_HOT_BLOCKS * bs);
+    if (blocks == NULL ||
+        blockdev_read(device, start_lba + JBENCH_FIRST_BLOCK * spb, JBENCH_HOT_BLOCKS * spb, blocks) != 0)
+    {
+        print_str("Error: cannot read benchmark blocks");
+        print_newline();
+        free(blocks);
+        journal_close(&journal);
+        return -1;
+    }
+
+    // Synchronous ordered writes: every update goes home and is flushed
+    uint64_t start = timer_tsc();
+    uint32_t sync_done = 0;
+    while (sync_done < ops)
+    {
+        uint32_t index = sync_done % JBENCH_HOT_BLOCKS;
+        if (blockdev_write(device, start_lba + (JBENCH_FIRST_BLOCK + index) * spb, spb,
+                           blocks + index * bs) != 0 ||
+            blockdev_flush(device) != 0)
+        {
+            break;
+        }
+        sync_done++;
+    }
+    uint64_t sync_us = timer_elapsed_us(start);
+
+    // Group commit through the journal, including the final checkpoint.
+    // An operation counts once the transaction holding it has committed.
+    start = timer_tsc();
+    uint32_t group_done = 0;
+    int group_failed = 0;
+    for (uint32_t i = 0; i < ops && !group_failed; i++)
+    {
+        uint32_t index = i % JBENCH_HOT_BLOCKS;
+        if (journal_dirty_block(&journal, JBENCH_FIRST_BLOCK + index, blocks + index * bs) != 0)
+        {
+            group_failed = 1;
+        }
+        else if ((i + 1) % batch == 0)
+        {
+            if (journal_commit(&journal) != 0)
+            {
+                group_failed = 1;
+            }
+            else
+            {
+                group_done = i + 1;
+            }
+        }
+    }
+    if (!group_failed)
+    {
+        if (journal_commit(&journal) != 0 || journal_checkpoint(&journal) != 0)
+        {
+            group_failed = 1;
+        }
+        else
+        {
+            group_done = ops;
+        }
+    }
+    uint64_t group_us = timer_elapsed_us(start);
+
+    int result = 0;
+    if (sync_done < ops)
+    {
+        kprintf("Error: synchronous write failed after %u of %u ops\n", sync_done, ops);
+        result = -1;
+    }
+    else
+    {
+        print_ops_per_second("Synchronous writes: ", ops, sync_us);
+    }
+    if (group_failed)
+    {
+        kprintf("Error: group commit failed after %u of %u ops\n", group_done, ops);
+        result = -1;
+    }
+    else
+    {
+        print_ops_per_second("Group commit:       ", ops, group_us);
+    }
+    journal_print_stats(&journal);
+
+    free(blocks);
+    journal_close(&journal);
+    return result;
+}
+
+// Runs a fio-style workload against the selected disk
+int benchmark_disk(char *args)
+{
+    if (current_disk == -1)
+    {
+        print_str("No disk selected");
+        print_newline();
+        return -1;
+    }
+
+    DiskBenchConfig config;
+    int force;
+    disk_bench_defaults(&config);
+    if (disk_bench_parse(args, &config, &force) != 0)
+    {
+        return -1;
+    }
+    if ((config.pattern == BENCH_WRITE || config.pattern == BENCH_RANDWRITE) && !force)
+    {
+        print_str("Write workloads overwrite the region; add 'force' to run them");
+        print_newline();
+        return -1;
+    }
+    return disk_bench_run(available_disks[current_disk].device, &config);
+}
+
+// Copies one known disk onto another, sector for sector
+int clone_disks(int src_index, int dst_index, int sparse)
+{
+    BlockDevice *src = disktool_get_device(src_index);
+    BlockDevice *dst = disktool_get_device(dst_index);
+    if (src == NULL || dst == NULL)
+    {
+        print_str("Invalid disk index");
+        print_newline();
+        return -1;
+    }
+    return disk_clone(src, dst, sparse ? CLONE_SPARSE : 0);
+}
@@ -0,0 +1,449 @@
+// ext4.c - read-only ext2/3/4 driver for the VFS
+#include "vfs.h"
+#include "partition.h"
+#include "journal.h"
+#include "filesystem.h"
+#include "print.h"
+#include "string.h"
+#include "memory.h"
+#include "memory_allocator.h"
+#include "trace.h"
+
+#define EXT4_SUPERBLOCK_OFFSET 1024
+#define EXT4_MAGIC 0xEF53
+#define EXT4_ROOT_INO 2
+#define EXT4_EXT_MAGIC 0xF30A
+#define EXT4_GOOD_OLD_INODE_SIZE 128
+
+#define EXT4_FEATURE_INCOMPAT_FILETYPE    0x0002
+#define EXT4_FEATURE_INCOMPAT_RECOVER     0x0004
+#define EXT4_FEATURE_INCOMPAT_EXTENTS     0x0040
+#define EXT4_FEATURE_INCOMPAT_64BIT       0x0080
+#define EXT4_FEATURE_INCOMPAT_MMP         0x0100
+#define EXT4_FEATURE_INCOMPAT_FLEX_BG     0x0200
+#define EXT4_FEATURE_INCOMPAT_EA_INODE    0x0400
+#define EXT4_FEATURE_INCOMPAT_CSUM_SEED   0x2000
+#define EXT4_FEATURE_INCOMPAT_LARGEDIR    0x4000
+#define EXT4_FEATURE_INCOMPAT_INLINE_DATA 0x8000
+
+#define EXT4_SUPPORTED_INCOMPAT (EXT4_FEATURE_INCOMPAT_FILETYPE | EXT4_FEATURE_INCOMPAT_RECOVER | \
+                                 EXT4_FEATURE_INCOMPAT_EXTENTS | EXT4_FEATURE_INCOMPAT_64BIT | \
+                                 EXT4_FEATURE_INCOMPAT_MMP | EXT4_FEATURE_INCOMPAT_FLEX_BG | \
+                                 EXT4_FEATURE_INCOMPAT_EA_INODE | EXT4_FEATURE_INCOMPAT_CSUM_SEED | \
+                                 EXT4_FEATURE_INCOMPAT_LARGEDIR | EXT4_FEATURE_INCOMPAT_INLINE_DATA)
+
+#define EXT4_EXTENTS_FL     0x00080000
+#define EXT4_INLINE_DATA_FL 0x10000000
+
+#define EXT4_FT_REG_FILE 1
+#define EXT4_FT_DIR      2
+#define EXT4_FT_SYMLINK  7
+
+#define EXT4_INIT_MAX_LEN 32768
+#define EXT4_MAX_EXTENT_DEPTH 5
+
+typedef struct {
+    uint16_t i_mode;
+    uint16_t i_uid;
+    uint32_t i_size_lo;
+    uint32_t i_atime;
+    uint32_t i_ctime;
+    uint32_t i_mtime;
+    uint32_t i_dtime;
+    uint16_t i_gid;
+    uint16_t i_links_count;
+    uint32_t i_blocks_lo;
+    uint32_t i_flags;
+    uint32_t i_osd1;
+    uint32_t i_block[15];
+    uint32_t i_generation;
+    uint32_t i_file_acl_lo;
+    uint32_t i_size_high;
+    uint32_t i_obso_faddr;
+    uint16_t l_i_blocks_high;
+} __attribute__((packed)) Ext4Inode;
+
+typedef struct {
+    uint32_t inode;
+    uint16_t rec_len;
+    uint8_t  name_len;
+    uint8_t  file_type;
+    char     name[];
+} __attribute__((packed)) Ext4DirEntry;
+
+typedef struct {
+    uint32_t block_size;
+    uint32_t sectors_per_block;
+    uint32_t inodes_per_group;
+    uint32_t inode_size;
+    uint32_t desc_size;
+    uint32_t group_count;
+    uint64_t gdt_block;
+    uint32_t incompat;
+    uint8_t *scratch;            // One block for extent index / indirect blocks
+} Ext4Info;
+
+typedef struct {
+    uint32_t flags;
+    uint32_t i_block[15];
+} Ext4InodeInfo;
+
+static const VfsInodeOps ext4_inode_ops;
+static const VfsSuperOps ext4_super_ops;
+
+static int ext4_read_bytes(VfsSuperblock *sb, uint64_t offset, uint32_t length, uint8_t *buffer) {
+    uint64_t lba = sb->start_lba + offset / SECTOR_SIZE;
+    uint32_t span = (uint32_t)(offset % SECTOR_SIZE) + length;
+    return blockdev_read(sb->dev, lba, (span + SECTOR_SIZE - 1) / SECTOR_SIZE, buffer);
+}
+
+static int ext4_read_block(VfsSuperblock *sb, uint64_t block, uint32_t count, uint8_t *buffer) {
+    Ext4Info *info = (Ext4Info *)sb->fs_private;
+    return blockdev_read(sb->dev, sb->start_lba + block * info->sectors_per_block,
+                         count * info->sectors_per_block, buffer);
+}
+
+static int ext4_read_inode(VfsSuperblock *sb, uint64_t ino, VfsInode *inode) {
+    Ext4Info *info = (Ext4Info *)sb->fs_private;
+    uint8_t buffer[2 * SECTOR_SIZE];
+
+    if (ino == 0 || info->inode_size > sizeof(buffer)) {
+        return -1;
+    }
+    uint32_t group = (uint32_t)((ino - 1) / info->inodes_per_group);
+    uint32_t index = (uint32_t)((ino - 1) % info->inodes_per_group);
+    if (group >= info->group_count) {
+        return -1;
+    }
+
+    // Group descriptors never straddle a sector
+    uint64_t desc_offset = info->gdt_block * info->block_size + (uint64_t)group * info->desc_size;
+    if (ext4_read_bytes(sb, desc_offset, SECTOR_SIZE, buffer) != 0) {
+        return -1;
+    }
+    Ext4GroupDesc *gd = (Ext4GroupDesc *)(buffer + desc_offset % SECTOR_SIZE);
+    uint64_t inode_table = gd->bg_inode_table_lo;
+    if ((info->incompat & EXT4_FEATURE_INCOMPAT_64BIT) && info->desc_size >= 64) {
+        inode_table |= (uint64_t)gd->bg_inode_table_hi << 32;
+    }
+
+    uint64_t inode_offset = inode_table * info->block_size + (uint64_t)index * info->inode_size;
+    if (ext4_read_bytes(sb, inode_offset, info->inode_size, buffer) != 0) {
+        return -1;
+    }
+    Ext4Inode *raw = (Ext4Inode *)(buffer + inode_offset % SECTOR_SIZE);
+
+    Ext4InodeInfo *private_info = (Ext4InodeInfo *)allocate(sizeof(Ext4InodeInfo));
+    if (private_info == NULL) {
+        return -1;
+    }
+    private_info->flags = raw->i_flags;
+    memory_copy(private_info->i_block, raw->i_block, sizeof(private_info->i_block));
+
+    inode->mode = raw->i_mode;
+    inode->links = raw->i_links_count;
+    inode->size = raw->i_size_lo | ((uint64_t)raw->i_size_high << 32);
+    inode->blocks = raw->i_blocks_lo | ((uint64_t)raw->l_i_blocks_high << 32);
+    inode->mtime = raw->i_mtime;
+    inode->ops = &ext4_inode_ops;
+    inode->fs_private = private_info;
+    return 0;
+}
+
+static void ext4_release_inode(VfsInode *inode) {
+    free(inode->fs_private);
+    inode->fs_private = NULL;
+}
+
+/**
+ * ext4_map_extent - Maps a logical block through an extent tree.
+ *
+ * Sets *physical to 0 for holes and uninitialized extents (read as zeros)
+ * and *run to the number of following logical blocks with the same mapping.
+ */
+static int ext4_map_extent(VfsSuperblock *sb, const uint8_t *node, uint32_t logical,
+                           uint64_t *physical, uint32_t *run, int level)
+{
+    Ext4Info *info = (Ext4Info *)sb->fs_private;
+    uint16_t magic = *(const uint16_t *)node;
+    uint16_t entries = *(const uint16_t *)(node + 2);
+    uint16_t depth = *(const uint16_t *)(node + 6);
+    const uint8_t *entry = node + 12;
+
+    if (magic != EXT4_EXT_MAGIC || level > EXT4_MAX_EXTENT_DEPTH) {
+        print_str("Error: corrupt ext4 extent tree");
+        print_newline();
+        return -1;
+    }
+
+    if (depth > 0) {
+        // Last index whose range starts at or before the block
+        const uint8_t *chosen = NULL;
+        for (uint16_t i = 0; i < entries; i++, entry += 12) {
+            if (*(const uint32_t *)entry > logical) {
+                break;
+            }
+            chosen = entry;
+        }
+        if (chosen == NULL) {
+            *physical = 0;
+            *run = (entries > 0) ? *(const uint32_t *)(node + 12) - logical : 1;
+            return 0;
+        }
+        uint64_t leaf = *(const uint32_t *)(chosen + 4) | ((uint64_t)*(const uint16_t *)(chosen + 8) << 32);
+        if (ext4_read_block(sb, leaf, 1, info->scratch) != 0) {
+            return -1;
+        }
+        return ext4_map_extent(sb, info->scratch, logical, physical, run, level + 1);
+    }
+
+    uint32_t next_start = 0xFFFFFFFF;
+    for (uint16_t i = 0; i < entries; i++, entry += 12) {
+        uint32_t first = *(const uint32_t *)entry;
+        uint32_t length = *(const uint16_t *)(entry + 4);
+        int uninitialized = length > EXT4_INIT_MAX_LEN;
+        if (uninitialized) {
+            length -= EXT4_INIT_MAX_LEN;
+        }
+
+        if (logical >= first && logical < first + length) {
+            uint64_t start = *(const uint32_t *)(entry + 8) | ((uint64_t)*(const uint16_t *)(entry + 6) << 32);
+            *physical = uninitialized ? 0 : start + (logical - first);
+            *run = first + length - logical;
+            return 0;
+        }
+        if (first > logical && first < next_start) {
+            next_start = first;
+        }
+    }
+
+    *physical = 0;
+    *run = next_start - logical;
+    return 0;
+}
+
+// Maps a logical block of an ext2/3-style inode through its indirect blocks
+static int ext4_map_indirect(VfsSuperblock *sb, const Ext4InodeInfo *inode_info, uint32_t logical,
+                             uint64_t *physical)
+{
+    Ext4Info *info = (Ext4Info *)sb->fs_private;
+    uint32_t per_block = info->block_size / 4;
+    uint32_t *table = (uint32_t *)info->scratch;
+    uint32_t block;
+    int levels;
+
+    if (logical < 12) {
+        *physical = inode_info->i_block[logical];
+        return 0;
+    }
+    logical -= 12;
+    if (logical < per_block) {
+        block = inode_info->i_block[12];
+        levels = 1;
+    } else if ((logical -= per_block) < per_block * per_block) {
+        block = inode_info->i_block[13];
+        levels = 2;
+    } else {
+        logical -= per_block * per_block;
+        block = inode_info->i_block[14];
+        levels = 3;
+    }
+
+    for (int level = levels - 1; level >= 0 && block != 0; level--) {
+        uint32_t divisor = 1;
+        for (int i = 0; i < level; i++) {
+            divisor *= per_block;
+        }
+        if (ext4_read_block(sb, block, 1, info->scratch) != 0) {
+            return -1;
+        }
+        block = table[(logical / divisor) % per_block];
+    }
+    *physical = block;
+    return 0;
+}
+
+/**
+ * ext4_readpage - Fills a page cache page with file contents.
+ *
+ * Physically contiguous blocks are read with a single device request
+ * straight into the page; holes are zero-filled.
+ */
+static int ext4_readpage(VfsInode *inode, uint64_t index, uint8_t *data) {
+    TRACE_SCOPE("fs:ext4_readpage", index);
+    VfsSuperblock *sb = inode->sb;
+    Ext4Info *info = (Ext4Info *)sb->fs_private;
+    Ext4InodeInfo *inode_info = (Ext4InodeInfo *)inode->fs_private;
+    uint32_t blocks_per_page = PAGE_SIZE / info->block_size;
+    uint32_t logical = (uint32_t)(index * blocks_per_page);
+
+    if (inode_info->flags & EXT4_INLINE_DATA_FL) {
+        print_str("Error: inline data files are not supported");
+        print_newline();
+        return -1;
+    }
+
+    // Fast symlinks keep their target inside i_block
+    if ((inode->mode & VFS_S_IFMT) == VFS_S_IFLNK && inode->size < sizeof(inode_info->i_block) &&
+        !(inode_info->flags & EXT4_EXTENTS_FL)) {
+        memory_zero(data, PAGE_SIZE);
+        memory_copy(data, inode_info->i_block, inode->size);
+        return 0;
+    }
+
+    uint32_t i = 0;
+    while (i < blocks_per_page) {
+        if ((uint64_t)(logical + i) * info->block_size >= inode->size) {
+            memory_zero(data + i * info->block_size, (blocks_per_page - i) * info->block_size);
+            break;
+        }
+
+        uint64_t physical;
+        uint32_t run = 1;
+        int result = (inode_info->flags & EXT4_EXTENTS_FL)
+            ? ext4_map_extent(sb, (const uint8_t *)inode_info->i_block, logical + i, &physical, &run, 0)
+            : ext4_map_indirect(sb, inode_info, logical + i, &physical);
+        if (result != 0) {
+            return -1;
+        }
+        if (run > blocks_per_page - i) {
+            run = blocks_per_page - i;
+        }
+
+        if (physical == 0) {
+            memory_zero(data + i * info->block_size, run * info->block_size);
+        } else if (ext4_read_block(sb, physical, run, data + i * info->block_size) != 0) {
+            return -1;
+        }
+        i += run;
+    }
+    return 0;
+}
+
+static int ext4_readdir(VfsInode *dir, uint64_t *cookie, VfsDirEntry *entry) {
+    while (*cookie < dir->size) {
+        uint32_t offset = *cookie & (PAGE_SIZE - 1);
+        CachePage *page = vfs_get_page(dir, *cookie >> PAGE_SHIFT);
+        if (page == NULL) {
+            return -1;
+        }
+
+        Ext4DirEntry *de = (Ext4DirEntry *)(page->data + offset);
+        if (de->rec_len < 8 || (de->rec_len & 3) || offset + de->rec_len > PAGE_SIZE ||
+            de->name_len + 8 > de->rec_len) {
+            page_cache_put(page);
+            print_str("Error: corrupt ext4 directory entry");
+            print_newline();
+            return -1;
+        }
+        *cookie += de->rec_len;
+
+        if (de->inode == 0) {
+            page_cache_put(page);
+            continue;
+        }
+
+        entry->ino = de->inode;
+        memory_copy(entry->name, de->name, de->name_len);
+        entry->name[de->name_len] = '\0';
+        switch (de->file_type) {
+        case EXT4_FT_REG_FILE: entry->mode = VFS_S_IFREG; break;
+        case EXT4_FT_DIR:      entry->mode = VFS_S_IFDIR; break;
+        case EXT4_FT_SYMLINK:  entry->mode = VFS_S_IFLNK; break;
+        default:               entry->mode = 0; break;
+        }
+        page_cache_put(page);
+        return 1;
+    }
+    return 0;
+}
+
+static void ext4_put_super(VfsSuperblock *sb) {
+    Ext4Info *info = (Ext4Info *)sb->fs_private;
+    if (info != NULL) {
+        free(info->scratch);
+        free(info);
+    }
+    sb->fs_private = NULL;
+}
+
+int ext4_mount(VfsSuperblock *sb) {
+    uint8_t buffer[EXT4_SUPERBLOCK_OFFSET];
+
+    if (blockdev_read(sb->dev, sb->start_lba + EXT4_SUPERBLOCK_OFFSET / SECTOR_SIZE,
+                      sizeof(buffer) / SECTOR_SIZE, buffer) != 0) {
+        return -1;
+    }
+
+    Ext4Superblock *raw = (Ext4Superblock *)buffer;
+    if (raw->s_magic != EXT4_MAGIC) {
+        return -1;
+    }
+
+    uint32_t block_size = 1024u << raw->s_log_block_size;
+    uint32_t incompat = (raw->s_rev_level == 0) ? 0 : raw->s_feature_incompat;
+    if (incompat & ~EXT4_SUPPORTED_INCOMPAT) {
+        print_str("ext4: unsupported incompatible features ");
+        print_hex(incompat & ~EXT4_SUPPORTED_INCOMPAT);
+        print_newline();
+        return -1;
+    }
+    if (block_size > PAGE_SIZE || raw->s_inodes_per_group == 0 || raw->s_blocks_per_group == 0) {
+        print_str("ext4: unsupported block size or geometry");
+        print_newline();
+        return -1;
+    }
+
+    // Bring the filesystem up to date before reading anything else
+    if (raw->s_feature_compat & EXT4_FEATURE_COMPAT_HAS_JOURNAL) {
+        Journal journal;
+        if (journal_load(&journal, sb->dev, sb->start_lba) == 0) {
+            journal_close(&journal);
+        } else {
+            print_str("ext4: journal not replayed, contents may be stale");
+            print_newline();
+        }
+    }
+
+    Ext4Info *info = (Ext4Info *)allocate(sizeof(Ext4Info));
+    if (info == NULL) {
+        return -1;
+    }
+    info->block_size = block_size;
+    info->sectors_per_block = block_size / SECTOR_SIZE;
+    info->inodes_per_group = raw->s_inodes_per_group;
+    info->inode_size = (raw->s_rev_level == 0) ? EXT4_GOOD_OLD_INODE_SIZE : raw->s_inode_size;
+    info->desc_size = ((incompat & EXT4_FEATURE_INCOMPAT_64BIT) && raw->s_desc_size) ? raw->s_desc_size : 32;
+    info->incompat = incompat;
+    info->gdt_block = raw->s_first_data_block + 1;
+
+    uint64_t blocks_count = raw->s_blocks_count_lo;
+    if (incompat & EXT4_FEATURE_INCOMPAT_64BIT) {
+        blocks_count |= (uint64_t)raw->s_blocks_count_hi << 32;
+    }
+    info->group_count = (uint32_t)((blocks_count - raw->s_first_data_block + raw->s_blocks_per_group - 1) /
+                                   raw->s_blocks_per_group);
+
+    info->scratch = (uint8_t *)allocate(block_size);
+    if (info->scratch == NULL) {
+        free(info);
+        return -1;
+    }
+
+    sb->fs_private = info;
+    sb->block_size = block_size;
+    sb->root_ino = EXT4_ROOT_INO;
+    sb->ops = &ext4_super_ops;
+    return 0;
+}
+
+static const VfsInodeOps ext4_inode_ops = {
+    .readdir = ext4_readdir,
+    .readpage = ext4_readpage,
+};
+
+static const VfsSuperOps ext4_super_ops = {
+    .read_inode = ext4_read_inode,
+    .release_inode = ext4_release_inode,
+    .put_super = ext4_put_super,
+};
@@ -0,0 +1,404 @@
+// fat32.c - read-only FAT32 driver for the VFS
+#include "vfs.h"
+#include "filesystem.h"
+#include "print.h"
+#include "memory.h"
+#include "memory_allocator.h"
+
+#define FAT32_ROOT_INO      1
+#define FAT32_EOC           0x0FFFFFF8
+#define FAT32_CLUSTER_MASK  0x0FFFFFFF
+
+#define FAT_ATTR_READ_ONLY  0x01
+#define FAT_ATTR_VOLUME_ID  0x08
+#define FAT_ATTR_DIRECTORY  0x10
+#define FAT_ATTR_LFN        0x0F
+#define FAT_LFN_LAST        0x40
+#define FAT_NTRES_LOWER_BASE 0x08
+#define FAT_NTRES_LOWER_EXT  0x10
+#define FAT_DIRENT_SIZE     32
+
+typedef struct {
+    uint8_t  name[11];
+    uint8_t  attr;
+    uint8_t  ntres;
+    uint8_t  crt_time_tenth;
+    uint16_t crt_time;
+    uint16_t crt_date;
+    uint16_t lst_acc_date;
+    uint16_t fst_clus_hi;
+    uint16_t wrt_time;
+    uint16_t wrt_date;
+    uint16_t fst_clus_lo;
+    uint32_t file_size;
+} __attribute__((packed)) FatDirEntry;
+
+typedef struct {
+    uint32_t sectors_per_cluster;
+    uint32_t cluster_size;
+    uint32_t fat_start;          // Volume-relative sectors
+    uint32_t data_start;
+    uint32_t root_cluster;
+    uint32_t cluster_count;
+    uint32_t fat_cached_sector;  // FAT sector held in fat_cache, 0 if none
+    uint32_t fat_cache[SECTOR_SIZE / 4];
+} FatInfo;
+
+typedef struct {
+    uint32_t first_cluster;
+    uint32_t cached_index;       // Last cluster looked up, for sequential reads
+    uint32_t cached_cluster;
+} FatInodeInfo;
+
+static const VfsInodeOps fat32_inode_ops;
+static const VfsSuperOps fat32_super_ops;
+
+static int fat_valid_cluster(const FatInfo *info, uint32_t cluster) {
+    return cluster >= 2 && cluster < info->cluster_count + 2;
+}
+
+static uint32_t fat_next_cluster(VfsSuperblock *sb, uint32_t cluster) {
+    FatInfo *info = (FatInfo *)sb->fs_private;
+    uint32_t sector = info->fat_start + (cluster * 4) / SECTOR_SIZE;
+
+    if (info->fat_cached_sector != sector) {
+        if (blockdev_read(sb->dev, sb->start_lba + sector, 1, (uint8_t *)info->fat_cache) != 0) {
+            return FAT32_EOC;
+        }
+        info->fat_cached_sector = sector;
+    }
+    return info->fat_cache[cluster % (SECTOR_SIZE / 4)] & FAT32_CLUSTER_MASK;
+}
+
+static uint64_t fat_cluster_lba(VfsSuperblock *sb, uint32_t cluster) {
+    FatInfo *info = (FatInfo *)sb->fs_private;
+    return sb->start_lba + info->data_start + (uint64_t)(cluster - 2) * info->sectors_per_cluster;
+}
+
+// Returns the cluster holding cluster-index `index` of a chain, 0 past the end
+static uint32_t fat_cluster_at(VfsSuperblock *sb, FatInodeInfo *inode_info, uint32_t index) {
+    FatInfo *info = (FatInfo *)sb->fs_private;
+    uint32_t cluster = inode_info->first_cluster;
+    uint32_t position = 0;
+
+    if (inode_info->cached_cluster != 0 && inode_info->cached_index <= index) {
+        cluster = inode_info->cached_cluster;
+        position = inode_info->cached_index;
+    }
+
+    while (position < index) {
+        if (!fat_valid_cluster(info, cluster)) {
+            return 0;
+        }
+        cluster = fat_next_cluster(sb, cluster);
+        position++;
+    }
+    if (!fat_valid_cluster(info, cluster)) {
+        return 0;
+    }
+
+    inode_info->cached_index = index;
+    inode_info->cached_cluster = cluster;
+    return cluster;
+}
+
+static uint32_t fat_chain_length(VfsSuperblock *sb, uint32_t cluster) {
+    FatInfo *info = (FatInfo *)sb->fs_private;
+    uint32_t length = 0;
+
+    while (fat_valid_cluster(info, cluster) && length <= info->cluster_count) {
+        length++;
+        cluster = fat_next_cluster(sb, cluster);
+    }
+    return length;
+}
+
+// Days-from-civil conversion of a FAT timestamp to seconds since 1970
+static uint32_t fat_to_unix_time(uint16_t date, uint16_t time) {
+    int32_t year = 1980 + (date >> 9);
+    uint32_t month = (date >> 5) & 0x0F;
+    uint32_t day = date & 0x1F;
+
+    if (month < 1 || month > 12 || day < 1) {
+        return 0;
+    }
+    year -= month <= 2;
+    int32_t era = year / 400;
+    uint32_t year_of_era = (uint32_t)(year - era * 400);
+    uint32_t day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    uint32_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    int32_t days = era * 146097 + (int32_t)day_of_era - 719468;
+
+    return (uint32_t)days * 86400 + (time >> 11) * 3600 + ((time >> 5) & 0x3F) * 60 + (time & 0x1F) * 2;
+}
+
+static int fat32_read_inode(VfsSuperblock *sb, uint64_t ino, VfsInode *inode) {
+    FatInfo *info = (FatInfo *)sb->fs_private;
+    FatInodeInfo *inode_info = (FatInodeInfo *)allocate(sizeof(FatInodeInfo));
+    if (inode_info == NULL) {
+        return -1;
+    }
+    memory_zero(inode_info, sizeof(FatInodeInfo));
+
+    inode->ops = &fat32_inode_ops;
+    inode->fs_private = inode_info;
+    inode->links = 1;
+
+    if (ino == FAT32_ROOT_INO) {
+        inode_info->first_cluster = info->root_cluster;
+        inode->mode = VFS_S_IFDIR | 0755;
+        inode->size = (uint64_t)fat_chain_length(sb, info->root_cluster) * info->cluster_size;
+        inode->blocks = inode->size / SECTOR_SIZE;
+        return 0;
+    }
+
+    // Other inode numbers encode where the directory entry lives:
+    // first cluster of the parent directory << 32 | byte offset within it
+    FatInodeInfo parent = {(uint32_t)(ino >> 32), 0, 0};
+    uint32_t offset = (uint32_t)ino;
+    uint32_t cluster = fat_cluster_at(sb, &parent, offset / info->cluster_size);
+    uint8_t sector[SECTOR_SIZE];
+    if (cluster == 0 ||
+        blockdev_read(sb->dev, fat_cluster_lba(sb, cluster) + (offset % info->cluster_size) / SECTOR_SIZE,
+                      1, sector) != 0) {
+        free(inode_info);
+        return -1;
+    }
+
+    FatDirEntry *entry = (FatDirEntry *)(sector + offset % SECTOR_SIZE);
+    inode_info->first_cluster = ((uint32_t)entry->fst_clus_hi << 16) | entry->fst_clus_lo;
+    inode->mtime = fat_to_unix_time(entry->wrt_date, entry->wrt_time);
+
+    if (entry->attr & FAT_ATTR_DIRECTORY) {
+        // ".." of a first-level directory points at cluster 0, meaning the root
+        if (inode_info->first_cluster == 0) {
+            inode_info->first_cluster = info->root_cluster;
+        }
+        inode->mode = VFS_S_IFDIR | 0755;
+        inode->size = (uint64_t)fat_chain_length(sb, inode_info->first_cluster) * info->cluster_size;
+    } else {
+        inode->mode = VFS_S_IFREG | ((entry->attr & FAT_ATTR_READ_ONLY) ? 0444 : 0644);
+        inode->size = entry->file_size;
+    }
+    inode->blocks = ((inode->size + info->cluster_size - 1) / info->cluster_size) * info->sectors_per_cluster;
+    return 0;
+}
+
+static void fat32_release_inode(VfsInode *inode) {
+    free(inode->fs_private);
+    inode->fs_private = NULL;
+}
+
+/**
+ * fat32_readpage - Fills a page cache page from the cluster chain.
+ *
+ * Runs of physically consecutive clusters are read with one device
+ * request directly into the page.
+ */
+static int fat32_readpage(VfsInode *inode, uint64_t index, uint8_t *data) {
+    VfsSuperblock *sb = inode->sb;
+    FatInfo *info = (FatInfo *)sb->fs_private;
+    FatInodeInfo *inode_info = (FatInodeInfo *)inode->fs_private;
+    uint64_t offset = index << PAGE_SHIFT;
+    uint32_t done = 0;
+
+    while (done < PAGE_SIZE) {
+        uint32_t cluster = fat_cluster_at(sb, inode_info, (uint32_t)(offset / info->cluster_size));
+        if (cluster == 0 || offset >= inode->size) {
+            memory_zero(data + done, PAGE_SIZE - done);
+            break;
+        }
+
+        uint32_t within = (uint32_t)(offset % info->cluster_size);
+        uint32_t length = info->cluster_size - within;
+        uint32_t last = cluster;
+
+        // Extend over physically contiguous clusters
+        while (length < PAGE_SIZE - done) {
+            uint32_t next = fat_next_cluster(sb, last);
+            if (next != last + 1) {
+                break;
+            }
+            last = next;
+            length += info->cluster_size;
+        }
+        if (length > PAGE_SIZE - done) {
+            length = PAGE_SIZE - done;
+        }
+
+        if (blockdev_read(sb->dev, fat_cluster_lba(sb, cluster) + within / SECTOR_SIZE,
+                          length / SECTOR_SIZE, data + done) != 0) {
+            return -1;
+        }
+        done += length;
+        offset += length;
+    }
+    return 0;
+}
+
+static uint8_t fat_lfn_checksum(const uint8_t *short_name) {
+    uint8_t sum = 0;
+    for (int i = 0; i < 11; i++) {
+        sum = (uint8_t)(((sum & 1) << 7) + (sum >> 1) + short_name[i]);
+    }
+    return sum;
+}
+
+// Collects the 13 UCS-2 characters of one long-name entry as ASCII
+static void fat_lfn_collect(const uint8_t *raw, char *name) {
+    static const uint8_t offsets[13] = {1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30};
+    uint32_t base = ((raw[0] & 0x1F) - 1) * 13;
+
+    for (int i = 0; i < 13 && base + i < VFS_NAME_MAX; i++) {
+        uint16_t c = raw[offsets[i]] | (raw[offsets[i] + 1] << 8);
+        if (c == 0x0000) {
+            name[base + i] = '\0';
+            return;
+        }
+        name[base + i] = (c < 0x80) ? (char)c : '?';
+    }
+}
+
+static void fat_short_name(const FatDirEntry *entry, char *name) {
+    int length = 0;
+
+    for (int i = 0; i < 8 && entry->name[i] != ' '; i++) {
+        char c = (i == 0 && entry->name[0] == 0x05) ? (char)0xE5 : (char)entry->name[i];
+        if ((entry->ntres & FAT_NTRES_LOWER_BASE) && c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+        name[length++] = c;
+    }
+    if (entry->name[8] != ' ') {
+        name[length++] = '.';
+        for (int i = 8; i < 11 && entry->name[i] != ' '; i++) {
+            char c = (char)entry->name[i];
+            if ((entry->ntres & FAT_NTRES_LOWER_EXT) && c >= 'A' && c <= 'Z') {
+                c += 'a' - 'A';
+            }
+            name[length++] = c;
+        }
+    }
+    name[length] = '\0';
+}
+
+static int fat32_readdir(VfsInode *dir, uint64_t *cookie, VfsDirEntry *entry) {
+    FatInodeInfo *dir_info = (FatInodeInfo *)dir->fs_private;
+    int have_lfn = 0;
+    uint8_t lfn_checksum = 0;
+
+    while (*cookie < dir->size) {
+        uint64_t position = *cookie;
+        CachePage *page = vfs_get_page(dir, position >> PAGE_SHIFT);
+        if (page == NULL) {
+            return -1;
+        }
+        const uint8_t *raw = page->data + (position & (PAGE_SIZE - 1));
+        const FatDirEntry *de = (const FatDirEntry *)raw;
+        *cookie += FAT_DIRENT_SIZE;
+
+        if (raw[0] == 0x00) {
+            page_cache_put(page);
+            *cookie = dir->size;
+            return 0;
+        }
+        if (raw[0] == 0xE5) {
+            have_lfn = 0;
+            page_cache_put(page);
+            continue;
+        }
+        if (de->attr == FAT_ATTR_LFN) {
+            if (raw[0] & FAT_LFN_LAST) {
+                memory_zero(entry->name, sizeof(entry->name));
+                have_lfn = 1;
+                lfn_checksum = raw[13];
+            }
+            if (have_lfn && (raw[0] & 0x1F) != 0) {
+                fat_lfn_collect(raw, entry->name);
+            }
+            page_cache_put(page);
+            continue;
+        }
+        if (de->attr & FAT_ATTR_VOLUME_ID) {
+            have_lfn = 0;
+            page_cache_put(page);
+            continue;
+        }
+
+        if (!have_lfn || lfn_checksum != fat_lfn_checksum(de->name)) {
+            fat_short_name(de, entry->name);
+        }
+        entry->mode = (de->attr & FAT_ATTR_DIRECTORY) ? VFS_S_IFDIR : VFS_S_IFREG;
+        entry->ino = ((uint64_t)dir_info->first_cluster << 32) | (uint32_t)position;
+        page_cache_put(page);
+        return 1;
+    }
+    return 0;
+}
+
+static void fat32_put_super(VfsSuperblock *sb) {
+    free(sb->fs_private);
+    sb->fs_private = NULL;
+}
+
+int fat32_mount(VfsSuperblock *sb) {
+    uint8_t boot[SECTOR_SIZE];
+
+    if (blockdev_read(sb->dev, sb->start_lba, 1, boot) != 0) {
+        return -1;
+    }
+
+    uint16_t bytes_per_sector = boot[11] | (boot[12] << 8);
+    uint8_t sectors_per_cluster = boot[13];
+    uint16_t reserved = boot[14] | (boot[15] << 8);
+    uint8_t num_fats = boot[16];
+    uint16_t root_entries = boot[17] | (boot[18] << 8);
+    uint16_t fat_size_16 = boot[22] | (boot[23] << 8);
+    uint32_t total_sectors = *(uint32_t *)(boot + 32);
+    uint32_t fat_size = *(uint32_t *)(boot + 36);
+    uint32_t root_cluster = *(uint32_t *)(boot + 44);
+
+    // FAT32 has no fixed root directory and no 16-bit FAT size
+    if (boot[510] != 0x55 || boot[511] != 0xAA || bytes_per_sector != SECTOR_SIZE ||
+        sectors_per_cluster == 0 || (sectors_per_cluster & (sectors_per_cluster - 1)) ||
+        num_fats == 0 || root_entries != 0 || fat_size_16 != 0 || fat_size == 0) {
+        return -1;
+    }
+
+    FatInfo *info = (FatInfo *)allocate(sizeof(FatInfo));
+    if (info == NULL) {
+        return -1;
+    }
+    info->sectors_per_cluster = sectors_per_cluster;
+    info->cluster_size = sectors_per_cluster * SECTOR_SIZE;
+    info->fat_start = reserved;
+    info->data_start = reserved + num_fats * fat_size;
+    info->root_cluster = root_cluster;
+    info->cluster_count = (total_sectors > info->data_start)
+        ? (total_sectors - info->data_start) / sectors_per_cluster : 0;
+    info->fat_cached_sector = 0;
+
+    sb->fs_private = info;
+    if (!fat_valid_cluster(info, root_cluster)) {
+        print_str("fat32: invalid root cluster");
+        print_newline();
+        fat32_put_super(sb);
+        return -1;
+    }
+
+    sb->block_size = info->cluster_size;
+    sb->root_ino = FAT32_ROOT_INO;
+    sb->ops = &fat32_super_ops;
+    return 0;
+}
+
+static const VfsInodeOps fat32_inode_ops = {
+    .readdir = fat32_readdir,
+    .readpage = fat32_readpage,
+};
+
+static const VfsSuperOps fat32_super_ops = {
+    .read_inode = fat32_read_inode,
+    .release_inode = fat32_release_inode,
+    .put_super = fat32_put_super,
+};
@@ -0,0 +1,216 @@
+// fbcon.c - text console on a linear framebuffer
+#include "fbcon.h"
+#include "font.h"
+#include "multiboot2.h"
+#include "paging.h"
+
+// Four 32-bit pixels; byte aligned so unaligned pitches are still fine
+typedef uint32_t pixel_vec __attribute__((vector_size(16), aligned(4)));
+
+static uint8_t *fb_base = 0;
+static uint32_t fb_pitch;
+static uint32_t fb_width;
+static uint32_t fb_height;
+static uint32_t fb_bytes;     // Per pixel: 4 takes the vector path, 2 or 3 the byte path
+static size_t fb_cols;
+static size_t fb_rows;
+
+// The 16 VGA text colours in framebuffer pixel format
+static uint32_t palette[16];
+
+// Pixel masks for every possible font row byte: all ones where the glyph
+// is set, so a cell row is (fg & mask) | (bg & ~mask) in two vector ops
+static pixel_vec glyph_masks[256][2];
+
+static const uint32_t vga_colors_rgb[16] = {
+    0x000000, 0x0000AA, 0x00AA00, 0x00AAAA, 0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
+    0x555555, 0x5555FF, 0x55FF55, 0x55FFFF, 0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF,
+};
+
+static uint32_t pack_channel(uint32_t value, uint8_t position, uint8_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    if (size < 8) {
+        value >>= 8 - size;
+    }
+    return value << position;
+}
+
+static uint32_t pack_color(const Multiboot2FramebufferTag *tag, uint32_t rgb) {
+    return pack_channel((rgb >> 16) & 0xFF, tag->red_field_position, tag->red_mask_size) |
+           pack_channel((rgb >> 8) & 0xFF, tag->green_field_position, tag->green_mask_size) |
+           pack_channel(rgb & 0xFF, tag->blue_field_position, tag->blue_mask_size);
+}
+
+// Stores the low fb_bytes bytes of a packed pixel, little endian
+static inline void put_pixel(uint8_t *out, uint32_t pixel) {
+    if (fb_bytes == 4) {
+        *(uint32_t *)out = pixel;
+        return;
+    }
+    out[0] = (uint8_t)pixel;
+    out[1] = (uint8_t)(pixel >> 8);
+    if (fb_bytes == 3) {
+        out[2] = (uint8_t)(pixel >> 16);
+    }
+}
+
+// 15, 16 and 24-bit modes: no lane-sized pixels, so one pixel at a time
+static void draw_row_bytes(uint8_t *line, const uint8_t *cells, size_t count) {
+    for (int y = 0; y < FBCON_CELL_HEIGHT; y++, line += fb_pitch) {
+        int font_row = y * FONT_HEIGHT / FBCON_CELL_HEIGHT;
+        uint8_t *out = line;
+        for (size_t col = 0; col < count; col++) {
+            uint8_t attribute = cells[col * 2 + 1];
+            uint32_t foreground = palette[attribute & 0x0F];
+            uint32_t background = palette[(attribute >> 4) & 0x0F];
+            uint8_t bits = font8x8[cells[col * 2] & 0x7F][font_row];
+            for (int x = 0; x < FBCON_CELL_WIDTH; x++, out += fb_bytes) {
+                put_pixel(out, (bits & (1 << x)) ? foreground : background);
+            }
+        }
+    }
+}
+
+int fbcon_init(void) {
+    const Multiboot2FramebufferTag *tag =
+        (const Multiboot2FramebufferTag *)multiboot2_find_tag(MULTIBOOT2_TAG_FRAMEBUFFER);
+
+    if (fb_base != 0) {
+        return 0;
+    }
+    if (tag == 0 || tag->size < sizeof(Multiboot2FramebufferTag) ||
+        tag->framebuffer_type != MULTIBOOT2_FRAMEBUFFER_RGB ||
+        (tag->framebuffer_bpp != 32 && tag->framebuffer_bpp != 24 && tag->framebuffer_bpp != 16 &&
+         tag->framebuffer_bpp != 15) ||
+        tag->framebuffer_width < 80 * FBCON_CELL_WIDTH || tag->framebuffer_height < 25 * FBCON_CELL_HEIGHT) {
+        return -1;
+    }
+
+    // Write-combined: glyph rows go out as bursts instead of single stores
+    uint8_t *base = (uint8_t *)mmio_map(tag->framebuffer_addr,
+                                        (uint64_t)tag->framebuffer_pitch * tag->framebuffer_height,
+                                        MMIO_WRITE_COMBINING);
+    if (base == 0) {
+        return -1;
+    }
+
+    fb_pitch = tag->framebuffer_pitch;
+    fb_width = tag->framebuffer_width;
+    fb_height = tag->framebuffer_height;
+    fb_bytes = (tag->framebuffer_bpp + 7) / 8;
+    fb_cols = fb_width / FBCON_CELL_WIDTH;
+    fb_rows = fb_height / FBCON_CELL_HEIGHT;
+    if (fb_cols > FBCON_MAX_COLS) {
+        fb_cols = FBCON_MAX_COLS;
+    }
+    if (fb_rows > FBCON_MAX_ROWS) {
+        fb_rows = FBCON_MAX_ROWS;
+    }
+
+    for (int i = 0; i < 16; i++) {
+        palette[i] = pack_color(tag, vga_colors_rgb[i]);
+    }
+    for (int bits = 0; bits < 256; bits++) {
+        uint32_t lanes[8];
+        for (int x = 0; x < 8; x++) {
+            lanes[x] = (bits & (1 << x)) ? 0xFFFFFFFF : 0;
+        }
+        glyph_masks[bits][0] = (pixel_vec){lanes[0], lanes[1], lanes[2], lanes[3]};
+        glyph_masks[bits][1] = (pixel_vec){lanes[4], lanes[5], lanes[6], lanes[7]};
+    }
+
+    // Clear everything once, including margins no text cell covers
+    fb_base = base;
+    for (uint32_t y = 0; y < fb_height; y++) {
+        uint8_t *line = fb_base + (uint64_t)y * fb_pitch;
+        for (uint32_t x = 0; x < fb_width; x++) {
+            put_pixel(line + x * fb_bytes, palette[0]);
+        }
+    }
+    return 0;
+}
+
+int fbcon_available(void) {
+    return fb_base != 0;
+}
+
+void fbcon_geometry(size_t *cols, size_t *rows) {
+    *cols = fb_cols;
+    *rows = fb_rows;
+}
+
+void fbcon_resolution(uint32_t *width, uint32_t *height) {
+    *width = fb_width;
+    *height = fb_height;
+}
+
+/**
+ * fbcon_draw_row - Renders one text row.
+ *
+ * Colours are resolved once per cell; the row is then written one
+ * scanline at a time so the stores to video memory stay sequential.
+ */
+void fbcon_draw_row(size_t row, const uint8_t *cells, size_t count) {
+    // Static: 10 KiB is too much for the boot stack
+    static pixel_vec fg[FBCON_MAX_COLS];
+    static pixel_vec bg[FBCON_MAX_COLS];
+    static const uint8_t *glyphs[FBCON_MAX_COLS];
+
+    if (row >= fb_rows) {
+        return;
+    }
+    if (count > fb_cols) {
+        count = fb_cols;
+    }
+    if (fb_bytes != 4) {
+        draw_row_bytes(fb_base + (uint64_t)row * FBCON_CELL_HEIGHT * fb_pitch, cells, count);
+        return;
+    }
+
+    for (size_t col = 0; col < count; col++) {
+        uint8_t character = cells[col * 2];
+        uint8_t attribute = cells[col * 2 + 1];
+        uint32_t foreground = palette[attribute & 0x0F];
+        uint32_t background = palette[(attribute >> 4) & 0x0F];
+        fg[col] = (pixel_vec){foreground, foreground, foreground, foreground};
+        bg[col] = (pixel_vec){background, background, background, background};
+        glyphs[col] = font8x8[character & 0x7F];
+    }
+
+    uint8_t *line = fb_base + (uint64_t)row * FBCON_CELL_HEIGHT * fb_pitch;
+    for (int y = 0; y < FBCON_CELL_HEIGHT; y++, line += fb_pitch) {
+        pixel_vec *out = (pixel_vec *)line;
+        int font_row = y * FONT_HEIGHT / FBCON_CELL_HEIGHT;
+        for (size_t col = 0; col < count; col++) {
+            const pixel_vec *mask = glyph_masks[glyphs[col][font_row]];
+            out[col * 2] = (fg[col] & mask[0]) | (bg[col] & ~mask[0]);
+            out[col * 2 + 1] = (fg[col] & mask[1]) | (bg[col] & ~mask[1]);
+        }
+    }
+}
+
+// Whole scanline blocks are moved with 16-byte loads and stores
+void fbcon_scroll(size_t rows) {
+    if (rows == 0 || rows >= fb_rows) {
+        return;
+    }
+
+    uint32_t lines = (uint32_t)((fb_rows - rows) * FBCON_CELL_HEIGHT);
+    uint32_t offset = (uint32_t)(rows * FBCON_CELL_HEIGHT);
+    size_t bytes = fb_cols * FBCON_CELL_WIDTH * fb_bytes;
+    size_t vectors = bytes / sizeof(pixel_vec);
+
+    for (uint32_t y = 0; y < lines; y++) {
+        uint8_t *dst = fb_base + (uint64_t)y * fb_pitch;
+        const uint8_t *src = fb_base + (uint64_t)(y + offset) * fb_pitch;
+        for (size_t i = 0; i < vectors; i++) {
+            ((pixel_vec *)dst)[i] = ((const pixel_vec *)src)[i];
+        }
+        // 24-bit rows need not be a whole number of vectors
+        for (size_t i = vectors * sizeof(pixel_vec); i < bytes; i++) {
+            dst[i] = src[i];
+        }
+    }
+}
@@ -2,13 +2,54 @@
 #include "filesystem.h"
 #include "print.h"
 
+#include "timer.h"
+
 #include "port.h" // Assume this contains `outb` and `inb` functions
+#include "pci.h"
+#include "klog.h"
+#include "interrupts.h"
+#include "idle.h"
+#include "paging.h"
+#include "trace.h"
 
 #define ATA_PRIMARY_IO_BASE  0x1F0
 #define ATA_SECONDARY_IO_BASE 0x170
+#define ATA_SECONDARY_CONTROL 0x376
 #define ATA_CMD_IDENTIFY 0xEC
+#define ATA_CMD_IDENTIFY_PACKET 0xA1
 #define SECTOR_SIZE 512
 #define ATA_CMD_WRITE_SECTORS 0x30
+#define ATA_CMD_FLUSH_CACHE 0xE7
+#define ATA_CMD_DATA_SET_MANAGEMENT 0x06
+#define ATA_CMD_READ_DMA_EXT 0x25
+#define ATA_CMD_WRITE_DMA_EXT 0x35
+#define ATA_DSM_TRIM 0x0001
+
+// Bus master IDE registers, relative to BAR4 (+8 for the secondary channel)
+#define BM_COMMAND 0x00
+#define BM_STATUS 0x02
+#define BM_PRDT 0x04
+#define BM_CMD_START 0x01
+#define BM_CMD_TO_MEMORY 0x08
+#define BM_STATUS_ACTIVE 0x01
+#define BM_STATUS_ERROR 0x02
+#define BM_STATUS_IRQ 0x04
+
+#define ATA_PRD_EOT 0x8000
+#define ATA_PRD_ENTRIES 32
+#define ATA_DMA_TIMEOUT_MS 10000
+#define ATA_IDLE_RECHECK_US 10000 // Sleep bound in case a completion IRQ is lost
+#define ATA_PIO_TIMEOUT_MS 10000
+#define ATA_FLUSH_TIMEOUT_MS 30000 // Spin-up plus writing back a full cache
+
+// PCI IDE programming interface bits: channel runs in native PCI mode
+#define IDE_PROG_IF_PRIMARY_NATIVE 0x01
+#define IDE_PROG_IF_SECONDARY_NATIVE 0x04
+
+// TRIM range entries: 48-bit LBA + 16-bit length, 64 per 512-byte block
+#define ATA_DSM_RANGES_PER_BLOCK 64
+#define ATA_DSM_MAX_RANGE 0xFFFF
+#define ATA_DSM_MAX_BLOCKS 8
 
 void read_string_from_identify(uint16_t *identify_buffer, int start, int end, char *output)
 {
@@ -30,78 +71,293 @@ int is_blank_or_whitespace(const char *str)
 }
 
 
-void display_available_disks()
+// Probe state of one ATA channel; both channels advance in the same loop
+typedef enum {
+    PROBE_SELECT,
+    PROBE_WAIT_BSY,
+    PROBE_WAIT_DRQ,
+    PROBE_DONE
+} ProbeState;
+
+typedef struct {
+    int controller;
+    uint16_t io_base;
+    uint16_t control;
+    int drive;                   // Drive currently being probed (0 or 1)
+    ProbeState state;
+    uint64_t start_tsc;
+    uint64_t deadline_tsc;
+} ChannelProbe;
+
+static AtaDevice ata_devices[ATA_MAX_DEVICES];
+static int ata_probed = 0;
+static uint32_t ata_probe_total_us = 0;
+
+// Reading the alternate status register four times gives the 400ns settle delay
+static void ata_select_delay(uint16_t control)
 {
-    print_str("Model / Size / Type");
-    print_newline();
+    for (int i = 0; i < 4; ++i) {
+        inb(control);
+    }
+}
 
+static void ata_trim_model(char *model)
+{
+    int length = 0;
+    while (model[length] != '\0') {
+        length++;
+    }
+    while (length > 0 && model[length - 1] == ' ') {
+        model[--length] = '\0';
+    }
+}
+
+static void probe_finish_device(ChannelProbe *probe, AtaDeviceType type)
+{
+    AtaDevice *device = &ata_devices[probe->controller * 2 + probe->drive];
+    device->type = type;
+    device->probe_us = (uint32_t)timer_elapsed_us(probe->start_tsc);
+
+    if (type == ATA_DEVICE_ATA || type == ATA_DEVICE_ATAPI) {
+        uint16_t *id = device->identify;
+        read_string_from_identify(id, 27, 46, device->model);
+        ata_trim_model(device->model);
+
+        device->lba48 = (type == ATA_DEVICE_ATA) && (id[83] & (1 << 10));
+        if (device->lba48) {
+            device->sector_count = (uint64_t)id[100] | ((uint64_t)id[101] << 16) |
+                                   ((uint64_t)id[102] << 32) | ((uint64_t)id[103] << 48);
+        } else if (type == ATA_DEVICE_ATA) {
+            device->sector_count = (uint32_t)id[60] | ((uint32_t)id[61] << 16);
+        }
+    }
+
+    probe->drive++;
+    probe->state = (probe->drive < 2) ? PROBE_SELECT : PROBE_DONE;
+}
+
+static void probe_issue(ChannelProbe *probe, uint8_t command)
+{
+    outb(probe->io_base + 2, 0);
+    outb(probe->io_base + 3, 0);
+    outb(probe->io_base + 4, 0);
+    outb(probe->io_base + 5, 0);
+    outb(probe->io_base + 7, command);
+}
+
+/**
+ * probe_step - Advances one channel's probe without blocking.
+ *
+ * Every wait is a poll against a TSC deadline, so a silent device costs at
+ * most ATA_PROBE_TIMEOUT_MS and an empty channel costs a couple of port reads.
+ */
+static void probe_step(ChannelProbe *probe, uint64_t timeout_ticks)
+{
+    if (probe->state == PROBE_DONE) {
+        return;
+    }
+
+    AtaDevice *device = &ata_devices[probe->controller * 2 + probe->drive];
     uint8_t status;
-    uint16_t identify_buffer[256];
-    int drive_count = 0;
 
-    for (int controller = 0; controller < 2; ++controller)
-    {
-        uint16_t io_base = (controller == 0) ? ATA_PRIMARY_IO_BASE : ATA_SECONDARY_IO_BASE;
+    switch (probe->state) {
+    case PROBE_SELECT:
+        probe->start_tsc = timer_tsc();
+        probe->deadline_tsc = probe->start_tsc + timeout_ticks;
 
-        for (int drive = 0; drive < 2; ++drive)
-        {
-            // Select drive (0xA0 = Master, 0xB0 = Slave)
-            outb(io_base + 6, 0xA0 | (drive << 4));
+        // Nothing drives an empty channel, so its status floats to 0xFF
+        if (probe->drive == 0 && inb(probe->io_base + 7) == 0xFF) {
+            probe_finish_device(probe, ATA_DEVICE_NONE);
+            probe_finish_device(probe, ATA_DEVICE_NONE);
+            return;
+        }
 
-            // Send IDENTIFY command
-            outb(io_base + 7, ATA_CMD_IDENTIFY);
+        outb(probe->io_base + 6, 0xA0 | (probe->drive << 4));
+        ata_select_delay(probe->control);
+        probe_issue(probe, ATA_CMD_IDENTIFY);
 
-            // Check if the drive exists
-            status = inb(io_base + 7);
-            if (status == 0) continue;
+        status = inb(probe->io_base + 7);
+        if (status == 0 || status == 0xFF) {
+            probe_finish_device(probe, ATA_DEVICE_NONE);
+            return;
+        }
+        probe->state = PROBE_WAIT_BSY;
+        return;
 
-            // Wait for the drive to be ready
-            while ((inb(io_base + 7) & 0x80) != 0); // Wait until BSY is clear
+    case PROBE_WAIT_BSY:
+        status = inb(probe->io_base + 7);
+        if (status & ATA_STATUS_BSY) {
+            break;
+        }
 
-            // Read IDENTIFY data
-            for (int i = 0; i < 256; ++i)
-            {
-                identify_buffer[i] = inw(io_base);
+        // Packet devices abort IDENTIFY and leave their signature in LBA mid/high
+        uint8_t mid = inb(probe->io_base + 4);
+        uint8_t high = inb(probe->io_base + 5);
+        if ((mid == 0x14 && high == 0xEB) || (mid == 0x69 && high == 0x96)) {
+            device->type = ATA_DEVICE_ATAPI;
+            probe_issue(probe, ATA_CMD_IDENTIFY_PACKET);
+            probe->state = PROBE_WAIT_DRQ;
+            return;
+        }
+        if (mid != 0 || high != 0) {
+            probe_finish_device(probe, ATA_DEVICE_UNKNOWN);
+            return;
+        }
+        device->type = ATA_DEVICE_ATA;
+        probe->state = PROBE_WAIT_DRQ;
+        return;
+
+    case PROBE_WAIT_DRQ:
+        status = inb(probe->io_base + 7);
+        if (!(status & ATA_STATUS_BSY)) {
+            if (status & (ATA_STATUS_ERR | ATA_STATUS_DF)) {
+                probe_finish_device(probe, ATA_DEVICE_UNKNOWN);
+                return;
             }
+            if (status & ATA_STATUS_DRQ) {
+                for (int i = 0; i < 256; ++i) {
+                    device->identify[i] = inw(probe->io_base);
+                }
+                probe_finish_device(probe, device->type);
+                return;
+            }
+        }
+        break;
 
-            // Retrieve model number
-            char model[41];
-            read_string_from_identify(identify_buffer, 27, 46, model);
+    case PROBE_DONE:
+        return;
+    }
 
-            // Check if model is empty, if so set to "(Unknown)"
-            if (model[0] == '\0') {
-                print_str("(Unknown)");
-            } else {
-                print_str(model);
-            }
+    if (timer_tsc() > probe->deadline_tsc) {
+        device->timed_out = 1;
+        probe_finish_device(probe, ATA_DEVICE_NONE);
+    }
+}
 
-            // Total sectors and size calculation
-            uint32_t total_sectors = identify_buffer[60] | (identify_buffer[61] << 16);
-            uint64_t total_size_mb = (total_sectors * SECTOR_SIZE) / (1024 * 1024);
+/**
+ * ata_probe_devices - Detects the devices at all four ATA positions.
+ *
+ * The primary and secondary channels are probed concurrently; each one
+ * walks master then slave. Results are cached for ata_get_device().
+ *
+ * @return: Number of ATA (non-packet) disks found.
+ */
+int ata_probe_devices(void)
+{
+    ChannelProbe probes[2] = {
+        {0, ATA_PRIMARY_IO_BASE, ATA_PRIMARY_CONTROL, 0, PROBE_SELECT, 0, 0},
+        {1, ATA_SECONDARY_IO_BASE, ATA_SECONDARY_CONTROL, 0, PROBE_SELECT, 0, 0},
+    };
+    uint64_t timeout_ticks = ATA_PROBE_TIMEOUT_MS * timer_tsc_khz();
+    uint64_t start = timer_tsc();
+
+    for (int i = 0; i < ATA_MAX_DEVICES; ++i) {
+        AtaDevice *device = &ata_devices[i];
+        device->controller = i / 2;
+        device->drive = i % 2;
+        device->type = ATA_DEVICE_NONE;
+        device->lba48 = 0;
+        device->timed_out = 0;
+        device->sector_count = 0;
+        device->probe_us = 0;
+        device->model[0] = '\0';
+    }
 
-            // Determine type abbreviation
-            const char *type;
-            if (controller == 0 && drive == 0) type = "PM";
-            else if (controller == 0 && drive == 1) type = "PS";
-            else if (controller == 1 && drive == 0) type = "SM";
-            else if (controller == 1 && drive == 1) type = "SS";
+    while (probes[0].state != PROBE_DONE || probes[1].state != PROBE_DONE) {
+        probe_step(&probes[0], timeout_ticks);
+        probe_step(&probes[1], timeout_ticks);
+        asm volatile("pause");
+    }
 
-            // Display drive information in requested format
-            print_str("  ");
-            print_int(total_size_mb);
-            print_str(" MB ");
-            print_str(type);
-            print_newline();
+    ata_probe_total_us = (uint32_t)timer_elapsed_us(start);
+    ata_probed = 1;
 
-            drive_count++;
+    int disks = 0;
+    for (int i = 0; i < ATA_MAX_DEVICES; ++i) {
+        if (ata_devices[i].type == ATA_DEVICE_ATA) {
+            disks++;
         }
     }
+    return disks;
+}
+
+// Cached result for position `index` (controller * 2 + drive), probing on first use
+const AtaDevice *ata_get_device(int index)
+{
+    if (!ata_probed) {
+        ata_probe_devices();
+    }
+    if (index < 0 || index >= ATA_MAX_DEVICES) {
+        return 0;
+    }
+    return &ata_devices[index];
+}
+
+uint32_t ata_probe_time_us(void)
+{
+    return ata_probe_total_us;
+}
+
+void display_available_disks()
+{
+    static const char *positions[ATA_MAX_DEVICES] = {"PM", "PS", "SM", "SS"};
+    int drive_count = 0;
+
+    print_str("Model / Size / Type / Probe time");
+    print_newline();
+
+    for (int i = 0; i < ATA_MAX_DEVICES; ++i)
+    {
+        const AtaDevice *device = ata_get_device(i);
+        if (device->type == ATA_DEVICE_NONE)
+        {
+            if (device->timed_out)
+            {
+                print_str("(no response)  ");
+                print_str((char *)positions[i]);
+                print_str(" timed out after ");
+                print_int(device->probe_us / 1000);
+                print_str(" ms");
+                print_newline();
+            }
+            continue;
+        }
+
+        // Check if model is empty, if so set to "(Unknown)"
+        if (device->model[0] == '\0') {
+            print_str("(Unknown)");
+        } else {
+            print_str((char *)device->model);
+        }
+
+        print_str("  ");
+        if (device->type == ATA_DEVICE_ATA)
+        {
+            print_int(device->sector_count / (1024 * 1024 / SECTOR_SIZE));
+            print_str(" MB ");
+        }
+        else
+        {
+            print_str(device->type == ATA_DEVICE_ATAPI ? "ATAPI " : "unsupported ");
+        }
+        print_str((char *)positions[i]);
+        print_str(" ");
+        print_int(device->probe_us);
+        print_str(" us");
+        print_newline();
+
+        drive_count++;
+    }
 
     if (drive_count == 0)
     {
         print_str("No drives found.");
         print_newline();
     }
+    print_str("Probe took ");
+    print_int(ata_probe_total_us);
+    print_str(" us");
+    print_newline();
 }
 
 void init_filesystem()
@@ -111,6 +367,46 @@ void init_filesystem()
     // We could check if the drive is present or ready here.
 }
 
+/**
+ * ata_wait_status - Waits for BSY to clear and every bit of `want` to be set.
+ *
+ * PIO data blocks and non-data commands such as FLUSH CACHE raise INTRQ
+ * just like DMA, so where the channel's interrupt is wired the CPU sleeps
+ * between checks as in ata_dma_wait(); otherwise it spins. ERR or DF end
+ * the wait early.
+ *
+ * @return: The final status register, or -1 after `timeout_ms`.
+ */
+static int ata_wait_status(int controller, uint8_t want, uint32_t timeout_ms)
+{
+    uint16_t io_base = (controller == 0) ? ATA_PRIMARY_IO_BASE : ATA_SECONDARY_IO_BASE;
+    int sleep = ata_dma_irq_available(controller);
+    uint64_t deadline = timer_tsc() + timeout_ms * timer_tsc_khz();
+
+    while (1) {
+        uint64_t flags = irq_save();
+        uint8_t status = inb(io_base + 7);
+        if (!(status & ATA_STATUS_BSY) && ((status & want) == want || (status & (ATA_STATUS_ERR | ATA_STATUS_DF)))) {
+            irq_restore(flags);
+            return status;
+        }
+
+        uint64_t now = timer_tsc();
+        if (now > deadline) {
+            irq_restore(flags);
+            klog_value(KLOG_ERROR, "ata: drive timed out, status", status);
+            return -1;
+        }
+        if (sleep) {
+            uint64_t recheck = now + ATA_IDLE_RECHECK_US * timer_tsc_khz() / 1000;
+            idle_wait(flags, recheck < deadline ? recheck : deadline);
+        } else {
+            irq_restore(flags);
+            asm volatile("pause");
+        }
+    }
+}
+
 int ata_write_sector(uint32_t lba, const uint8_t *buffer) {
     // Select drive and head
     outb(ATA_PRIMARY_IO_BASE + 6, 0xE0 | ((lba >> 24) & 0x0F)); // Master, LBA mode
@@ -120,14 +416,14 @@ int ata_write_sector(uint32_t lba, const uint8_t *buffer) {
     outb(ATA_PRIMARY_IO_BASE + 5, (uint8_t)(lba >> 16));        // LBA high byte
     outb(ATA_PRIMARY_IO_BASE + 7, ATA_CMD_WRITE_SECTORS);       // Send write command
 
-    // Wait for the drive to be ready (clear BSY)
-    while (inb(ATA_PRIMARY_IO_BASE + 7) & 0x80) {
-        // Busy waiting until BSY flag is cleared
+    // Wait for the drive to ask for the data
+    if (ata_wait_status(0, ATA_STATUS_DRQ, ATA_PIO_TIMEOUT_MS) < 0) {
+        return -1;
     }
 
     // Check for any errors before writing
     if (inb(ATA_PRIMARY_IO_BASE + 7) & 0x01) {  // ERR bit
-        print_str("Error: Disk reported an error before writing.");
+        klog_value(KLOG_ERROR, "ata: error status before write, LBA", lba);
         return -1;
     }
 
@@ -137,14 +433,14 @@ int ata_write_sector(uint32_t lba, const uint8_t *buffer) {
         outw(ATA_PRIMARY_IO_BASE, word);  // Write 16 bits (2 bytes) at a time
     }
 
-    // Wait for the drive to finish the write (check DRQ and BSY flags)
-    while (inb(ATA_PRIMARY_IO_BASE + 7) & 0x80) {
-        // Wait until BSY is cleared
+    // Wait for the drive to finish the write
+    if (ata_wait_status(0, 0, ATA_PIO_TIMEOUT_MS) < 0) {
+        return -1;
     }
 
     // Check for errors after the write
     if (inb(ATA_PRIMARY_IO_BASE + 7) & 0x01) {  // ERR bit
-        print_str("Error: Disk reported an error after writing.");
+        klog_value(KLOG_ERROR, "ata: write failed, LBA", lba);
         return -1;
     }
 
@@ -163,12 +459,14 @@ int ata_write_sector_disk(int controller, int drive, uint32_t lba, const uint8_t
     outb(io_base + 5, (uint8_t)(lba >> 16));        // LBA high byte
     outb(io_base + 7, ATA_CMD_WRITE_SECTORS);       // Send write command
 
-    // Wait for the drive to be ready (clear BSY)
-    while (inb(io_base + 7) & 0x80);
+    // Wait for the drive to ask for the data
+    if (ata_wait_status(controller, ATA_STATUS_DRQ, ATA_PIO_TIMEOUT_MS) < 0) {
+        return -1;
+    }
 
     // Check for any errors before writing
     if (inb(io_base + 7) & 0x01) {  // ERR bit
-        print_str("Error: Disk reported an error before writing.");
+        klog_value(KLOG_ERROR, "ata: error status before write, LBA", lba);
         return -1;
     }
 
@@ -178,12 +476,14 @@ int ata_write_sector_disk(int controller, int drive, uint32_t lba, const uint8_t
         outw(io_base, word);  // Write 16 bits (2 bytes) at a time
     }
 
-    // Wait for the drive to finish the write (check DRQ and BSY flags)
-    while (inb(io_base + 7) & 0x80);
+    // Wait for the drive to finish the write
+    if (ata_wait_status(controller, 0, ATA_PIO_TIMEOUT_MS) < 0) {
+        return -1;
+    }
 
     // Check for errors after the write
     if (inb(io_base + 7) & 0x01) {  // ERR bit
-        print_str("Error: Disk reported an error after writing.");
+        klog_value(KLOG_ERROR, "ata: write failed, LBA", lba);
         return -1;
     }
 
@@ -202,12 +502,14 @@ int ata_read_sector_disk(int controller, int drive, uint32_t lba, uint8_t *buffe
     outb(io_base + 5, (uint8_t)(lba >> 16));        // LBA high byte
     outb(io_base + 7, ATA_CMD_READ_SECTORS);        // Send read command
 
-    // Wait for the drive to be ready (clear BSY)
-    while (inb(io_base + 7) & 0x80);
+    // Wait for the sector to be ready
+    if (ata_wait_status(controller, ATA_STATUS_DRQ, ATA_PIO_TIMEOUT_MS) < 0) {
+        return -1;
+    }
 
     // Check for errors before reading
     if (inb(io_base + 7) & 0x01) {  // ERR bit
-        print_str("Error reading from disk.");
+        klog_value(KLOG_ERROR, "ata: read failed, LBA", lba);
         return -1;
     }
 
@@ -222,6 +524,403 @@ int ata_read_sector_disk(int controller, int drive, uint32_t lba, uint8_t *buffe
 }
 
 
+// Waits for BSY to clear and DRQ to assert; returns -1 on ERR, DF or timeout
+static int ata_wait_drq(int controller)
+{
+    int status = ata_wait_status(controller, ATA_STATUS_DRQ, ATA_PIO_TIMEOUT_MS);
+    return (status < 0 || (status & (ATA_STATUS_ERR | ATA_STATUS_DF))) ? -1 : 0;
+}
+
+// Issues a 28-bit LBA command covering up to 256 sectors (count 0 means 256)
+static void ata_issue_lba28(uint16_t io_base, int drive, uint32_t lba, uint8_t count, uint8_t command)
+{
+    outb(io_base + 6, 0xE0 | ((drive << 4) & 0x10) | ((lba >> 24) & 0x0F));
+    outb(io_base + 2, count);
+    outb(io_base + 3, (uint8_t)lba);
+    outb(io_base + 4, (uint8_t)(lba >> 8));
+    outb(io_base + 5, (uint8_t)(lba >> 16));
+    outb(io_base + 7, command);
+}
+
+// Reads `count` consecutive sectors with as few commands as possible
+int ata_read_sectors_disk(int controller, int drive, uint32_t lba, uint32_t count, uint8_t *buffer) {
+    TRACE_SCOPE("ata:read", count);
+    uint16_t io_base = (controller == 0) ? ATA_PRIMARY_IO_BASE : ATA_SECONDARY_IO_BASE;
+
+    while (count > 0) {
+        uint32_t chunk = (count > 256) ? 256 : count;
+        ata_issue_lba28(io_base, drive, lba, (uint8_t)chunk, ATA_CMD_READ_SECTORS);
+
+        for (uint32_t s = 0; s < chunk; ++s) {
+            if (ata_wait_drq(controller) != 0) {
+                klog_value(KLOG_ERROR, "ata: read failed, LBA", lba);
+                return -1;
+            }
+            uint16_t *words = (uint16_t *)(buffer + s * SECTOR_SIZE);
+            for (int i = 0; i < SECTOR_SIZE / 2; ++i) {
+                words[i] = inw(io_base);
+            }
+        }
+
+        lba += chunk;
+        count -= chunk;
+        buffer += chunk * SECTOR_SIZE;
+    }
+    return 0;
+}
+
+// Writes `count` consecutive sectors as one sequential stream
+int ata_write_sectors_disk(int controller, int drive, uint32_t lba, uint32_t count, const uint8_t *buffer) {
+    TRACE_SCOPE("ata:write", count);
+    uint16_t io_base = (controller == 0) ? ATA_PRIMARY_IO_BASE : ATA_SECONDARY_IO_BASE;
+
+    while (count > 0) {
+        uint32_t chunk = (count > 256) ? 256 : count;
+        ata_issue_lba28(io_base, drive, lba, (uint8_t)chunk, ATA_CMD_WRITE_SECTORS);
+
+        for (uint32_t s = 0; s < chunk; ++s) {
+            if (ata_wait_drq(controller) != 0) {
+                klog_value(KLOG_ERROR, "ata: error status before write, LBA", lba);
+                return -1;
+            }
+            const uint16_t *words = (const uint16_t *)(buffer + s * SECTOR_SIZE);
+            for (int i = 0; i < SECTOR_SIZE / 2; ++i) {
+                outw(io_base, words[i]);
+            }
+        }
+
+        // Wait for the last sector to be accepted
+        int status = ata_wait_status(controller, 0, ATA_PIO_TIMEOUT_MS);
+        if (status < 0 || (status & (ATA_STATUS_ERR | ATA_STATUS_DF))) {
+            klog_value(KLOG_ERROR, "ata: write failed, LBA", lba);
+            return -1;
+        }
+
+        lba += chunk;
+        count -= chunk;
+        buffer += chunk * SECTOR_SIZE;
+    }
+    return 0;
+}
+
+// Commits the drive's volatile write cache to media
+int ata_flush_disk(int controller, int drive) {
+    TRACE_SCOPE("ata:flush", drive);
+    uint16_t io_base = (controller == 0) ? ATA_PRIMARY_IO_BASE : ATA_SECONDARY_IO_BASE;
+
+    outb(io_base + 6, 0xE0 | ((drive << 4) & 0x10));
+    outb(io_base + 7, ATA_CMD_FLUSH_CACHE);
+
+    int status = ata_wait_status(controller, 0, ATA_FLUSH_TIMEOUT_MS);
+    if (status < 0 || (status & ATA_STATUS_ERR)) {
+        klog(KLOG_ERROR, "ata: cache flush failed");
+        return -1;
+    }
+    return 0;
+}
+
+
+
+// Physical Region Descriptor; addresses go through virt_to_phys()
+typedef struct {
+    uint32_t address;
+    uint16_t byte_count;         // 0 means 64 KiB
+    uint16_t flags;
+} __attribute__((packed)) AtaPrd;
+
+static AtaPrd ata_prd_tables[2][ATA_PRD_ENTRIES] __attribute__((aligned(4096)));
+static uint64_t ata_dsm_ranges[ATA_DSM_MAX_BLOCKS * ATA_DSM_RANGES_PER_BLOCK] __attribute__((aligned(4096)));
+static uint16_t ata_bm_base = 0;
+static int ata_bm_checked = 0;
+static int ata_irq_wired[2];
+
+// Reading the status register deasserts INTRQ; completion itself is
+// collected by ata_dma_poll()
+static void ata_primary_irq(InterruptFrame *frame)
+{
+    (void)frame;
+    inb(ATA_PRIMARY_IO_BASE + 7);
+}
+
+static void ata_secondary_irq(InterruptFrame *frame)
+{
+    (void)frame;
+    inb(ATA_SECONDARY_IO_BASE + 7);
+}
+
+// Locates the PCI IDE function once and enables bus mastering on it
+static uint16_t ata_bus_master(int controller)
+{
+    if (!ata_bm_checked) {
+        PciDevice ide;
+        ata_bm_checked = 1;
+        if (pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &ide) == 0 && (ide.prog_if & 0x80)) {
+            uint32_t bar4 = pci_config_read32(ide.bus, ide.slot, ide.function, PCI_BAR4);
+            if (bar4 & 1) {
+                ata_bm_base = bar4 & 0xFFFC;
+                pci_enable(&ide, PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+                klog_value(KLOG_INFO, "ata: bus-master DMA at I/O port", ata_bm_base);
+
+                // Channels in compatibility mode interrupt on the legacy lines
+                if (!(ide.prog_if & IDE_PROG_IF_PRIMARY_NATIVE)) {
+                    irq_register(IRQ_ATA_PRIMARY, ata_primary_irq);
+                    ata_irq_wired[0] = 1;
+                }
+                if (!(ide.prog_if & IDE_PROG_IF_SECONDARY_NATIVE)) {
+                    irq_register(IRQ_ATA_SECONDARY, ata_secondary_irq);
+                    ata_irq_wired[1] = 1;
+                }
+            }
+        }
+    }
+    return ata_bm_base ? ata_bm_base + controller * 8 : 0;
+}
+
+int ata_dma_available(int controller)
+{
+    return ata_bus_master(controller) != 0;
+}
+
+int ata_dma_irq_available(int controller)
+{
+    return ata_bus_master(controller) != 0 && ata_irq_wired[controller];
+}
+
+// Splits `buffer` into PRD entries that never cross a 64 KiB boundary
+static int ata_build_prdt(int controller, const void *buffer, uint32_t bytes)
+{
+    AtaPrd *prdt = ata_prd_tables[controller];
+    uint64_t address = virt_to_phys(buffer);
+    int entries = 0;
+
+    // Demand-paged VMM buffers are scattered, may not be present yet and
+    // may share read-only frames, so only linear mappings are accepted
+    if (!paging_phys_contiguous(buffer, bytes) || address + bytes > 0x100000000ULL || (address & 1) || (bytes & 1) || bytes == 0) {
+        return -1;
+    }
+    while (bytes > 0) {
+        uint32_t chunk = 0x10000 - (uint32_t)(address & 0xFFFF);
+        if (chunk > bytes) {
+            chunk = bytes;
+        }
+        if (entries == ATA_PRD_ENTRIES) {
+            return -1;
+        }
+        prdt[entries].address = (uint32_t)address;
+        prdt[entries].byte_count = (uint16_t)chunk;
+        prdt[entries].flags = 0;
+        entries++;
+        address += chunk;
+        bytes -= chunk;
+    }
+    prdt[entries - 1].flags = ATA_PRD_EOT;
+    return 0;
+}
+
+// One command in flight per channel; the deadline is armed by ata_dma_start()
+static uint64_t ata_dma_deadline[2];
+static int ata_dma_active[2];
+
+/**
+ * ata_dma_start - Issues one 48-bit DMA command and returns immediately.
+ *
+ * `to_memory` selects the transfer direction (device -> buffer). The buffer
+ * must sit below 4 GiB physical. Completion is collected with ata_dma_poll().
+ * Fails if the drive is still busy ATA_PROBE_TIMEOUT_MS after selection.
+ */
+static int ata_dma_start(int controller, int drive, uint8_t command, uint16_t features,
+                         uint64_t lba, uint16_t count, void *buffer, uint32_t bytes, int to_memory)
+{
+    uint16_t io_base = (controller == 0) ? ATA_PRIMARY_IO_BASE : ATA_SECONDARY_IO_BASE;
+    uint16_t bm = ata_bus_master(controller);
+    uint8_t direction = to_memory ? BM_CMD_TO_MEMORY : 0;
+
+    if (bm == 0 || ata_dma_active[controller] || ata_build_prdt(controller, buffer, bytes) != 0) {
+        return -1;
+    }
+
+    outb(bm + BM_COMMAND, direction);
+    outl(bm + BM_PRDT, (uint32_t)virt_to_phys(ata_prd_tables[controller]));
+    outb(bm + BM_STATUS, inb(bm + BM_STATUS) | BM_STATUS_ERROR | BM_STATUS_IRQ);
+
+    // High-order bytes go in first, then the low-order bytes
+    outb(io_base + 6, 0x40 | ((drive << 4) & 0x10));
+    uint64_t deadline = timer_tsc() + ATA_PROBE_TIMEOUT_MS * timer_tsc_khz();
+    while (inb(io_base + 7) & ATA_STATUS_BSY) {
+        if (timer_tsc() > deadline) {
+            klog(KLOG_ERROR, "ata: drive stayed busy, DMA command not issued");
+            return -1;
+        }
+        asm volatile("pause");
+    }
+    outb(io_base + 1, (uint8_t)(features >> 8));
+    outb(io_base + 2, (uint8_t)(count >> 8));
+    outb(io_base + 3, (uint8_t)(lba >> 24));
+    outb(io_base + 4, (uint8_t)(lba >> 32));
+    outb(io_base + 5, (uint8_t)(lba >> 40));
+    outb(io_base + 1, (uint8_t)features);
+    outb(io_base + 2, (uint8_t)count);
+    outb(io_base + 3, (uint8_t)lba);
+    outb(io_base + 4, (uint8_t)(lba >> 8));
+    outb(io_base + 5, (uint8_t)(lba >> 16));
+    outb(io_base + 7, command);
+    outb(bm + BM_COMMAND, direction | BM_CMD_START);
+
+    ata_dma_deadline[controller] = timer_tsc() + ATA_DMA_TIMEOUT_MS * timer_tsc_khz();
+    ata_dma_active[controller] = 1;
+    return 0;
+}
+
+/**
+ * ata_dma_poll - Checks the command started on `controller`.
+ *
+ * Bus master completion and the ATA status are both checked, and the
+ * engine is stopped once the command is over.
+ *
+ * @return: 1 while running, 0 on success, -1 on error or timeout.
+ */
+int ata_dma_poll(int controller)
+{
+    uint16_t io_base = (controller == 0) ? ATA_PRIMARY_IO_BASE : ATA_SECONDARY_IO_BASE;
+    uint16_t bm = ata_bus_master(controller);
+
+    if (!ata_dma_active[controller]) {
+        return 0;
+    }
+
+    uint8_t bm_status = inb(bm + BM_STATUS);
+    uint8_t status = inb(io_base + 7);
+    if (!((bm_status & BM_STATUS_IRQ) || !(bm_status & BM_STATUS_ACTIVE)) || (status & ATA_STATUS_BSY)) {
+        if (timer_tsc() <= ata_dma_deadline[controller]) {
+            return 1;
+        }
+        outb(bm + BM_COMMAND, 0);
+        ata_dma_active[controller] = 0;
+        klog(KLOG_ERROR, "ata: DMA command timed out");
+        return -1;
+    }
+
+    outb(bm + BM_COMMAND, 0);
+    outb(bm + BM_STATUS, bm_status | BM_STATUS_ERROR | BM_STATUS_IRQ);
+    ata_dma_active[controller] = 0;
+    if ((bm_status & BM_STATUS_ERROR) || (status & (ATA_STATUS_ERR | ATA_STATUS_DF))) {
+        return -1;
+    }
+    return 0;
+}
+
+// Sleeps until the channel interrupts when it can, spins otherwise
+int ata_dma_wait(int controller)
+{
+    TRACE_SCOPE("ata:dma_wait", controller);
+    int sleep = ata_dma_irq_available(controller);
+    while (1) {
+        uint64_t flags = irq_save();
+        int result = ata_dma_poll(controller);
+        if (result != 1) {
+            irq_restore(flags);
+            return result;
+        }
+        if (sleep) {
+            idle_wait(flags, timer_tsc() + ATA_IDLE_RECHECK_US * timer_tsc_khz() / 1000);
+        } else {
+            irq_restore(flags);
+            asm volatile("pause");
+        }
+    }
+}
+
+static int ata_dma_command(int controller, int drive, uint8_t command, uint16_t features,
+                           uint64_t lba, uint16_t count, void *buffer, uint32_t bytes, int to_memory)
+{
+    if (ata_dma_start(controller, drive, command, features, lba, count, buffer, bytes, to_memory) != 0) {
+        return -1;
+    }
+    return ata_dma_wait(controller);
+}
+
+int ata_dma_rw_supported(int controller, int drive)
+{
+    const AtaDevice *device = ata_get_device(controller * 2 + drive);
+    return device != 0 && device->type == ATA_DEVICE_ATA && device->lba48 && ata_dma_available(controller);
+}
+
+// Starts READ/WRITE DMA EXT for up to ATA_DMA_MAX_SECTORS; finish with ata_dma_poll()
+int ata_dma_start_rw(int controller, int drive, uint64_t lba, uint32_t count, uint8_t *buffer, int write)
+{
+    TRACE_INSTANT("ata:dma_start", count);
+    if (count == 0 || count > ATA_DMA_MAX_SECTORS || !ata_dma_rw_supported(controller, drive)) {
+        return -1;
+    }
+    return ata_dma_start(controller, drive, write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT, 0,
+                         lba, (uint16_t)count, buffer, count * SECTOR_SIZE, !write);
+}
+
+// IDENTIFY word 169 bit 0 advertises DATA SET MANAGEMENT with the TRIM bit
+int ata_trim_supported(int controller, int drive)
+{
+    const AtaDevice *device = ata_get_device(controller * 2 + drive);
+    if (device == 0 || device->type != ATA_DEVICE_ATA || !device->lba48) {
+        return 0;
+    }
+    return (device->identify[169] & 1) && ata_dma_available(controller);
+}
+
+// Word 69: bit 14 = deterministic data after TRIM, bit 5 = that data reads as zeros
+int ata_trim_zeroes(int controller, int drive)
+{
+    if (!ata_trim_supported(controller, drive)) {
+        return 0;
+    }
+    uint16_t word = ata_get_device(controller * 2 + drive)->identify[69];
+    return (word & (1 << 14)) && (word & (1 << 5));
+}
+
+/**
+ * ata_trim_disk - Discards `count` sectors starting at `lba`.
+ *
+ * The range is cut into 65535-sector entries, and as many 512-byte range
+ * blocks as the drive accepts (IDENTIFY word 105) go out per command, so a
+ * whole disk is trimmed in a handful of commands instead of one per range.
+ */
+int ata_trim_disk(int controller, int drive, uint64_t lba, uint64_t count)
+{
+    const AtaDevice *device = ata_get_device(controller * 2 + drive);
+    uint32_t max_blocks;
+
+    if (!ata_trim_supported(controller, drive)) {
+        return -1;
+    }
+    max_blocks = device->identify[105] ? device->identify[105] : 1;
+    if (max_blocks > ATA_DSM_MAX_BLOCKS) {
+        max_blocks = ATA_DSM_MAX_BLOCKS;
+    }
+
+    while (count > 0) {
+        uint32_t ranges = 0;
+        while (count > 0 && ranges < max_blocks * ATA_DSM_RANGES_PER_BLOCK) {
+            uint64_t length = (count > ATA_DSM_MAX_RANGE) ? ATA_DSM_MAX_RANGE : count;
+            ata_dsm_ranges[ranges++] = (lba & 0xFFFFFFFFFFFFULL) | (length << 48);
+            lba += length;
+            count -= length;
+        }
+
+        // Unused entries in the last block must have a zero length
+        uint32_t blocks = (ranges + ATA_DSM_RANGES_PER_BLOCK - 1) / ATA_DSM_RANGES_PER_BLOCK;
+        while (ranges < blocks * ATA_DSM_RANGES_PER_BLOCK) {
+            ata_dsm_ranges[ranges++] = 0;
+        }
+
+        if (ata_dma_command(controller, drive, ATA_CMD_DATA_SET_MANAGEMENT, ATA_DSM_TRIM, 0,
+                            (uint16_t)blocks, ata_dsm_ranges, blocks * SECTOR_SIZE, 0) != 0) {
+            klog(KLOG_ERROR, "ata: drive rejected DATA SET MANAGEMENT (TRIM)");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
 int ata_read_sector(uint32_t lba, uint8_t *buffer)
 {
     // Select drive and head
@@ -239,7 +938,7 @@ int ata_read_sector(uint32_t lba, uint8_t *buffer)
     // Check for errors
     if (inb(ATA_PRIMARY_IO_BASE + 7) & 0x01)
     { // ERR bit
-        print_str("Error reading from disk.");
+        klog_value(KLOG_ERROR, "ata: read failed, LBA", lba);
         return -1;
     }
 
@@ -0,0 +1,65 @@
+// histogram.c
+#include "histogram.h"
+#include "memory.h"
+
+static uint32_t bucket_index(uint64_t value) {
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return (uint32_t)value;
+    }
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - HISTOGRAM_SUB_BITS;
+    return (uint32_t)(shift + 1) * HISTOGRAM_SUB_BUCKETS +
+           (uint32_t)((value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+// Largest value that still lands in bucket `index`
+static uint64_t bucket_upper(uint32_t index) {
+    if (index < HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+    int shift = (int)(index / HISTOGRAM_SUB_BUCKETS) - 1;
+    uint64_t sub = HISTOGRAM_SUB_BUCKETS + (index % HISTOGRAM_SUB_BUCKETS);
+    return ((sub + 1) << shift) - 1;
+}
+
+void histogram_reset(Histogram *hist) {
+    memory_zero(hist, sizeof(Histogram));
+    hist->min = ~0ULL;
+}
+
+void histogram_record(Histogram *hist, uint64_t value) {
+    hist->buckets[bucket_index(value)]++;
+    hist->count++;
+    hist->sum += value;
+    if (value < hist->min) {
+        hist->min = value;
+    }
+    if (value > hist->max) {
+        hist->max = value;
+    }
+}
+
+uint64_t histogram_percentile(const Histogram *hist, uint32_t permille) {
+    if (hist->count == 0) {
+        return 0;
+    }
+    // Rank of the sample we want, rounded up so p100 is the last one
+    uint64_t rank = (hist->count * permille + 999) / 1000;
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            uint64_t value = bucket_upper(i);
+            return (value > hist->max) ? hist->max : value;
+        }
+    }
+    return hist->max;
+}
+
+uint64_t histogram_mean(const Histogram *hist) {
+    return hist->count ? hist->sum / hist->count : 0;
+}
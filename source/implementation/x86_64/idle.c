@@ -0,0 +1,66 @@
+// idle.c - Sleeping the CPU while there is nothing to do
+#include "idle.h"
+#include "interrupts.h"
+#include "timer.h"
+
+#define CPUID_ECX_MONITOR (1 << 3)
+
+static int use_mwait = 0;
+static uint64_t init_tsc = 0;
+static uint64_t sleeps = 0;
+static uint64_t deadline_sleeps = 0;
+static uint64_t idle_tsc = 0;
+
+// Address armed with MONITOR; nothing writes it, interrupts end the wait
+static volatile uint64_t monitor_line __attribute__((aligned(64)));
+
+void idle_init(void) {
+    uint32_t eax = 1, ebx, ecx = 0, edx;
+    asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+    use_mwait = (ecx & CPUID_ECX_MONITOR) != 0;
+    init_tsc = timer_tsc();
+}
+
+void idle_wait(uint64_t flags, uint64_t deadline_tsc) {
+    if (!(flags & RFLAGS_IF)) {
+        asm volatile("pause");
+        return;
+    }
+    if (deadline_tsc != 0) {
+        if (timer_tsc() >= deadline_tsc) {
+            irq_restore(flags);
+            return;
+        }
+        timer_set_deadline(deadline_tsc);
+        deadline_sleeps++;
+    }
+
+    uint64_t start = timer_tsc();
+    // sti holds off interrupts for one more instruction, so the sleep is
+    // entered before any pending interrupt is delivered
+    if (use_mwait) {
+        asm volatile("monitor" : : "a"(&monitor_line), "c"(0), "d"(0));
+        asm volatile("sti; mwait" : : "a"(0), "c"(0) : "memory");
+    } else {
+        interrupts_enable_and_halt();
+    }
+
+    // Interrupts are on again; account for the sleep without racing them
+    interrupts_disable();
+    idle_tsc += timer_tsc() - start;
+    sleeps++;
+    if (deadline_tsc != 0) {
+        timer_set_deadline(0);
+    }
+    interrupts_enable();
+}
+
+void idle_get_stats(IdleStats *stats) {
+    uint64_t flags = irq_save();
+    stats->sleeps = sleeps;
+    stats->deadline_sleeps = deadline_sleeps;
+    stats->idle_tsc = idle_tsc;
+    stats->total_tsc = timer_tsc() - init_tsc;
+    stats->mwait = use_mwait;
+    irq_restore(flags);
+}
@@ -0,0 +1,510 @@
+// initramfs.c - read-only cpio (newc) / tar archive filesystem for the VFS
+#include "initramfs.h"
+#include "vfs.h"
+#include "ramdisk.h"
+#include "multiboot2.h"
+#include "print.h"
+#include "string.h"
+#include "memory.h"
+#include "memory_allocator.h"
+#include "filesystem.h"
+
+#define RAMFS_ROOT_INO      1
+#define RAMFS_NONE          0xFFFFFFFF
+#define RAMFS_COOKIE_END    0xFFFFFFFFFFFFFFFFULL
+
+#define CPIO_HEADER_SIZE    110
+#define TAR_BLOCK_SIZE      512
+#define TAR_PATH_MAX        256
+
+typedef enum {
+    ARCHIVE_CPIO,
+    ARCHIVE_TAR
+} ArchiveFormat;
+
+typedef struct {
+    uint8_t *base;
+    uint64_t length;
+    uint64_t offset;
+    ArchiveFormat format;
+    const char *long_name;       // GNU tar 'L' record for the next header
+    uint32_t long_name_length;
+    char path[TAR_PATH_MAX];     // tar prefix + name joined here
+} ArchiveReader;
+
+typedef struct {
+    const char *path;            // Not NUL-terminated
+    uint32_t path_length;
+    uint32_t mode;
+    uint32_t mtime;
+    uint64_t size;
+    uint8_t *data;               // Points into the archive
+} ArchiveEntry;
+
+typedef struct {
+    const char *name;            // NUL-terminated, in the name pool
+    uint32_t mode;
+    uint32_t mtime;
+    uint64_t size;
+    uint8_t *data;               // File contents inside the archive (zero-copy)
+    uint32_t first_child;
+    uint32_t last_child;
+    uint32_t next_sibling;
+} RamfsNode;
+
+typedef struct {
+    RamfsNode *nodes;            // nodes[0] is the root; inode number = index + 1
+    uint32_t count;
+    uint32_t capacity;
+    char *names;
+    uint32_t names_used;
+    uint32_t names_capacity;
+} RamfsInfo;
+
+static const VfsInodeOps ramfs_inode_ops;
+static const VfsSuperOps ramfs_super_ops;
+
+static uint64_t parse_hex(const uint8_t *field, int length) {
+    uint64_t value = 0;
+    for (int i = 0; i < length; i++) {
+        uint8_t c = field[i];
+        uint8_t digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else {
+            return ~0ULL;
+        }
+        value = (value << 4) | digit;
+    }
+    return value;
+}
+
+// Octal numbers in tar headers may be space or NUL terminated
+static uint64_t parse_octal(const uint8_t *field, int length) {
+    uint64_t value = 0;
+    int i = 0;
+    while (i < length && field[i] == ' ') {
+        i++;
+    }
+    for (; i < length && field[i] >= '0' && field[i] <= '7'; i++) {
+        value = (value << 3) | (uint64_t)(field[i] - '0');
+    }
+    return value;
+}
+
+static uint32_t field_length(const uint8_t *field, uint32_t max) {
+    uint32_t length = 0;
+    while (length < max && field[length] != '\0') {
+        length++;
+    }
+    return length;
+}
+
+static int archive_detect(uint8_t *base, uint64_t length, ArchiveFormat *format) {
+    if (length >= CPIO_HEADER_SIZE && memory_compare(base, "07070", 5) == 0 &&
+        (base[5] == '1' || base[5] == '2')) {
+        *format = ARCHIVE_CPIO;
+        return 0;
+    }
+    if (length >= TAR_BLOCK_SIZE && memory_compare(base + 257, "ustar", 5) == 0) {
+        *format = ARCHIVE_TAR;
+        return 0;
+    }
+    return -1;
+}
+
+static int cpio_next(ArchiveReader *reader, ArchiveEntry *entry) {
+    uint64_t offset = reader->offset;
+    if (offset + CPIO_HEADER_SIZE > reader->length) {
+        return -1;
+    }
+    const uint8_t *header = reader->base + offset;
+    if (memory_compare(header, "07070", 5) != 0) {
+        return -1;
+    }
+
+    uint64_t mode = parse_hex(header + 14, 8);
+    uint64_t mtime = parse_hex(header + 46, 8);
+    uint64_t file_size = parse_hex(header + 54, 8);
+    uint64_t name_size = parse_hex(header + 94, 8);
+    if (mode == ~0ULL || file_size == ~0ULL || name_size == ~0ULL || name_size == 0) {
+        return -1;
+    }
+
+    uint64_t data = (offset + CPIO_HEADER_SIZE + name_size + 3) & ~3ULL;
+    uint64_t next = (data + file_size + 3) & ~3ULL;
+    if (offset + CPIO_HEADER_SIZE + name_size > reader->length || data + file_size > reader->length) {
+        return -1;
+    }
+
+    entry->path = (const char *)header + CPIO_HEADER_SIZE;
+    entry->path_length = (uint32_t)name_size - 1;
+    if (entry->path_length == 10 && memory_compare(entry->path, "TRAILER!!!", 10) == 0) {
+        return 0;
+    }
+    entry->mode = (uint32_t)mode;
+    entry->mtime = (uint32_t)mtime;
+    entry->size = file_size;
+    entry->data = reader->base + data;
+    reader->offset = next;
+    return 1;
+}
+
+static int tar_next(ArchiveReader *reader, ArchiveEntry *entry) {
+    for (;;) {
+        uint64_t offset = reader->offset;
+        if (offset + TAR_BLOCK_SIZE > reader->length) {
+            return 0; // Archives may end without the two zero blocks
+        }
+        uint8_t *header = reader->base + offset;
+        if (memory_is_zero(header, TAR_BLOCK_SIZE)) {
+            return 0;
+        }
+        if (memory_compare(header + 257, "ustar", 5) != 0) {
+            return -1;
+        }
+
+        uint64_t size = parse_octal(header + 124, 12);
+        uint64_t data = offset + TAR_BLOCK_SIZE;
+        if (data + size > reader->length) {
+            return -1;
+        }
+        reader->offset = data + ((size + TAR_BLOCK_SIZE - 1) & ~(uint64_t)(TAR_BLOCK_SIZE - 1));
+
+        char type = (char)header[156];
+        if (type == 'L') {
+            // GNU long name: the payload is the path of the next member
+            reader->long_name = (const char *)reader->base + data;
+            reader->long_name_length = field_length(reader->base + data, (uint32_t)size);
+            continue;
+        }
+
+        uint32_t mode = (uint32_t)parse_octal(header + 100, 8) & 0xFFF;
+        if (type == '0' || type == '\0' || type == '7') {
+            mode |= VFS_S_IFREG;
+        } else if (type == '5') {
+            mode |= VFS_S_IFDIR;
+            size = 0;
+        } else if (type == '2') {
+            mode |= VFS_S_IFLNK;
+        } else {
+            reader->long_name = NULL;
+            continue; // Hard links, devices and FIFOs are not represented
+        }
+
+        if (reader->long_name != NULL) {
+            entry->path = reader->long_name;
+            entry->path_length = reader->long_name_length;
+            reader->long_name = NULL;
+        } else {
+            // ustar splits long paths into prefix "/" name
+            uint32_t prefix_length = field_length(header + 345, 155);
+            uint32_t name_length = field_length(header, 100);
+            uint32_t length = 0;
+            if (prefix_length > 0) {
+                memory_copy(reader->path, header + 345, prefix_length);
+                length = prefix_length;
+                reader->path[length++] = '/';
+            }
+            memory_copy(reader->path + length, header, name_length);
+            entry->path = reader->path;
+            entry->path_length = length + name_length;
+        }
+
+        entry->mode = mode;
+        entry->mtime = (uint32_t)parse_octal(header + 136, 12);
+        if (type == '2') {
+            // The link target lives in the header rather than in a data block
+            entry->data = header + 157;
+            entry->size = field_length(header + 157, 100);
+        } else {
+            entry->data = reader->base + data;
+            entry->size = size;
+        }
+        return 1;
+    }
+}
+
+static int archive_next(ArchiveReader *reader, ArchiveEntry *entry) {
+    return (reader->format == ARCHIVE_CPIO) ? cpio_next(reader, entry) : tar_next(reader, entry);
+}
+
+// Strips "./", leading and trailing slashes; an empty result is the root itself
+static void archive_clean_path(ArchiveEntry *entry) {
+    while (entry->path_length > 0) {
+        if (entry->path[0] == '/') {
+            entry->path++;
+            entry->path_length--;
+        } else if (entry->path_length >= 2 && entry->path[0] == '.' && entry->path[1] == '/') {
+            entry->path += 2;
+            entry->path_length -= 2;
+        } else if (entry->path_length == 1 && entry->path[0] == '.') {
+            entry->path_length = 0;
+        } else {
+            break;
+        }
+    }
+    while (entry->path_length > 0 && entry->path[entry->path_length - 1] == '/') {
+        entry->path_length--;
+    }
+}
+
+static uint32_t ramfs_find_child(RamfsInfo *info, uint32_t parent, const char *name, uint32_t length) {
+    for (uint32_t child = info->nodes[parent].first_child; child != RAMFS_NONE;
+         child = info->nodes[child].next_sibling) {
+        const char *child_name = info->nodes[child].name;
+        if (memory_compare(child_name, name, length) == 0 && child_name[length] == '\0') {
+            return child;
+        }
+    }
+    return RAMFS_NONE;
+}
+
+static uint32_t ramfs_add_node(RamfsInfo *info, uint32_t parent, const char *name, uint32_t length) {
+    if (info->count == info->capacity || info->names_used + length + 1 > info->names_capacity) {
+        return RAMFS_NONE;
+    }
+    uint32_t index = info->count++;
+    RamfsNode *node = &info->nodes[index];
+    char *copy = info->names + info->names_used;
+
+    memory_copy(copy, name, length);
+    copy[length] = '\0';
+    info->names_used += length + 1;
+
+    memory_zero(node, sizeof(RamfsNode));
+    node->name = copy;
+    node->mode = VFS_S_IFDIR | 0755; // Implicit parent directories
+    node->first_child = RAMFS_NONE;
+    node->last_child = RAMFS_NONE;
+    node->next_sibling = RAMFS_NONE;
+
+    // Appending keeps readdir in archive order
+    RamfsNode *dir = &info->nodes[parent];
+    if (dir->last_child == RAMFS_NONE) {
+        dir->first_child = index;
+    } else {
+        info->nodes[dir->last_child].next_sibling = index;
+    }
+    dir->last_child = index;
+    return index;
+}
+
+static int ramfs_insert(RamfsInfo *info, const ArchiveEntry *entry) {
+    uint32_t node = 0;
+    uint32_t start = 0;
+
+    while (start < entry->path_length) {
+        uint32_t end = start;
+        while (end < entry->path_length && entry->path[end] != '/') {
+            end++;
+        }
+        if (end > start) {
+            if (!VFS_ISDIR(info->nodes[node].mode)) {
+                return -1;
+            }
+            uint32_t child = ramfs_find_child(info, node, entry->path + start, end - start);
+            if (child == RAMFS_NONE) {
+                child = ramfs_add_node(info, node, entry->path + start, end - start);
+                if (child == RAMFS_NONE) {
+                    return -1;
+                }
+            }
+            node = child;
+        }
+        start = end + 1;
+    }
+
+    RamfsNode *target = &info->nodes[node];
+    if (node != 0) {
+        target->mode = entry->mode;
+        target->size = VFS_ISDIR(entry->mode) ? 0 : entry->size;
+        target->data = entry->data;
+    }
+    target->mtime = entry->mtime;
+    return 0;
+}
+
+static void ramfs_put_super(VfsSuperblock *sb) {
+    RamfsInfo *info = (RamfsInfo *)sb->fs_private;
+    if (info != NULL) {
+        free(info->nodes);
+        free(info->names);
+        free(info);
+        sb->fs_private = NULL;
+    }
+}
+
+/**
+ * initramfs_mount - Indexes an archive that sits on a RAM disk.
+ *
+ * Only the directory tree is built (one pass to size it, one to fill it);
+ * file contents are never copied, and pages handed to the page cache point
+ * straight into the archive.
+ */
+int initramfs_mount(VfsSuperblock *sb) {
+    uint64_t bytes;
+    uint8_t *memory = ramdisk_memory(sb->dev, &bytes);
+    if (memory == NULL || sb->start_lba * SECTOR_SIZE >= bytes) {
+        return -1;
+    }
+
+    ArchiveReader reader;
+    memory_zero(&reader, sizeof(reader));
+    reader.base = memory + sb->start_lba * SECTOR_SIZE;
+    reader.length = sb->sector_count * SECTOR_SIZE;
+    if (sb->start_lba + sb->sector_count >= sb->dev->sector_count) {
+        reader.length = bytes - sb->start_lba * SECTOR_SIZE; // Includes a partial last sector
+    }
+    if (archive_detect(reader.base, reader.length, &reader.format) != 0) {
+        return -1;
+    }
+
+    // Every path component may need its own node
+    ArchiveEntry entry;
+    uint32_t max_nodes = 1;
+    uint32_t name_bytes = 0;
+    int result;
+    while ((result = archive_next(&reader, &entry)) == 1) {
+        archive_clean_path(&entry);
+        for (uint32_t i = 0; i < entry.path_length; i++) {
+            max_nodes += (entry.path[i] == '/');
+        }
+        max_nodes++;
+        name_bytes += entry.path_length + 1;
+    }
+    if (result < 0) {
+        print_str("initramfs: archive is truncated or corrupt, using what could be read");
+        print_newline();
+    }
+
+    RamfsInfo *info = (RamfsInfo *)allocate(sizeof(RamfsInfo));
+    if (info == NULL) {
+        return -1;
+    }
+    info->nodes = (RamfsNode *)allocate(max_nodes * sizeof(RamfsNode));
+    info->names = (char *)allocate(name_bytes + 1);
+    info->capacity = max_nodes;
+    info->names_capacity = name_bytes + 1;
+    info->count = 1;
+    info->names_used = 1;
+    sb->fs_private = info;
+    if (info->nodes == NULL || info->names == NULL) {
+        ramfs_put_super(sb);
+        return -1;
+    }
+
+    memory_zero(&info->nodes[0], sizeof(RamfsNode));
+    info->names[0] = '\0';
+    info->nodes[0].name = info->names;
+    info->nodes[0].mode = VFS_S_IFDIR | 0755;
+    info->nodes[0].first_child = RAMFS_NONE;
+    info->nodes[0].last_child = RAMFS_NONE;
+    info->nodes[0].next_sibling = RAMFS_NONE;
+
+    reader.offset = 0;
+    reader.long_name = NULL;
+    while (archive_next(&reader, &entry) == 1) {
+        archive_clean_path(&entry);
+        if (ramfs_insert(info, &entry) != 0) {
+            print_str("initramfs: skipping entry under a non-directory");
+            print_newline();
+        }
+    }
+
+    sb->block_size = PAGE_SIZE;
+    sb->root_ino = RAMFS_ROOT_INO;
+    sb->ops = &ramfs_super_ops;
+    return 0;
+}
+
+static int ramfs_read_inode(VfsSuperblock *sb, uint64_t ino, VfsInode *inode) {
+    RamfsInfo *info = (RamfsInfo *)sb->fs_private;
+    if (ino == 0 || ino > info->count) {
+        return -1;
+    }
+
+    RamfsNode *node = &info->nodes[ino - 1];
+    inode->mode = node->mode;
+    inode->links = VFS_ISDIR(node->mode) ? 2 : 1;
+    inode->size = node->size;
+    inode->blocks = (node->size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    inode->mtime = node->mtime;
+    inode->ops = &ramfs_inode_ops;
+    inode->fs_private = node;
+    return 0;
+}
+
+// The cookie is the index of the next child + 1 (0 = start)
+static int ramfs_readdir(VfsInode *dir, uint64_t *cookie, VfsDirEntry *entry) {
+    RamfsInfo *info = (RamfsInfo *)dir->sb->fs_private;
+    RamfsNode *node = (RamfsNode *)dir->fs_private;
+
+    if (*cookie == RAMFS_COOKIE_END) {
+        return 0;
+    }
+    uint32_t child = (*cookie == 0) ? node->first_child : (uint32_t)(*cookie - 1);
+    if (child == RAMFS_NONE || child >= info->count) {
+        *cookie = RAMFS_COOKIE_END;
+        return 0;
+    }
+
+    RamfsNode *current = &info->nodes[child];
+    uint32_t length = field_length((const uint8_t *)current->name, VFS_NAME_MAX);
+    memory_copy(entry->name, current->name, length);
+    entry->name[length] = '\0';
+    entry->mode = current->mode & VFS_S_IFMT;
+    entry->ino = child + 1;
+    *cookie = (current->next_sibling == RAMFS_NONE) ? RAMFS_COOKIE_END : (uint64_t)current->next_sibling + 1;
+    return 1;
+}
+
+static uint8_t *ramfs_mappage(VfsInode *inode, uint64_t index) {
+    RamfsNode *node = (RamfsNode *)inode->fs_private;
+    return node->data + (index << PAGE_SHIFT);
+}
+
+static const VfsInodeOps ramfs_inode_ops = {
+    .readdir = ramfs_readdir,
+    .mappage = ramfs_mappage,
+};
+
+static const VfsSuperOps ramfs_super_ops = {
+    .read_inode = ramfs_read_inode,
+    .put_super = ramfs_put_super,
+};
+
+void initramfs_init(void) {
+    int mounted = 0;
+
+    for (int i = 0; i < multiboot2_module_count(); i++) {
+        const BootModule *module = multiboot2_module(i);
+        if (strcmp(module->cmdline, "script") == 0) {
+            continue; // Boot script, run by the shell
+        }
+        BlockDevice *dev = ramdisk_create_from(module->start, module->size);
+        if (dev == NULL) {
+            continue;
+        }
+
+        ArchiveFormat format;
+        if (mounted || archive_detect(module->start, module->size, &format) != 0) {
+            continue;
+        }
+        if (vfs_mount(dev, 0, dev->sector_count, "/") == 0) {
+            mounted = 1;
+            print_str("initramfs: mounted ");
+            print_str(dev->name);
+            print_str(" (");
+            print_int(module->size / 1024);
+            print_str(" KB, ");
+            print_str(format == ARCHIVE_CPIO ? "cpio" : "tar");
+            print_str(") at /");
+            print_newline();
+        }
+    }
+}
@@ -0,0 +1,185 @@
+// interrupts.c - IDT and 8259 PIC setup
+#include "interrupts.h"
+#include "port.h"
+#include "print.h"
+#include "string.h"
+#include "serial.h"
+#include "klog.h"
+#include "kprintf.h"
+
+#define IDT_ENTRIES         (IRQ_BASE_VECTOR + IRQ_COUNT)
+#define IDT_INTERRUPT_GATE  0x8E // Present, ring 0, 64-bit interrupt gate
+#define KERNEL_CODE_SELECTOR 0x08
+
+#define PIC1_COMMAND        0x20
+#define PIC1_DATA           0x21
+#define PIC2_COMMAND        0xA0
+#define PIC2_DATA           0xA1
+#define PIC_EOI             0x20
+#define PIC_READ_ISR        0x0B
+#define PIC_CASCADE_IRQ     2
+
+typedef struct {
+    uint16_t offset_low;
+    uint16_t selector;
+    uint8_t ist;
+    uint8_t type_attr;
+    uint16_t offset_mid;
+    uint32_t offset_high;
+    uint32_t reserved;
+} __attribute__((packed)) IdtEntry;
+
+typedef struct {
+    uint16_t limit;
+    uint64_t base;
+} __attribute__((packed)) IdtPointer;
+
+// Entry points defined in isr.asm, one per vector
+extern uint64_t isr_stub_table[IDT_ENTRIES];
+
+static IdtEntry idt[IDT_ENTRIES] __attribute__((aligned(16)));
+static IrqHandler irq_handlers[IRQ_COUNT];
+static ExceptionHandler exception_handlers[IRQ_BASE_VECTOR];
+static uint16_t irq_mask = 0xFFFF;
+
+static const char *exception_names[32] = {
+    "divide error", "debug", "NMI", "breakpoint", "overflow", "bound range",
+    "invalid opcode", "device not available", "double fault", "coprocessor overrun",
+    "invalid TSS", "segment not present", "stack fault", "general protection",
+    "page fault", "reserved", "x87 error", "alignment check", "machine check",
+    "SIMD error", "virtualization", "control protection", "reserved", "reserved",
+    "reserved", "reserved", "reserved", "reserved", "hypervisor injection",
+    "VMM communication", "security", "reserved",
+};
+
+static inline void io_wait(void) {
+    outb(0x80, 0);
+}
+
+static void pic_write_mask(void) {
+    outb(PIC1_DATA, irq_mask & 0xFF);
+    outb(PIC2_DATA, irq_mask >> 8);
+}
+
+static void pic_remap(void) {
+    outb(PIC1_COMMAND, 0x11); // ICW1: initialise, ICW4 follows
+    io_wait();
+    outb(PIC2_COMMAND, 0x11);
+    io_wait();
+    outb(PIC1_DATA, IRQ_BASE_VECTOR);
+    io_wait();
+    outb(PIC2_DATA, IRQ_BASE_VECTOR + 8);
+    io_wait();
+    outb(PIC1_DATA, 1 << PIC_CASCADE_IRQ);
+    io_wait();
+    outb(PIC2_DATA, PIC_CASCADE_IRQ);
+    io_wait();
+    outb(PIC1_DATA, 0x01); // 8086 mode
+    io_wait();
+    outb(PIC2_DATA, 0x01);
+    io_wait();
+    pic_write_mask();
+}
+
+// Spurious IRQ 7/15 arrive without their in-service bit set
+static int pic_spurious(uint8_t irq) {
+    uint16_t port = (irq < 8) ? PIC1_COMMAND : PIC2_COMMAND;
+    outb(port, PIC_READ_ISR);
+    return !(inb(port) & (1 << (irq & 7)));
+}
+
+static void idt_set_gate(int vector, uint64_t handler) {
+    idt[vector].offset_low = handler & 0xFFFF;
+    idt[vector].selector = KERNEL_CODE_SELECTOR;
+    idt[vector].ist = 0;
+    idt[vector].type_attr = IDT_INTERRUPT_GATE;
+    idt[vector].offset_mid = (handler >> 16) & 0xFFFF;
+    idt[vector].offset_high = handler >> 32;
+    idt[vector].reserved = 0;
+}
+
+void interrupts_init(void) {
+    for (int vector = 0; vector < IDT_ENTRIES; vector++) {
+        idt_set_gate(vector, isr_stub_table[vector]);
+    }
+
+    IdtPointer pointer = {
+        .limit = sizeof(idt) - 1,
+        .base = (uint64_t)idt,
+    };
+    asm volatile("lidt %0" : : "m"(pointer));
+
+    pic_remap();
+}
+
+void irq_register(uint8_t irq, IrqHandler handler) {
+    if (irq >= IRQ_COUNT) {
+        return;
+    }
+    uint64_t flags = irq_save();
+    irq_handlers[irq] = handler;
+    irq_mask &= ~(1 << irq);
+    if (irq >= 8) {
+        irq_mask &= ~(1 << PIC_CASCADE_IRQ);
+    }
+    pic_write_mask();
+    irq_restore(flags);
+}
+
+void exception_register(uint8_t vector, ExceptionHandler handler) {
+    if (vector < IRQ_BASE_VECTOR) {
+        exception_handlers[vector] = handler;
+    }
+}
+
+// Report an exception nothing could recover from and stop
+static void exception_halt(InterruptFrame *frame) {
+    klog_drain_console();
+    print_set_color(PRINT_COLOR_WHITE, PRINT_COLOR_RED);
+    print_newline();
+    print_str("CPU exception ");
+    print_int(frame->vector);
+    print_str(" (");
+    print_str((char *)exception_names[frame->vector]);
+    kprintf(") at RIP 0x%lx, error code 0x%lx", frame->rip, frame->error_code);
+    if (frame->vector == EXCEPTION_PAGE_FAULT) {
+        uint64_t address;
+        asm volatile("mov %%cr2, %0" : "=r"(address));
+        kprintf(", address 0x%lx", address);
+    }
+    print_newline();
+    print_flush();
+    serial_flush();
+
+    for (;;) {
+        asm volatile("cli; hlt");
+    }
+}
+
+// Called from isr_common with interrupts disabled
+void interrupt_dispatch(InterruptFrame *frame) {
+    if (frame->vector < IRQ_BASE_VECTOR) {
+        ExceptionHandler handler = exception_handlers[frame->vector];
+        if (handler == 0 || handler(frame) != 0) {
+            exception_halt(frame);
+        }
+        return;
+    }
+
+    uint8_t irq = (uint8_t)(frame->vector - IRQ_BASE_VECTOR);
+    if ((irq == 7 || irq == 15) && pic_spurious(irq)) {
+        if (irq == 15) {
+            outb(PIC1_COMMAND, PIC_EOI); // The master did see the cascade
+        }
+        return;
+    }
+
+    if (irq_handlers[irq] != 0) {
+        irq_handlers[irq](frame);
+    }
+
+    if (irq >= 8) {
+        outb(PIC2_COMMAND, PIC_EOI);
+    }
+    outb(PIC1_COMMAND, PIC_EOI);
+}
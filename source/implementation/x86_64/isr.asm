@@ -0,0 +1,166 @@
+; isr.asm - interrupt entry stubs
+global isr_stub_table
+extern interrupt_dispatch
+
+section .text
+bits 64
+
+; CPU exceptions with an error code get no dummy, so every frame has the
+; same layout (see InterruptFrame in interrupts.h)
+%macro ISR_NOERR 1
+isr_%1:
+    push qword 0
+    push qword %1
+    jmp isr_common
+%endmacro
+
+%macro ISR_ERR 1
+isr_%1:
+    push qword %1
+    jmp isr_common
+%endmacro
+
+ISR_NOERR 0
+ISR_NOERR 1
+ISR_NOERR 2
+ISR_NOERR 3
+ISR_NOERR 4
+ISR_NOERR 5
+ISR_NOERR 6
+ISR_NOERR 7
+ISR_ERR 8
+ISR_NOERR 9
+ISR_ERR 10
+ISR_ERR 11
+ISR_ERR 12
+ISR_ERR 13
+ISR_ERR 14
+ISR_NOERR 15
+ISR_NOERR 16
+ISR_ERR 17
+ISR_NOERR 18
+ISR_NOERR 19
+ISR_NOERR 20
+ISR_ERR 21
+ISR_NOERR 22
+ISR_NOERR 23
+ISR_NOERR 24
+ISR_NOERR 25
+ISR_NOERR 26
+ISR_NOERR 27
+ISR_NOERR 28
+ISR_ERR 29
+ISR_ERR 30
+ISR_NOERR 31
+ISR_NOERR 32
+ISR_NOERR 33
+ISR_NOERR 34
+ISR_NOERR 35
+ISR_NOERR 36
+ISR_NOERR 37
+ISR_NOERR 38
+ISR_NOERR 39
+ISR_NOERR 40
+ISR_NOERR 41
+ISR_NOERR 42
+ISR_NOERR 43
+ISR_NOERR 44
+ISR_NOERR 45
+ISR_NOERR 46
+ISR_NOERR 47
+
+isr_common:
+    push rax
+    push rbx
+    push rcx
+    push rdx
+    push rsi
+    push rdi
+    push rbp
+    push r8
+    push r9
+    push r10
+    push r11
+    push r12
+    push r13
+    push r14
+    push r15
+
+    ; The kernel uses SSE, so the interrupted code may have live XMM state.
+    ; The frame is 176 bytes, which keeps rsp 16-byte aligned for fxsave
+    ; and for the call.
+    sub rsp, 512
+    fxsave [rsp]
+    lea rdi, [rsp + 512]
+    call interrupt_dispatch
+    fxrstor [rsp]
+    add rsp, 512
+
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop r11
+    pop r10
+    pop r9
+    pop r8
+    pop rbp
+    pop rdi
+    pop rsi
+    pop rdx
+    pop rcx
+    pop rbx
+    pop rax
+    add rsp, 16 ; vector and error code
+    iretq
+
+section .rodata
+isr_stub_table:
+    dq isr_0
+    dq isr_1
+    dq isr_2
+    dq isr_3
+    dq isr_4
+    dq isr_5
+    dq isr_6
+    dq isr_7
+    dq isr_8
+    dq isr_9
+    dq isr_10
+    dq isr_11
+    dq isr_12
+    dq isr_13
+    dq isr_14
+    dq isr_15
+    dq isr_16
+    dq isr_17
+    dq isr_18
+    dq isr_19
+    dq isr_20
+    dq isr_21
+    dq isr_22
+    dq isr_23
+    dq isr_24
+    dq isr_25
+    dq isr_26
+    dq isr_27
+    dq isr_28
+    dq isr_29
+    dq isr_30
+    dq isr_31
+    dq isr_32
+    dq isr_33
+    dq isr_34
+    dq isr_35
+    dq isr_36
+    dq isr_37
+    dq isr_38
+    dq isr_39
+    dq isr_40
+    dq isr_41
+    dq isr_42
+    dq isr_43
+    dq isr_44
+    dq isr_45
+    dq isr_46
+    dq isr_47
@@ -0,0 +1,736 @@
+// journal.c
+#include "journal.h"
+#include "partition.h"
+#include "filesystem.h"
+#include "print.h"
+#include "string.h"
+#include "memory.h"
+#include "memory_allocator.h"
+#include "crc32.h"
+#include "timer.h"
+#include "trace.h"
+
+#define EXT4_SUPERBLOCK_OFFSET 1024
+#define EXT4_MAGIC 0xEF53
+#define EXT4_EXT_MAGIC 0xF30A
+
+// Incompatible features we know how to replay
+#define JOURNAL_REPLAY_INCOMPAT (JBD2_FEATURE_INCOMPAT_REVOKE | JBD2_FEATURE_INCOMPAT_64BIT | \
+                                 JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT | JBD2_FEATURE_INCOMPAT_CSUM_V2 | \
+                                 JBD2_FEATURE_INCOMPAT_CSUM_V3)
+
+// Features of the log we write: CRC32 over each transaction lets the commit
+// block go out in the same write as the data, covered by a single flush.
+#define JOURNAL_WRITE_COMPAT   JBD2_FEATURE_COMPAT_CHECKSUM
+#define JOURNAL_WRITE_INCOMPAT (JBD2_FEATURE_INCOMPAT_REVOKE | JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT)
+#define JOURNAL_TAG_BYTES      8
+
+#define JOURNAL_MAX_REVOKE     4096
+
+enum {
+    PASS_SCAN,
+    PASS_REVOKE,
+    PASS_REPLAY
+};
+
+static uint32_t revoke_blocknr[JOURNAL_MAX_REVOKE];
+static uint32_t revoke_sequence[JOURNAL_MAX_REVOKE];
+static uint32_t revoke_count = 0;
+
+static inline uint32_t be32(uint32_t value) {
+    return __builtin_bswap32(value);
+}
+
+static inline uint16_t be16_at(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t be32_at(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Transaction IDs wrap, so compare them modulo 2^32
+static inline int tid_after(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) > 0;
+}
+
+// Maps a journal block to its sector; *contiguous receives how many blocks
+// from there on are physically consecutive
+static uint64_t log_map(const Journal *j, uint32_t log_block, uint32_t *contiguous) {
+    for (uint32_t i = 0; i < j->extent_count; i++) {
+        const JournalExtent *extent = &j->extents[i];
+        if (log_block >= extent->logical && log_block - extent->logical < extent->length) {
+            uint32_t offset = log_block - extent->logical;
+            *contiguous = extent->length - offset;
+            return j->part_lba + (uint64_t)(extent->start + offset) * j->sectors_per_block;
+        }
+    }
+    *contiguous = 0;
+    return 0;
+}
+
+static uint64_t log_to_lba(const Journal *j, uint32_t log_block) {
+    uint32_t contiguous;
+    return log_map(j, log_block, &contiguous);
+}
+
+// Writes `count` consecutive journal blocks, one request per extent crossed
+static int write_log_run(const Journal *j, uint32_t log_block, uint32_t count, const uint8_t *data) {
+    while (count > 0) {
+        uint32_t run;
+        uint64_t lba = log_map(j, log_block, &run);
+        if (run == 0) {
+            return -1;
+        }
+        if (run > count) {
+            run = count;
+        }
+        if (blockdev_write(j->dev, lba, run * j->sectors_per_block, data) != 0) {
+            return -1;
+        }
+        log_block += run;
+        count -= run;
+        data += run * j->block_size;
+    }
+    return 0;
+}
+
+static uint64_t home_to_lba(const Journal *j, uint32_t blocknr) {
+    return j->part_lba + (uint64_t)blocknr * j->sectors_per_block;
+}
+
+static uint32_t log_next(const Journal *j, uint32_t log_block) {
+    return (log_block + 1 >= j->maxlen) ? j->first : log_block + 1;
+}
+
+static int read_log_block(const Journal *j, uint32_t log_block, uint8_t *buffer) {
+    return blockdev_read(j->dev, log_to_lba(j, log_block), j->sectors_per_block, buffer);
+}
+
+static int journal_flush(Journal *j) {
+    j->stats.flushes++;
+    return blockdev_flush(j->dev);
+}
+
+static uint32_t journal_tag_bytes(uint32_t incompat) {
+    if (incompat & JBD2_FEATURE_INCOMPAT_CSUM_V3) {
+        return 16;
+    }
+    uint32_t size = 12;
+    if (incompat & JBD2_FEATURE_INCOMPAT_CSUM_V2) {
+        size += 2;
+    }
+    return (incompat & JBD2_FEATURE_INCOMPAT_64BIT) ? size : size - 4;
+}
+
+static uint32_t log_used(const Journal *j) {
+    if (j->tail == 0) {
+        return 0;
+    }
+    uint32_t capacity = j->maxlen - j->first;
+    return (j->head >= j->tail) ? j->head - j->tail : capacity - (j->tail - j->head);
+}
+
+// Rewrites journal block 0 so that recovery starts at `start` (0 = log empty)
+static int write_journal_superblock(Journal *j, uint32_t start, uint32_t sequence) {
+    uint8_t *buffer = j->io_buffer;
+    if (read_log_block(j, 0, buffer) != 0) {
+        return -1;
+    }
+
+    JournalSuperblock *jsb = (JournalSuperblock *)buffer;
+    jsb->s_start = be32(start);
+    jsb->s_sequence = be32(sequence);
+    jsb->s_feature_compat = be32(j->feature_compat);
+    jsb->s_feature_incompat = be32(JOURNAL_WRITE_INCOMPAT);
+    jsb->s_feature_ro_compat = 0;
+
+    return blockdev_write(j->dev, log_to_lba(j, 0), j->sectors_per_block, buffer);
+}
+
+void journal_describe_in_superblock(void *ext4_sb, uint32_t journal_block, uint32_t length,
+                                    uint32_t block_size)
+{
+    Ext4Superblock *sb = (Ext4Superblock *)ext4_sb;
+    uint64_t size_bytes = (uint64_t)length * block_size;
+
+    sb->s_feature_compat |= EXT4_FEATURE_COMPAT_HAS_JOURNAL;
+    sb->s_journal_inum = EXT4_JOURNAL_INO;
+    sb->s_jnl_backup_type = EXT3_JNL_BACKUP_BLOCKS;
+    memory_zero(sb->s_jnl_blocks, sizeof(sb->s_jnl_blocks));
+
+    // Copy of the journal inode's i_block: a depth-0 extent tree with one extent
+    sb->s_jnl_blocks[0] = EXT4_EXT_MAGIC | (1 << 16); // eh_magic, eh_entries
+    sb->s_jnl_blocks[1] = 4;                          // eh_max, eh_depth = 0
+    sb->s_jnl_blocks[2] = 0;                          // eh_generation
+    sb->s_jnl_blocks[3] = 0;                          // ee_block
+    sb->s_jnl_blocks[4] = length & 0xFFFF;            // ee_len, ee_start_hi = 0
+    sb->s_jnl_blocks[5] = journal_block;              // ee_start_lo
+    sb->s_jnl_blocks[15] = (uint32_t)(size_bytes >> 32);
+    sb->s_jnl_blocks[16] = (uint32_t)size_bytes;
+}
+
+int journal_format(BlockDevice *dev, uint64_t part_lba, uint32_t journal_block,
+                   uint32_t length, uint32_t block_size)
+{
+    TRACE_SCOPE("fs:journal_format", length);
+    uint32_t sectors_per_block = block_size / SECTOR_SIZE;
+    uint8_t *buffer = (uint8_t *)allocate(block_size * 2);
+    if (buffer == NULL) {
+        print_str("Error: cannot allocate journal buffer");
+        print_newline();
+        return -1;
+    }
+    memory_zero(buffer, block_size * 2);
+
+    JournalSuperblock *jsb = (JournalSuperblock *)buffer;
+    jsb->s_header.h_magic = be32(JBD2_MAGIC_NUMBER);
+    jsb->s_header.h_blocktype = be32(JBD2_SUPERBLOCK_V2);
+    jsb->s_blocksize = be32(block_size);
+    jsb->s_maxlen = be32(length);
+    jsb->s_first = be32(1);
+    // The log is not zeroed, so start from an unpredictable transaction ID to
+    // keep stale blocks from an earlier journal from matching during recovery.
+    jsb->s_sequence = be32((uint32_t)(timer_tsc() >> 4) | 1);
+    jsb->s_start = 0;
+    jsb->s_feature_compat = be32(JOURNAL_WRITE_COMPAT);
+    jsb->s_feature_incompat = be32(JOURNAL_WRITE_INCOMPAT);
+    jsb->s_nr_users = be32(1);
+
+    uint64_t seed = timer_tsc();
+    for (int i = 0; i < 16; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        jsb->s_uuid[i] = (uint8_t)(seed >> 56);
+    }
+
+    // Superblock plus a zeroed first log block
+    int result = blockdev_write(dev, part_lba + (uint64_t)journal_block * sectors_per_block,
+                                sectors_per_block * 2, buffer);
+    if (result == 0) {
+        result = blockdev_flush(dev);
+    }
+    free(buffer);
+    return result;
+}
+
+static int revoke_record(uint32_t blocknr, uint32_t sequence) {
+    for (uint32_t i = 0; i < revoke_count; i++) {
+        if (revoke_blocknr[i] == blocknr) {
+            if (tid_after(sequence, revoke_sequence[i])) {
+                revoke_sequence[i] = sequence;
+            }
+            return 0;
+        }
+    }
+    if (revoke_count == JOURNAL_MAX_REVOKE) {
+        return -1;
+    }
+    revoke_blocknr[revoke_count] = blocknr;
+    revoke_sequence[revoke_count] = sequence;
+    revoke_count++;
+    return 0;
+}
+
+// A block is skipped if a revoke record from this or a later transaction names it
+static int revoke_hides(uint32_t blocknr, uint32_t sequence) {
+    for (uint32_t i = 0; i < revoke_count; i++) {
+        if (revoke_blocknr[i] == blocknr) {
+            return !tid_after(sequence, revoke_sequence[i]);
+        }
+    }
+    return 0;
+}
+
+/**
+ * journal_pass - One walk over the live part of the log.
+ *
+ * PASS_SCAN finds the first transaction that is missing or fails its
+ * commit checksum and stores its ID in *end_sequence. PASS_REVOKE
+ * collects revoke records and PASS_REPLAY copies logged blocks to
+ * their home locations, both stopping at that transaction.
+ */
+static int journal_pass(Journal *j, int pass, uint32_t start, uint32_t sequence,
+                        uint32_t incompat, uint32_t *end_sequence)
+{
+    uint32_t tag_bytes = journal_tag_bytes(incompat);
+    uint32_t tail_bytes = (incompat & (JBD2_FEATURE_INCOMPAT_CSUM_V2 | JBD2_FEATURE_INCOMPAT_CSUM_V3)) ? 4 : 0;
+    uint32_t record_bytes = (incompat & JBD2_FEATURE_INCOMPAT_64BIT) ? 8 : 4;
+    int use_crc = (j->feature_compat & JBD2_FEATURE_COMPAT_CHECKSUM) != 0;
+    uint8_t *block = j->io_buffer;
+    uint8_t *data = j->tx_data;
+    uint32_t next_block = start;
+    uint32_t crc = ~0u;
+
+    while (1) {
+        if (pass != PASS_SCAN && !tid_after(*end_sequence, sequence)) {
+            break;
+        }
+        if (read_log_block(j, next_block, block) != 0) {
+            return -1;
+        }
+
+        JournalHeader *header = (JournalHeader *)block;
+        if (be32(header->h_magic) != JBD2_MAGIC_NUMBER || be32(header->h_sequence) != sequence) {
+            break;
+        }
+
+        uint32_t type = be32(header->h_blocktype);
+        if (type == JBD2_DESCRIPTOR_BLOCK) {
+            if (pass == PASS_SCAN && use_crc) {
+                crc = crc32_be(crc, block, j->block_size);
+            }
+
+            uint8_t *tag = block + sizeof(JournalHeader);
+            uint8_t *end = block + j->block_size - tail_bytes;
+            while (tag + tag_bytes <= end) {
+                uint32_t blocknr = be32_at(tag);
+                uint16_t flags = be16_at(tag + 6);
+                next_block = log_next(j, next_block);
+
+                if (pass == PASS_SCAN && use_crc) {
+                    if (read_log_block(j, next_block, data) != 0) {
+                        return -1;
+                    }
+                    crc = crc32_be(crc, data, j->block_size);
+                } else if (pass == PASS_REPLAY && !revoke_hides(blocknr, sequence)) {
+                    if ((incompat & JBD2_FEATURE_INCOMPAT_64BIT) && be32_at(tag + 8) != 0) {
+                        print_str("Error: journal block beyond 32-bit range");
+                        print_newline();
+                        return -1;
+                    }
+                    if (read_log_block(j, next_block, data) != 0) {
+                        return -1;
+                    }
+                    if (flags & JBD2_FLAG_ESCAPE) {
+                        *(uint32_t *)data = be32(JBD2_MAGIC_NUMBER);
+                    }
+                    if (blockdev_write(j->dev, home_to_lba(j, blocknr), j->sectors_per_block, data) != 0) {
+                        return -1;
+                    }
+                    j->stats.replayed++;
+                }
+
+                tag += tag_bytes;
+                if (!(flags & JBD2_FLAG_SAME_UUID)) {
+                    tag += 16;
+                }
+                if (flags & JBD2_FLAG_LAST_TAG) {
+                    break;
+                }
+            }
+            next_block = log_next(j, next_block);
+        } else if (type == JBD2_COMMIT_BLOCK) {
+            if (pass == PASS_SCAN && use_crc) {
+                JournalCommitBlock *commit = (JournalCommitBlock *)block;
+                if (commit->h_chksum_type == JBD2_CRC32_CHKSUM &&
+                    commit->h_chksum_size == JBD2_CRC32_CHKSUM_SIZE &&
+                    be32(commit->h_chksum[0]) != crc) {
+                    // Torn transaction: the log ends here
+                    break;
+                }
+            }
+            crc = ~0u;
+            sequence++;
+            next_block = log_next(j, next_block);
+        } else if (type == JBD2_REVOKE_BLOCK) {
+            if (pass == PASS_REVOKE) {
+                JournalRevokeHeader *revoke = (JournalRevokeHeader *)block;
+                uint32_t used = be32(revoke->r_count);
+                if (used > j->block_size) {
+                    used = j->block_size;
+                }
+                for (uint32_t offset = sizeof(JournalRevokeHeader); offset + record_bytes <= used;
+                     offset += record_bytes) {
+                    uint32_t blocknr = be32_at(block + offset + record_bytes - 4);
+                    if (revoke_record(blocknr, sequence) != 0) {
+                        print_str("Error: too many revoked blocks in journal");
+                        print_newline();
+                        return -1;
+                    }
+                }
+            }
+            next_block = log_next(j, next_block);
+        } else {
+            break;
+        }
+    }
+
+    if (pass == PASS_SCAN) {
+        *end_sequence = sequence;
+    }
+    return 0;
+}
+
+static void journal_release(Journal *j) {
+    free(j->tx_data);
+    free(j->io_buffer);
+    j->tx_data = NULL;
+    j->io_buffer = NULL;
+}
+
+static int journal_recover(Journal *j, uint32_t start, uint32_t sequence, uint32_t incompat) {
+    uint32_t end_sequence = sequence;
+
+    revoke_count = 0;
+    if (journal_pass(j, PASS_SCAN, start, sequence, incompat, &end_sequence) != 0 ||
+        journal_pass(j, PASS_REVOKE, start, sequence, incompat, &end_sequence) != 0 ||
+        journal_pass(j, PASS_REPLAY, start, sequence, incompat, &end_sequence) != 0) {
+        print_str("Error: journal recovery failed");
+        print_newline();
+        return -1;
+    }
+
+    print_str("Journal: replayed ");
+    print_int(end_sequence - sequence);
+    print_str(" transactions (");
+    print_int(j->stats.replayed);
+    print_str(" blocks)");
+    print_newline();
+
+    // The first ID that did not commit may still tag a torn transaction's
+    // blocks in the log, so new transactions start after it, as jbd2 does
+    j->sequence = end_sequence + 1;
+    return journal_flush(j);
+}
+
+int journal_load(Journal *j, BlockDevice *dev, uint64_t part_lba) {
+    uint8_t sb_buffer[EXT4_SUPERBLOCK_OFFSET];
+
+    memory_zero(j, sizeof(Journal));
+    j->dev = dev;
+    j->part_lba = part_lba;
+
+    if (blockdev_read(dev, part_lba + EXT4_SUPERBLOCK_OFFSET / SECTOR_SIZE,
+                      sizeof(sb_buffer) / SECTOR_SIZE, sb_buffer) != 0) {
+        print_str("Error: cannot read ext4 superblock");
+        print_newline();
+        return -1;
+    }
+
+    Ext4Superblock *sb = (Ext4Superblock *)sb_buffer;
+    if (sb->s_magic != EXT4_MAGIC || !(sb->s_feature_compat & EXT4_FEATURE_COMPAT_HAS_JOURNAL)) {
+        print_str("Error: partition has no ext4 journal");
+        print_newline();
+        return -1;
+    }
+    // s_jnl_blocks backs up i_block of the journal inode: an extent header
+    // (magic, entries / max, depth) followed by up to four 12-byte extents
+    uint32_t entries = sb->s_jnl_blocks[0] >> 16;
+    if (sb->s_jnl_backup_type != EXT3_JNL_BACKUP_BLOCKS ||
+        (sb->s_jnl_blocks[0] & 0xFFFF) != EXT4_EXT_MAGIC || (sb->s_jnl_blocks[1] >> 16) != 0 ||
+        entries == 0 || entries > JOURNAL_MAX_EXTENTS) {
+        print_str("Error: journal inode backup is missing or not extent-mapped");
+        print_newline();
+        return -1;
+    }
+
+    j->block_size = 1024u << sb->s_log_block_size;
+    j->sectors_per_block = j->block_size / SECTOR_SIZE;
+
+    uint32_t mapped = 0;
+    for (uint32_t i = 0; i < entries; i++) {
+        uint32_t len_and_start_hi = sb->s_jnl_blocks[4 + i * 3];
+        JournalExtent *extent = &j->extents[i];
+        extent->logical = sb->s_jnl_blocks[3 + i * 3];
+        extent->length = len_and_start_hi & 0xFFFF;
+        extent->start = sb->s_jnl_blocks[5 + i * 3];
+        // ee_start_hi must be zero and extents must cover the log in order
+        if ((len_and_start_hi >> 16) != 0 || extent->logical != mapped || extent->length > 32768) {
+            print_str("Error: only an initialized journal below 16 TiB is supported");
+            print_newline();
+            return -1;
+        }
+        mapped += extent->length;
+    }
+    j->extent_count = entries;
+    j->journal_block = j->extents[0].start;
+
+    uint64_t journal_bytes = ((uint64_t)sb->s_jnl_blocks[15] << 32) | sb->s_jnl_blocks[16];
+    if ((uint64_t)mapped * j->block_size < journal_bytes) {
+        print_str("Error: journal extents do not cover the journal inode");
+        print_newline();
+        return -1;
+    }
+
+    j->io_buffer = (uint8_t *)allocate(j->block_size);
+    j->tx_data = (uint8_t *)allocate((JOURNAL_MAX_TX_BLOCKS + 2) * j->block_size);
+    if (j->io_buffer == NULL || j->tx_data == NULL) {
+        print_str("Error: cannot allocate journal buffers");
+        print_newline();
+        journal_release(j);
+        return -1;
+    }
+
+    if (read_log_block(j, 0, j->io_buffer) != 0) {
+        journal_release(j);
+        return -1;
+    }
+
+    JournalSuperblock *jsb = (JournalSuperblock *)j->io_buffer;
+    uint32_t type = be32(jsb->s_header.h_blocktype);
+    uint32_t incompat = (type == JBD2_SUPERBLOCK_V2) ? be32(jsb->s_feature_incompat) : 0;
+    if (be32(jsb->s_header.h_magic) != JBD2_MAGIC_NUMBER ||
+        (type != JBD2_SUPERBLOCK_V1 && type != JBD2_SUPERBLOCK_V2) ||
+        be32(jsb->s_blocksize) != j->block_size || be32(jsb->s_maxlen) > mapped) {
+        print_str("Error: invalid jbd2 superblock");
+        print_newline();
+        journal_release(j);
+        return -1;
+    }
+    if (incompat & ~JOURNAL_REPLAY_INCOMPAT) {
+        print_str("Error: unsupported jbd2 incompatible features: ");
+        print_hex(incompat & ~JOURNAL_REPLAY_INCOMPAT);
+        print_newline();
+        journal_release(j);
+        return -1;
+    }
+
+    j->first = be32(jsb->s_first);
+    j->maxlen = be32(jsb->s_maxlen);
+    j->sequence = be32(jsb->s_sequence);
+    j->feature_compat = (type == JBD2_SUPERBLOCK_V2) ? be32(jsb->s_feature_compat) : 0;
+    memory_copy(j->uuid, jsb->s_uuid, sizeof(j->uuid));
+    uint32_t start = be32(jsb->s_start);
+    if (j->first == 0 || j->first >= j->maxlen || (start != 0 && (start < j->first || start >= j->maxlen))) {
+        print_str("Error: jbd2 log start outside the journal");
+        print_newline();
+        journal_release(j);
+        return -1;
+    }
+
+    if (start != 0 && journal_recover(j, start, j->sequence, incompat) != 0) {
+        journal_release(j);
+        return -1;
+    }
+
+    // The log is empty now, which lets us switch it to the feature set we
+    // write; the superblock is rewritten here after a replay, otherwise on
+    // the first commit
+    j->feature_compat = JOURNAL_WRITE_COMPAT;
+    j->head = j->first;
+    j->tail = 0;
+    if (start != 0 && (write_journal_superblock(j, 0, j->sequence) != 0 || journal_flush(j) != 0)) {
+        journal_release(j);
+        return -1;
+    }
+    return 0;
+}
+
+int journal_dirty_block(Journal *j, uint32_t blocknr, const uint8_t *data) {
+    if (j->tx_data == NULL) {
+        return -1;
+    }
+    j->stats.updates++;
+
+    // A block dirtied twice in one transaction is logged once
+    for (uint32_t i = 0; i < j->tx_count; i++) {
+        if (j->tx_blocknr[i] == blocknr) {
+            memory_copy(j->tx_data + (i + 1) * j->block_size, data, j->block_size);
+            return 0;
+        }
+    }
+
+    if (j->tx_count == JOURNAL_MAX_TX_BLOCKS && journal_commit(j) != 0) {
+        return -1;
+    }
+
+    j->tx_blocknr[j->tx_count] = blocknr;
+    memory_copy(j->tx_data + (j->tx_count + 1) * j->block_size, data, j->block_size);
+    j->tx_count++;
+    return 0;
+}
+
+static void checkpoint_track(Journal *j, uint32_t blocknr, uint32_t log_block, uint8_t escaped) {
+    for (uint32_t i = 0; i < j->cp_count; i++) {
+        if (j->cp_blocknr[i] == blocknr) {
+            j->cp_logblock[i] = log_block;
+            j->cp_escaped[i] = escaped;
+            return;
+        }
+    }
+    j->cp_blocknr[j->cp_count] = blocknr;
+    j->cp_logblock[j->cp_count] = log_block;
+    j->cp_escaped[j->cp_count] = escaped;
+    j->cp_count++;
+}
+
+/**
+ * journal_commit - Writes the running transaction to the log.
+ *
+ * tx_data is laid out exactly as the transaction appears on disk:
+ * descriptor, data blocks, commit block. The whole run goes out as one
+ * sequential write (two if it wraps the end of the log), followed by a
+ * single cache flush. The commit block carries a CRC32 of the other
+ * blocks, so recovery discards a transaction whose write was torn.
+ */
+int journal_commit(Journal *j) {
+    if (j->tx_count == 0) {
+        return 0;
+    }
+
+    uint32_t capacity = j->maxlen - j->first;
+    uint32_t needed = j->tx_count + 2;
+    if (needed >= capacity) {
+        print_str("Error: transaction larger than journal");
+        print_newline();
+        return -1;
+    }
+    if (log_used(j) + needed >= capacity || j->cp_count + j->tx_count > JOURNAL_MAX_CHECKPOINT) {
+        if (journal_checkpoint(j) != 0) {
+            return -1;
+        }
+    }
+
+    uint32_t bs = j->block_size;
+    uint8_t *descriptor = j->tx_data;
+    uint8_t *commit_block = j->tx_data + (j->tx_count + 1) * bs;
+    uint8_t escaped[JOURNAL_MAX_TX_BLOCKS];
+
+    // Descriptor block
+    memory_zero(descriptor, bs);
+    JournalHeader *header = (JournalHeader *)descriptor;
+    header->h_magic = be32(JBD2_MAGIC_NUMBER);
+    header->h_blocktype = be32(JBD2_DESCRIPTOR_BLOCK);
+    header->h_sequence = be32(j->sequence);
+
+    uint8_t *tag = descriptor + sizeof(JournalHeader);
+    for (uint32_t i = 0; i < j->tx_count; i++) {
+        uint8_t *data = j->tx_data + (i + 1) * bs;
+        uint16_t flags = (i > 0) ? JBD2_FLAG_SAME_UUID : 0;
+
+        // Data that looks like a journal header must not be mistaken for one
+        escaped[i] = (*(uint32_t *)data == be32(JBD2_MAGIC_NUMBER));
+        if (escaped[i]) {
+            *(uint32_t *)data = 0;
+            flags |= JBD2_FLAG_ESCAPE;
+        }
+        if (i == j->tx_count - 1) {
+            flags |= JBD2_FLAG_LAST_TAG;
+        }
+
+        *(uint32_t *)tag = be32(j->tx_blocknr[i]);
+        tag[4] = 0;
+        tag[5] = 0;
+        tag[6] = (uint8_t)(flags >> 8);
+        tag[7] = (uint8_t)flags;
+        tag += JOURNAL_TAG_BYTES;
+        if (i == 0) {
+            memory_copy(tag, j->uuid, sizeof(j->uuid));
+            tag += sizeof(j->uuid);
+        }
+    }
+
+    // Commit block with the CRC32 of descriptor + data
+    uint32_t crc = crc32_be(~0u, descriptor, (j->tx_count + 1) * bs);
+    memory_zero(commit_block, bs);
+    JournalCommitBlock *commit = (JournalCommitBlock *)commit_block;
+    commit->h.h_magic = be32(JBD2_MAGIC_NUMBER);
+    commit->h.h_blocktype = be32(JBD2_COMMIT_BLOCK);
+    commit->h.h_sequence = be32(j->sequence);
+    commit->h_chksum_type = JBD2_CRC32_CHKSUM;
+    commit->h_chksum_size = JBD2_CRC32_CHKSUM_SIZE;
+    commit->h_chksum[0] = be32(crc);
+
+    // First transaction after an empty log: point recovery at it. The flush
+    // below makes this and the transaction durable together.
+    if (j->tail == 0 && write_journal_superblock(j, j->head, j->sequence) != 0) {
+        return -1;
+    }
+
+    uint32_t first_run = j->maxlen - j->head;
+    if (first_run > needed) {
+        first_run = needed;
+    }
+    if (write_log_run(j, j->head, first_run, j->tx_data) != 0) {
+        return -1;
+    }
+    if (first_run < needed &&
+        write_log_run(j, j->first, needed - first_run, j->tx_data + first_run * bs) != 0) {
+        return -1;
+    }
+    if (journal_flush(j) != 0) {
+        return -1;
+    }
+
+    uint32_t log_block = j->head;
+    for (uint32_t i = 0; i < j->tx_count; i++) {
+        log_block = log_next(j, log_block);
+        checkpoint_track(j, j->tx_blocknr[i], log_block, escaped[i]);
+    }
+
+    if (j->tail == 0) {
+        j->tail = j->head;
+    }
+    j->head = log_next(j, log_next(j, log_block));
+    j->sequence++;
+    j->stats.transactions++;
+    j->stats.blocks_logged += j->tx_count;
+    j->tx_count = 0;
+    return 0;
+}
+
+int journal_checkpoint(Journal *j) {
+    if (j->cp_count == 0) {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < j->cp_count; i++) {
+        if (read_log_block(j, j->cp_logblock[i], j->io_buffer) != 0) {
+            return -1;
+        }
+        if (j->cp_escaped[i]) {
+            *(uint32_t *)j->io_buffer = be32(JBD2_MAGIC_NUMBER);
+        }
+        if (blockdev_write(j->dev, home_to_lba(j, j->cp_blocknr[i]), j->sectors_per_block,
+                           j->io_buffer) != 0) {
+            return -1;
+        }
+    }
+
+    // Home locations must be durable before the log is declared empty
+    if (journal_flush(j) != 0) {
+        return -1;
+    }
+    if (write_journal_superblock(j, 0, j->sequence) != 0) {
+        return -1;
+    }
+
+    j->cp_count = 0;
+    j->tail = 0;
+    j->head = j->first;
+    j->stats.checkpoints++;
+    return 0;
+}
+
+void journal_close(Journal *j) {
+    if (j->tx_data != NULL && j->io_buffer != NULL) {
+        if (journal_commit(j) == 0) {
+            journal_checkpoint(j);
+        }
+    }
+    journal_release(j);
+}
+
+void journal_print_stats(const Journal *j) {
+    print_str("Journal: ");
+    print_int(j->maxlen);
+    print_str(" blocks at block ");
+    print_int(j->journal_block);
+    print_str(", next transaction ");
+    print_int(j->sequence);
+    print_newline();
+    print_str("  transactions: ");
+    print_int(j->stats.transactions);
+    print_str(", updates: ");
+    print_int(j->stats.updates);
+    print_str(", blocks logged: ");
+    print_int(j->stats.blocks_logged);
+    print_newline();
+    print_str("  flushes: ");
+    print_int(j->stats.flushes);
+    print_str(", checkpoints: ");
+    print_int(j->stats.checkpoints);
+    print_str(", replayed blocks: ");
+    print_int(j->stats.replayed);
+    print_newline();
+}
@@ -0,0 +1,232 @@
+// keyboard.c - Interrupt-driven PS/2 keyboard (scancode set 1)
+#include "keyboard.h"
+#include "interrupts.h"
+#include "port.h"
+
+#define KEYBOARD_DATA_PORT      0x60
+#define KEYBOARD_STATUS_PORT    0x64
+#define KEYBOARD_OUTPUT_FULL    0x01
+#define KEYBOARD_AUX_DATA       0x20 // Byte came from the mouse port
+
+// Single producer (the IRQ handler), single consumer (keyboard_read_char).
+// Each side only writes its own index, so no lock is needed; the release
+// store of `ring_head` publishes the scancode written before it.
+#define SCANCODE_RING 256
+
+#define SCANCODE_RELEASE   0x80
+#define SCANCODE_EXTENDED  0xE0
+#define SCANCODE_PAUSE     0xE1 // Followed by five more bytes, no release
+
+#define KEY_LEFT_CTRL    0x1D
+#define KEY_LEFT_SHIFT   0x2A
+#define KEY_RIGHT_SHIFT  0x36
+#define KEY_LEFT_ALT     0x38
+#define KEY_CAPS_LOCK    0x3A
+#define KEY_NUM_LOCK     0x45
+#define KEY_KEYPAD_FIRST 0x47
+#define KEY_KEYPAD_LAST  0x53
+
+// Extended (0xE0-prefixed) make codes that produce characters
+#define KEY_EXT_KEYPAD_ENTER 0x1C
+#define KEY_EXT_KEYPAD_SLASH 0x35
+
+#define MOD_SHIFT_LEFT  0x01
+#define MOD_SHIFT_RIGHT 0x02
+#define MOD_CTRL        0x04
+#define MOD_ALT         0x08
+
+static uint8_t ring[SCANCODE_RING];
+static uint32_t ring_head = 0; // Written by the IRQ handler only
+static uint32_t ring_tail = 0; // Written by the consumer only
+static uint64_t dropped = 0;
+static int irq_mode = 0;
+
+// Decoder state, owned by the consumer
+static uint8_t modifiers = 0;
+static uint8_t extended = 0;
+static uint8_t pause_skip = 0;
+static uint8_t caps_lock = 0;
+static uint8_t locks_held = 0;
+static uint8_t num_lock = 1;
+
+static const char key_map[128] = {
+    0,  27, '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=', '\b',
+    '\t', 'q', 'w', 'e', 'r', 't', 'y', 'u', 'i', 'o', 'p', '[', ']', '\n',
+    0, 'a', 's', 'd', 'f', 'g', 'h', 'j', 'k', 'l', ';', '\'', '`',
+    0, '\\', 'z', 'x', 'c', 'v', 'b', 'n', 'm', ',', '.', '/', 0,
+    '*', 0, ' '
+};
+
+static const char shifted_key_map[128] = {
+    0,  27, '!', '@', '#', '$', '%', '^', '&', '*', '(', ')', '_', '+', '\b',
+    '\t', 'Q', 'W', 'E', 'R', 'T', 'Y', 'U', 'I', 'O', 'P', '{', '}', '\n',
+    0, 'A', 'S', 'D', 'F', 'G', 'H', 'J', 'K', 'L', ':', '"', '~',
+    0, '|', 'Z', 'X', 'C', 'V', 'B', 'N', 'M', '<', '>', '?', 0,
+    '*', 0, ' '
+};
+
+// Keypad 0x47-0x53 with Num Lock on
+static const char keypad_map[KEY_KEYPAD_LAST - KEY_KEYPAD_FIRST + 1] = {
+    '7', '8', '9', '-', '4', '5', '6', '+', '1', '2', '3', '0', '.'
+};
+
+static void keyboard_irq(InterruptFrame *frame) {
+    (void)frame;
+
+    uint32_t head = ring_head;
+    while (inb(KEYBOARD_STATUS_PORT) & KEYBOARD_OUTPUT_FULL) {
+        uint8_t status = inb(KEYBOARD_STATUS_PORT);
+        uint8_t scancode = inb(KEYBOARD_DATA_PORT);
+        if (status & KEYBOARD_AUX_DATA) {
+            continue;
+        }
+        if (head - __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE) == SCANCODE_RING) {
+            dropped++;
+            continue;
+        }
+        ring[head % SCANCODE_RING] = scancode;
+        head++;
+    }
+    __atomic_store_n(&ring_head, head, __ATOMIC_RELEASE);
+}
+
+void keyboard_init(void) {
+    // Anything typed before now was never decoded; start from a clean state
+    while (inb(KEYBOARD_STATUS_PORT) & KEYBOARD_OUTPUT_FULL) {
+        inb(KEYBOARD_DATA_PORT);
+    }
+    irq_register(IRQ_KEYBOARD, keyboard_irq);
+    irq_mode = 1;
+}
+
+uint64_t keyboard_dropped(void) {
+    return dropped;
+}
+
+static int next_scancode(void) {
+    if (!irq_mode) {
+        uint8_t status = inb(KEYBOARD_STATUS_PORT);
+        if (!(status & KEYBOARD_OUTPUT_FULL)) {
+            return -1;
+        }
+        uint8_t scancode = inb(KEYBOARD_DATA_PORT);
+        return (status & KEYBOARD_AUX_DATA) ? -1 : scancode;
+    }
+
+    uint32_t tail = ring_tail;
+    if (tail == __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE)) {
+        return -1;
+    }
+    uint8_t scancode = ring[tail % SCANCODE_RING];
+    __atomic_store_n(&ring_tail, tail + 1, __ATOMIC_RELEASE);
+    return scancode;
+}
+
+// Feeds one scancode through the set-1 state machine; returns the
+// character it completes, or -1 for prefixes, releases and modifiers
+static int decode(uint8_t scancode) {
+    if (pause_skip > 0) {
+        pause_skip--;
+        return -1;
+    }
+    if (scancode == SCANCODE_PAUSE) {
+        pause_skip = 5;
+        return -1;
+    }
+    if (scancode == SCANCODE_EXTENDED) {
+        extended = 1;
+        return -1;
+    }
+
+    int is_extended = extended;
+    int released = scancode & SCANCODE_RELEASE;
+    uint8_t key = scancode & ~SCANCODE_RELEASE;
+    extended = 0;
+
+    uint8_t modifier = 0;
+    if (key == KEY_LEFT_SHIFT && !is_extended) {
+        modifier = MOD_SHIFT_LEFT;
+    } else if (key == KEY_RIGHT_SHIFT && !is_extended) {
+        modifier = MOD_SHIFT_RIGHT;
+    } else if (key == KEY_LEFT_CTRL) {
+        modifier = MOD_CTRL; // Right Ctrl is the same code behind 0xE0
+    } else if (key == KEY_LEFT_ALT) {
+        modifier = MOD_ALT;
+    }
+    if (modifier) {
+        if (released) {
+            modifiers &= ~modifier;
+        } else {
+            modifiers |= modifier;
+        }
+        return -1;
+    }
+
+    // Lock keys toggle once per press, not on every typematic repeat
+    if (key == KEY_CAPS_LOCK || (key == KEY_NUM_LOCK && !is_extended)) {
+        uint8_t held_bit = (key == KEY_CAPS_LOCK) ? 1 : 2;
+        if (released) {
+            locks_held &= ~held_bit;
+        } else if (!(locks_held & held_bit)) {
+            locks_held |= held_bit;
+            if (key == KEY_CAPS_LOCK) {
+                caps_lock = !caps_lock;
+            } else {
+                num_lock = !num_lock;
+            }
+        }
+        return -1;
+    }
+
+    if (released) {
+        return -1;
+    }
+
+    if (is_extended) {
+        if (key == KEY_EXT_KEYPAD_ENTER) {
+            return '\n';
+        }
+        if (key == KEY_EXT_KEYPAD_SLASH) {
+            return '/';
+        }
+        return -1; // Cursor and navigation keys are not used by the shell
+    }
+
+    if (key >= KEY_KEYPAD_FIRST && key <= KEY_KEYPAD_LAST) {
+        char c = keypad_map[key - KEY_KEYPAD_FIRST];
+        if (num_lock || c == '-' || c == '+') {
+            return c;
+        }
+        return -1;
+    }
+
+    int shifted = (modifiers & (MOD_SHIFT_LEFT | MOD_SHIFT_RIGHT)) != 0;
+    char c = shifted ? shifted_key_map[key] : key_map[key];
+    if (c >= 'a' && c <= 'z') {
+        if (caps_lock) {
+            c = shifted_key_map[key];
+        }
+    } else if (c >= 'A' && c <= 'Z') {
+        if (caps_lock) {
+            c = key_map[key];
+        }
+    }
+    if (c == 0) {
+        return -1;
+    }
+    if ((modifiers & MOD_CTRL) && ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))) {
+        return c & 0x1F;
+    }
+    return c;
+}
+
+int keyboard_read_char(void) {
+    int scancode;
+    while ((scancode = next_scancode()) >= 0) {
+        int c = decode((uint8_t)scancode);
+        if (c >= 0) {
+            return c;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,121 @@
+// klog.c - lock-free kernel log ring
+#include "klog.h"
+#include "print.h"
+#include "timer.h"
+#include "kprintf.h"
+#include "ring.h"
+
+// Producers only touch the ring; nothing is shared with the console, so
+// logging costs a string copy
+static KlogRecord records[KLOG_RECORDS] __attribute__((aligned(64)));
+static Ring ring = RING_INIT(records);
+static uint64_t console_cursor = 0;
+static int console_level = KLOG_WARNING;
+static uint64_t boot_tsc = 0;
+
+static const char *level_names[] = {"error", "warn", "info", "debug"};
+
+void klog_init(void) {
+    boot_tsc = timer_tsc();
+}
+
+static uint16_t append_text(char *text, uint16_t length, const char *source) {
+    while (*source != '\0' && length < KLOG_TEXT_MAX - 1) {
+        text[length++] = *source++;
+    }
+    return length;
+}
+
+// Claims the next slot and marks it as being written
+static KlogRecord *klog_begin(int level, uint64_t *number) {
+    KlogRecord *record = ring_claim(&ring, number);
+    record->tsc = timer_tsc();
+    record->cpu = ring_cpu();
+    record->level = (uint8_t)level;
+    return record;
+}
+
+static void klog_write(int level, const char *message, int has_value, uint64_t value) {
+    uint64_t number;
+    KlogRecord *record = klog_begin(level, &number);
+
+    uint16_t length = append_text(record->text, 0, message);
+    if (has_value) {
+        char digits[21];
+        int count = 0;
+        do {
+            digits[count++] = '0' + (value % 10);
+            value /= 10;
+        } while (value != 0);
+        if (length < KLOG_TEXT_MAX - 1) {
+            record->text[length++] = ' ';
+        }
+        while (count > 0 && length < KLOG_TEXT_MAX - 1) {
+            record->text[length++] = digits[--count];
+        }
+    }
+    record->text[length] = '\0';
+    record->length = length;
+    ring_publish(record, number);
+}
+
+void klogf(int level, const char *format, ...) {
+    uint64_t number;
+    KlogRecord *record = klog_begin(level, &number);
+
+    va_list args;
+    va_start(args, format);
+    int length = kvsnprintf(record->text, KLOG_TEXT_MAX, format, args);
+    va_end(args);
+
+    record->length = (length < KLOG_TEXT_MAX) ? length : KLOG_TEXT_MAX - 1;
+    ring_publish(record, number);
+}
+
+void klog(int level, const char *message) {
+    klog_write(level, message, 0, 0);
+}
+
+void klog_value(int level, const char *message, uint64_t value) {
+    klog_write(level, message, 1, value);
+}
+
+uint64_t klog_oldest(void) {
+    return ring_oldest(&ring);
+}
+
+int klog_read(uint64_t *cursor, KlogRecord *record) {
+    if (!ring_read(&ring, cursor, record)) {
+        return 0;
+    }
+    record->text[KLOG_TEXT_MAX - 1] = '\0';
+    return 1;
+}
+
+const char *klog_level_name(int level) {
+    if (level < KLOG_ERROR || level > KLOG_DEBUG) {
+        return "?";
+    }
+    return level_names[level];
+}
+
+uint64_t klog_tsc_to_us(uint64_t tsc) {
+    return (tsc > boot_tsc) ? timer_tsc_to_us(tsc - boot_tsc) : 0;
+}
+
+void klog_set_console_level(int level) {
+    console_level = level;
+}
+
+void klog_drain_console(void) {
+    KlogRecord record;
+    while (klog_read(&console_cursor, &record)) {
+        if (record.level > console_level) {
+            continue;
+        }
+        print_str((char *)klog_level_name(record.level));
+        print_str(": ");
+        print_str(record.text);
+        print_newline();
+    }
+}
@@ -0,0 +1,249 @@
+// kprintf.c - printf-style formatting for the kernel
+#include "kprintf.h"
+#include "print.h"
+
+#define KPRINTF_BUFFER 512
+
+// "00" "01" ... "99": two decimal digits per division by 100
+static const char digit_pairs[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const char hex_lower[] = "0123456789abcdef";
+static const char hex_upper[] = "0123456789ABCDEF";
+
+// Bounded output; `length` keeps counting past the end like vsnprintf
+typedef struct {
+    char *buffer;
+    size_t size;
+    size_t length;
+} FormatOutput;
+
+static inline void out_char(FormatOutput *out, char c) {
+    if (out->length + 1 < out->size) {
+        out->buffer[out->length] = c;
+    }
+    out->length++;
+}
+
+static void out_repeat(FormatOutput *out, char c, int count) {
+    while (count-- > 0) {
+        out_char(out, c);
+    }
+}
+
+/**
+ * format_decimal - Writes `value` in decimal, right-aligned at `end`.
+ *
+ * Returns the number of digits; they occupy end[-digits] .. end[-1].
+ * Two digits are produced per division via the digit_pairs table.
+ */
+int format_decimal(char *end, uint64_t value) {
+    char *p = end;
+    while (value >= 100) {
+        uint64_t quotient = value / 100;
+        uint32_t pair = (uint32_t)(value - quotient * 100) * 2;
+        p -= 2;
+        p[0] = digit_pairs[pair];
+        p[1] = digit_pairs[pair + 1];
+        value = quotient;
+    }
+    if (value >= 10) {
+        p -= 2;
+        p[0] = digit_pairs[value * 2];
+        p[1] = digit_pairs[value * 2 + 1];
+    } else {
+        *--p = (char)('0' + value);
+    }
+    return (int)(end - p);
+}
+
+static int format_hex(char *end, uint64_t value, const char *digits) {
+    char *p = end;
+    do {
+        *--p = digits[value & 0xF];
+        value >>= 4;
+    } while (value != 0);
+    return (int)(end - p);
+}
+
+// Emits a converted number with sign/prefix, zero or space padding
+static void out_number(FormatOutput *out, const char *digits, int count, const char *prefix,
+                       int width, int left, int zero_pad) {
+    int prefix_length = 0;
+    while (prefix[prefix_length] != '\0') {
+        prefix_length++;
+    }
+    int padding = width - count - prefix_length;
+
+    if (!left && !zero_pad) {
+        out_repeat(out, ' ', padding);
+    }
+    for (int i = 0; i < prefix_length; i++) {
+        out_char(out, prefix[i]);
+    }
+    if (!left && zero_pad) {
+        out_repeat(out, '0', padding);
+    }
+    for (int i = 0; i < count; i++) {
+        out_char(out, digits[i]);
+    }
+    if (left) {
+        out_repeat(out, ' ', padding);
+    }
+}
+
+/**
+ * kvsnprintf - Formats into `buffer`, which is always NUL terminated.
+ *
+ * Supports %d %i %u %x %X %p %s %c and %%, the flags '-', '0' and
+ * '#', a width (digits or '*'), a precision for %s, and the length
+ * modifiers h, l, ll and z. Returns the length the full output would
+ * have, as vsnprintf does.
+ */
+int kvsnprintf(char *buffer, size_t size, const char *format, va_list args) {
+    FormatOutput out = {buffer, size, 0};
+    char digits[24];
+    char *digits_end = digits + sizeof(digits);
+
+    while (*format != '\0') {
+        if (*format != '%') {
+            out_char(&out, *format++);
+            continue;
+        }
+        format++;
+
+        int left = 0;
+        int zero_pad = 0;
+        int alternate = 0;
+        for (;; format++) {
+            if (*format == '-') {
+                left = 1;
+            } else if (*format == '0') {
+                zero_pad = 1;
+            } else if (*format == '#') {
+                alternate = 1;
+            } else {
+                break;
+            }
+        }
+
+        int width = 0;
+        if (*format == '*') {
+            width = va_arg(args, int);
+            if (width < 0) {
+                left = 1;
+                width = -width;
+            }
+            format++;
+        }
+        while (*format >= '0' && *format <= '9') {
+            width = width * 10 + (*format++ - '0');
+        }
+
+        int precision = -1;
+        if (*format == '.') {
+            format++;
+            precision = 0;
+            while (*format >= '0' && *format <= '9') {
+                precision = precision * 10 + (*format++ - '0');
+            }
+        }
+
+        int is_long = 0;
+        while (*format == 'l' || *format == 'z' || *format == 'h') {
+            if (*format != 'h') {
+                is_long = 1; // long, long long and size_t are all 64-bit here
+            }
+            format++;
+        }
+
+        char conversion = *format;
+        if (conversion == '\0') {
+            break;
+        }
+        format++;
+
+        switch (conversion) {
+        case 'd':
+        case 'i': {
+            int64_t value = is_long ? va_arg(args, int64_t) : va_arg(args, int);
+            uint64_t magnitude = (value < 0) ? (uint64_t)0 - (uint64_t)value : (uint64_t)value;
+            int count = format_decimal(digits_end, magnitude);
+            out_number(&out, digits_end - count, count, (value < 0) ? "-" : "", width, left, zero_pad);
+            break;
+        }
+        case 'u': {
+            uint64_t value = is_long ? va_arg(args, uint64_t) : va_arg(args, unsigned int);
+            int count = format_decimal(digits_end, value);
+            out_number(&out, digits_end - count, count, "", width, left, zero_pad);
+            break;
+        }
+        case 'x':
+        case 'X': {
+            uint64_t value = is_long ? va_arg(args, uint64_t) : va_arg(args, unsigned int);
+            int count = format_hex(digits_end, value, (conversion == 'x') ? hex_lower : hex_upper);
+            const char *prefix = (alternate && value != 0) ? ((conversion == 'x') ? "0x" : "0X") : "";
+            out_number(&out, digits_end - count, count, prefix, width, left, zero_pad);
+            break;
+        }
+        case 'p': {
+            uint64_t value = (uint64_t)va_arg(args, void *);
+            int count = format_hex(digits_end, value, hex_lower);
+            out_number(&out, digits_end - count, count, "0x", width, left, zero_pad);
+            break;
+        }
+        case 's': {
+            const char *text = va_arg(args, const char *);
+            if (text == 0) {
+                text = "(null)";
+            }
+            int length = 0;
+            while (text[length] != '\0' && (precision < 0 || length < precision)) {
+                length++;
+            }
+            out_number(&out, text, length, "", width, left, 0);
+            break;
+        }
+        case 'c': {
+            char c = (char)va_arg(args, int);
+            out_number(&out, &c, 1, "", width, left, 0);
+            break;
+        }
+        default:
+            out_char(&out, conversion); // Includes "%%"
+            break;
+        }
+    }
+
+    if (size > 0) {
+        buffer[(out.length < size) ? out.length : size - 1] = '\0';
+    }
+    return (int)out.length;
+}
+
+int ksnprintf(char *buffer, size_t size, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = kvsnprintf(buffer, size, format, args);
+    va_end(args);
+    return length;
+}
+
+// Output beyond KPRINTF_BUFFER - 1 characters is cut off
+int kprintf(const char *format, ...) {
+    char buffer[KPRINTF_BUFFER];
+    va_list args;
+    va_start(args, format);
+    int length = kvsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    if (length > (int)sizeof(buffer) - 1) {
+        length = sizeof(buffer) - 1;
+    }
+    print_write(buffer, length);
+    return length;
+}
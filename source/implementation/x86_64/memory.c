@@ -128,20 +128,42 @@ void memory_zero(void* dest, size_t length) {
     memory_set(dest, 0, length);
 }
 
+// 16-byte SSE2 lane used by memory_is_zero
+typedef uint64_t zero_vector __attribute__((vector_size(16)));
+
 /**
  * memory_is_zero - Checks if a memory block is filled with zeros.
  * 
  * @param ptr: Pointer to the memory block.
  * @param length: Number of bytes to check.
  * 
- * This function checks whether all 'length' bytes in the memory block 
- * pointed to by 'ptr' are zeros. It returns 1 if all bytes are zero, 
- * and 0 otherwise.
+ * Bytes are checked one at a time up to a 16-byte boundary, then 64 bytes
+ * per iteration are OR-ed together in SSE2 registers so a zero chunk costs
+ * one test per cache line. Returns as soon as a non-zero byte is seen.
  * 
  * @return: Returns 1 if all bytes are zero, 0 otherwise.
  */
 int memory_is_zero(const void* ptr, size_t length) {
     const unsigned char* p = (const unsigned char*)ptr;
+
+    while (length > 0 && ((uintptr_t)p & 15) != 0) {
+        if (*p++ != 0) {
+            return 0;
+        }
+        length--;
+    }
+
+    const zero_vector* v = (const zero_vector*)p;
+    while (length >= 64) {
+        zero_vector acc = v[0] | v[1] | v[2] | v[3];
+        if ((acc[0] | acc[1]) != 0) {
+            return 0;
+        }
+        v += 4;
+        length -= 64;
+    }
+
+    p = (const unsigned char*)v;
     while (length-- > 0) {
         if (*p++ != 0) {
             return 0;
@@ -1,11 +1,17 @@
 #include "memory_allocator.h"
 #include <stdint.h>
+#include "pmm.h"
+#include "paging.h"
+#include "klog.h"
+#include "trace.h"
 
-// The size of the memory pool in bytes
-#define MEMORY_POOL_SIZE 1024 * 1024 * 100 // 100 MB pool
+// The pool takes up to this much, and at most half of free memory
+#define MEMORY_POOL_MAX (1024 * 1024 * 100) // 100 MB
+#define MEMORY_POOL_MIN (1024 * 1024)
 
-// Memory pool where the allocations will come from
-static uint8_t memory_pool[MEMORY_POOL_SIZE];
+// Disk DMA goes straight to pool buffers, so the pool is physically
+// contiguous and below the 4 GiB the IDE bus master can reach
+#define MEMORY_POOL_LIMIT 0x100000000ULL
 
 // Structure to represent a block of memory
 typedef struct MemoryBlock {
@@ -15,20 +21,41 @@ typedef struct MemoryBlock {
 } MemoryBlock;
 
 // Pointer to the first block in the free list
-static MemoryBlock* free_list = (MemoryBlock*)memory_pool;
+static MemoryBlock* free_list = NULL;
 
 /**
  * memory_allocator_init - Initializes the memory allocator.
  * 
- * This function sets up the memory pool by initializing the free list 
- * with a single large block representing the entire memory pool. 
- * It marks the block as free and available for allocation. 
- * This function should be called before any allocation requests.
+ * This function carves the memory pool out of free physical memory, 
+ * reached through the direct map, and initializes the free list with 
+ * a single large block covering it. Nothing needs zeroing up front, 
+ * unlike a pool in the kernel's BSS. Call after pmm_init() and before 
+ * any allocation requests.
  */
 void memory_allocator_init() {
-    free_list->size = MEMORY_POOL_SIZE - sizeof(MemoryBlock);
+    PmmStats stats;
+    pmm_get_stats(&stats);
+
+    uint64_t size = stats.free_frames * PMM_FRAME_SIZE / 2;
+    if (size > MEMORY_POOL_MAX) {
+        size = MEMORY_POOL_MAX;
+    }
+    size &= ~(uint64_t)(PMM_FRAME_SIZE - 1);
+
+    uint64_t phys = 0;
+    while (size >= MEMORY_POOL_MIN && (phys = pmm_alloc_contiguous(size / PMM_FRAME_SIZE, MEMORY_POOL_LIMIT)) == 0) {
+        size /= 2;
+    }
+    if (phys == 0) {
+        klogf(KLOG_ERROR, "heap: no free memory for the pool");
+        return;
+    }
+
+    free_list = (MemoryBlock*)phys_to_virt(phys);
+    free_list->size = size - sizeof(MemoryBlock);
     free_list->is_free = 1;
     free_list->next = NULL;
+    klogf(KLOG_INFO, "heap: %lu MiB pool at physical 0x%lx", size >> 20, phys);
 }
 
 /**
@@ -46,6 +73,7 @@ void memory_allocator_init() {
  * allocation fails.
  */
 void* allocate(size_t size) {
+    TRACE_SCOPE("heap:allocate", size);
     MemoryBlock* current = free_list;
 
     while (current != NULL) {
@@ -85,6 +113,7 @@ void* allocate(size_t size) {
  * @return: None.
  */
 void free(void* ptr) {
+    TRACE_SCOPE("heap:free", 0);
     if (ptr == NULL) {
         return;
     }
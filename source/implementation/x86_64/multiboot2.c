@@ -0,0 +1,148 @@
+// multiboot2.c
+#include "multiboot2.h"
+
+// Everything below this is identity mapped by the boot page tables
+#define MULTIBOOT2_MAPPED_LIMIT 0x100000000ULL
+
+static const uint8_t *info_start = 0;
+static uint32_t info_size = 0;
+static const char *boot_cmdline = "";
+static BootModule modules[MULTIBOOT2_MAX_MODULES];
+static int module_count = 0;
+
+// Tags follow an 8-byte header and are each padded to 8 bytes
+#define FOR_EACH_TAG(tag) \
+    for (const Multiboot2Tag *tag = (const Multiboot2Tag *)(info_start + 8); \
+         (const uint8_t *)tag + sizeof(Multiboot2Tag) <= info_start + info_size && \
+         tag->type != MULTIBOOT2_TAG_END; \
+         tag = (const Multiboot2Tag *)((const uint8_t *)tag + ((tag->size + 7) & ~7u)))
+
+void multiboot2_init(uint64_t info_addr) {
+    if (info_addr == 0 || (info_addr & 7) || info_addr >= MULTIBOOT2_MAPPED_LIMIT) {
+        return;
+    }
+    info_start = (const uint8_t *)info_addr;
+    info_size = *(const uint32_t *)info_start;
+    if (info_addr + info_size > MULTIBOOT2_MAPPED_LIMIT) {
+        info_start = 0;
+        info_size = 0;
+        return;
+    }
+
+    FOR_EACH_TAG(tag) {
+        if (tag->size < sizeof(Multiboot2Tag)) {
+            break;
+        }
+        if (tag->type == MULTIBOOT2_TAG_CMDLINE) {
+            boot_cmdline = (const char *)tag + sizeof(Multiboot2Tag);
+        } else if (tag->type == MULTIBOOT2_TAG_MODULE && module_count < MULTIBOOT2_MAX_MODULES) {
+            // 32-bit addresses, so modules always lie in the mapped range
+            const Multiboot2ModuleTag *module = (const Multiboot2ModuleTag *)tag;
+            if (module->mod_end <= module->mod_start) {
+                continue;
+            }
+            modules[module_count].start = (uint8_t *)(uint64_t)module->mod_start;
+            modules[module_count].size = module->mod_end - module->mod_start;
+            modules[module_count].cmdline = module->cmdline;
+            module_count++;
+        }
+    }
+}
+
+const char *multiboot2_cmdline(void) {
+    return boot_cmdline;
+}
+
+int multiboot2_cmdline_option(const char *key, char *value, int size) {
+    const char *option = boot_cmdline;
+
+    while (*option != '\0') {
+        while (*option == ' ') {
+            option++;
+        }
+
+        int i = 0;
+        while (key[i] != '\0' && option[i] == key[i]) {
+            i++;
+        }
+        const char *end = option + i;
+        if (key[i] == '\0' && (*end == '\0' || *end == ' ' || *end == '=')) {
+            int length = 0;
+            if (*end == '=') {
+                end++;
+                while (end[length] != '\0' && end[length] != ' ' && length < size - 1) {
+                    value[length] = end[length];
+                    length++;
+                }
+            }
+            if (size > 0) {
+                value[length] = '\0';
+            }
+            return 0;
+        }
+
+        while (*option != '\0' && *option != ' ') {
+            option++;
+        }
+    }
+    return -1;
+}
+
+const BootModule *multiboot2_find_module(const char *name) {
+    for (int i = 0; i < module_count; i++) {
+        const char *cmdline = modules[i].cmdline;
+        int j = 0;
+        while (name[j] != '\0' && cmdline[j] == name[j]) {
+            j++;
+        }
+        if (name[j] == '\0' && cmdline[j] == '\0') {
+            return &modules[i];
+        }
+    }
+    return 0;
+}
+
+void multiboot2_info_range(uint64_t *start, uint64_t *size) {
+    *start = (uint64_t)info_start;
+    *size = info_size;
+}
+
+int multiboot2_module_count(void) {
+    return module_count;
+}
+
+const BootModule *multiboot2_module(int index) {
+    if (index < 0 || index >= module_count) {
+        return 0;
+    }
+    return &modules[index];
+}
+
+int multiboot2_mmap_count(void) {
+    const Multiboot2MmapTag *tag = (const Multiboot2MmapTag *)multiboot2_find_tag(MULTIBOOT2_TAG_MMAP);
+    if (tag == 0 || tag->entry_size < sizeof(Multiboot2MmapEntry) || tag->size < sizeof(Multiboot2MmapTag)) {
+        return 0;
+    }
+    return (tag->size - sizeof(Multiboot2MmapTag)) / tag->entry_size;
+}
+
+const Multiboot2MmapEntry *multiboot2_mmap_entry(int index) {
+    if (index < 0 || index >= multiboot2_mmap_count()) {
+        return 0;
+    }
+    const Multiboot2MmapTag *tag = (const Multiboot2MmapTag *)multiboot2_find_tag(MULTIBOOT2_TAG_MMAP);
+    return (const Multiboot2MmapEntry *)((const uint8_t *)tag + sizeof(Multiboot2MmapTag) +
+                                         (uint64_t)index * tag->entry_size);
+}
+
+const Multiboot2Tag *multiboot2_find_tag(uint32_t type) {
+    if (info_start == 0) {
+        return 0;
+    }
+    FOR_EACH_TAG(tag) {
+        if (tag->type == type) {
+            return tag;
+        }
+    }
+    return 0;
+}
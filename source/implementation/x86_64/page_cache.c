@@ -0,0 +1,314 @@
+// page_cache.c
+#include "page_cache.h"
+#include "memory.h"
+#include "memory_allocator.h"
+
+#define RADIX_SHIFT 6
+#define RADIX_SLOTS (1 << RADIX_SHIFT)
+#define RADIX_MASK  (RADIX_SLOTS - 1)
+#define RADIX_MAX_HEIGHT 11   // 64 - PAGE_SHIFT bits of index, 6 per level
+
+typedef struct RadixNode {
+    void *slots[RADIX_SLOTS];
+    uint32_t count;           // Non-empty slots
+} RadixNode;
+
+// LRU list: head is the most recently used page
+static CachePage *lru_head = NULL;
+static CachePage *lru_tail = NULL;
+static PageCacheStats stats = {0, 0, 0, 0, 0, PAGE_CACHE_MAX_PAGES, 0};
+
+static RadixNode *radix_node_alloc(void) {
+    RadixNode *node = (RadixNode *)allocate(sizeof(RadixNode));
+    if (node != NULL) {
+        memory_zero(node, sizeof(RadixNode));
+        stats.nodes++;
+    }
+    return node;
+}
+
+static void radix_node_free(RadixNode *node) {
+    free(node);
+    stats.nodes--;
+}
+
+static uint64_t radix_capacity(uint32_t height) {
+    return (height >= RADIX_MAX_HEIGHT) ? ~0ULL : (1ULL << (height * RADIX_SHIFT));
+}
+
+static CachePage *radix_lookup(PageTree *tree, uint64_t index) {
+    if (tree->height == 0 || index >= radix_capacity(tree->height)) {
+        return NULL;
+    }
+
+    RadixNode *node = (RadixNode *)tree->root;
+    for (uint32_t level = tree->height - 1; node != NULL; level--) {
+        void *slot = node->slots[(index >> (level * RADIX_SHIFT)) & RADIX_MASK];
+        if (level == 0) {
+            return (CachePage *)slot;
+        }
+        node = (RadixNode *)slot;
+    }
+    return NULL;
+}
+
+static int radix_insert(PageTree *tree, uint64_t index, CachePage *page) {
+    // Grow the tree upwards until the index fits
+    while (tree->height == 0 || index >= radix_capacity(tree->height)) {
+        RadixNode *root = radix_node_alloc();
+        if (root == NULL) {
+            return -1;
+        }
+        if (tree->root != NULL) {
+            root->slots[0] = tree->root;
+            root->count = 1;
+        }
+        tree->root = root;
+        tree->height++;
+    }
+
+    RadixNode *node = (RadixNode *)tree->root;
+    for (uint32_t level = tree->height - 1; level > 0; level--) {
+        uint32_t offset = (index >> (level * RADIX_SHIFT)) & RADIX_MASK;
+        if (node->slots[offset] == NULL) {
+            RadixNode *child = radix_node_alloc();
+            if (child == NULL) {
+                return -1;
+            }
+            node->slots[offset] = child;
+            node->count++;
+        }
+        node = (RadixNode *)node->slots[offset];
+    }
+
+    node->slots[index & RADIX_MASK] = page;
+    node->count++;
+    tree->nr_pages++;
+    return 0;
+}
+
+static void radix_delete(PageTree *tree, uint64_t index) {
+    RadixNode *path[RADIX_MAX_HEIGHT];
+    uint32_t offsets[RADIX_MAX_HEIGHT];
+
+    if (tree->height == 0 || index >= radix_capacity(tree->height)) {
+        return;
+    }
+
+    RadixNode *node = (RadixNode *)tree->root;
+    uint32_t depth = 0;
+    for (uint32_t level = tree->height - 1; ; level--) {
+        if (node == NULL) {
+            return;
+        }
+        path[depth] = node;
+        offsets[depth] = (index >> (level * RADIX_SHIFT)) & RADIX_MASK;
+        if (level == 0) {
+            break;
+        }
+        node = (RadixNode *)node->slots[offsets[depth]];
+        depth++;
+    }
+
+    if (path[depth]->slots[offsets[depth]] == NULL) {
+        return;
+    }
+    tree->nr_pages--;
+
+    // Clear the slot and release nodes that became empty, bottom-up
+    for (int d = (int)depth; d >= 0; d--) {
+        path[d]->slots[offsets[d]] = NULL;
+        path[d]->count--;
+        if (path[d]->count != 0) {
+            return;
+        }
+        radix_node_free(path[d]);
+        if (d == 0) {
+            tree->root = NULL;
+            tree->height = 0;
+        }
+    }
+}
+
+static void lru_unlink(CachePage *page) {
+    if (page->lru_prev) {
+        page->lru_prev->lru_next = page->lru_next;
+    } else {
+        lru_head = page->lru_next;
+    }
+    if (page->lru_next) {
+        page->lru_next->lru_prev = page->lru_prev;
+    } else {
+        lru_tail = page->lru_prev;
+    }
+    page->lru_prev = NULL;
+    page->lru_next = NULL;
+}
+
+static void lru_push_front(CachePage *page) {
+    page->lru_prev = NULL;
+    page->lru_next = lru_head;
+    if (lru_head) {
+        lru_head->lru_prev = page;
+    }
+    lru_head = page;
+    if (lru_tail == NULL) {
+        lru_tail = page;
+    }
+}
+
+// Takes the least recently used unpinned page away from its owner for reuse
+static CachePage *page_cache_reclaim(void) {
+    for (CachePage *page = lru_tail; page != NULL; page = page->lru_prev) {
+        if (page->refcount == 0) {
+            lru_unlink(page);
+            radix_delete(page->tree, page->index);
+            stats.evictions++;
+            return page;
+        }
+    }
+    return NULL;
+}
+
+// Finds a page slot; `own_buffer` says whether the caller needs a private PAGE_SIZE buffer
+static CachePage *page_cache_new_page(int own_buffer) {
+    CachePage *page = NULL;
+    if (stats.pages < stats.max_pages) {
+        page = (CachePage *)allocate(sizeof(CachePage));
+        if (page != NULL) {
+            page->data = NULL;
+            page->mapped = 1; // No buffer yet
+            stats.pages++;
+        }
+    }
+    if (page == NULL) {
+        page = page_cache_reclaim();
+        if (page == NULL) {
+            return NULL;
+        }
+    }
+
+    // A recycled page may come with or without a buffer of its own
+    if (own_buffer && page->mapped) {
+        page->data = (uint8_t *)allocate(PAGE_SIZE);
+        if (page->data == NULL) {
+            free(page);
+            stats.pages--;
+            return NULL;
+        }
+        page->mapped = 0;
+    } else if (!own_buffer && !page->mapped) {
+        free(page->data);
+        page->data = NULL;
+        page->mapped = 1;
+    }
+    return page;
+}
+
+static void page_cache_free_page(CachePage *page) {
+    if (!page->mapped) {
+        free(page->data);
+    }
+    free(page);
+    stats.pages--;
+}
+
+static CachePage *page_cache_hit(CachePage *page) {
+    stats.hits++;
+    lru_unlink(page);
+    lru_push_front(page);
+    page->refcount++;
+    return page;
+}
+
+static void page_cache_init_page(CachePage *page, PageTree *tree, uint64_t index) {
+    page->index = index;
+    page->tree = tree;
+    page->refcount = 1;
+    page->lru_prev = NULL;
+    page->lru_next = NULL;
+}
+
+/**
+ * page_cache_get - Looks up a file page, reading it in on a miss.
+ *
+ * The returned page stays pinned until page_cache_put(); callers read
+ * page->data in place, so file contents are never copied out of the cache.
+ */
+CachePage *page_cache_get(PageTree *tree, uint64_t index, PageFiller fill, void *context) {
+    CachePage *page = radix_lookup(tree, index);
+    if (page != NULL) {
+        return page_cache_hit(page);
+    }
+
+    stats.misses++;
+    page = page_cache_new_page(1);
+    if (page == NULL) {
+        return NULL;
+    }
+    page_cache_init_page(page, tree, index);
+
+    if (fill(context, index, page->data) != 0 || radix_insert(tree, index, page) != 0) {
+        page_cache_free_page(page);
+        return NULL;
+    }
+    stats.fill_bytes += PAGE_SIZE;
+    lru_push_front(page);
+    return page;
+}
+
+/**
+ * page_cache_get_mapped - Like page_cache_get() for memory-resident objects.
+ *
+ * The page points straight at the bytes returned by `map` instead of a
+ * private buffer, so nothing is copied; only the small CachePage is
+ * allocated, and it is indexed and recycled like any other page.
+ */
+CachePage *page_cache_get_mapped(PageTree *tree, uint64_t index, PageMapper map, void *context) {
+    CachePage *page = radix_lookup(tree, index);
+    if (page != NULL) {
+        return page_cache_hit(page);
+    }
+
+    stats.misses++;
+    uint8_t *data = map(context, index);
+    if (data == NULL) {
+        return NULL;
+    }
+    page = page_cache_new_page(0);
+    if (page == NULL) {
+        return NULL;
+    }
+    page_cache_init_page(page, tree, index);
+    page->data = data;
+
+    if (radix_insert(tree, index, page) != 0) {
+        page_cache_free_page(page);
+        return NULL;
+    }
+    lru_push_front(page);
+    return page;
+}
+
+void page_cache_put(CachePage *page) {
+    if (page != NULL && page->refcount > 0) {
+        page->refcount--;
+    }
+}
+
+void page_cache_drop_tree(PageTree *tree) {
+    CachePage *page = lru_head;
+    while (page != NULL && tree->nr_pages > 0) {
+        CachePage *next = page->lru_next;
+        if (page->tree == tree) {
+            lru_unlink(page);
+            radix_delete(tree, page->index);
+            page_cache_free_page(page);
+        }
+        page = next;
+    }
+}
+
+void page_cache_get_stats(PageCacheStats *out) {
+    *out = stats;
+}
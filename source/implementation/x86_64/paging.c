@@ -0,0 +1,293 @@
+// paging.c - Direct map, MMIO mappings and memory types
+#include "paging.h"
+#include "multiboot2.h"
+#include "klog.h"
+
+#define PAGE_4K 0x1000ULL
+#define PAGE_2M 0x200000ULL
+#define PAGE_1G 0x40000000ULL
+
+#define CPUID_EDX_PGE      (1 << 13)
+#define CPUID_EDX_PAT      (1 << 16)
+#define CPUID_EDX_1G_PAGES (1 << 26) // Leaf 0x80000001
+#define CR4_PGE            (1 << 7)
+
+// PAT entries 0-3 (selected by PWT and PCD) become WB, WC, UC-, UC and
+// 4-7 repeat them; the power-on default has WT where WC is now
+#define MSR_PAT   0x277
+#define PAT_VALUE 0x0007010600070106ULL
+
+// Without 1 GiB pages every GiB of direct map costs one page directory,
+// and each unaligned end of a RAM range can cost a directory and a table
+#define PAGING_POOL_TABLES    128
+#define DIRECT_MAP_MAX_RANGES 32
+#define IDENTITY_MAP_END   0x100000000ULL // Boot tables map the low 4 GiB 1:1
+
+// Page tables come from the kernel image, so KERNEL_VMA + physical
+// address always reaches them
+static uint64_t table_pool[PAGING_POOL_TABLES][512] __attribute__((aligned(4096)));
+static uint32_t tables_used = 0;
+
+static uint64_t *pml4 = 0;
+static int has_1g_pages = 0;
+static int has_pat = 0;
+static int has_global_pages = 0;
+static uint64_t direct_map_bytes = 0;
+static int direct_map_count = 0;
+static struct {
+    uint64_t start;
+    uint64_t end;
+} direct_map[DIRECT_MAP_MAX_RANGES];
+static uint64_t direct_map_page_size = 0;
+static uint64_t mmio_next = MMIO_BASE;
+
+static inline void cpuid(uint32_t leaf, uint32_t *ecx, uint32_t *edx) {
+    uint32_t eax = leaf, ebx;
+    *ecx = 0;
+    asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(*ecx), "=d"(*edx));
+}
+
+static inline void write_msr(uint32_t msr, uint64_t value) {
+    asm volatile("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+static inline uint64_t *table_virt(uint64_t entry) {
+    return (uint64_t *)((entry & PTE_ADDRESS) + KERNEL_VMA);
+}
+
+// Returns the table an entry points to, allocating it if absent
+static uint64_t *next_table(uint64_t *table, int index) {
+    if (!(table[index] & PTE_PRESENT)) {
+        if (tables_used == PAGING_POOL_TABLES) {
+            return 0;
+        }
+        uint64_t *fresh = table_pool[tables_used++];
+        table[index] = ((uint64_t)fresh - KERNEL_VMA) | PTE_PRESENT | PTE_WRITABLE;
+    }
+    return table_virt(table[index]);
+}
+
+// Maps with the largest pages that alignment allows; -1 when out of tables
+static int map_range(uint64_t virt, uint64_t phys, uint64_t size, uint64_t flags) {
+    while (size > 0) {
+        uint64_t *pdpt = next_table(pml4, (virt >> 39) & 511);
+        if (pdpt == 0) {
+            return -1;
+        }
+        if (has_1g_pages && ((virt | phys) & (PAGE_1G - 1)) == 0 && size >= PAGE_1G) {
+            pdpt[(virt >> 30) & 511] = phys | flags | PTE_HUGE | PTE_PRESENT;
+            virt += PAGE_1G;
+            phys += PAGE_1G;
+            size -= PAGE_1G;
+            continue;
+        }
+
+        uint64_t *pd = next_table(pdpt, (virt >> 30) & 511);
+        if (pd == 0) {
+            return -1;
+        }
+        if (((virt | phys) & (PAGE_2M - 1)) == 0 && size >= PAGE_2M) {
+            pd[(virt >> 21) & 511] = phys | flags | PTE_HUGE | PTE_PRESENT;
+            virt += PAGE_2M;
+            phys += PAGE_2M;
+            size -= PAGE_2M;
+            continue;
+        }
+
+        uint64_t *pt = next_table(pd, (virt >> 21) & 511);
+        if (pt == 0) {
+            return -1;
+        }
+        pt[(virt >> 12) & 511] = phys | flags | PTE_PRESENT;
+        virt += PAGE_4K;
+        phys += PAGE_4K;
+        size -= PAGE_4K;
+    }
+    return 0;
+}
+
+// Collects what the firmware calls memory, page aligned, sorted and merged
+// so that no two ranges share a page. Holes such as the PCI window and
+// the LAPIC stay out of the direct map and only get mmio_map() mappings.
+static void collect_ram_ranges(void) {
+    for (int i = 0; i < multiboot2_mmap_count(); i++) {
+        const Multiboot2MmapEntry *entry = multiboot2_mmap_entry(i);
+        if (entry->type != MULTIBOOT2_MEMORY_AVAILABLE &&
+            entry->type != MULTIBOOT2_MEMORY_ACPI_RECLAIMABLE &&
+            entry->type != MULTIBOOT2_MEMORY_NVS) {
+            continue;
+        }
+        uint64_t start = entry->base_addr & ~(PAGE_4K - 1);
+        uint64_t end = (entry->base_addr + entry->length + PAGE_4K - 1) & ~(PAGE_4K - 1);
+        if (end <= start) {
+            continue;
+        }
+        if (direct_map_count == DIRECT_MAP_MAX_RANGES) {
+            klogf(KLOG_WARNING, "paging: more than %d RAM ranges, 0x%lx-0x%lx left out",
+                  DIRECT_MAP_MAX_RANGES, start, end);
+            continue;
+        }
+
+        int slot = direct_map_count++;
+        while (slot > 0 && direct_map[slot - 1].start > start) {
+            direct_map[slot] = direct_map[slot - 1];
+            slot--;
+        }
+        direct_map[slot].start = start;
+        direct_map[slot].end = end;
+    }
+
+    int merged = 0;
+    for (int i = 0; i < direct_map_count; i++) {
+        if (merged > 0 && direct_map[i].start <= direct_map[merged - 1].end) {
+            if (direct_map[i].end > direct_map[merged - 1].end) {
+                direct_map[merged - 1].end = direct_map[i].end;
+            }
+        } else {
+            direct_map[merged++] = direct_map[i];
+        }
+    }
+    direct_map_count = merged;
+}
+
+// 1 if [phys, phys + size) lies inside a single direct-mapped RAM range
+static int direct_map_contains(uint64_t phys, uint64_t size) {
+    for (int i = 0; i < direct_map_count; i++) {
+        if (phys >= direct_map[i].start && phys < direct_map[i].end) {
+            return size <= direct_map[i].end - phys;
+        }
+    }
+    return 0;
+}
+
+void paging_init(void) {
+    uint32_t ecx, edx;
+    uint64_t cr3, cr4;
+
+    cpuid(1, &ecx, &edx);
+    has_pat = (edx & CPUID_EDX_PAT) != 0;
+    has_global_pages = (edx & CPUID_EDX_PGE) != 0;
+    cpuid(0x80000001, &ecx, &edx);
+    has_1g_pages = (edx & CPUID_EDX_1G_PAGES) != 0;
+
+    asm volatile("mov %%cr3, %0" : "=r"(cr3));
+    pml4 = table_virt(cr3);
+
+    if (has_pat) {
+        // No mapping uses PWT/PCD yet, so nothing is cached under the old types
+        write_msr(MSR_PAT, PAT_VALUE);
+    }
+    if (has_global_pages) {
+        asm volatile("mov %%cr4, %0" : "=r"(cr4));
+        asm volatile("mov %0, %%cr4" : : "r"(cr4 | CR4_PGE) : "memory");
+    }
+
+    collect_ram_ranges();
+
+    uint64_t global = has_global_pages ? PTE_GLOBAL : 0;
+    int mapped = 0;
+    for (; mapped < direct_map_count; mapped++) {
+        uint64_t start = direct_map[mapped].start;
+        uint64_t size = direct_map[mapped].end - start;
+        if (map_range(DIRECT_MAP_BASE + start, start, size, PTE_WRITABLE | global) != 0) {
+            break;
+        }
+        direct_map_bytes += size;
+    }
+    if (mapped < direct_map_count) {
+        // The failing range may be partly mapped; treat it and the rest as absent
+        klogf(KLOG_WARNING, "paging: out of page tables, direct map stops at 0x%lx",
+              direct_map[mapped].start);
+        direct_map_count = mapped;
+    }
+
+    // Address spaces copy the top-level entries when they are created, so
+    // the MMIO window needs its table before the first one exists
+    next_table(pml4, (MMIO_BASE >> 39) & 511);
+    direct_map_page_size = has_1g_pages ? PAGE_1G : PAGE_2M;
+
+    klogf(KLOG_INFO, "paging: direct map of %lu MiB in %d RAM ranges with %s pages%s",
+          direct_map_bytes >> 20, direct_map_count, has_1g_pages ? "1 GiB" : "2 MiB",
+          has_pat ? ", PAT write-combining" : "");
+}
+
+uint64_t virt_to_phys(const void *virt) {
+    uint64_t address = (uint64_t)virt;
+
+    if (address >= KERNEL_VMA) {
+        return address - KERNEL_VMA;
+    }
+    if (address >= DIRECT_MAP_BASE && direct_map_contains(address - DIRECT_MAP_BASE, 1)) {
+        return address - DIRECT_MAP_BASE;
+    }
+    if (address < IDENTITY_MAP_END) {
+        return address;
+    }
+
+    // MMIO, the VMM slot and private ranges: walk the loaded tables. Tables
+    // the frame allocator handed out can sit anywhere in RAM, so every
+    // level is reached through the direct map.
+    uint64_t cr3;
+    asm volatile("mov %%cr3, %0" : "=r"(cr3));
+    uint64_t entry = cr3;
+    for (int shift = 39; shift >= 12; shift -= 9) {
+        if (shift < 39 && !(entry & PTE_PRESENT)) {
+            return 0;
+        }
+        entry = ((uint64_t *)phys_to_virt(entry & PTE_ADDRESS))[(address >> shift) & 511];
+        if (shift > 12 && shift < 39 && (entry & PTE_HUGE)) {
+            uint64_t mask = (1ULL << shift) - 1;
+            return (entry & PTE_ADDRESS & ~mask) | (address & mask);
+        }
+    }
+    return (entry & PTE_PRESENT) ? (entry & PTE_ADDRESS) | (address & (PAGE_4K - 1)) : 0;
+}
+
+int paging_phys_contiguous(const void *virt, uint64_t size) {
+    uint64_t address = (uint64_t)virt;
+
+    if (address + size < address) {
+        return 0;
+    }
+    if (address >= KERNEL_VMA) {
+        return 1;
+    }
+    if (address >= DIRECT_MAP_BASE) {
+        return direct_map_contains(address - DIRECT_MAP_BASE, size);
+    }
+    return address + size <= IDENTITY_MAP_END;
+}
+
+void *mmio_map(uint64_t phys, uint64_t size, int cache) {
+    uint64_t offset = phys & (PAGE_4K - 1);
+    uint64_t base = phys - offset;
+    uint64_t length = (size + offset + PAGE_4K - 1) & ~(PAGE_4K - 1);
+
+    // Same offset within 2 MiB as the physical range, so large pages fit
+    uint64_t virt = ((mmio_next + PAGE_2M - 1) & ~(PAGE_2M - 1)) + (base & (PAGE_2M - 1));
+
+    uint64_t flags = PTE_WRITABLE | PTE_PCD | PTE_PWT;
+    if (cache == MMIO_WRITE_COMBINING && has_pat) {
+        flags = PTE_WRITABLE | PTE_PWT; // PAT entry 1
+    }
+    if (has_global_pages) {
+        flags |= PTE_GLOBAL;
+    }
+
+    if (pml4 == 0 || map_range(virt, base, length, flags) != 0) {
+        return 0;
+    }
+    mmio_next = virt + length;
+    return (void *)(virt + offset);
+}
+
+void paging_get_stats(PagingStats *stats) {
+    stats->direct_map_bytes = direct_map_bytes;
+    stats->direct_map_page_size = direct_map_page_size;
+    stats->mmio_bytes = mmio_next - MMIO_BASE;
+    stats->tables_used = tables_used;
+    stats->tables_total = PAGING_POOL_TABLES;
+    stats->has_1g_pages = has_1g_pages;
+    stats->has_pat = has_pat;
+    stats->has_global_pages = has_global_pages;
+}
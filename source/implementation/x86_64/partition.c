@@ -4,6 +4,11 @@
 #include "port.h"
 #include "memory.h"
 #include "memory_allocator.h"
+#include "journal.h"
+#include "blockdev.h"
+#include "disktool.h"
+#include "klog.h"
+#include "trace.h"
 
 
 #define MBR_SIZE 512
@@ -21,11 +26,20 @@
 #define EXT4_SUPERBLOCK_OFFSET 1024
 #define EXT4_MAGIC 0xEF53
 #define EXT4_DEFAULT_BLOCK_SIZE 4096
+#define EXT4_MIN_SECTORS (32 * 1024 * 1024 / SECTOR_SIZE)
 #define EXT4_FIRST_INO 11
 #define EXT4_FEATURE_COMPAT_DIR_INDEX 0x0020
 #define EXT4_FEATURE_INCOMPAT_EXTENTS 0x0040
 #define EXT4_FEATURE_INCOMPAT_64BIT 0x0080
 
+// The journal is a contiguous run of blocks inside block group 0
+#define EXT4_JOURNAL_START_BLOCK 1024
+#define EXT4_JOURNAL_BLOCKS JBD2_MIN_JOURNAL_BLOCKS
+// The 1024-byte superblock spans two sectors
+#define EXT4_SUPERBLOCK_SECTORS ((sizeof(Ext4Superblock) + SECTOR_SIZE - 1) / SECTOR_SIZE)
+
+#define EXT4_JOURNAL_MIN_FS_BLOCKS (EXT4_JOURNAL_START_BLOCK + EXT4_JOURNAL_BLOCKS * 2)
+
 
 
 static void init_superblock(Ext4Superblock *sb, uint32_t total_sectors)
@@ -75,19 +89,40 @@ static void init_superblock(Ext4Superblock *sb, uint32_t total_sectors)
     memory_copy(sb->s_volume_name, (const uint8_t *)volume_name, strlen(volume_name));
 }
 
-int format_ext4(int controller, int drive, uint32_t start_lba, uint32_t total_sectors) {
+/**
+ * partition_check_format_range - Checks that the formatters can address a range.
+ *
+ * The ext4 and FAT32 layouts are built with 32-bit sector numbers, so a
+ * partition must end below 2^32 sectors (2 TiB); a larger one would wrap
+ * and be written over the start of the disk. Reports the error and
+ * returns -1 for such a range.
+ */
+int partition_check_format_range(uint64_t start_lba, uint64_t sector_count) {
+    if (start_lba + sector_count > FORMAT_MAX_SECTOR) {
+        print_str("Error: partition ends past 2 TiB, which cannot be formatted");
+        print_newline();
+        return -1;
+    }
+    return 0;
+}
+
+int format_ext4(BlockDevice *dev, uint64_t start_lba, uint64_t total_sectors) {
+    TRACE_SCOPE("fs:format_ext4", total_sectors);
+    if (partition_check_format_range(start_lba, total_sectors) != 0) {
+        return -1;
+    }
     print_str("Formatting partition to ext4...");
     print_newline();
     
     // Size check (32MB minimum)
-    if (total_sectors < 8192) {
+    if (total_sectors < EXT4_MIN_SECTORS) {
         print_str("Error: minimum ext4 size is 32 MB");
         print_newline();
         return -1;
     }
 
-    // Dynamically allocate memory for the disk buffer
-    uint8_t* disk_buffer = (uint8_t*)allocate(SECTOR_SIZE);
+    // Dynamically allocate memory for the disk buffer (large enough for the whole superblock)
+    uint8_t* disk_buffer = (uint8_t*)allocate(EXT4_SUPERBLOCK_SECTORS * SECTOR_SIZE);
     if (disk_buffer == NULL) {
         print_str("Error: cannot allocate memory for disk buffer");
         print_newline();
@@ -100,8 +135,8 @@ int format_ext4(int controller, int drive, uint32_t start_lba, uint32_t total_se
     // Calculate sector containing superblock
     uint32_t sb_sector = start_lba + (EXT4_SUPERBLOCK_OFFSET / SECTOR_SIZE);
 
-    // Read the sector that will contain the superblock
-    if (ata_read_sector_disk(controller, drive, sb_sector, disk_buffer) != 0) {
+    // Read the sectors that will contain the superblock
+    if (blockdev_read(dev, sb_sector, EXT4_SUPERBLOCK_SECTORS, disk_buffer) != 0) {
         print_str("Error: cannot read superblock");
         print_newline();
         free(disk_buffer);  // Free allocated memory before returning
@@ -112,6 +147,14 @@ int format_ext4(int controller, int drive, uint32_t start_lba, uint32_t total_se
     Ext4Superblock *sb = (Ext4Superblock *)(disk_buffer + (EXT4_SUPERBLOCK_OFFSET % SECTOR_SIZE));
     init_superblock(sb, total_sectors);
 
+    // Reserve the jbd2 journal if the filesystem is large enough to hold it
+    int has_journal = sb->s_blocks_count_lo >= EXT4_JOURNAL_MIN_FS_BLOCKS;
+    if (has_journal) {
+        journal_describe_in_superblock(sb, EXT4_JOURNAL_START_BLOCK, EXT4_JOURNAL_BLOCKS,
+                                       EXT4_DEFAULT_BLOCK_SIZE);
+        sb->s_free_blocks_count_lo -= EXT4_JOURNAL_BLOCKS;
+    }
+
     // Calculate number of block groups with bounds checking
     uint32_t blocks_per_group = sb->s_blocks_per_group;
     if (blocks_per_group == 0) {
@@ -145,8 +188,8 @@ int format_ext4(int controller, int drive, uint32_t start_lba, uint32_t total_se
     print_int(num_block_groups);
     print_newline();
 
-    // Write the superblock sector back
-    if (ata_write_sector_disk(controller, drive, sb_sector, disk_buffer) != 0) {
+    // Write the superblock sectors back
+    if (blockdev_write(dev, sb_sector, EXT4_SUPERBLOCK_SECTORS, disk_buffer) != 0) {
         print_str("Error: cannot write superblock");
         print_newline();
         free(disk_buffer);  // Free allocated memory before returning
@@ -157,13 +200,9 @@ int format_ext4(int controller, int drive, uint32_t start_lba, uint32_t total_se
     uint32_t first_block = sb->s_first_data_block;
     
     for (uint32_t group = 0; group < num_block_groups; group++) {
-        // Print progress every 10 groups
+        // Progress goes to the kernel log (see dmesg) instead of the screen
         if (group % 10 == 0) {
-            print_str("Processing block group ");
-            print_int(group);
-            print_str(" of ");
-            print_int(num_block_groups);
-            print_newline();
+            klog_value(KLOG_INFO, "ext4: formatting block group", group);
         }
 
         // Clear buffer for block group descriptor
@@ -187,13 +226,16 @@ int format_ext4(int controller, int drive, uint32_t start_lba, uint32_t total_se
         gd->bg_inode_bitmap_lo = group_first_block + 1;
         gd->bg_inode_table_lo = group_first_block + 2;
         gd->bg_free_blocks_count_lo = blocks_in_group - 4; // Subtract metadata blocks
+        if (group == 0 && has_journal) {
+            gd->bg_free_blocks_count_lo -= EXT4_JOURNAL_BLOCKS;
+        }
         gd->bg_free_inodes_count_lo = sb->s_inodes_per_group;
         gd->bg_used_dirs_count_lo = 0;
         gd->bg_flags = 0;
 
         // Write block group descriptor
         uint32_t gdt_sector = sb_sector + 1 + group;
-        if (ata_write_sector_disk(controller, drive, gdt_sector, disk_buffer) != 0) {
+        if (blockdev_write(dev, gdt_sector, 1, disk_buffer) != 0) {
             print_str("Error: cannot write block group descriptor at sector ");
             print_int(gdt_sector);
             print_newline();
@@ -204,9 +246,12 @@ int format_ext4(int controller, int drive, uint32_t start_lba, uint32_t total_se
         // Initialize and write block bitmap
         memory_zero(disk_buffer, SECTOR_SIZE);
         disk_buffer[0] = 0x0F; // First 4 blocks used
+        if (group == 0 && has_journal) {
+            memory_set(disk_buffer + EXT4_JOURNAL_START_BLOCK / 8, 0xFF, EXT4_JOURNAL_BLOCKS / 8);
+        }
         uint32_t bitmap_sector = start_lba + ((group_first_block * EXT4_DEFAULT_BLOCK_SIZE) / SECTOR_SIZE);
 
-        if (ata_write_sector_disk(controller, drive, bitmap_sector, disk_buffer) != 0) {
+        if (blockdev_write(dev, bitmap_sector, 1, disk_buffer) != 0) {
             print_str("Error: cannot write block bitmap at sector ");
             print_int(bitmap_sector);
             print_newline();
@@ -216,7 +261,7 @@ int format_ext4(int controller, int drive, uint32_t start_lba, uint32_t total_se
 
         // Write empty inode bitmap
         memory_zero(disk_buffer, SECTOR_SIZE);
-        if (ata_write_sector_disk(controller, drive, bitmap_sector + 1, disk_buffer) != 0) {
+        if (blockdev_write(dev, bitmap_sector + 1, 1, disk_buffer) != 0) {
             print_str("Error: cannot write inode bitmap at sector ");
             print_int(bitmap_sector + 1);
             print_newline();
@@ -225,6 +270,20 @@ int format_ext4(int controller, int drive, uint32_t start_lba, uint32_t total_se
         }
     }
 
+    if (has_journal) {
+        print_str("Creating journal (");
+        print_int(EXT4_JOURNAL_BLOCKS);
+        print_str(" blocks)...");
+        print_newline();
+        if (journal_format(dev, start_lba, EXT4_JOURNAL_START_BLOCK,
+                           EXT4_JOURNAL_BLOCKS, EXT4_DEFAULT_BLOCK_SIZE) != 0) {
+            print_str("Error: cannot create journal");
+            print_newline();
+            free(disk_buffer);
+            return -1;
+        }
+    }
+
     print_str("EXT4 formatting completed successfully.");
     print_newline();
     
@@ -234,60 +293,28 @@ int format_ext4(int controller, int drive, uint32_t start_lba, uint32_t total_se
     return 0;
 }
 
-void create_ext4_partition(int controller, int drive, uint32_t start_lba, uint32_t sector_count)
+// Adds an ext4 partition to the table and formats it
+int create_ext4_partition(BlockDevice *dev, PartitionMap *map, uint64_t start_lba, uint64_t sector_count)
 {
-    uint8_t mbr[MBR_SIZE];
-    print_str("Reading MBR...");
+    TRACE_SCOPE("fs:create_ext4_partition", sector_count);
+    print_str("Creating partition table entry...");
     print_newline();
-    // Read the MBR
-    if (ata_read_sector_disk(controller, drive, 0, mbr) != 0)
+    if (partition_check_format_range(start_lba, sector_count) != 0 ||
+        partition_map_add(dev, map, start_lba, sector_count, EXT4_PARTITION_TYPE) != 0)
     {
-        print_str("Error: Unable to read MBR.");
-        print_newline();
-        return;
+        return -1;
     }
 
-    print_str("Creating partition table...");
-    print_newline();
-    PartitionEntry *partition_table = (PartitionEntry *)(mbr + PARTITION_TABLE_OFFSET);
-
-    // Find first empty partition slot
-    for (int i = 0; i < 4; ++i)
+    if (format_ext4(dev, start_lba, sector_count) != 0)
     {
-        if (partition_table[i].type == 0x00)
-        {
-            partition_table[i].status = 0x00;
-            partition_table[i].type = EXT4_PARTITION_TYPE;
-            partition_table[i].lba_first = start_lba;
-            partition_table[i].sector_count = sector_count;
-
-            // Write updated MBR
-            print_str("Writing sector...");
-            print_newline();
-            if (ata_write_sector_disk(controller, drive, 0, mbr) != 0)
-            {
-                print_str("Error: Unable to write MBR.");
-                print_newline();
-                return;
-            }
-
-            // Format the partition with ext4
-
-            if (format_ext4(controller, drive, start_lba, sector_count) != 0)
-            {
-                print_str("Error: Unable to format ext4 partition.");
-                print_newline();
-                return;
-            }
-
-            print_str("EXT4 Partition created and formatted successfully.");
-            print_newline();
-            return;
-        }
+        print_str("Error: Unable to format ext4 partition.");
+        print_newline();
+        return -1;
     }
 
-    print_str("Error: No empty partition slots available.");
+    print_str("EXT4 Partition created and formatted successfully.");
     print_newline();
+    return 0;
 }
 // FAT32 Boot Sector structure
 typedef struct
@@ -324,8 +351,13 @@ typedef struct
 } __attribute__((packed)) FAT32BootSector;
 
 // Initialize a FAT32 filesystem on the partition
-int format_fat32(int controller, int drive, uint32_t start_lba, uint32_t total_sectors)
+int format_fat32(BlockDevice *dev, uint64_t start_lba, uint64_t total_sectors)
 {
+    TRACE_SCOPE("fs:format_fat32", total_sectors);
+    if (partition_check_format_range(start_lba, total_sectors) != 0)
+    {
+        return -1;
+    }
     FAT32BootSector boot_sector = {0};
 
     // Basic boot sector fields
@@ -361,7 +393,7 @@ int format_fat32(int controller, int drive, uint32_t start_lba, uint32_t total_s
     boot_sector.boot_signature_2 = 0xAA55;
 
     // Write boot sector
-    if (ata_write_sector_disk(controller, drive, start_lba, (uint8_t *)&boot_sector) != 0)
+    if (blockdev_write(dev, start_lba, 1, (uint8_t *)&boot_sector) != 0)
     {
         return -1;
     }
@@ -378,8 +410,8 @@ int format_fat32(int controller, int drive, uint32_t start_lba, uint32_t total_s
     uint32_t fat1_start = start_lba + RESERVED_SECTORS;
     uint32_t fat2_start = fat1_start + boot_sector.sectors_per_fat_32;
 
-    if (ata_write_sector_disk(controller, drive, fat1_start, fat_sector) != 0 ||
-        ata_write_sector_disk(controller, drive, fat2_start, fat_sector) != 0)
+    if (blockdev_write(dev, fat1_start, 1, fat_sector) != 0 ||
+        blockdev_write(dev, fat2_start, 1, fat_sector) != 0)
     {
         return -1;
     }
@@ -387,209 +419,38 @@ int format_fat32(int controller, int drive, uint32_t start_lba, uint32_t total_s
     return 0;
 }
 
-void create_fat32_partition(int controller, int drive, uint32_t start_lba, uint32_t sector_count)
+// Adds a FAT32 partition to the table and formats it
+int create_fat32_partition(BlockDevice *dev, PartitionMap *map, uint64_t start_lba, uint64_t sector_count)
 {
-    uint8_t mbr[MBR_SIZE];
-
-    // Read the MBR
-    if (ata_read_sector_disk(controller, drive, 0, mbr) != 0)
+    TRACE_SCOPE("fs:create_fat32_partition", sector_count);
+    if (partition_check_format_range(start_lba, sector_count) != 0 ||
+        partition_map_add(dev, map, start_lba, sector_count, FAT32_PARTITION_TYPE) != 0)
     {
-        print_str("Error: Unable to read MBR.");
-        print_newline();
-        return;
+        return -1;
     }
 
-    // Locate the first available slot in the MBR partition table
-    PartitionEntry *partition_table = (PartitionEntry *)(mbr + PARTITION_TABLE_OFFSET);
-
-    // Find first empty partition slot
-    for (int i = 0; i < 4; ++i)
+    if (format_fat32(dev, start_lba, sector_count) != 0)
     {
-        if (partition_table[i].type == 0x00)
-        {
-            // Set up the new FAT32 partition
-            partition_table[i].status = 0x00;               // Mark as inactive; can be set to bootable later
-            partition_table[i].type = FAT32_PARTITION_TYPE; // FAT32 type
-            partition_table[i].lba_first = start_lba;
-            partition_table[i].sector_count = sector_count;
-
-            // Write updated MBR
-            if (ata_write_sector_disk(controller, drive, 0, mbr) != 0)
-            {
-                print_str("Error: Unable to write MBR.");
-                print_newline();
-                return;
-            }
-
-            // Format the partition with FAT32
-            if (format_fat32(controller, drive, start_lba, sector_count) != 0)
-            {
-                print_str("Error: Unable to format FAT32 partition.");
-                print_newline();
-                return;
-            }
-
-            print_str("FAT32 Partition created and formatted successfully.");
-            print_newline();
-            return;
-        }
-    }
-
-    print_str("Error: No empty partition slots available.");
-    print_newline();
-}
-
-#define EXT4_SUPERBLOCK_OFFSET 1024
-#define EXT4_MAGIC 0xEF53
-#define EXT4_VOLUME_NAME_LEN 16
-
-void display_partitions()
-{
-    uint8_t mbr[MBR_SIZE];
-    uint8_t superblock_buffer[sizeof(Ext4Superblock)];
-
-    // Read the MBR (sector 0)
-    if (ata_read_sector(0, mbr) != 0)
-    {
-        print_str("Error: Unable to read MBR.");
-        return;
+        print_str("Error: Unable to format FAT32 partition.");
+        print_newline();
+        return -1;
     }
 
-    PartitionEntry *partition_table = (PartitionEntry *)(mbr + PARTITION_TABLE_OFFSET);
-
-    print_str("Partition Table:");
+    print_str("FAT32 Partition created and formatted successfully.");
     print_newline();
-
-    for (int i = 0; i < 4; ++i)
-    {
-        if (partition_table[i].type != 0x00)
-        { // Check if partition entry is valid
-            print_str("Partition ");
-            print_int(i);
-            print_str(":");
-
-            // Calculate partition size in MB
-            uint32_t size_in_mb = (partition_table[i].sector_count * SECTOR_SIZE) / (1024 * 1024);
-
-            print_str(" Start LBA: ");
-            print_int(partition_table[i].lba_first);
-            print_str(", Size: ");
-            print_int(size_in_mb);
-            print_str(" MB");
-
-            // Display filesystem type based on partition type code
-            print_str(", Type: ");
-            switch (partition_table[i].type)
-            {
-            case 0x83:
-            {
-                print_str("EXT4");
-
-                // For EXT4 partitions, try to read the superblock
-                uint32_t superblock_lba = partition_table[i].lba_first + (EXT4_SUPERBLOCK_OFFSET / SECTOR_SIZE);
-                if (ata_read_sector(superblock_lba, superblock_buffer) == 0)
-                {
-                    Ext4Superblock *sb = (Ext4Superblock *)superblock_buffer;
-
-                    // Verify EXT4 magic number
-                    if (sb->s_magic == EXT4_MAGIC)
-                    {
-                        // Check if volume name is not empty
-                        int has_name = 0;
-                        for (int j = 0; j < EXT4_VOLUME_NAME_LEN; j++)
-                        {
-                            if (sb->s_volume_name[j] != 0)
-                            {
-                                has_name = 1;
-                                break;
-                            }
-                        }
-
-                        if (has_name == 1)
-                        {
-                            print_str(" [Volume: ");
-                            // Print only up to the first null character or max length
-                            for (int j = 0; j < EXT4_VOLUME_NAME_LEN && sb->s_volume_name[j]; j++)
-                            {
-                                char c = sb->s_volume_name[j];
-                                // Only print printable ASCII characters
-                                if (c >= 32 && c <= 126)
-                                {
-                                    print_char(c);
-                                }
-                            }
-                            print_str("]");
-                        }
-                    }
-                }
-                break;
-            }
-            case 0x82:
-                print_str("Linux swap");
-                break;
-            case 0x07:
-                print_str("NTFS");
-                break;
-            case 0x0C:
-                print_str("FAT32 LBA");
-                break;
-            case 0x0B:
-                print_str("FAT32");
-                break;
-            case 0x0F:
-                print_str("Extended");
-                break;
-            case 0x05:
-                print_str("Extended");
-                break;
-            case 0x04:
-                print_str("FAT16");
-                break;
-            case 0x06:
-                print_str("FAT16B");
-                break;
-            case 0x0E:
-                print_str("FAT16B LBA");
-                break;
-            default:
-                print_str("Unknown (0x");
-                uint8_t high_nibble = (partition_table[i].type >> 4) & 0x0F;
-                uint8_t low_nibble = partition_table[i].type & 0x0F;
-
-                char hex_chars[] = "0123456789ABCDEF";
-                char hex_str[3] = {
-                    hex_chars[high_nibble],
-                    hex_chars[low_nibble],
-                    ')'};
-                print_str(hex_str);
-                break;
-            }
-
-            // Display bootable flag if set
-            if (partition_table[i].status & 0x80)
-            {
-                print_str(" [Bootable]");
-            }
-
-            print_newline();
-        }
-    }
+    return 0;
 }
 
 void select_partition(int partition_number)
 {
-    uint8_t mbr[MBR_SIZE];
-
-    // Read the MBR (sector 0)
-    if (ata_read_sector(0, mbr) != 0)
+    PartitionMap *map = disktool_get_partition_map(0);
+    if (map == NULL)
     {
-        print_str("Error: Unable to read MBR.");
+        print_str("Error: Unable to read partition table.");
         return;
     }
 
-    PartitionEntry *partition_table = (PartitionEntry *)(mbr + PARTITION_TABLE_OFFSET);
-
-    if (partition_number < 0 || partition_number >= 4 || partition_table[partition_number].type == 0x00)
+    if (partition_number < 0 || partition_number >= (int)map->count)
     {
         print_str("Invalid or empty partition.");
         return;
@@ -0,0 +1,669 @@
+// partition_map.c - MBR/GPT partition tables and the cached per-disk map
+#include "partition.h"
+#include "disktool.h"
+#include "crc32.h"
+#include "timer.h"
+#include "print.h"
+#include "string.h"
+#include "memory.h"
+#include "memory_allocator.h"
+#include "trace.h"
+
+#define MBR_SIGNATURE_OFFSET 510
+#define MBR_MAX_SECTORS 0xFFFFFFFFULL
+#define EXT4_SUPERBLOCK_OFFSET 1024
+#define EXT4_MAGIC 0xEF53
+
+// New partitions start on 1 MiB boundaries
+#define PARTITION_ALIGN_SECTORS 2048
+
+// Type GUIDs in on-disk byte order (first three fields little-endian)
+static const uint8_t guid_linux_data[16] = {
+    0xAF, 0x3D, 0xC6, 0x0F, 0x83, 0x84, 0x72, 0x47,
+    0x8E, 0x79, 0x3D, 0x69, 0xD8, 0x47, 0x7D, 0xE4};
+static const uint8_t guid_basic_data[16] = {
+    0xA2, 0xA0, 0xD0, 0xEB, 0xE5, 0xB9, 0x33, 0x44,
+    0x87, 0xC0, 0x68, 0xB6, 0xB7, 0x26, 0x99, 0xC7};
+static const uint8_t guid_efi_system[16] = {
+    0x28, 0x73, 0x2A, 0xC1, 0x1F, 0xF8, 0xD2, 0x11,
+    0xBA, 0x4B, 0x00, 0xA0, 0xC9, 0x3E, 0xC9, 0x3B};
+static const uint8_t guid_linux_swap[16] = {
+    0x6D, 0xFD, 0x57, 0x06, 0xAB, 0xA4, 0xC4, 0x43,
+    0x84, 0xE5, 0x09, 0x33, 0xC8, 0x4B, 0x4F, 0x4F};
+static const uint8_t guid_bios_boot[16] = {
+    0x48, 0x61, 0x68, 0x21, 0x49, 0x64, 0x6F, 0x6E,
+    0x74, 0x4E, 0x65, 0x65, 0x64, 0x45, 0x46, 0x49};
+
+typedef struct {
+    const uint8_t *guid;
+    uint8_t mbr_type;
+} GptTypeMapping;
+
+// The first entry for an MBR code is used when creating partitions
+static const GptTypeMapping gpt_types[] = {
+    {guid_linux_data, 0x83},
+    {guid_basic_data, FAT32_PARTITION_TYPE},
+    {guid_basic_data, 0x07},
+    {guid_efi_system, MBR_TYPE_EFI_SYSTEM},
+    {guid_linux_swap, 0x82},
+    {guid_bios_boot, 0x00},
+};
+
+#define NUM_GPT_TYPES (sizeof(gpt_types) / sizeof(gpt_types[0]))
+
+static uint8_t gpt_type_to_mbr(const uint8_t *guid) {
+    for (uint32_t i = 0; i < NUM_GPT_TYPES; i++) {
+        if (memory_compare(guid, gpt_types[i].guid, 16) == 0) {
+            return gpt_types[i].mbr_type;
+        }
+    }
+    return 0xFF;
+}
+
+static const uint8_t *mbr_type_to_gpt(uint8_t type) {
+    for (uint32_t i = 0; i < NUM_GPT_TYPES; i++) {
+        if (gpt_types[i].mbr_type == type) {
+            return gpt_types[i].guid;
+        }
+    }
+    return guid_basic_data;
+}
+
+// Version 4 GUID; the TSC is the only entropy source available this early
+static void generate_guid(uint8_t *guid) {
+    static uint64_t state = 0;
+    if (state == 0) {
+        state = timer_tsc() | 1;
+    }
+    for (int i = 0; i < 16; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        guid[i] = (uint8_t)(state ^ (timer_tsc() >> 3));
+    }
+    guid[7] = (guid[7] & 0x0F) | 0x40;
+    guid[8] = (guid[8] & 0x3F) | 0x80;
+}
+
+static int is_zero_guid(const uint8_t *guid) {
+    for (int i = 0; i < 16; i++) {
+        if (guid[i] != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void map_reset(BlockDevice *dev, PartitionMap *map, PartitionScheme scheme) {
+    memory_zero(map, sizeof(PartitionMap));
+    map->scheme = scheme;
+    map->generation = dev->label_generation;
+    map->first_usable = PARTITION_ALIGN_SECTORS;
+    map->last_usable = dev->sector_count ? dev->sector_count - 1 : 0;
+    if (map->last_usable > MBR_MAX_SECTORS) {
+        map->last_usable = MBR_MAX_SECTORS;
+    }
+}
+
+static void parse_mbr(BlockDevice *dev, PartitionMap *map, const uint8_t *mbr) {
+    const PartitionEntry *table = (const PartitionEntry *)(mbr + PARTITION_TABLE_OFFSET);
+    int signed_mbr = mbr[MBR_SIGNATURE_OFFSET] == 0x55 && mbr[MBR_SIGNATURE_OFFSET + 1] == 0xAA;
+
+    map_reset(dev, map, signed_mbr ? PARTITION_SCHEME_MBR : PARTITION_SCHEME_NONE);
+    for (uint32_t i = 0; i < 4; i++) {
+        if (table[i].type == 0x00) {
+            continue;
+        }
+        // Tables written before the boot signature was set are still honoured
+        map->scheme = PARTITION_SCHEME_MBR;
+        Partition *part = &map->entries[map->count++];
+        part->lba_first = table[i].lba_first;
+        part->sector_count = table[i].sector_count;
+        part->slot = i;
+        part->type = table[i].type;
+        part->bootable = (table[i].status & 0x80) != 0;
+    }
+}
+
+static int gpt_header_valid(GptHeader *header, uint64_t lba, uint64_t sector_count) {
+    if (header->signature != GPT_SIGNATURE || header->header_size < GPT_HEADER_SIZE ||
+        header->header_size > SECTOR_SIZE || header->my_lba != lba) {
+        return 0;
+    }
+
+    uint32_t expected = header->header_crc32;
+    header->header_crc32 = 0;
+    uint32_t actual = crc32_le(0, header, header->header_size);
+    header->header_crc32 = expected;
+
+    return actual == expected &&
+           header->entry_size == GPT_ENTRY_SIZE &&
+           header->num_entries != 0 && header->num_entries <= GPT_MAX_ENTRIES &&
+           header->first_usable_lba <= header->last_usable_lba &&
+           header->last_usable_lba < sector_count;
+}
+
+// Reads and checks one copy of the GPT (header at `lba` plus its entry array)
+static int read_gpt_copy(BlockDevice *dev, uint64_t lba, GptHeader *header, uint8_t *entries) {
+    uint8_t sector[SECTOR_SIZE];
+
+    if (blockdev_read(dev, lba, 1, sector) != 0) {
+        return -1;
+    }
+    memory_copy(header, sector, sizeof(GptHeader));
+    if (!gpt_header_valid(header, lba, dev->sector_count)) {
+        return -1;
+    }
+
+    uint32_t entry_bytes = header->num_entries * GPT_ENTRY_SIZE;
+    uint32_t entry_sectors = (entry_bytes + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    if (blockdev_read(dev, header->entries_lba, entry_sectors, entries) != 0 ||
+        crc32_le(0, entries, entry_bytes) != header->entries_crc32) {
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_gpt(BlockDevice *dev, PartitionMap *map) {
+    GptHeader header;
+    uint8_t *entries = (uint8_t *)allocate(GPT_ENTRY_SECTORS * SECTOR_SIZE);
+    if (entries == NULL) {
+        return -1;
+    }
+
+    map_reset(dev, map, PARTITION_SCHEME_GPT);
+    if (read_gpt_copy(dev, 1, &header, entries) != 0) {
+        if (dev->sector_count == 0 || read_gpt_copy(dev, dev->sector_count - 1, &header, entries) != 0) {
+            print_str("Error: both GPT copies on ");
+            print_str(dev->name);
+            print_str(" are damaged");
+            print_newline();
+            free(entries);
+            return -1;
+        }
+        print_str("Warning: primary GPT on ");
+        print_str(dev->name);
+        print_str(" is damaged, using the backup (rewritten on the next change)");
+        print_newline();
+        map->gpt_from_backup = 1;
+    }
+
+    map->first_usable = header.first_usable_lba;
+    map->last_usable = header.last_usable_lba;
+    memory_copy(map->disk_guid, header.disk_guid, 16);
+
+    for (uint32_t i = 0; i < header.num_entries; i++) {
+        const GptEntry *entry = (const GptEntry *)(entries + i * GPT_ENTRY_SIZE);
+        if (is_zero_guid(entry->type_guid) || entry->last_lba < entry->first_lba) {
+            continue;
+        }
+        Partition *part = &map->entries[map->count++];
+        part->lba_first = entry->first_lba;
+        part->sector_count = entry->last_lba - entry->first_lba + 1;
+        part->slot = i;
+        part->type = gpt_type_to_mbr(entry->type_guid);
+        part->attributes = entry->attributes;
+        memory_copy(part->type_guid, entry->type_guid, 16);
+        memory_copy(part->unique_guid, entry->unique_guid, 16);
+        memory_copy(part->name, entry->name, sizeof(part->name));
+    }
+
+    free(entries);
+    return 0;
+}
+
+/**
+ * partition_map_load - Builds the partition map of a disk.
+ *
+ * A protective MBR (type 0xEE) routes to the GPT; anything else is read
+ * as a classic 4-entry MBR.
+ */
+int partition_map_load(BlockDevice *dev, PartitionMap *map) {
+    uint8_t mbr[MBR_SIZE];
+
+    map->valid = 0;
+    if (blockdev_read(dev, 0, 1, mbr) != 0) {
+        print_str("Error: Unable to read MBR.");
+        print_newline();
+        return -1;
+    }
+
+    const PartitionEntry *table = (const PartitionEntry *)(mbr + PARTITION_TABLE_OFFSET);
+    for (int i = 0; i < 4; i++) {
+        if (table[i].type == MBR_TYPE_GPT_PROTECTIVE) {
+            if (parse_gpt(dev, map) != 0) {
+                return -1;
+            }
+            map->valid = 1;
+            return 0;
+        }
+    }
+
+    parse_mbr(dev, map, mbr);
+    map->valid = 1;
+    return 0;
+}
+
+// Reloads the map only if the table areas were written since it was built
+int partition_map_refresh(BlockDevice *dev, PartitionMap *map) {
+    if (map->valid && map->generation == dev->label_generation) {
+        return 0;
+    }
+    return partition_map_load(dev, map);
+}
+
+/**
+ * partition_map_find_free - Finds the first aligned gap large enough.
+ *
+ * @return: 0 with *start_lba set, or -1 if no gap fits.
+ */
+int partition_map_find_free(const PartitionMap *map, uint64_t sector_count, uint64_t *start_lba) {
+    uint64_t candidate = (map->first_usable + PARTITION_ALIGN_SECTORS - 1) & ~(uint64_t)(PARTITION_ALIGN_SECTORS - 1);
+
+    // Partitions may be stored in any slot order, so retry after every overlap
+    for (uint32_t pass = 0; pass <= map->count; pass++) {
+        int moved = 0;
+        for (uint32_t i = 0; i < map->count; i++) {
+            const Partition *part = &map->entries[i];
+            uint64_t end = part->lba_first + part->sector_count;
+            if (candidate < end && part->lba_first < candidate + sector_count) {
+                candidate = (end + PARTITION_ALIGN_SECTORS - 1) & ~(uint64_t)(PARTITION_ALIGN_SECTORS - 1);
+                moved = 1;
+            }
+        }
+        if (!moved) {
+            break;
+        }
+    }
+
+    if (sector_count == 0 || candidate + sector_count - 1 > map->last_usable) {
+        return -1;
+    }
+    *start_lba = candidate;
+    return 0;
+}
+
+static int write_mbr(BlockDevice *dev, const PartitionMap *map) {
+    uint8_t mbr[MBR_SIZE];
+
+    // Keep the boot code and disk signature
+    if (blockdev_read(dev, 0, 1, mbr) != 0) {
+        return -1;
+    }
+    PartitionEntry *table = (PartitionEntry *)(mbr + PARTITION_TABLE_OFFSET);
+    memory_zero(table, 4 * sizeof(PartitionEntry));
+
+    for (uint32_t i = 0; i < map->count; i++) {
+        const Partition *part = &map->entries[i];
+        PartitionEntry *entry = &table[part->slot];
+        entry->status = part->bootable ? 0x80 : 0x00;
+        entry->type = part->type;
+        entry->lba_first = (uint32_t)part->lba_first;
+        entry->sector_count = (uint32_t)part->sector_count;
+    }
+    mbr[MBR_SIGNATURE_OFFSET] = 0x55;
+    mbr[MBR_SIGNATURE_OFFSET + 1] = 0xAA;
+
+    if (blockdev_write(dev, 0, 1, mbr) != 0) {
+        return -1;
+    }
+    return blockdev_flush(dev);
+}
+
+// MBR covering the whole disk with one 0xEE entry, as GPT requires
+static int write_protective_mbr(BlockDevice *dev) {
+    uint8_t mbr[MBR_SIZE];
+
+    if (blockdev_read(dev, 0, 1, mbr) != 0) {
+        return -1;
+    }
+    PartitionEntry *table = (PartitionEntry *)(mbr + PARTITION_TABLE_OFFSET);
+    memory_zero(table, 4 * sizeof(PartitionEntry));
+
+    uint64_t covered = dev->sector_count - 1;
+    table[0].start_sector = 0x0002;
+    table[0].type = MBR_TYPE_GPT_PROTECTIVE;
+    table[0].end_head = 0xFF;
+    table[0].end_sector = 0xFFFF;
+    table[0].lba_first = 1;
+    table[0].sector_count = (covered > MBR_MAX_SECTORS) ? (uint32_t)MBR_MAX_SECTORS : (uint32_t)covered;
+    mbr[MBR_SIGNATURE_OFFSET] = 0x55;
+    mbr[MBR_SIGNATURE_OFFSET + 1] = 0xAA;
+
+    return blockdev_write(dev, 0, 1, mbr);
+}
+
+static void fill_gpt_header(GptHeader *header, const PartitionMap *map, uint64_t my_lba,
+                            uint64_t alternate_lba, uint64_t entries_lba, uint32_t entries_crc) {
+    memory_zero(header, sizeof(GptHeader));
+    header->signature = GPT_SIGNATURE;
+    header->revision = GPT_REVISION;
+    header->header_size = GPT_HEADER_SIZE;
+    header->my_lba = my_lba;
+    header->alternate_lba = alternate_lba;
+    header->first_usable_lba = map->first_usable;
+    header->last_usable_lba = map->last_usable;
+    memory_copy(header->disk_guid, map->disk_guid, 16);
+    header->entries_lba = entries_lba;
+    header->num_entries = GPT_MAX_ENTRIES;
+    header->entry_size = GPT_ENTRY_SIZE;
+    header->entries_crc32 = entries_crc;
+    header->header_crc32 = crc32_le(0, header, GPT_HEADER_SIZE);
+}
+
+/**
+ * write_gpt - Writes both GPT copies from the map.
+ *
+ * The backup goes first so that a crash part way through always leaves one
+ * consistent copy for partition_map_load() to fall back on.
+ */
+static int write_gpt(BlockDevice *dev, const PartitionMap *map) {
+    uint8_t *entries = (uint8_t *)allocate(GPT_ENTRY_SECTORS * SECTOR_SIZE);
+    uint8_t sector[SECTOR_SIZE];
+    if (entries == NULL) {
+        return -1;
+    }
+
+    memory_zero(entries, GPT_ENTRY_SECTORS * SECTOR_SIZE);
+    for (uint32_t i = 0; i < map->count; i++) {
+        const Partition *part = &map->entries[i];
+        GptEntry *entry = (GptEntry *)(entries + part->slot * GPT_ENTRY_SIZE);
+        memory_copy(entry->type_guid, part->type_guid, 16);
+        memory_copy(entry->unique_guid, part->unique_guid, 16);
+        entry->first_lba = part->lba_first;
+        entry->last_lba = part->lba_first + part->sector_count - 1;
+        entry->attributes = part->attributes;
+        memory_copy(entry->name, part->name, sizeof(entry->name));
+    }
+    uint32_t entries_crc = crc32_le(0, entries, GPT_MAX_ENTRIES * GPT_ENTRY_SIZE);
+
+    uint64_t last_lba = dev->sector_count - 1;
+    uint64_t backup_entries_lba = last_lba - GPT_ENTRY_SECTORS;
+    int result = -1;
+
+    memory_zero(sector, SECTOR_SIZE);
+    if (blockdev_write(dev, backup_entries_lba, GPT_ENTRY_SECTORS, entries) == 0) {
+        fill_gpt_header((GptHeader *)sector, map, last_lba, 1, backup_entries_lba, entries_crc);
+        if (blockdev_write(dev, last_lba, 1, sector) == 0 && blockdev_flush(dev) == 0 &&
+            blockdev_write(dev, 2, GPT_ENTRY_SECTORS, entries) == 0) {
+            fill_gpt_header((GptHeader *)sector, map, 1, last_lba, 2, entries_crc);
+            if (blockdev_write(dev, 1, 1, sector) == 0 && blockdev_flush(dev) == 0) {
+                result = 0;
+            }
+        }
+    }
+
+    free(entries);
+    if (result != 0) {
+        print_str("Error: Unable to write GPT.");
+        print_newline();
+    }
+    return result;
+}
+
+static int write_map(BlockDevice *dev, PartitionMap *map) {
+    TRACE_SCOPE("fs:write_partition_map", map->count);
+    int result = (map->scheme == PARTITION_SCHEME_GPT) ? write_gpt(dev, map) : write_mbr(dev, map);
+    map->valid = 0; // Rebuilt from disk on the next refresh
+    return result;
+}
+
+/**
+ * partition_map_add - Adds a partition and writes the table.
+ *
+ * A disk without any table gets an MBR, as before GPT support existed.
+ */
+int partition_map_add(BlockDevice *dev, PartitionMap *map, uint64_t start_lba, uint64_t sector_count, uint8_t type) {
+    if (partition_map_refresh(dev, map) != 0) {
+        return -1;
+    }
+    if (map->scheme == PARTITION_SCHEME_NONE) {
+        map->scheme = PARTITION_SCHEME_MBR;
+    }
+
+    uint64_t last = start_lba + sector_count - 1;
+    if (sector_count == 0 || start_lba < map->first_usable || last > map->last_usable) {
+        print_str("Error: partition does not fit on the disk.");
+        print_newline();
+        return -1;
+    }
+    for (uint32_t i = 0; i < map->count; i++) {
+        const Partition *part = &map->entries[i];
+        if (start_lba < part->lba_first + part->sector_count && part->lba_first <= last) {
+            print_str("Error: partition overlaps partition ");
+            print_int(i);
+            print_newline();
+            return -1;
+        }
+    }
+
+    // Lowest free slot, keeping entries ordered by slot
+    uint32_t max_slots = (map->scheme == PARTITION_SCHEME_GPT) ? GPT_MAX_ENTRIES : 4;
+    uint32_t slot = 0;
+    uint32_t position = 0;
+    while (position < map->count && map->entries[position].slot == slot) {
+        position++;
+        slot++;
+    }
+    if (slot >= max_slots) {
+        print_str("Error: No empty partition slots available.");
+        if (map->scheme == PARTITION_SCHEME_MBR) {
+            print_str(" Use mkgpt for up to 128 partitions.");
+        }
+        print_newline();
+        return -1;
+    }
+
+    for (uint32_t i = map->count; i > position; i--) {
+        map->entries[i] = map->entries[i - 1];
+    }
+    map->count++;
+
+    Partition *part = &map->entries[position];
+    memory_zero(part, sizeof(Partition));
+    part->lba_first = start_lba;
+    part->sector_count = sector_count;
+    part->slot = slot;
+    part->type = type;
+    if (map->scheme == PARTITION_SCHEME_GPT) {
+        memory_copy(part->type_guid, mbr_type_to_gpt(type), 16);
+        generate_guid(part->unique_guid);
+        const char *name = (type == 0x83) ? "Linux filesystem" : "Basic data partition";
+        for (int i = 0; name[i] != '\0' && i < GPT_NAME_CHARS; i++) {
+            part->name[i] = (uint16_t)name[i];
+        }
+    }
+
+    return write_map(dev, map);
+}
+
+int partition_map_delete(BlockDevice *dev, PartitionMap *map, uint32_t index) {
+    if (partition_map_refresh(dev, map) != 0) {
+        return -1;
+    }
+    if (index >= map->count) {
+        print_str("Partition does not exist");
+        print_newline();
+        return -1;
+    }
+
+    for (uint32_t i = index; i + 1 < map->count; i++) {
+        map->entries[i] = map->entries[i + 1];
+    }
+    map->count--;
+    return write_map(dev, map);
+}
+
+/**
+ * partition_map_init_gpt - Replaces the partition table with an empty GPT.
+ *
+ * Writes a protective MBR, then primary and backup headers with 128 empty
+ * entries. Existing partitions are forgotten.
+ */
+int partition_map_init_gpt(BlockDevice *dev, PartitionMap *map) {
+    uint64_t reserved = 1 + GPT_ENTRY_SECTORS;
+    if (dev->sector_count < 2 * reserved + 2 * PARTITION_ALIGN_SECTORS) {
+        print_str("Error: disk too small for GPT");
+        print_newline();
+        return -1;
+    }
+
+    memory_zero(map, sizeof(PartitionMap));
+    map->scheme = PARTITION_SCHEME_GPT;
+    map->first_usable = 1 + reserved;
+    map->last_usable = dev->sector_count - 1 - reserved;
+    generate_guid(map->disk_guid);
+
+    if (write_protective_mbr(dev) != 0) {
+        print_str("Error: Unable to write MBR.");
+        print_newline();
+        return -1;
+    }
+    return write_map(dev, map);
+}
+
+static void print_guid(const uint8_t *guid) {
+    static const char hex[] = "0123456789ABCDEF";
+    // Display order: the first three groups are stored little-endian
+    static const uint8_t order[16] = {3, 2, 1, 0, 5, 4, 7, 6, 8, 9, 10, 11, 12, 13, 14, 15};
+
+    for (int i = 0; i < 16; i++) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) {
+            print_char('-');
+        }
+        print_char(hex[guid[order[i]] >> 4]);
+        print_char(hex[guid[order[i]] & 0x0F]);
+    }
+}
+
+static void print_type(const Partition *part, int gpt) {
+    switch (part->type) {
+    case 0x83:
+        print_str(gpt ? "Linux filesystem" : "EXT4");
+        break;
+    case 0x82:
+        print_str("Linux swap");
+        break;
+    case 0x07:
+        print_str("NTFS");
+        break;
+    case 0x0C:
+        print_str(gpt ? "Basic data" : "FAT32 LBA");
+        break;
+    case 0x0B:
+        print_str("FAT32");
+        break;
+    case 0x0F:
+    case 0x05:
+        print_str("Extended");
+        break;
+    case 0x04:
+        print_str("FAT16");
+        break;
+    case 0x06:
+        print_str("FAT16B");
+        break;
+    case 0x0E:
+        print_str("FAT16B LBA");
+        break;
+    case MBR_TYPE_EFI_SYSTEM:
+        print_str("EFI System");
+        break;
+    default:
+        if (gpt && part->type == 0x00) {
+            print_str("BIOS boot");
+        } else if (gpt) {
+            print_str("Unknown {");
+            print_guid(part->type_guid);
+            print_str("}");
+        } else {
+            print_str("Unknown (");
+            print_hex(part->type);
+            print_str(")");
+        }
+        break;
+    }
+}
+
+// Appends " [Volume: name]" for ext4 partitions that carry a label
+static void print_ext4_label(BlockDevice *dev, const Partition *part) {
+    uint8_t buffer[SECTOR_SIZE];
+    if (blockdev_read(dev, part->lba_first + EXT4_SUPERBLOCK_OFFSET / SECTOR_SIZE, 1, buffer) != 0) {
+        return;
+    }
+
+    Ext4Superblock *sb = (Ext4Superblock *)buffer;
+    if (sb->s_magic != EXT4_MAGIC || sb->s_volume_name[0] == 0) {
+        return;
+    }
+    print_str(" [Volume: ");
+    for (int j = 0; j < (int)sizeof(sb->s_volume_name) && sb->s_volume_name[j]; j++) {
+        char c = sb->s_volume_name[j];
+        if (c >= 32 && c <= 126) {
+            print_char(c);
+        }
+    }
+    print_str("]");
+}
+
+void display_partition_map(BlockDevice *dev, const PartitionMap *map) {
+    int gpt = map->scheme == PARTITION_SCHEME_GPT;
+
+    print_str("Partition Table (");
+    print_str(gpt ? "GPT" : (map->scheme == PARTITION_SCHEME_MBR ? "MBR" : "none"));
+    print_str("):");
+    print_newline();
+    if (gpt) {
+        print_str("Disk GUID: ");
+        print_guid(map->disk_guid);
+        if (map->gpt_from_backup) {
+            print_str(" (from backup header)");
+        }
+        print_newline();
+    }
+
+    for (uint32_t i = 0; i < map->count; i++) {
+        const Partition *part = &map->entries[i];
+        print_str("Partition ");
+        print_int(i);
+        print_str(": Start LBA: ");
+        print_int(part->lba_first);
+        print_str(", Size: ");
+        print_int(part->sector_count / (1024 * 1024 / SECTOR_SIZE));
+        print_str(" MB, Type: ");
+        print_type(part, gpt);
+        if (part->type == 0x83) {
+            print_ext4_label(dev, part);
+        }
+        if (gpt && part->name[0] != 0) {
+            print_str(" \"");
+            for (int j = 0; j < GPT_NAME_CHARS && part->name[j] != 0; j++) {
+                print_char(part->name[j] < 0x80 ? (char)part->name[j] : '?');
+            }
+            print_str("\"");
+        }
+        if (part->bootable) {
+            print_str(" [Bootable]");
+        }
+        print_newline();
+    }
+}
+
+void display_partitions() {
+    BlockDevice *dev;
+
+    for (int i = 0; (dev = disktool_get_device(i)) != NULL; i++) {
+        PartitionMap *map = disktool_get_partition_map(i);
+        print_str("Disk ");
+        print_int(i);
+        print_str(" (");
+        print_str(dev->name);
+        print_str(") ");
+        if (map == NULL) {
+            print_str("has an unreadable partition table");
+            print_newline();
+            continue;
+        }
+        display_partition_map(dev, map);
+    }
+}
@@ -0,0 +1,66 @@
+// pci.c
+#include "pci.h"
+#include "port.h"
+
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA    0xCFC
+
+static uint32_t pci_address(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset) {
+    return 0x80000000u | ((uint32_t)bus << 16) | ((uint32_t)(slot & 0x1F) << 11) |
+           ((uint32_t)(function & 0x07) << 8) | (offset & 0xFC);
+}
+
+uint32_t pci_config_read32(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset) {
+    outl(PCI_CONFIG_ADDRESS, pci_address(bus, slot, function, offset));
+    return inl(PCI_CONFIG_DATA);
+}
+
+void pci_config_write32(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset, uint32_t value) {
+    outl(PCI_CONFIG_ADDRESS, pci_address(bus, slot, function, offset));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+// Brute-force scan; functions 1-7 are only checked on multi-function devices
+int pci_find_class(uint8_t class_code, uint8_t subclass, PciDevice *out) {
+    for (int bus = 0; bus < 256; bus++) {
+        for (int slot = 0; slot < 32; slot++) {
+            for (int function = 0; function < 8; function++) {
+                uint32_t id = pci_config_read32(bus, slot, function, PCI_VENDOR_ID);
+                if ((id & 0xFFFF) == 0xFFFF) {
+                    if (function == 0) {
+                        break;
+                    }
+                    continue;
+                }
+
+                uint32_t class_rev = pci_config_read32(bus, slot, function, PCI_CLASS_REVISION);
+                if ((class_rev >> 24) == class_code && ((class_rev >> 16) & 0xFF) == subclass) {
+                    out->bus = bus;
+                    out->slot = slot;
+                    out->function = function;
+                    out->vendor_id = id & 0xFFFF;
+                    out->device_id = id >> 16;
+                    out->class_code = class_code;
+                    out->subclass = subclass;
+                    out->prog_if = (class_rev >> 8) & 0xFF;
+                    return 0;
+                }
+
+                if (function == 0 &&
+                    !(pci_config_read32(bus, slot, 0, PCI_HEADER_TYPE) & 0x00800000)) {
+                    break;
+                }
+            }
+        }
+    }
+    return -1;
+}
+
+void pci_enable(const PciDevice *dev, uint16_t command_bits) {
+    uint32_t command = pci_config_read32(dev->bus, dev->slot, dev->function, PCI_COMMAND);
+    if ((command & command_bits) != command_bits) {
+        // The upper half is the status register; writing zeros there leaves it untouched
+        pci_config_write32(dev->bus, dev->slot, dev->function, PCI_COMMAND,
+                           (command & 0xFFFF) | command_bits);
+    }
+}
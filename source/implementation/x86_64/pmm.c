@@ -0,0 +1,220 @@
+// pmm.c - Physical frame allocator
+#include "pmm.h"
+#include "paging.h"
+#include "multiboot2.h"
+#include "interrupts.h"
+#include "memory.h"
+#include "klog.h"
+
+#define PMM_MAX_REGIONS  32
+#define PMM_MAX_RESERVED (MULTIBOOT2_MAX_MODULES + 2)
+#define PMM_LOW_MEMORY   0x100000ULL // BIOS data, option ROMs and the like
+#define PMM_PINNED       0xFF
+
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+} PmmRange;
+
+// End of .bss, from the linker script
+extern char kernel_end[];
+
+// Free memory is handed out front to back from these ranges; frames
+// freed later go on a list threaded through the frames themselves
+static PmmRange regions[PMM_MAX_REGIONS];
+static int region_count = 0;
+static int region_current = 0;
+static uint64_t free_list = 0;
+
+static PmmRange reserved[PMM_MAX_RESERVED];
+static int reserved_count = 0;
+
+static uint8_t refcounts[PMM_MAX_FRAMES];
+static uint64_t total_frames = 0;
+static uint64_t free_frames = 0;
+static uint64_t ignored_frames = 0;
+
+static void reserve(uint64_t start, uint64_t size) {
+    if (size == 0 || reserved_count == PMM_MAX_RESERVED) {
+        return;
+    }
+    reserved[reserved_count].start = start & ~(uint64_t)(PMM_FRAME_SIZE - 1);
+    reserved[reserved_count].end = (start + size + PMM_FRAME_SIZE - 1) & ~(uint64_t)(PMM_FRAME_SIZE - 1);
+    reserved_count++;
+}
+
+// Adds [start, end) minus the reserved ranges from `first` onwards
+static void add_free_range(uint64_t start, uint64_t end, int first) {
+    for (int i = first; i < reserved_count && start < end; i++) {
+        if (reserved[i].end <= start || reserved[i].start >= end) {
+            continue;
+        }
+        if (reserved[i].start > start) {
+            add_free_range(start, reserved[i].start, i + 1);
+        }
+        start = reserved[i].end;
+    }
+    if (start >= end) {
+        return;
+    }
+    if (region_count == PMM_MAX_REGIONS) {
+        ignored_frames += (end - start) / PMM_FRAME_SIZE;
+        return;
+    }
+    regions[region_count].start = start;
+    regions[region_count].end = end;
+    region_count++;
+    total_frames += (end - start) / PMM_FRAME_SIZE;
+}
+
+void pmm_init(void) {
+    uint64_t limit = PMM_MAX_FRAMES * PMM_FRAME_SIZE;
+    uint64_t info_start, info_size;
+
+    reserve(0, virt_to_phys(kernel_end));
+    multiboot2_info_range(&info_start, &info_size);
+    reserve(info_start, info_size);
+    for (int i = 0; i < multiboot2_module_count(); i++) {
+        const BootModule *module = multiboot2_module(i);
+        reserve((uint64_t)module->start, module->size);
+    }
+
+    for (int i = 0; i < multiboot2_mmap_count(); i++) {
+        const Multiboot2MmapEntry *entry = multiboot2_mmap_entry(i);
+        if (entry->type != MULTIBOOT2_MEMORY_AVAILABLE) {
+            continue;
+        }
+        uint64_t start = (entry->base_addr + PMM_FRAME_SIZE - 1) & ~(uint64_t)(PMM_FRAME_SIZE - 1);
+        uint64_t end = (entry->base_addr + entry->length) & ~(uint64_t)(PMM_FRAME_SIZE - 1);
+        if (start < PMM_LOW_MEMORY) {
+            start = PMM_LOW_MEMORY;
+        }
+        if (end > limit) {
+            if (start < limit) {
+                ignored_frames += (end - limit) / PMM_FRAME_SIZE;
+            } else if (end > start) {
+                ignored_frames += (end - start) / PMM_FRAME_SIZE;
+            }
+            end = limit;
+        }
+        if (start < end) {
+            add_free_range(start, end, 0);
+        }
+    }
+    free_frames = total_frames;
+
+    klogf(KLOG_INFO, "pmm: %lu MiB free in %d ranges", (total_frames * PMM_FRAME_SIZE) >> 20, region_count);
+    if (ignored_frames != 0) {
+        klogf(KLOG_WARNING, "pmm: ignoring %lu MiB above the frame limit", (ignored_frames * PMM_FRAME_SIZE) >> 20);
+    }
+}
+
+uint64_t pmm_alloc(void) {
+    uint64_t frame = 0;
+    uint64_t flags = irq_save();
+
+    if (free_list != 0) {
+        frame = free_list;
+        free_list = *(uint64_t *)phys_to_virt(frame);
+    } else {
+        while (region_current < region_count && regions[region_current].start == regions[region_current].end) {
+            region_current++;
+        }
+        if (region_current < region_count) {
+            frame = regions[region_current].start;
+            regions[region_current].start += PMM_FRAME_SIZE;
+        }
+    }
+    if (frame != 0) {
+        refcounts[frame / PMM_FRAME_SIZE] = 1;
+        free_frames--;
+    }
+
+    irq_restore(flags);
+    return frame;
+}
+
+uint64_t pmm_alloc_contiguous(uint64_t frames, uint64_t limit) {
+    uint64_t bytes = frames * PMM_FRAME_SIZE;
+    uint64_t flags = irq_save();
+    uint64_t start = 0;
+
+    // Taken off the top of a range, away from where pmm_alloc() hands out
+    for (int i = region_current; i < region_count && start == 0; i++) {
+        uint64_t end = regions[i].end < limit ? regions[i].end : limit;
+        if (end > regions[i].start && end - regions[i].start >= bytes) {
+            start = end - bytes;
+            if (end == regions[i].end) {
+                regions[i].end = start;
+            } else if (region_count < PMM_MAX_REGIONS) {
+                regions[region_count].start = end;
+                regions[region_count].end = regions[i].end;
+                region_count++;
+                regions[i].end = start;
+            } else {
+                start = 0;
+            }
+        }
+    }
+    if (start != 0) {
+        for (uint64_t frame = start; frame < start + bytes; frame += PMM_FRAME_SIZE) {
+            refcounts[frame / PMM_FRAME_SIZE] = PMM_PINNED;
+        }
+        free_frames -= frames;
+    }
+
+    irq_restore(flags);
+    return start;
+}
+
+uint64_t pmm_alloc_zeroed(void) {
+    uint64_t frame = pmm_alloc();
+    if (frame != 0) {
+        memory_zero(phys_to_virt(frame), PMM_FRAME_SIZE);
+    }
+    return frame;
+}
+
+int pmm_ref(uint64_t frame) {
+    uint8_t *count = &refcounts[frame / PMM_FRAME_SIZE];
+    uint64_t flags = irq_save();
+    int result = -1;
+
+    if (*count == PMM_PINNED) {
+        result = 0;
+    } else if (*count < PMM_PINNED - 1) {
+        (*count)++;
+        result = 0;
+    }
+
+    irq_restore(flags);
+    return result;
+}
+
+void pmm_put(uint64_t frame) {
+    uint8_t *count = &refcounts[frame / PMM_FRAME_SIZE];
+    uint64_t flags = irq_save();
+
+    if (*count != PMM_PINNED && *count != 0 && --(*count) == 0) {
+        *(uint64_t *)phys_to_virt(frame) = free_list;
+        free_list = frame;
+        free_frames++;
+    }
+
+    irq_restore(flags);
+}
+
+uint32_t pmm_refcount(uint64_t frame) {
+    return refcounts[frame / PMM_FRAME_SIZE];
+}
+
+void pmm_pin(uint64_t frame) {
+    refcounts[frame / PMM_FRAME_SIZE] = PMM_PINNED;
+}
+
+void pmm_get_stats(PmmStats *stats) {
+    stats->total_frames = total_frames;
+    stats->free_frames = free_frames;
+    stats->ignored_frames = ignored_frames;
+    stats->regions = region_count;
+}
@@ -2,235 +2,328 @@
 #include "print.h"
 #include "memory.h"
 #include "console.h"
+#include "timer.h"
+#include "fbcon.h"
+#include "serial.h"
+#include "kprintf.h"
+#include "keyboard.h"
+#include "interrupts.h"
+#include "idle.h"
 #include <stdint.h>
+#include "trace.h"
 
-const static size_t NUM_COLS = 80;
-const static size_t NUM_ROWS = 25;
+#define VGA_COLS 80
+#define VGA_ROWS 25
 
 struct Char {
     uint8_t character;
     uint8_t color;
 };
 
-struct Char* buffer = (struct Char*) 0xb8000;
+// Output is rendered into a RAM shadow of the screen and copied to the
+// display in bulk; uncached MMIO writes per glyph (and MMIO reads when
+// scrolling) are what made long outputs slow. The shadow is a ring of
+// rows: screen row r lives in shadow row (top + r) % num_rows, so
+// scrolling only advances `top` and clears one row. Dirty flags belong to
+// shadow rows, which keep their contents while they move up the screen.
+#define PRINT_FLUSH_INTERVAL_US 16000 // Roughly one frame at 60 Hz
+#define SHADOW_COLS FBCON_MAX_COLS
+#define SHADOW_ROWS FBCON_MAX_ROWS
+
+static volatile uint64_t* const vga_memory = (volatile uint64_t*) 0xb8000;
+static struct Char shadow[SHADOW_ROWS * SHADOW_COLS] __attribute__((aligned(8)));
+static uint8_t row_dirty[SHADOW_ROWS];
+static int output_pending = 0;
+static size_t pending_scroll = 0;   // Rows scrolled since the last flush
+static uint64_t last_flush_tsc = 0;
+static int flush_armed = 0;         // A timer callback will flush
+static int backend = PRINT_BACKEND_VGA_TEXT;
+static size_t num_cols = VGA_COLS;
+static size_t num_rows = VGA_ROWS;
+static size_t top = 0;
 static size_t col = 0;
 static size_t row = 0;
 uint8_t color = PRINT_COLOR_WHITE | PRINT_COLOR_BLACK << 4;
 
-// Map basic scan codes to ASCII characters for lowercase letters and numbers
-static const char key_map[128] = {
-    0,  27, '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=', '\b',
-    '\t', 'q', 'w', 'e', 'r', 't', 'y', 'u', 'i', 'o', 'p', '[', ']', '\n',
-    0, 'a', 's', 'd', 'f', 'g', 'h', 'j', 'k', 'l', ';', '\'', '`',
-    0, '\\', 'z', 'x', 'c', 'v', 'b', 'n', 'm', ',', '.', '/', 0,
-    '*', 0, ' '
-};
+static inline size_t shadow_index(size_t screen_row) {
+    size_t index = top + screen_row;
+    if (index >= num_rows) {
+        index -= num_rows;
+    }
+    return index;
+}
 
-// Map for uppercase letters and shifted characters
-static const char shifted_key_map[128] = {
-    0,  27, '!', '@', '#', '$', '%', '^', '&', '*', '(', ')', '_', '+', '\b',
-    '\t', 'Q', 'W', 'E', 'R', 'T', 'Y', 'U', 'I', 'O', 'P', '{', '}', '\n',
-    0, 'A', 'S', 'D', 'F', 'G', 'H', 'J', 'K', 'L', ':', '"', '~',
-    0, '|', 'Z', 'X', 'C', 'V', 'B', 'N', 'M', '<', '>', '?', 0,
-    '*', 0, ' '
-};
+static inline struct Char* shadow_row(size_t screen_row) {
+    return &shadow[shadow_index(screen_row) * SHADOW_COLS];
+}
 
-static inline uint8_t inb(uint16_t port) {
-    uint8_t result;
-    __asm__ volatile("inb %1, %0" : "=a"(result) : "Nd"(port));
-    return result;
+static inline void mark_dirty(size_t screen_row) {
+    row_dirty[shadow_index(screen_row)] = 1;
+    output_pending = 1;
 }
 
 void print_hex_digit(unsigned char digit) {
-    if (digit < 10) {
-        print_char('0' + digit);
-    } else {
-        print_char('A' + (digit - 10));
-    }
+    print_char((digit < 10) ? '0' + digit : 'A' + (digit - 10));
 }
 
 void print_hex(unsigned int number) {
-    // Handle special case of 0
-    if (number == 0) {
-        print_str("0x0");
-        return;
+    kprintf("0x%X", number);
+}
+
+void print_dec(uint64_t number) {
+    print_int(number);
+}
+
+void clear_row(size_t row) {
+    struct Char* cells = shadow_row(row);
+    for (size_t col = 0; col < num_cols; col++) {
+        cells[col].character = ' ';
+        cells[col].color = color;
     }
+    mark_dirty(row);
+}
 
-    print_str("0x");
-    
-    // Find first non-zero digit
-    int started = 0;
-    for (int i = 7; i >= 0; i--) {
-        unsigned char digit = (number >> (i * 4)) & 0xF;
-        if (digit != 0 || started) {
-            print_hex_digit(digit);
-            started = 1;
-        }
+static void vga_draw_row(size_t screen_row, const struct Char* cells) {
+    const uint64_t* src = (const uint64_t*) cells;
+    volatile uint64_t* dst = vga_memory + screen_row * (VGA_COLS * sizeof(struct Char) / 8);
+    for (size_t i = 0; i < VGA_COLS * sizeof(struct Char) / 8; i++) {
+        dst[i] = src[i];
     }
 }
 
-void print_dec(unsigned int number) {
-    char buffer[11];  // Maximum 10 digits for 32-bit number plus null terminator
-    int i = 0;
-    
-    // Handle special case of 0
-    if (number == 0) {
-        print_char('0');
+/**
+ * print_flush - Brings the display up to date with the shadow.
+ *
+ * Only dirty rows are drawn. VGA text rows are written 8 bytes at a
+ * time; on the framebuffer, rows scrolled since the last flush are moved
+ * as one block of scanlines instead of being drawn again. Runs with
+ * interrupts off, since the flush timer may call it at any point.
+ */
+void print_flush() {
+    uint64_t flags = irq_save();
+    if (flush_armed) {
+        flush_armed = 0;
+        timer_set_callback(0, 0);
+    }
+    if (!output_pending) {
+        irq_restore(flags);
         return;
     }
-    
-    // Convert number to string (in reverse)
-    while (number > 0) {
-        buffer[i++] = '0' + (number % 10);
-        number /= 10;
+
+    if (pending_scroll > 0) {
+        if (backend == PRINT_BACKEND_FRAMEBUFFER && pending_scroll < num_rows) {
+            fbcon_scroll(pending_scroll);
+        } else {
+            for (size_t i = 0; i < num_rows; i++) {
+                row_dirty[i] = 1;
+            }
+        }
+        pending_scroll = 0;
     }
-    
-    // Print in correct order
-    while (i > 0) {
-        print_char(buffer[--i]);
+
+    for (size_t screen_row = 0; screen_row < num_rows; screen_row++) {
+        size_t index = shadow_index(screen_row);
+        if (!row_dirty[index]) {
+            continue;
+        }
+        const struct Char* cells = &shadow[index * SHADOW_COLS];
+        if (backend == PRINT_BACKEND_FRAMEBUFFER) {
+            fbcon_draw_row(screen_row, (const uint8_t*) cells, num_cols);
+        } else {
+            vga_draw_row(screen_row, cells);
+        }
+        row_dirty[index] = 0;
     }
-}
 
-#define KEYBOARD_DATA_PORT 0x60
-#define KEYBOARD_STATUS_PORT 0x64
-#define KEYBOARD_BUFFER_FULL 0x01
-#define LEFT_SHIFT_PRESSED  0x2A
-#define RIGHT_SHIFT_PRESSED 0x36
-#define LEFT_SHIFT_RELEASED 0xAA
-#define RIGHT_SHIFT_RELEASED 0xB6
-#define CAPS_LOCK_PRESSED 0x3A
+    output_pending = 0;
+    last_flush_tsc = timer_tsc();
+    irq_restore(flags);
+}
 
-static int caps_lock_enabled = 0;
-static int shift_pressed = 0;
+static void print_flush_timer(void) {
+    flush_armed = 0;
+    print_flush();
+}
 
-void clear_row(size_t row) {
-    struct Char empty = (struct Char) {
-        character: ' ',
-        color: color,
-    };
-    
-    // Use memory_set to clear the entire row with the empty character
-    for (size_t col = 0; col < NUM_COLS; col++) {
-        memory_copy(&buffer[col + NUM_COLS * row], &empty, sizeof(struct Char));
+// Flushes at most once per interval. Output still pending is flushed by a
+// one-shot timer at the end of the interval, so the last lines before a
+// long silent operation show up without waiting for more output. Call
+// with interrupts off.
+static void print_flush_lazy() {
+    if (!output_pending) {
+        return;
+    }
+    uint64_t due = last_flush_tsc + PRINT_FLUSH_INTERVAL_US * timer_tsc_khz() / 1000;
+    if (timer_tsc() >= due) {
+        print_flush();
+    } else if (!flush_armed) {
+        flush_armed = 1;
+        timer_set_callback(due, print_flush_timer);
     }
 }
 
 void print_clear() {
+    uint64_t flags = irq_save();
     row = 0;
-    for (size_t i = 0; i < NUM_ROWS; i++) {
+    col = 0;
+    top = 0;
+    pending_scroll = 0;
+    for (size_t i = 0; i < num_rows; i++) {
         clear_row(i);
     }
+    print_flush();
+    irq_restore(flags);
 }
 
-void print_newline() {
+int print_set_backend(int new_backend) {
+    uint64_t flags = irq_save();
+    if (new_backend == PRINT_BACKEND_FRAMEBUFFER) {
+        if (!fbcon_available()) {
+            irq_restore(flags);
+            return -1;
+        }
+        fbcon_geometry(&num_cols, &num_rows);
+    } else {
+        num_cols = VGA_COLS;
+        num_rows = VGA_ROWS;
+    }
+    backend = new_backend;
+    print_clear();
+    irq_restore(flags);
+    return 0;
+}
+
+int print_get_backend() {
+    return backend;
+}
+
+// The screen side of the console; serial output is handled by the callers
+static void screen_newline() {
     col = 0;
 
-    if (row < NUM_ROWS - 1) {
+    if (row < num_rows - 1) {
         row++;
     } else {
-        // Use memory_move to scroll the screen up
-        memory_move(buffer, buffer + NUM_COLS, (NUM_ROWS - 1) * NUM_COLS * sizeof(struct Char));
-        clear_row(NUM_ROWS - 1);
+        // The old top row becomes the new bottom row
+        top = (top + 1 == num_rows) ? 0 : top + 1;
+        pending_scroll++;
+        clear_row(num_rows - 1);
     }
 }
 
-void print_char(char character) {
+static void screen_char(char character) {
     if (character == '\n') {
-        print_newline();
+        screen_newline();
         return;
     }
 
     if (character == '\b') {
         if (col == 0 && row > 0) {
             row--;
-            col = NUM_COLS - 1;
+            col = num_cols - 1;
         } else if (col > 0) {
             col--;
         }
 
-        struct Char empty = (struct Char) {
-            character: ' ',
-            color: color,
-        };
-        memory_copy(&buffer[col + NUM_COLS * row], &empty, sizeof(struct Char));
+        struct Char* cell = &shadow_row(row)[col];
+        cell->character = ' ';
+        cell->color = color;
+        mark_dirty(row);
         return;
     }
 
-    if (col >= NUM_COLS) {
-        print_newline();
+    if (col >= num_cols) {
+        screen_newline();
     }
 
-    struct Char ch = (struct Char) {
-        character: (uint8_t) character,
-        color: color,
-    };
-    memory_copy(&buffer[col + NUM_COLS * row], &ch, sizeof(struct Char));
+    struct Char* cell = &shadow_row(row)[col];
+    cell->character = (uint8_t) character;
+    cell->color = color;
+    mark_dirty(row);
 
     col++;
 }
 
-void print_str(char* str) {
-    for (size_t i = 0; str[i] != '\0'; i++) {
-        print_char(str[i]);
-    }
+void print_newline() {
+    uint64_t flags = irq_save();
+    screen_newline();
+    print_flush_lazy();
+    irq_restore(flags);
+    serial_write_char('\n');
 }
 
-void print_set_color(uint8_t foreground, uint8_t background) {
-    color = foreground + (background << 4);
+void print_char(char character) {
+    uint64_t flags = irq_save();
+    screen_char(character);
+    print_flush_lazy();
+    irq_restore(flags);
+    if (character == '\b') {
+        serial_write_str("\b \b");
+    } else {
+        serial_write_char(character); // Queued; the UART drains it by interrupt
+    }
 }
 
-void print_int(uint32_t num) {
-    char buffer[11];  // Enough for 32-bit integer
-    memory_zero(buffer, sizeof(buffer));
-    
-    if (num == 0) {
-        print_str("0");
-        return;
+// One console write: the shadow is updated in a loop, the serial port gets
+// the whole block at once, and the display is flushed at most once
+void print_write(const char* text, size_t length) {
+    TRACE_SCOPE("console:write", length);
+    uint64_t flags = irq_save();
+    for (size_t i = 0; i < length; i++) {
+        screen_char(text[i]);
     }
+    print_flush_lazy();
+    irq_restore(flags);
+    serial_write(text, length);
+}
 
-    int i = 10;
-    while (num > 0 && i > 0) {
-        buffer[--i] = '0' + (num % 10);
-        num /= 10;
+void print_str(char* str) {
+    size_t length = 0;
+    while (str[length] != '\0') {
+        length++;
     }
+    print_write(str, length);
+}
 
-    print_str(&buffer[i]);
+void print_set_color(uint8_t foreground, uint8_t background) {
+    color = foreground + (background << 4);
 }
 
+void print_int(uint64_t num) {
+    char buffer[20];
+    int length = format_decimal(buffer + sizeof(buffer), num);
+    print_write(buffer + sizeof(buffer) - length, length);
+}
+
+// Blocks until the keyboard or the serial terminal delivers a character,
+// halting the CPU in between instead of spinning on the controller
 char get_char() {
-    uint8_t scan_code = 0;
+    // Nothing may stay unflushed while waiting for the user
+    print_flush();
 
     while (1) {
-        if (inb(KEYBOARD_STATUS_PORT) & KEYBOARD_BUFFER_FULL) {
-            scan_code = inb(KEYBOARD_DATA_PORT);
-
-            // Handle Shift key
-            if (scan_code == LEFT_SHIFT_PRESSED || scan_code == RIGHT_SHIFT_PRESSED) {
-                shift_pressed = 1;
-                continue;
-            } else if (scan_code == LEFT_SHIFT_RELEASED || scan_code == RIGHT_SHIFT_RELEASED) {
-                shift_pressed = 0;
-                continue;
-            }
-
-            // Handle Caps Lock key
-            if (scan_code == CAPS_LOCK_PRESSED) {
-                caps_lock_enabled = !caps_lock_enabled;
-                continue;
-            }
+        uint64_t flags = irq_save();
+
+        // A serial terminal types into the same prompt as the keyboard
+        int serial_char = serial_read_char();
+        if (serial_char == '\r') {
+            irq_restore(flags);
+            return '\n';
+        } else if (serial_char == 0x7F) {
+            irq_restore(flags);
+            return '\b';
+        } else if (serial_char > 0 && serial_char < 0x80) {
+            irq_restore(flags);
+            return (char) serial_char;
+        }
 
-            // Handle key press for normal and shifted/caps lock states
-            if (scan_code < 128) {
-                if (shift_pressed || caps_lock_enabled) {
-                    if (scan_code >= 'a' && scan_code <= 'z' && caps_lock_enabled && !shift_pressed) {
-                        return shifted_key_map[scan_code];
-                    }
-                    return shifted_key_map[scan_code];
-                } else {
-                    return key_map[scan_code];
-                }
-            }
+        int key = keyboard_read_char();
+        if (key >= 0) {
+            irq_restore(flags);
+            return (char) key;
         }
+
+        idle_wait(flags, 0);
     }
 }
 
@@ -0,0 +1,16 @@
+// qemu.c
+#include "qemu.h"
+#include "port.h"
+#include "print.h"
+#include "serial.h"
+
+void qemu_exit(uint8_t status) {
+    print_flush();
+    serial_flush();
+    outb(QEMU_DEBUG_EXIT_PORT, status);
+
+    // Not running under QEMU, or the device was not configured
+    for (;;) {
+        asm volatile("cli; hlt");
+    }
+}
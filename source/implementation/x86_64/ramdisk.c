@@ -0,0 +1,139 @@
+// ramdisk.c
+#include "ramdisk.h"
+#include "memory.h"
+#include "vmm.h"
+#include "print.h"
+
+#define RAMDISK_SECTOR_SIZE 512
+
+static BlockDevice ramdisks[RAMDISK_MAX];
+static uint64_t ramdisk_bytes[RAMDISK_MAX];
+static int ramdisk_total = 0;
+
+static int ram_read(BlockDevice *dev, uint64_t lba, uint32_t count, uint8_t *buffer) {
+    memory_copy(buffer, (uint8_t *)dev->private_data + lba * RAMDISK_SECTOR_SIZE,
+                (size_t)count * RAMDISK_SECTOR_SIZE);
+    return 0;
+}
+
+static int ram_write(BlockDevice *dev, uint64_t lba, uint32_t count, const uint8_t *buffer) {
+    memory_copy((uint8_t *)dev->private_data + lba * RAMDISK_SECTOR_SIZE, buffer,
+                (size_t)count * RAMDISK_SECTOR_SIZE);
+    return 0;
+}
+
+// Discarded sectors read back as zeros, like a thin-provisioned disk; whole
+// pages of demand-paged disks give their memory back
+static int ram_discard(BlockDevice *dev, uint64_t lba, uint64_t count) {
+    uint8_t *start = (uint8_t *)dev->private_data + lba * RAMDISK_SECTOR_SIZE;
+    uint64_t bytes = count * RAMDISK_SECTOR_SIZE;
+    uint64_t head = (PAGE_SIZE - ((uint64_t)start & (PAGE_SIZE - 1))) & (PAGE_SIZE - 1);
+
+    if (bytes < head || vmm_discard(vmm_kernel_space(), start, bytes) != 0) {
+        memory_set(start, 0, bytes);
+        return 0;
+    }
+    uint64_t tail = ((uint64_t)start + bytes) & (PAGE_SIZE - 1);
+    memory_set(start, 0, head);
+    memory_set(start + bytes - tail, 0, tail);
+    return 0;
+}
+
+// Nothing is volatile beyond memory itself, so there is no flush
+static const BlockDeviceOps ram_ops = {
+    .read = ram_read,
+    .write = ram_write,
+    .discard = ram_discard,
+};
+
+static BlockDevice *ramdisk_register(void *data, uint64_t bytes) {
+    BlockDevice *dev = &ramdisks[ramdisk_total];
+    uint64_t sector_count = bytes / RAMDISK_SECTOR_SIZE;
+    char *name = dev->name;
+
+    name[0] = 'r';
+    name[1] = 'a';
+    name[2] = 'm';
+    name[3] = '0' + ramdisk_total;
+    name[4] = '\0';
+    dev->sector_count = sector_count;
+    dev->ops = &ram_ops;
+    dev->controller = -1;
+    dev->drive = -1;
+    dev->private_data = data;
+    dev->flags = BLOCKDEV_DISCARD_ZEROES;
+    dev->label_generation++;
+
+    ramdisk_bytes[ramdisk_total] = bytes;
+    ramdisk_total++;
+    return dev;
+}
+
+BlockDevice *ramdisk_create(uint64_t sector_count) {
+    if (ramdisk_total == RAMDISK_MAX) {
+        print_str("Error: too many RAM disks");
+        print_newline();
+        return NULL;
+    }
+    if (sector_count == 0) {
+        print_str("Error: RAM disk size must be positive");
+        print_newline();
+        return NULL;
+    }
+
+    // Memory is only committed as sectors are written
+    uint64_t bytes = sector_count * RAMDISK_SECTOR_SIZE;
+    void *data = vmm_map_anonymous(vmm_kernel_space(), bytes, VMM_WRITE);
+    if (data == NULL) {
+        print_str("Error: not enough address space for the RAM disk");
+        print_newline();
+        return NULL;
+    }
+    return ramdisk_register(data, bytes);
+}
+
+BlockDevice *ramdisk_snapshot(BlockDevice *source) {
+    uint64_t bytes;
+    uint8_t *memory = ramdisk_memory(source, &bytes);
+
+    if (ramdisk_total == RAMDISK_MAX) {
+        print_str("Error: too many RAM disks");
+        print_newline();
+        return NULL;
+    }
+    void *data = (memory != NULL) ? vmm_map_copy(vmm_kernel_space(), memory) : NULL;
+    if (data == NULL) {
+        print_str("Error: only RAM disks made with ramdisk can be snapshotted");
+        print_newline();
+        return NULL;
+    }
+    return ramdisk_register(data, bytes);
+}
+
+BlockDevice *ramdisk_create_from(void *data, uint64_t bytes) {
+    if (ramdisk_total == RAMDISK_MAX || bytes < RAMDISK_SECTOR_SIZE) {
+        return NULL;
+    }
+    BlockDevice *dev = ramdisk_register(data, bytes);
+    dev->flags |= BLOCKDEV_READ_ONLY;
+    return dev;
+}
+
+uint8_t *ramdisk_memory(BlockDevice *dev, uint64_t *bytes) {
+    if (dev->ops != &ram_ops) {
+        return NULL;
+    }
+    *bytes = ramdisk_bytes[dev - ramdisks];
+    return (uint8_t *)dev->private_data;
+}
+
+int ramdisk_count(void) {
+    return ramdisk_total;
+}
+
+BlockDevice *ramdisk_get(int index) {
+    if (index < 0 || index >= ramdisk_total) {
+        return NULL;
+    }
+    return &ramdisks[index];
+}
@@ -0,0 +1,68 @@
+// ring.c - lock-free record rings (klog, trace)
+#include "ring.h"
+#include "memory.h"
+
+static inline uint64_t *slot_sequence(Ring *ring, uint64_t number) {
+    return (uint64_t *)((uint8_t *)ring->slots + (number & (ring->capacity - 1)) * ring->slot_size);
+}
+
+void *ring_claim(Ring *ring, uint64_t *number) {
+    *number = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    uint64_t *sequence = slot_sequence(ring, *number);
+
+    __atomic_store_n(sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return sequence;
+}
+
+void ring_publish(void *slot, uint64_t number) {
+    __atomic_store_n((uint64_t *)slot, number + 1, __ATOMIC_RELEASE);
+}
+
+int ring_read(Ring *ring, uint64_t *cursor, void *record) {
+    for (;;) {
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (*cursor >= head) {
+            return 0;
+        }
+        if (head - *cursor > ring->capacity) {
+            *cursor = head - ring->capacity;
+        }
+
+        uint64_t *slot = slot_sequence(ring, *cursor);
+        uint64_t sequence = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+        if (sequence != *cursor + 1) {
+            if (sequence == 0 || sequence < *cursor + 1) {
+                return 0; // Claimed but not committed yet; try again later
+            }
+            (*cursor)++; // Already overwritten by a newer record
+            continue;
+        }
+
+        memory_copy(record, slot, ring->slot_size);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(slot, __ATOMIC_RELAXED) != sequence) {
+            (*cursor)++; // Overwritten while it was being copied
+            continue;
+        }
+        (*cursor)++;
+        return 1;
+    }
+}
+
+uint64_t ring_oldest(Ring *ring) {
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    return (head > ring->capacity) ? head - ring->capacity : 0;
+}
+
+uint64_t ring_count(Ring *ring) {
+    return __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+}
+
+void ring_reset(Ring *ring) {
+    __atomic_store_n(&ring->head, 0, __ATOMIC_RELAXED);
+    for (uint64_t i = 0; i < ring->capacity; i++) {
+        *slot_sequence(ring, i) = 0;
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
@@ -0,0 +1,266 @@
+// serial.c
+#include "serial.h"
+#include "port.h"
+#include "interrupts.h"
+
+// 16550 register offsets
+#define UART_DATA        0
+#define UART_IER         1
+#define UART_IIR         2 // Read
+#define UART_FCR         2 // Write
+#define UART_LCR         3
+#define UART_MCR         4
+#define UART_LSR         5
+#define UART_MSR         6
+
+#define UART_LSR_DR      0x01
+#define UART_LSR_THRE    0x20
+#define UART_LSR_TEMT    0x40
+#define UART_LCR_DLAB    0x80
+#define UART_IER_RX      0x01
+#define UART_IER_THRE    0x02
+#define UART_IIR_NONE    0x01
+
+#define UART_FIFO_SIZE   16
+
+// Power-of-two rings indexed by free-running counters
+#define SERIAL_TX_RING   4096
+#define SERIAL_RX_RING   256
+
+static int uart_ok = 0;
+static int irq_mode = 0;
+static int fifo_room = 0;          // Polled mode: bytes the TX FIFO still takes
+
+static uint8_t tx_ring[SERIAL_TX_RING];
+static volatile uint32_t tx_head = 0;
+static volatile uint32_t tx_tail = 0;
+static volatile int tx_active = 0; // THRE interrupt armed
+
+static uint8_t rx_ring[SERIAL_RX_RING];
+static volatile uint32_t rx_head = 0;
+static volatile uint32_t rx_tail = 0;
+
+static uint8_t ier = 0;
+
+/**
+ * serial_init - Sets up COM1 for polled transmission.
+ *
+ * The UART is briefly put in loopback mode and a test byte is echoed;
+ * if it does not come back the port is treated as absent so that
+ * writes never spin on a missing device.
+ */
+void serial_init(void) {
+    outb(SERIAL_COM1 + UART_IER, 0x00);
+    outb(SERIAL_COM1 + UART_LCR, UART_LCR_DLAB);
+    outb(SERIAL_COM1 + UART_DATA, 0x01); // Divisor 1 = 115200 baud
+    outb(SERIAL_COM1 + UART_IER, 0x00);
+    outb(SERIAL_COM1 + UART_LCR, 0x03);  // 8 data bits, no parity, one stop bit
+    outb(SERIAL_COM1 + UART_FCR, 0xC7);  // Enable and clear FIFOs, 14-byte threshold
+
+    outb(SERIAL_COM1 + UART_MCR, 0x1E);  // Loopback
+    outb(SERIAL_COM1 + UART_DATA, 0xAE);
+    uart_ok = (inb(SERIAL_COM1 + UART_DATA) == 0xAE);
+    outb(SERIAL_COM1 + UART_MCR, 0x0B);  // DTR, RTS, OUT2 (routes the IRQ)
+    while (uart_ok && (inb(SERIAL_COM1 + UART_LSR) & UART_LSR_DR)) {
+        inb(SERIAL_COM1 + UART_DATA);
+    }
+}
+
+int serial_present(void) {
+    return uart_ok;
+}
+
+// Moves up to a FIFO's worth of queued bytes to the UART; call only when
+// THRE is set and with interrupts disabled
+static void serial_fill_fifo(void) {
+    for (int i = 0; i < UART_FIFO_SIZE && tx_tail != tx_head; i++) {
+        outb(SERIAL_COM1 + UART_DATA, tx_ring[tx_tail % SERIAL_TX_RING]);
+        tx_tail++;
+    }
+}
+
+static void serial_set_ier(uint8_t value) {
+    ier = value;
+    outb(SERIAL_COM1 + UART_IER, ier);
+}
+
+static void serial_irq(InterruptFrame *frame) {
+    (void)frame;
+    for (;;) {
+        uint8_t iir = inb(SERIAL_COM1 + UART_IIR);
+        if (iir & UART_IIR_NONE) {
+            break;
+        }
+        switch (iir & 0x0E) {
+        case 0x04: // Received data
+        case 0x0C: // Character timeout
+            while (inb(SERIAL_COM1 + UART_LSR) & UART_LSR_DR) {
+                uint8_t byte = inb(SERIAL_COM1 + UART_DATA);
+                if (rx_head - rx_tail < SERIAL_RX_RING) {
+                    rx_ring[rx_head % SERIAL_RX_RING] = byte;
+                    rx_head++;
+                }
+            }
+            break;
+        case 0x02: // Transmit FIFO empty
+            if (tx_tail == tx_head) {
+                tx_active = 0;
+                serial_set_ier(ier & ~UART_IER_THRE);
+            } else {
+                serial_fill_fifo();
+            }
+            break;
+        case 0x06:
+            inb(SERIAL_COM1 + UART_LSR);
+            break;
+        default:
+            inb(SERIAL_COM1 + UART_MSR);
+            break;
+        }
+    }
+}
+
+/**
+ * serial_enable_interrupts - Switches COM1 to interrupt-driven operation.
+ *
+ * From here on writes only queue bytes; the THRE interrupt refills the
+ * 16-byte FIFO from the ring, and received bytes are buffered by the RX
+ * interrupt for serial_read_char().
+ */
+void serial_enable_interrupts(void) {
+    if (!uart_ok) {
+        return;
+    }
+    serial_flush();
+    irq_register(IRQ_COM1, serial_irq);
+    irq_mode = 1;
+    serial_set_ier(UART_IER_RX);
+}
+
+// Call with interrupts disabled
+static void serial_push(uint8_t c) {
+    // The caller outran the UART: push bytes out by polling rather than
+    // dropping them (this also keeps working with interrupts disabled)
+    while (tx_head - tx_tail >= SERIAL_TX_RING) {
+        if (inb(SERIAL_COM1 + UART_LSR) & UART_LSR_THRE) {
+            serial_fill_fifo();
+        }
+    }
+    tx_ring[tx_head % SERIAL_TX_RING] = c;
+    tx_head++;
+}
+
+static void serial_kick(void) {
+    if (!tx_active) {
+        if (inb(SERIAL_COM1 + UART_LSR) & UART_LSR_THRE) {
+            serial_fill_fifo();
+        }
+        tx_active = 1;
+        serial_set_ier(ier | UART_IER_THRE);
+    }
+}
+
+// Before interrupts are up, wait for an empty FIFO only every 16 bytes
+static void serial_poll_char(uint8_t c) {
+    if (fifo_room == 0) {
+        while (!(inb(SERIAL_COM1 + UART_LSR) & UART_LSR_THRE));
+        fifo_room = UART_FIFO_SIZE;
+    }
+    outb(SERIAL_COM1 + UART_DATA, c);
+    fifo_room--;
+}
+
+void serial_write_char(char c) {
+    if (!uart_ok) {
+        return;
+    }
+    if (c == '\n') {
+        serial_write_char('\r');
+    }
+    if (irq_mode) {
+        uint64_t flags = irq_save();
+        serial_push((uint8_t)c);
+        serial_kick();
+        irq_restore(flags);
+    } else {
+        serial_poll_char((uint8_t)c);
+    }
+}
+
+// Queues a whole block with interrupts disabled only once
+void serial_write(const char *data, uint64_t length) {
+    if (!uart_ok) {
+        return;
+    }
+    if (!irq_mode) {
+        for (uint64_t i = 0; i < length; i++) {
+            serial_write_char(data[i]);
+        }
+        return;
+    }
+
+    uint64_t flags = irq_save();
+    for (uint64_t i = 0; i < length; i++) {
+        if (data[i] == '\n') {
+            serial_push('\r');
+        }
+        serial_push((uint8_t)data[i]);
+    }
+    serial_kick();
+    irq_restore(flags);
+}
+
+void serial_write_str(const char *str) {
+    while (*str) {
+        serial_write_char(*str++);
+    }
+}
+
+void serial_write_dec(uint64_t value) {
+    char digits[20];
+    int length = 0;
+    do {
+        digits[length++] = '0' + (value % 10);
+        value /= 10;
+    } while (value != 0);
+    while (length > 0) {
+        serial_write_char(digits[--length]);
+    }
+}
+
+int serial_read_char(void) {
+    if (!uart_ok) {
+        return -1;
+    }
+    if (!irq_mode) {
+        if (inb(SERIAL_COM1 + UART_LSR) & UART_LSR_DR) {
+            return inb(SERIAL_COM1 + UART_DATA);
+        }
+        return -1;
+    }
+
+    int c = -1;
+    uint64_t flags = irq_save();
+    if (rx_tail != rx_head) {
+        c = rx_ring[rx_tail % SERIAL_RX_RING];
+        rx_tail++;
+    }
+    irq_restore(flags);
+    return c;
+}
+
+// Polls out everything queued, then waits for the shift register to empty
+void serial_flush(void) {
+    if (!uart_ok) {
+        return;
+    }
+    uint64_t flags = irq_save();
+    while (tx_tail != tx_head) {
+        if (inb(SERIAL_COM1 + UART_LSR) & UART_LSR_THRE) {
+            serial_fill_fifo();
+        }
+    }
+    while (!(inb(SERIAL_COM1 + UART_LSR) & UART_LSR_TEMT));
+    fifo_room = UART_FIFO_SIZE;
+    irq_restore(flags);
+}
@@ -0,0 +1,169 @@
+// timer.c
+#include "timer.h"
+#include "port.h"
+#include "interrupts.h"
+
+#define PIT_FREQUENCY_HZ      1193182
+#define PIT_CHANNEL0_DATA     0x40
+#define PIT_CHANNEL2_DATA     0x42
+#define PIT_COMMAND           0x43
+#define PIT_CHANNEL2_GATE     0x61
+#define PIT_CALIBRATE_MS      10
+
+// Fallback used until timer_init() runs or if calibration fails
+#define TSC_DEFAULT_KHZ       1000000
+
+// Channel 0, lobyte/hibyte, mode 0: one IRQ 0 edge when the count expires
+#define PIT_CHANNEL0_ONESHOT  0x30
+#define PIT_MAX_COUNT         0xFFFF
+
+static uint64_t tsc_khz = TSC_DEFAULT_KHZ;
+static uint64_t deadline_irqs = 0;
+static int pit_ready = 0;
+
+// Channel 0 serves both clients and is armed for the earlier deadline
+static uint64_t wake_deadline = 0;      // timer_set_deadline()
+static uint64_t callback_deadline = 0;  // timer_set_callback()
+static void (*callback)(void) = 0;
+
+/**
+ * pit_arm - Programs channel 0 for the earliest armed deadline.
+ *
+ * The PIT counts at most 65535 ticks (about 55 ms), so a later deadline
+ * fires early and is armed again from the interrupt. A deadline already
+ * in the past fires after one PIT tick. Call with interrupts disabled.
+ */
+static void pit_arm(void) {
+    uint64_t deadline = wake_deadline;
+    if (callback_deadline != 0 && (deadline == 0 || callback_deadline < deadline)) {
+        deadline = callback_deadline;
+    }
+    if (!pit_ready) {
+        return;
+    }
+    if (deadline == 0) {
+        outb(PIT_COMMAND, PIT_CHANNEL0_ONESHOT);
+        return;
+    }
+
+    uint64_t now = timer_tsc();
+    uint64_t count = 1;
+    if (deadline > now) {
+        count = ((deadline - now) * (PIT_FREQUENCY_HZ / 1000)) / tsc_khz;
+        if (count == 0) {
+            count = 1;
+        } else if (count > PIT_MAX_COUNT) {
+            count = PIT_MAX_COUNT;
+        }
+    }
+
+    outb(PIT_COMMAND, PIT_CHANNEL0_ONESHOT);
+    outb(PIT_CHANNEL0_DATA, count & 0xFF);
+    outb(PIT_CHANNEL0_DATA, count >> 8);
+}
+
+static void timer_irq(InterruptFrame *frame) {
+    (void)frame;
+    deadline_irqs++;
+
+    uint64_t now = timer_tsc();
+    if (wake_deadline != 0 && now >= wake_deadline) {
+        wake_deadline = 0; // The sleeper is awake now
+    }
+    if (callback_deadline != 0 && now >= callback_deadline) {
+        void (*run)(void) = callback;
+        callback_deadline = 0;
+        callback = 0;
+        run();
+    }
+    pit_arm();
+}
+
+/**
+ * timer_init - Measures the TSC frequency.
+ *
+ * Channel 2 of the PIT is programmed in one-shot mode for a fixed
+ * interval; its OUT pin (visible in bit 5 of port 0x61) goes high
+ * when the count expires. The number of TSC ticks seen in between
+ * gives the TSC rate without relying on interrupts.
+ */
+void timer_init(void) {
+    uint16_t count = (uint16_t)((PIT_FREQUENCY_HZ * PIT_CALIBRATE_MS) / 1000);
+
+    // Enable the channel 2 gate, keep the speaker disconnected
+    uint8_t gate = inb(PIT_CHANNEL2_GATE);
+    outb(PIT_CHANNEL2_GATE, (gate & ~0x02) | 0x01);
+
+    // Channel 2, lobyte/hibyte, mode 0 (interrupt on terminal count), binary
+    outb(PIT_COMMAND, 0xB0);
+    outb(PIT_CHANNEL2_DATA, count & 0xFF);
+    outb(PIT_CHANNEL2_DATA, count >> 8);
+
+    uint64_t start = timer_tsc();
+    uint32_t guard = 0;
+    while ((inb(PIT_CHANNEL2_GATE) & 0x20) == 0) {
+        if (++guard == 0x10000000) {
+            break; // PIT not responding, keep the default rate
+        }
+    }
+    uint64_t end = timer_tsc();
+
+    outb(PIT_CHANNEL2_GATE, gate);
+
+    if (guard != 0x10000000 && end > start) {
+        tsc_khz = (end - start) / PIT_CALIBRATE_MS;
+    }
+
+    // Stop the firmware's periodic 18.2 Hz tick: writing the mode without
+    // a count leaves channel 0 waiting, so IRQ 0 only fires for deadlines
+    outb(PIT_COMMAND, PIT_CHANNEL0_ONESHOT);
+    irq_register(IRQ_TIMER, timer_irq);
+
+    uint64_t flags = irq_save();
+    pit_ready = 1;
+    pit_arm();
+    irq_restore(flags);
+}
+
+void timer_set_deadline(uint64_t deadline_tsc) {
+    uint64_t flags = irq_save();
+    wake_deadline = deadline_tsc;
+    pit_arm();
+    irq_restore(flags);
+}
+
+void timer_set_callback(uint64_t deadline_tsc, void (*function)(void)) {
+    uint64_t flags = irq_save();
+    callback_deadline = (function != 0) ? deadline_tsc : 0;
+    callback = function;
+    pit_arm();
+    irq_restore(flags);
+}
+
+uint64_t timer_deadline_irqs(void) {
+    return deadline_irqs;
+}
+
+uint64_t timer_tsc_khz(void) {
+    return tsc_khz;
+}
+
+uint64_t timer_tsc_to_us(uint64_t ticks) {
+    return (ticks * 1000) / tsc_khz;
+}
+
+uint64_t timer_tsc_to_ns(uint64_t ticks) {
+    return (ticks * 1000000) / tsc_khz;
+}
+
+uint64_t timer_elapsed_us(uint64_t start_tsc) {
+    return timer_tsc_to_us(timer_tsc() - start_tsc);
+}
+
+void timer_delay_us(uint64_t us) {
+    uint64_t start = timer_tsc();
+    uint64_t ticks = (us * tsc_khz) / 1000;
+    while (timer_tsc() - start < ticks) {
+        asm volatile("pause");
+    }
+}
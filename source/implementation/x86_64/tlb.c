@@ -0,0 +1,182 @@
+// tlb.c - PCIDs and batched TLB invalidation
+//
+// Only the boot CPU runs, so a batch is issued locally and an address
+// space that is not loaded is flushed when it is next switched to
+#include "tlb.h"
+#include "interrupts.h"
+#include "klog.h"
+
+#define CPUID_ECX_PCID       (1 << 17)
+#define CPUID_EBX_INVPCID    (1 << 10) // Leaf 7
+#define CR4_PGE              (1 << 7)
+#define CR4_PCIDE            (1 << 17)
+#define CR3_PCID_MASK        0xFFFULL
+
+#define INVPCID_CONTEXT      1
+#define INVPCID_ALL_GLOBAL   2
+
+#define PAGE_4K 0x1000ULL
+
+static int has_pcid = 0;
+static int has_invpcid = 0;
+static int pcid_enabled = 0;
+static TlbStats stats;
+
+// Returns EAX; subleaf 0
+static inline uint32_t cpuid(uint32_t leaf, uint32_t *ebx, uint32_t *ecx) {
+    uint32_t eax = leaf, edx;
+    *ecx = 0;
+    asm volatile("cpuid" : "+a"(eax), "=b"(*ebx), "+c"(*ecx), "=d"(edx));
+    return eax;
+}
+
+static inline uint64_t read_cr3(void) {
+    uint64_t value;
+    asm volatile("mov %%cr3, %0" : "=r"(value));
+    return value;
+}
+
+static inline uint64_t read_cr4(void) {
+    uint64_t value;
+    asm volatile("mov %%cr4, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr4(uint64_t value) {
+    asm volatile("mov %0, %%cr4" : : "r"(value) : "memory");
+}
+
+static inline void invpcid(uint64_t type, uint64_t pcid, uint64_t address) {
+    struct {
+        uint64_t pcid;
+        uint64_t address;
+    } descriptor = {pcid, address};
+    asm volatile("invpcid %0, %1" : : "m"(descriptor), "r"(type) : "memory");
+}
+
+void tlb_init(void) {
+    uint32_t ebx, ecx;
+    uint32_t max_leaf = cpuid(0, &ebx, &ecx);
+
+    cpuid(1, &ebx, &ecx);
+    has_pcid = (ecx & CPUID_ECX_PCID) != 0;
+    if (max_leaf >= 7) {
+        cpuid(7, &ebx, &ecx);
+        has_invpcid = (ebx & CPUID_EBX_INVPCID) != 0;
+    }
+
+    // Kernel mappings must survive PCID switches, which takes global pages
+    if (!(read_cr4() & CR4_PGE)) {
+        has_pcid = 0;
+    }
+    if (has_pcid) {
+        tlb_set_pcid(1);
+    }
+    klogf(KLOG_INFO, "tlb: PCID %s, INVPCID %s", pcid_enabled ? "on" : "unsupported",
+          has_invpcid ? "yes" : "no");
+}
+
+int tlb_pcid_supported(void) {
+    return has_pcid;
+}
+
+int tlb_pcid_enabled(void) {
+    return pcid_enabled;
+}
+
+int tlb_set_pcid(int enabled) {
+    if (!has_pcid || (read_cr3() & CR3_PCID_MASK) != 0) {
+        return -1;
+    }
+
+    uint64_t flags = irq_save();
+    uint64_t cr4 = read_cr4();
+    write_cr4(enabled ? (cr4 | CR4_PCIDE) : (cr4 & ~(uint64_t)CR4_PCIDE));
+    pcid_enabled = enabled;
+    tlb_flush_all(1);
+    irq_restore(flags);
+    return 0;
+}
+
+void tlb_flush_page(uint64_t address) {
+    asm volatile("invlpg (%0)" : : "r"(address) : "memory");
+    stats.page_flushes++;
+}
+
+void tlb_flush_all(int global) {
+    if (global && has_invpcid) {
+        invpcid(INVPCID_ALL_GLOBAL, 0, 0);
+    } else if (global) {
+        // Clearing CR4.PGE drops every entry, global ones included
+        uint64_t cr4 = read_cr4();
+        write_cr4(cr4 & ~(uint64_t)CR4_PGE);
+        write_cr4(cr4);
+    } else if (pcid_enabled && has_invpcid) {
+        invpcid(INVPCID_CONTEXT, read_cr3() & CR3_PCID_MASK, 0);
+    } else {
+        // Reloading CR3 without CR3_NOFLUSH drops the current context
+        asm volatile("mov %0, %%cr3" : : "r"(read_cr3()) : "memory");
+    }
+    stats.full_flushes++;
+}
+
+void tlb_batch_add(TlbBatch *batch, uint64_t address) {
+    address &= ~(PAGE_4K - 1);
+
+    for (int i = batch->ranges - 1; i >= 0; i--) {
+        if (address + PAGE_4K >= batch->start[i] && address <= batch->end[i]) {
+            if (address < batch->start[i]) {
+                batch->start[i] = address;
+            }
+            if (address + PAGE_4K > batch->end[i]) {
+                batch->end[i] = address + PAGE_4K;
+            }
+            return;
+        }
+    }
+    if (batch->ranges == TLB_BATCH_RANGES) {
+        batch->overflow = 1;
+        return;
+    }
+    batch->start[batch->ranges] = address;
+    batch->end[batch->ranges] = address + PAGE_4K;
+    batch->ranges++;
+}
+
+void tlb_batch_flush(TlbBatch *batch, int global) {
+    uint64_t pages = 0;
+    for (int i = 0; i < batch->ranges; i++) {
+        pages += (batch->end[i] - batch->start[i]) / PAGE_4K;
+    }
+    if (pages == 0 && !batch->overflow) {
+        return;
+    }
+
+    stats.batches++;
+    if (batch->overflow || pages > TLB_FLUSH_CEILING) {
+        tlb_flush_all(global);
+    } else {
+        for (int i = 0; i < batch->ranges; i++) {
+            for (uint64_t address = batch->start[i]; address < batch->end[i]; address += PAGE_4K) {
+                tlb_flush_page(address);
+            }
+        }
+    }
+    tlb_batch_init(batch);
+}
+
+int tlb_batch_defer(TlbBatch *batch) {
+    int pending = batch->ranges != 0 || batch->overflow;
+    if (pending) {
+        stats.deferred++;
+    }
+    tlb_batch_init(batch);
+    return pending;
+}
+
+void tlb_get_stats(TlbStats *out) {
+    *out = stats;
+    out->has_pcid = has_pcid;
+    out->has_invpcid = has_invpcid;
+    out->pcid_enabled = pcid_enabled;
+}
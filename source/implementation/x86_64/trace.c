@@ -0,0 +1,55 @@
+// trace.c - Tracepoint rings
+#include "trace.h"
+#include "ring.h"
+#include "timer.h"
+
+int trace_enabled = 0;
+
+static TraceRecord records[TRACE_CPUS][TRACE_RECORDS];
+_Static_assert(TRACE_CPUS == 1, "one RING_INIT per CPU ring");
+static Ring rings[TRACE_CPUS] = {RING_INIT(records[0])};
+static uint64_t start_tsc = 0;
+
+void trace_set_enabled(int enabled) {
+    if (enabled && start_tsc == 0) {
+        start_tsc = timer_tsc();
+    }
+    __atomic_store_n(&trace_enabled, enabled, __ATOMIC_RELEASE);
+}
+
+void trace_clear(void) {
+    for (int cpu = 0; cpu < TRACE_CPUS; cpu++) {
+        ring_reset(&rings[cpu]);
+    }
+    start_tsc = timer_tsc();
+}
+
+uint64_t trace_start_tsc(void) {
+    return start_tsc;
+}
+
+void trace_record(const char *name, uint8_t phase, uint64_t arg) {
+    uint8_t cpu = ring_cpu();
+    uint64_t number;
+    TraceRecord *record = ring_claim(&rings[cpu], &number);
+
+    record->tsc = timer_tsc();
+    record->name = name;
+    record->arg = arg;
+    record->phase = phase;
+    record->cpu = cpu;
+    ring_publish(record, number);
+}
+
+const char *trace_begin(const char *name, uint64_t arg) {
+    trace_record(name, TRACE_PHASE_BEGIN, arg);
+    return name;
+}
+
+int trace_read(int cpu, uint64_t *cursor, TraceRecord *record) {
+    return ring_read(&rings[cpu], cursor, record);
+}
+
+uint64_t trace_count(int cpu) {
+    return ring_count(&rings[cpu]);
+}
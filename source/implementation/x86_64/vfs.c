@@ -0,0 +1,334 @@
+// vfs.c
+#include "vfs.h"
+#include "print.h"
+#include "string.h"
+#include "memory.h"
+#include "memory_allocator.h"
+
+typedef struct {
+    char path[VFS_PATH_MAX];
+    VfsSuperblock *sb;
+} VfsMount;
+
+static VfsMount mounts[VFS_MAX_MOUNTS];
+
+// Probed in order by vfs_mount()
+static const VfsFilesystemType filesystems[] = {
+    {"ext4", ext4_mount},
+    {"fat32", fat32_mount},
+    {"initramfs", initramfs_mount},
+};
+
+#define NUM_FILESYSTEMS (sizeof(filesystems) / sizeof(filesystems[0]))
+
+// Copies `path` without trailing slashes; "/" stays "/"
+static int normalize_path(const char *path, char *out) {
+    int length = strlen(path);
+    if (path[0] != '/' || length >= VFS_PATH_MAX) {
+        return -1;
+    }
+    while (length > 1 && path[length - 1] == '/') {
+        length--;
+    }
+    memory_copy(out, path, length);
+    out[length] = '\0';
+    return 0;
+}
+
+// Finds the mount owning `path` and returns the remainder after the mount point
+static VfsMount *find_mount(const char *path, const char **rest) {
+    VfsMount *best = NULL;
+    int best_length = -1;
+
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        if (mounts[i].sb == NULL) {
+            continue;
+        }
+        int length = strlen(mounts[i].path);
+        if (length == 1) {
+            length = 0; // "/" matches everything
+        } else if (memory_compare(path, mounts[i].path, length) != 0 ||
+                   (path[length] != '\0' && path[length] != '/')) {
+            continue;
+        }
+        if (length > best_length) {
+            best = &mounts[i];
+            best_length = length;
+        }
+    }
+
+    if (best != NULL) {
+        *rest = path + best_length;
+    }
+    return best;
+}
+
+int vfs_mount(BlockDevice *dev, uint64_t start_lba, uint64_t sector_count, const char *path) {
+    char mount_path[VFS_PATH_MAX];
+    VfsMount *slot = NULL;
+
+    if (normalize_path(path, mount_path) != 0) {
+        print_str("Error: mount point must be an absolute path");
+        print_newline();
+        return -1;
+    }
+
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        if (mounts[i].sb == NULL) {
+            if (slot == NULL) {
+                slot = &mounts[i];
+            }
+        } else if (strcmp(mounts[i].path, mount_path) == 0) {
+            print_str("Error: something is already mounted there");
+            print_newline();
+            return -1;
+        }
+    }
+    if (slot == NULL) {
+        print_str("Error: mount table full");
+        print_newline();
+        return -1;
+    }
+
+    VfsSuperblock *sb = (VfsSuperblock *)allocate(sizeof(VfsSuperblock));
+    if (sb == NULL) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < NUM_FILESYSTEMS; i++) {
+        memory_zero(sb, sizeof(VfsSuperblock));
+        sb->dev = dev;
+        sb->start_lba = start_lba;
+        sb->sector_count = sector_count;
+        if (filesystems[i].mount(sb) == 0) {
+            sb->fs_name = filesystems[i].name;
+            strcpy(slot->path, mount_path);
+            slot->sb = sb;
+            return 0;
+        }
+    }
+
+    free(sb);
+    print_str("Error: no supported filesystem found");
+    print_newline();
+    return -1;
+}
+
+int vfs_umount(const char *path) {
+    char mount_path[VFS_PATH_MAX];
+    if (normalize_path(path, mount_path) != 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        VfsSuperblock *sb = mounts[i].sb;
+        if (sb == NULL || strcmp(mounts[i].path, mount_path) != 0) {
+            continue;
+        }
+
+        for (VfsInode *inode = sb->inodes; inode != NULL; inode = inode->next) {
+            if (inode->refcount != 0) {
+                print_str("Error: filesystem is busy");
+                print_newline();
+                return -1;
+            }
+        }
+
+        VfsInode *inode = sb->inodes;
+        while (inode != NULL) {
+            VfsInode *next = inode->next;
+            page_cache_drop_tree(&inode->pages);
+            if (sb->ops->release_inode) {
+                sb->ops->release_inode(inode);
+            }
+            free(inode);
+            inode = next;
+        }
+        if (sb->ops->put_super) {
+            sb->ops->put_super(sb);
+        }
+        free(sb);
+        mounts[i].sb = NULL;
+        return 0;
+    }
+
+    print_str("Error: not mounted");
+    print_newline();
+    return -1;
+}
+
+void vfs_list_mounts(void) {
+    int count = 0;
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        if (mounts[i].sb == NULL) {
+            continue;
+        }
+        print_str((char *)mounts[i].sb->dev->name);
+        print_str(" at ");
+        print_str(mounts[i].path);
+        print_str(" type ");
+        print_str((char *)mounts[i].sb->fs_name);
+        print_str(" (start ");
+        print_int(mounts[i].sb->start_lba);
+        print_str(", block size ");
+        print_int(mounts[i].sb->block_size);
+        print_str(")");
+        print_newline();
+        count++;
+    }
+    if (count == 0) {
+        print_str("Nothing mounted.");
+        print_newline();
+    }
+}
+
+VfsInode *vfs_iget(VfsSuperblock *sb, uint64_t ino) {
+    for (VfsInode *inode = sb->inodes; inode != NULL; inode = inode->next) {
+        if (inode->ino == ino) {
+            inode->refcount++;
+            return inode;
+        }
+    }
+
+    VfsInode *inode = (VfsInode *)allocate(sizeof(VfsInode));
+    if (inode == NULL) {
+        return NULL;
+    }
+    memory_zero(inode, sizeof(VfsInode));
+    inode->ino = ino;
+    inode->sb = sb;
+
+    if (sb->ops->read_inode(sb, ino, inode) != 0) {
+        free(inode);
+        return NULL;
+    }
+
+    inode->refcount = 1;
+    inode->next = sb->inodes;
+    sb->inodes = inode;
+    return inode;
+}
+
+// Inodes stay cached with their pages until the filesystem is unmounted
+void vfs_iput(VfsInode *inode) {
+    if (inode != NULL && inode->refcount > 0) {
+        inode->refcount--;
+    }
+}
+
+static int vfs_lookup(VfsInode *dir, const char *name, int name_length, uint64_t *ino) {
+    VfsDirEntry entry;
+    uint64_t cookie = 0;
+    int result;
+
+    while ((result = dir->ops->readdir(dir, &cookie, &entry)) == 1) {
+        if (strlen(entry.name) == name_length && memory_compare(entry.name, name, name_length) == 0) {
+            *ino = entry.ino;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static VfsInode *vfs_resolve(const char *path) {
+    const char *rest;
+    VfsMount *mount = find_mount(path, &rest);
+    if (path[0] != '/' || mount == NULL) {
+        return NULL;
+    }
+
+    VfsInode *inode = vfs_iget(mount->sb, mount->sb->root_ino);
+    while (inode != NULL) {
+        while (*rest == '/') {
+            rest++;
+        }
+        if (*rest == '\0') {
+            return inode;
+        }
+
+        const char *end = rest;
+        while (*end != '\0' && *end != '/') {
+            end++;
+        }
+
+        uint64_t ino;
+        if (!VFS_ISDIR(inode->mode) || vfs_lookup(inode, rest, (int)(end - rest), &ino) != 0) {
+            vfs_iput(inode);
+            return NULL;
+        }
+        vfs_iput(inode);
+        inode = vfs_iget(mount->sb, ino);
+        rest = end;
+    }
+    return NULL;
+}
+
+int vfs_open(const char *path, VfsFile *file) {
+    file->inode = vfs_resolve(path);
+    file->position = 0;
+    return (file->inode != NULL) ? 0 : -1;
+}
+
+void vfs_close(VfsFile *file) {
+    vfs_iput(file->inode);
+    file->inode = NULL;
+}
+
+static int vfs_fill_page(void *context, uint64_t index, uint8_t *data) {
+    VfsInode *inode = (VfsInode *)context;
+    return inode->ops->readpage(inode, index, data);
+}
+
+static uint8_t *vfs_map_page(void *context, uint64_t index) {
+    VfsInode *inode = (VfsInode *)context;
+    return inode->ops->mappage(inode, index);
+}
+
+CachePage *vfs_get_page(VfsInode *inode, uint64_t index) {
+    if (index >= (inode->size + PAGE_SIZE - 1) >> PAGE_SHIFT) {
+        return NULL;
+    }
+    if (inode->ops->mappage) {
+        return page_cache_get_mapped(&inode->pages, index, vfs_map_page, inode);
+    }
+    return page_cache_get(&inode->pages, index, vfs_fill_page, inode);
+}
+
+int64_t vfs_read(VfsFile *file, void *buffer, uint64_t length) {
+    VfsInode *inode = file->inode;
+    uint8_t *out = (uint8_t *)buffer;
+    uint64_t done = 0;
+
+    if (file->position >= inode->size) {
+        return 0;
+    }
+    if (length > inode->size - file->position) {
+        length = inode->size - file->position;
+    }
+
+    while (done < length) {
+        uint64_t offset = file->position & (PAGE_SIZE - 1);
+        uint64_t chunk = PAGE_SIZE - offset;
+        if (chunk > length - done) {
+            chunk = length - done;
+        }
+
+        CachePage *page = vfs_get_page(inode, file->position >> PAGE_SHIFT);
+        if (page == NULL) {
+            return -1;
+        }
+        memory_copy(out + done, page->data + offset, chunk);
+        page_cache_put(page);
+
+        done += chunk;
+        file->position += chunk;
+    }
+    return (int64_t)done;
+}
+
+int vfs_readdir(VfsFile *dir, VfsDirEntry *entry) {
+    if (!VFS_ISDIR(dir->inode->mode)) {
+        return -1;
+    }
+    return dir->inode->ops->readdir(dir->inode, &dir->position, entry);
+}
@@ -0,0 +1,540 @@
+// vmm.c - Address spaces, demand paging and copy-on-write
+#include "vmm.h"
+#include "pmm.h"
+#include "paging.h"
+#include "interrupts.h"
+#include "tlb.h"
+#include "memory.h"
+#include "memory_allocator.h"
+#include "klog.h"
+
+// Page fault error code bits
+#define PF_WRITE    0x02
+#define PF_RESERVED 0x08
+
+#define CR0_WP (1 << 16)
+
+#define PML4_KERNEL_FIRST 256
+#define VMM_GUARD_SIZE    PAGE_SIZE // Left unmapped between mappings
+
+static AddressSpace kernel_space;
+static AddressSpace *current_space = &kernel_space;
+
+// Backs every untouched page that has only been read
+static uint64_t zero_frame = 0;
+
+// Kernel range pages are global so that they survive PCID switches
+static uint64_t kernel_global = 0;
+static uint64_t pcids_used[TLB_PCID_COUNT / 64];
+
+static inline uint64_t *table_at(uint64_t entry) {
+    return (uint64_t *)phys_to_virt(entry & PTE_ADDRESS);
+}
+
+static inline uint64_t leaf_flags(AddressSpace *space) {
+    return PTE_PRESENT | ((space == &kernel_space) ? kernel_global : 0);
+}
+
+// The kernel range is part of every address space and uses global pages;
+// a space that is not loaded is flushed when it next is
+static void flush_batch(AddressSpace *space, TlbBatch *batch) {
+    if (space == &kernel_space) {
+        tlb_batch_flush(batch, 1);
+    } else if (space == current_space) {
+        tlb_batch_flush(batch, 0);
+    } else if (tlb_batch_defer(batch)) {
+        space->tlb_stale = 1;
+    }
+}
+
+// Returns the page table entry for `address`, creating missing tables when
+// `create` is set. Otherwise NULL means a table is absent and *skip is how
+// many bytes from `address` it would have covered.
+static uint64_t *walk(AddressSpace *space, uint64_t address, int create, uint64_t *skip) {
+    uint64_t *table = (uint64_t *)phys_to_virt(space->pml4);
+
+    for (int shift = 39; shift > 12; shift -= 9) {
+        uint64_t *entry = &table[(address >> shift) & 511];
+        if (!(*entry & PTE_PRESENT)) {
+            if (!create) {
+                *skip = (1ULL << shift) - (address & ((1ULL << shift) - 1));
+                return NULL;
+            }
+            uint64_t frame = pmm_alloc_zeroed();
+            if (frame == 0) {
+                return NULL;
+            }
+            *entry = frame | PTE_PRESENT | PTE_WRITABLE;
+        }
+        table = table_at(*entry);
+    }
+    return &table[(address >> 12) & 511];
+}
+
+static Vma *find_vma(AddressSpace *space, uint64_t address) {
+    for (Vma *vma = space->vmas; vma != NULL && vma->start <= address; vma = vma->next) {
+        if (address < vma->end) {
+            return vma;
+        }
+    }
+    return NULL;
+}
+
+// Places a mapping in the first gap that fits, keeping the list sorted
+static Vma *insert_vma(AddressSpace *space, uint64_t size, uint32_t flags) {
+    size = (size + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+    if (size == 0 || size > space->limit - space->base) {
+        return NULL;
+    }
+
+    uint64_t start = space->base;
+    Vma **link = &space->vmas;
+    while (*link != NULL && (*link)->start < start + size + VMM_GUARD_SIZE) {
+        start = (*link)->end + VMM_GUARD_SIZE;
+        link = &(*link)->next;
+    }
+    if (start + size > space->limit || start + size < start) {
+        return NULL;
+    }
+
+    Vma *vma = (Vma *)allocate(sizeof(Vma));
+    if (vma == NULL) {
+        return NULL;
+    }
+    memory_zero(vma, sizeof(Vma));
+    vma->start = start;
+    vma->end = start + size;
+    vma->flags = flags;
+    vma->next = *link;
+
+    uint64_t irq = irq_save();
+    *link = vma;
+    space->mapped_bytes += size;
+    irq_restore(irq);
+    return vma;
+}
+
+// Drops the frames mapped in [start, end); the page tables stay for reuse
+static void release_range(AddressSpace *space, uint64_t start, uint64_t end) {
+    TlbBatch batch;
+    uint64_t address = start;
+
+    tlb_batch_init(&batch);
+    while (address < end) {
+        uint64_t skip;
+        uint64_t *pte = walk(space, address, 0, &skip);
+        if (pte == NULL) {
+            address += skip;
+            continue;
+        }
+        if (*pte & PTE_PRESENT) {
+            uint64_t frame = *pte & PTE_ADDRESS;
+            *pte = 0;
+            if (frame != zero_frame) {
+                pmm_put(frame);
+                space->resident_pages--;
+            }
+            tlb_batch_add(&batch, address);
+        }
+        address += PAGE_SIZE;
+    }
+    flush_batch(space, &batch);
+}
+
+// First touch of a page: anonymous reads share the zero frame, everything
+// else gets a frame of its own
+static int fault_in(AddressSpace *space, Vma *vma, uint64_t page, uint64_t *pte, int write) {
+    uint64_t writable = (vma->flags & VMM_WRITE) ? PTE_WRITABLE : 0;
+
+    if (!(vma->flags & VMM_FILE) && !write) {
+        *pte = zero_frame | leaf_flags(space);
+        space->minor_faults++;
+        return 0;
+    }
+
+    uint64_t frame = pmm_alloc_zeroed();
+    if (frame == 0) {
+        return -1;
+    }
+
+    int major = 0;
+    uint64_t offset = vma->file_offset + (page - vma->start);
+    if ((vma->flags & VMM_FILE) && offset < vma->inode->size) {
+        PageCacheStats before, after;
+        page_cache_get_stats(&before);
+        CachePage *cached = vfs_get_page(vma->inode, offset >> PAGE_SHIFT);
+        if (cached == NULL) {
+            pmm_put(frame);
+            return -1;
+        }
+
+        uint64_t length = vma->inode->size - offset;
+        if (length > PAGE_SIZE) {
+            length = PAGE_SIZE;
+        }
+        memory_copy(phys_to_virt(frame), cached->data, length);
+        page_cache_put(cached);
+        page_cache_get_stats(&after);
+        major = after.fill_bytes != before.fill_bytes;
+    }
+
+    *pte = frame | leaf_flags(space) | writable;
+    space->resident_pages++;
+    if (major) {
+        space->major_faults++;
+    } else {
+        space->minor_faults++;
+    }
+    return 0;
+}
+
+// Write to a read-only page of a writable mapping: the frame is shared
+// with the zero page or another mapping, unless the others are gone
+static int fault_copy(AddressSpace *space, uint64_t *pte) {
+    uint64_t frame = *pte & PTE_ADDRESS;
+
+    space->minor_faults++;
+    if (frame != zero_frame && pmm_refcount(frame) == 1) {
+        *pte |= PTE_WRITABLE;
+        return 0;
+    }
+
+    uint64_t copy = pmm_alloc();
+    if (copy == 0) {
+        return -1;
+    }
+    if (frame == zero_frame) {
+        memory_zero(phys_to_virt(copy), PAGE_SIZE);
+        space->resident_pages++;
+    } else {
+        memory_copy(phys_to_virt(copy), phys_to_virt(frame), PAGE_SIZE);
+        pmm_put(frame);
+        space->cow_faults++;
+    }
+    *pte = copy | leaf_flags(space) | PTE_WRITABLE;
+    return 0;
+}
+
+static int page_fault(InterruptFrame *frame) {
+    uint64_t address;
+    asm volatile("mov %%cr2, %0" : "=r"(address));
+
+    AddressSpace *space = current_space;
+    if (address >= VMM_KERNEL_BASE && address < VMM_KERNEL_END) {
+        space = &kernel_space;
+    }
+
+    int write = (frame->error_code & PF_WRITE) != 0;
+    Vma *vma = find_vma(space, address);
+    if (vma == NULL || (frame->error_code & PF_RESERVED) || (write && !(vma->flags & VMM_WRITE))) {
+        return -1;
+    }
+
+    uint64_t page = address & ~(uint64_t)(PAGE_SIZE - 1);
+    uint64_t *pte = walk(space, page, 1, NULL);
+    int result;
+    if (pte == NULL) {
+        result = -1;
+    } else if (!(*pte & PTE_PRESENT)) {
+        result = fault_in(space, vma, page, pte, write);
+    } else if (write && !(*pte & PTE_WRITABLE)) {
+        result = fault_copy(space, pte);
+    } else {
+        result = 0; // Already resolved; the TLB held a stale entry
+    }
+
+    if (result != 0) {
+        klogf(KLOG_ERROR, "vmm: cannot fault in 0x%lx in %s: out of memory or read error", address, space->name);
+        return -1;
+    }
+    tlb_flush_page(page);
+    return 0;
+}
+
+void vmm_init(void) {
+    uint64_t cr0, cr3;
+    asm volatile("mov %%cr3, %0" : "=r"(cr3));
+
+    const char *name = "kernel";
+    for (int i = 0; name[i] != '\0'; i++) {
+        kernel_space.name[i] = name[i];
+    }
+    kernel_space.pml4 = cr3 & PTE_ADDRESS;
+
+    // The shared slot gets its table now, so every address space created
+    // later copies a pointer to the same one
+    uint64_t table = pmm_alloc_zeroed();
+    zero_frame = pmm_alloc_zeroed();
+    if (table == 0 || zero_frame == 0) {
+        klogf(KLOG_ERROR, "vmm: no memory for the kernel address space");
+        return;
+    }
+    pmm_pin(zero_frame);
+    ((uint64_t *)phys_to_virt(kernel_space.pml4))[(VMM_KERNEL_BASE >> 39) & 511] =
+        table | PTE_PRESENT | PTE_WRITABLE;
+    kernel_space.base = VMM_KERNEL_BASE;
+    kernel_space.limit = VMM_KERNEL_END;
+    pcids_used[0] = 1;
+
+    PagingStats paging;
+    paging_get_stats(&paging);
+    kernel_global = paging.has_global_pages ? PTE_GLOBAL : 0;
+
+    // Copy-on-write relies on supervisor writes faulting on read-only pages
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    asm volatile("mov %0, %%cr0" : : "r"(cr0 | CR0_WP) : "memory");
+
+    exception_register(EXCEPTION_PAGE_FAULT, page_fault);
+    klogf(KLOG_INFO, "vmm: %llu GiB of demand-paged kernel memory at 0x%llx",
+          (VMM_KERNEL_END - VMM_KERNEL_BASE) >> 30, VMM_KERNEL_BASE);
+}
+
+AddressSpace *vmm_kernel_space(void) {
+    return &kernel_space;
+}
+
+AddressSpace *vmm_current(void) {
+    return current_space;
+}
+
+AddressSpace *vmm_create(const char *name) {
+    AddressSpace *space = (AddressSpace *)allocate(sizeof(AddressSpace));
+    if (space == NULL) {
+        return NULL;
+    }
+    memory_zero(space, sizeof(AddressSpace));
+    space->pml4 = pmm_alloc_zeroed();
+    if (space->pml4 == 0) {
+        free(space);
+        return NULL;
+    }
+    for (int i = 0; name[i] != '\0' && i < (int)sizeof(space->name) - 1; i++) {
+        space->name[i] = name[i];
+    }
+    space->base = VMM_PRIVATE_BASE;
+    space->limit = VMM_PRIVATE_END;
+    space->tlb_stale = 1; // The PCID may still tag a destroyed space's entries
+
+    // Identity-mapped low memory and the whole kernel half are shared
+    uint64_t *kernel_pml4 = (uint64_t *)phys_to_virt(kernel_space.pml4);
+    uint64_t *pml4 = (uint64_t *)phys_to_virt(space->pml4);
+    pml4[0] = kernel_pml4[0];
+    for (int i = PML4_KERNEL_FIRST; i < 512; i++) {
+        pml4[i] = kernel_pml4[i];
+    }
+
+    uint64_t irq = irq_save();
+    for (int pcid = 1; pcid < TLB_PCID_COUNT && space->pcid == 0; pcid++) {
+        if (!(pcids_used[pcid / 64] & (1ULL << (pcid % 64)))) {
+            pcids_used[pcid / 64] |= 1ULL << (pcid % 64);
+            space->pcid = pcid;
+        }
+    }
+    if (space->pcid == 0) {
+        irq_restore(irq);
+        pmm_put(space->pml4);
+        free(space);
+        return NULL;
+    }
+    space->next = kernel_space.next;
+    kernel_space.next = space;
+    irq_restore(irq);
+    return space;
+}
+
+int vmm_destroy(AddressSpace *space) {
+    if (space == &kernel_space || space == current_space) {
+        return -1;
+    }
+    while (space->vmas != NULL) {
+        vmm_unmap(space, (void *)space->vmas->start);
+    }
+
+    // Only the private range has tables of its own
+    uint64_t *pml4 = (uint64_t *)phys_to_virt(space->pml4);
+    for (int i = (int)(VMM_PRIVATE_BASE >> 39); i < PML4_KERNEL_FIRST; i++) {
+        if (!(pml4[i] & PTE_PRESENT)) {
+            continue;
+        }
+        uint64_t *pdpt = table_at(pml4[i]);
+        for (int j = 0; j < 512; j++) {
+            if (!(pdpt[j] & PTE_PRESENT)) {
+                continue;
+            }
+            uint64_t *pd = table_at(pdpt[j]);
+            for (int k = 0; k < 512; k++) {
+                if (pd[k] & PTE_PRESENT) {
+                    pmm_put(pd[k] & PTE_ADDRESS);
+                }
+            }
+            pmm_put(pdpt[j] & PTE_ADDRESS);
+        }
+        pmm_put(pml4[i] & PTE_ADDRESS);
+    }
+    pmm_put(space->pml4);
+
+    uint64_t irq = irq_save();
+    pcids_used[space->pcid / 64] &= ~(1ULL << (space->pcid % 64));
+    for (AddressSpace **link = &kernel_space.next; *link != NULL; link = &(*link)->next) {
+        if (*link == space) {
+            *link = space->next;
+            break;
+        }
+    }
+    irq_restore(irq);
+    free(space);
+    return 0;
+}
+
+void vmm_switch(AddressSpace *space) {
+    uint64_t cr3 = space->pml4;
+    uint64_t irq = irq_save();
+
+    if (tlb_pcid_enabled()) {
+        cr3 |= space->pcid;
+        if (!space->tlb_stale) {
+            cr3 |= CR3_NOFLUSH;
+        }
+    }
+    space->tlb_stale = 0;
+    current_space = space;
+    asm volatile("mov %0, %%cr3" : : "r"(cr3) : "memory");
+    irq_restore(irq);
+}
+
+int vmm_set_pcid(int enabled) {
+    if (current_space != &kernel_space || tlb_set_pcid(enabled) != 0) {
+        return -1;
+    }
+    // Entries cached under the old scheme are gone, but nothing recorded that
+    for (AddressSpace *space = kernel_space.next; space != NULL; space = space->next) {
+        space->tlb_stale = 1;
+    }
+    return 0;
+}
+
+void *vmm_map_anonymous(AddressSpace *space, uint64_t size, uint32_t flags) {
+    Vma *vma = insert_vma(space, size, flags & VMM_WRITE);
+    return (vma != NULL) ? (void *)vma->start : NULL;
+}
+
+void *vmm_map_file(AddressSpace *space, VfsInode *inode, uint64_t offset, uint64_t size, uint32_t flags) {
+    if (offset & (PAGE_SIZE - 1)) {
+        return NULL;
+    }
+    Vma *vma = insert_vma(space, size, (flags & VMM_WRITE) | VMM_FILE);
+    if (vma == NULL) {
+        return NULL;
+    }
+    vma->inode = inode;
+    vma->file_offset = offset;
+    inode->refcount++;
+    return (void *)vma->start;
+}
+
+void *vmm_map_copy(AddressSpace *space, const void *source) {
+    Vma *original = find_vma(space, (uint64_t)source);
+    if (original == NULL || original->start != (uint64_t)source || (original->flags & VMM_FILE)) {
+        return NULL;
+    }
+    Vma *copy = insert_vma(space, original->end - original->start, original->flags);
+    if (copy == NULL) {
+        return NULL;
+    }
+
+    // Both sides end up read-only on the same frames; the first write to
+    // either copies the frame, or takes it back once the other side is gone
+    TlbBatch batch;
+    tlb_batch_init(&batch);
+    uint64_t address = original->start;
+    while (address < original->end) {
+        uint64_t skip;
+        uint64_t *pte = walk(space, address, 0, &skip);
+        if (pte == NULL) {
+            address += skip;
+            continue;
+        }
+        if (*pte & PTE_PRESENT) {
+            uint64_t frame = *pte & PTE_ADDRESS;
+            uint64_t *target = walk(space, copy->start + (address - original->start), 1, NULL);
+            uint64_t fresh = 0;
+            if (target != NULL && pmm_ref(frame) == 0) {
+                if (*pte & PTE_WRITABLE) {
+                    *pte &= ~(uint64_t)PTE_WRITABLE;
+                    tlb_batch_add(&batch, address);
+                }
+                *target = frame | leaf_flags(space);
+            } else if (target != NULL && (fresh = pmm_alloc()) != 0) {
+                // Too many references to share; copy now instead
+                memory_copy(phys_to_virt(fresh), phys_to_virt(frame), PAGE_SIZE);
+                *target = fresh | leaf_flags(space) | PTE_WRITABLE;
+            } else {
+                flush_batch(space, &batch);
+                vmm_unmap(space, (void *)copy->start);
+                return NULL;
+            }
+            if (frame != zero_frame) {
+                space->resident_pages++;
+            }
+        }
+        address += PAGE_SIZE;
+    }
+
+    flush_batch(space, &batch);
+    return (void *)copy->start;
+}
+
+int vmm_unmap(AddressSpace *space, void *address) {
+    Vma *vma = NULL;
+    uint64_t irq = irq_save();
+    for (Vma **link = &space->vmas; *link != NULL; link = &(*link)->next) {
+        if ((*link)->start == (uint64_t)address) {
+            vma = *link;
+            *link = vma->next;
+            space->mapped_bytes -= vma->end - vma->start;
+            break;
+        }
+    }
+    irq_restore(irq);
+
+    if (vma == NULL) {
+        return -1;
+    }
+    release_range(space, vma->start, vma->end);
+    if (vma->inode != NULL) {
+        vfs_iput(vma->inode);
+    }
+    free(vma);
+    return 0;
+}
+
+int vmm_discard(AddressSpace *space, void *address, uint64_t size) {
+    uint64_t start = (uint64_t)address;
+    Vma *vma = find_vma(space, start);
+    if (vma == NULL || (vma->flags & VMM_FILE) || size > vma->end - start) {
+        return -1;
+    }
+
+    uint64_t first = (start + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+    uint64_t last = (start + size) & ~(uint64_t)(PAGE_SIZE - 1);
+    if (first < last) {
+        release_range(space, first, last);
+    }
+    return 0;
+}
+
+int vmm_count(void) {
+    int count = 0;
+    for (AddressSpace *space = &kernel_space; space != NULL; space = space->next) {
+        count++;
+    }
+    return count;
+}
+
+AddressSpace *vmm_get(int index) {
+    AddressSpace *space = &kernel_space;
+    while (space != NULL && index-- > 0) {
+        space = space->next;
+    }
+    return space;
+}
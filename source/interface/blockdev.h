@@ -0,0 +1,72 @@
+// blockdev.h
+#ifndef BLOCKDEV_H
+#define BLOCKDEV_H
+
+#include <stdint.h>
+
+#define BLOCKDEV_NAME_LEN 16
+
+// Sectors at each end of a disk that hold partition tables (MBR + GPT)
+#define BLOCKDEV_LABEL_SECTORS 34
+
+typedef struct BlockDevice BlockDevice;
+
+// Asynchronous request; `status` stays BLOCKREQ_PENDING until it completes
+#define BLOCKREQ_PENDING 1
+
+typedef struct {
+    int write;
+    uint64_t lba;
+    uint32_t count;
+    uint8_t *buffer;
+    int status;                // BLOCKREQ_PENDING, 0 = done, -1 = error
+} BlockRequest;
+
+// Device flags
+#define BLOCKDEV_DISCARD_ZEROES 0x01 // Discarded sectors read back as zeros
+#define BLOCKDEV_IRQ_COMPLETION 0x02 // Requests finish with an interrupt; waiters sleep
+#define BLOCKDEV_READ_ONLY      0x04 // Writes and discards are refused
+
+// Backend operations; lba and count are in 512-byte sectors
+typedef struct {
+    int (*read)(BlockDevice *dev, uint64_t lba, uint32_t count, uint8_t *buffer);
+    int (*write)(BlockDevice *dev, uint64_t lba, uint32_t count, const uint8_t *buffer);
+    int (*flush)(BlockDevice *dev);
+    int (*discard)(BlockDevice *dev, uint64_t lba, uint64_t count); // NULL if unsupported
+    // Optional; without them requests run synchronously inside blockdev_submit()
+    int (*submit)(BlockDevice *dev, BlockRequest *req);
+    void (*poll)(BlockDevice *dev, BlockRequest *req);
+} BlockDeviceOps;
+
+struct BlockDevice {
+    char name[BLOCKDEV_NAME_LEN];
+    uint64_t sector_count;
+    const BlockDeviceOps *ops;
+    int controller;            // ATA backend: 0 = primary, 1 = secondary
+    int drive;                 // ATA backend: 0 = master, 1 = slave
+    void *private_data;        // Other backends
+    uint32_t label_generation; // Bumped by writes to the partition table areas
+    uint32_t flags;            // BLOCKDEV_* flags
+};
+
+// Binds `dev` to an ATA PIO disk
+void blockdev_init_ata(BlockDevice *dev, int controller, int drive, uint64_t sector_count);
+
+// Range-checked wrappers around the backend operations; writes to a
+// BLOCKDEV_READ_ONLY device fail
+int blockdev_read(BlockDevice *dev, uint64_t lba, uint32_t count, uint8_t *buffer);
+int blockdev_write(BlockDevice *dev, uint64_t lba, uint32_t count, const uint8_t *buffer);
+int blockdev_flush(BlockDevice *dev);
+
+// Tells the device the range no longer holds data; -1 if unsupported or failed
+int blockdev_can_discard(BlockDevice *dev);
+int blockdev_discard(BlockDevice *dev, uint64_t lba, uint64_t count);
+
+// Starts `req`; returns -1 if it could not be issued at all
+int blockdev_submit(BlockDevice *dev, BlockRequest *req);
+// Non-blocking progress check; returns 1 while pending
+int blockdev_poll(BlockDevice *dev, BlockRequest *req);
+// Blocks until `req` completes and returns its status
+int blockdev_wait(BlockDevice *dev, BlockRequest *req);
+
+#endif // BLOCKDEV_H
@@ -0,0 +1,23 @@
+// boottime.h
+#ifndef BOOTTIME_H
+#define BOOTTIME_H
+
+#include <stdint.h>
+
+#define BOOT_MAX_MARKS 24
+
+// The end of one boot phase, stamped with the time-stamp counter, which
+// starts from zero at reset
+typedef struct {
+    const char *phase;
+    uint64_t tsc;
+} BootMark;
+
+// Records that `phase` ended now; marks past BOOT_MAX_MARKS are dropped
+void boot_mark(const char *phase);
+void boot_mark_at(const char *phase, uint64_t tsc);
+
+int boot_mark_count(void);
+const BootMark *boot_mark_get(int index);
+
+#endif // BOOTTIME_H
@@ -0,0 +1,64 @@
+// command.h
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <stdint.h>
+
+// Shells a command can be registered with
+enum {
+    COMMAND_SHELL_KERNEL = 0,
+    COMMAND_SHELL_DISKTOOL = 1,
+    COMMAND_SHELL_COUNT,
+};
+
+// What the dispatcher accepts after the command name
+enum {
+    COMMAND_ARGS_NONE = 0,     // Anything after the name is a usage error
+    COMMAND_ARGS_OPTIONAL = 1, // Handler gets "" when none are given
+    COMMAND_ARGS_REQUIRED = 2, // Missing arguments are a usage error
+};
+
+typedef void (*CommandHandler)(char *args);
+
+typedef struct {
+    const char *name;
+    const char *usage;         // Argument synopsis for help, "" if none
+    const char *help;
+    CommandHandler handler;
+    uint32_t shell;
+    uint32_t args;
+} Command;
+
+/**
+ * COMMAND - Registers a shell command from the file that implements it.
+ *
+ * Entries are collected by the linker into the .commands section
+ * (__commands_start .. __commands_end); command_init() sorts each shell's
+ * entries by name once so lookups are a binary search.
+ */
+#define COMMAND(shell_id, id, command_name, command_usage, command_help, command_args, command_handler) \
+    static const Command command_##id                                                           \
+    __attribute__((used, section(".commands"), aligned(8))) = {                                 \
+        .name = command_name,                                                                   \
+        .usage = command_usage,                                                                 \
+        .help = command_help,                                                                   \
+        .handler = command_handler,                                                             \
+        .shell = shell_id,                                                                      \
+        .args = command_args,                                                                   \
+    }
+
+// Builds the sorted per-shell tables; call once before the first dispatch
+void command_init(void);
+
+const Command *command_find(uint32_t shell, const char *name, int length);
+
+// Runs one input line; returns -1 if no such command is registered
+int command_dispatch(uint32_t shell, char *line);
+
+// Prints every command of `shell` with its usage and help text
+void command_print_help(uint32_t shell);
+
+// Background colour picked with setcolor; prompts and help use it
+extern int shell_color;
+
+#endif // COMMAND_H
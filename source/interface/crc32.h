@@ -0,0 +1,17 @@
+// crc32.h
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Big-endian (MSB-first) CRC32, polynomial 0x04C11DB7, no pre/post inversion.
+// Matches the kernel's crc32_be() used by the jbd2 COMPAT_CHECKSUM feature.
+uint32_t crc32_be(uint32_t crc, const void* data, size_t length);
+
+// Reflected (LSB-first) CRC32, polynomial 0xEDB88320, as used by GPT and
+// zlib. Pre/post inversion is applied internally: start a fresh checksum
+// with crc = 0 and pass the previous result to continue one.
+uint32_t crc32_le(uint32_t crc, const void* data, size_t length);
+
+#endif // CRC32_H
@@ -0,0 +1,40 @@
+// disk_bench.h
+#ifndef DISK_BENCH_H
+#define DISK_BENCH_H
+
+#include <stdint.h>
+#include "blockdev.h"
+
+#define DISK_BENCH_MAX_QUEUE_DEPTH 32
+#define DISK_BENCH_MAX_BLOCK_SIZE  (1024 * 1024)
+
+typedef enum {
+    BENCH_READ,
+    BENCH_WRITE,
+    BENCH_RANDREAD,
+    BENCH_RANDWRITE
+} DiskBenchPattern;
+
+typedef struct {
+    DiskBenchPattern pattern;
+    uint32_t block_size;         // Bytes, multiple of 512
+    uint32_t queue_depth;        // Requests submitted per batch
+    uint64_t offset_lba;         // Start of the tested region
+    uint64_t region_sectors;     // 0 = up to the end of the device
+    uint32_t runtime_ms;
+} DiskBenchConfig;
+
+// Fills `config` with the defaults (randread, 4 KiB, QD1, whole disk, 5 s)
+void disk_bench_defaults(DiskBenchConfig *config);
+
+// Parses fio-style "key=value" options; returns -1 on a malformed option
+int disk_bench_parse(char *args, DiskBenchConfig *config, int *force);
+
+/**
+ * Runs the workload against `dev` and prints IOPS, bandwidth and latency
+ * percentiles. One "bench ..." key=value line is also sent over serial.
+ * Write patterns overwrite the region.
+ */
+int disk_bench_run(BlockDevice *dev, const DiskBenchConfig *config);
+
+#endif // DISK_BENCH_H
@@ -0,0 +1,25 @@
+// disk_clone.h
+#ifndef DISK_CLONE_H
+#define DISK_CLONE_H
+
+#include <stdint.h>
+#include "blockdev.h"
+
+// Largest single transfer (one full PRD table) and the zero-detection granularity
+#define CLONE_CHUNK_SECTORS    2048
+#define CLONE_SEGMENT_SECTORS  128
+
+// Flags for disk_clone()
+#define CLONE_SPARSE 0x01      // Target is known to be zeroed: skip zero segments
+
+/**
+ * Copies every sector of `src` to the start of `dst`.
+ *
+ * Two 1 MiB buffers alternate so the read of the next chunk is in flight
+ * while the current one is written. All-zero 64 KiB segments are skipped
+ * with CLONE_SPARSE, or discarded when `dst` guarantees that discarded
+ * sectors read back as zeros; otherwise they are written like any data.
+ */
+int disk_clone(BlockDevice *src, BlockDevice *dst, int flags);
+
+#endif // DISK_CLONE_H
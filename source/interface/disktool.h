@@ -2,19 +2,21 @@
 #define DISKTOOL_H
 
 #include <stdint.h>
+#include "blockdev.h"
 
 // Constants
 #define SECTOR_SIZE            512
-#define MBR_SIZE              SECTOR_SIZE
+#define MBR_SIZE              512
 #define PARTITION_TABLE_OFFSET 0x1BE
 #define FAT32_PARTITION_TYPE  0x0C    // FAT32 LBA type
 
 // Type definitions
 typedef struct {
-    int controller;           // 0 = primary, 1 = secondary
+    int controller;           // 0 = primary, 1 = secondary, -1 = RAM disk
     int drive;               // 0 = master, 1 = slave
     uint64_t size_mb;        // Size in megabytes
     char model[41];          // Model name
+    BlockDevice *device;     // Block layer handle; stays valid across rescans
 } DiskInfo;
 
 typedef enum {
@@ -28,6 +30,18 @@ void list_disks(void);
 int select_disk(int disk_index);
 int create_partition_mb(uint32_t size_mb, FileSystemType fs_type);
 void display_partition_info(void);
+int format_disk(FileSystemType fs_type, int discard);
+int format_partition(int partition_index, FileSystemType fs_type, int discard);
 int delete_partition(int partition_index);
+int journal_partition(int partition_index);
+BlockDevice *disktool_get_device(int disk_index);
+struct PartitionMap *disktool_get_partition_map(int disk_index);
+int disktool_partition_range(int disk_index, int partition_index, uint64_t *start_lba, uint64_t *sector_count);
+int init_gpt(void);
+int benchmark_journal(int partition_index, uint32_t ops, uint32_t batch);
+int benchmark_disk(char *args);
+int clone_disks(int src_index, int dst_index, int sparse);
+int create_ramdisk(uint32_t size_mb);
+int snapshot_ramdisk(int disk_index);
 
 #endif // DISKTOOL_H
\ No newline at end of file
@@ -0,0 +1,34 @@
+// fbcon.h
+#ifndef FBCON_H
+#define FBCON_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Text cells are 8x16 pixels: the 8x8 font drawn with doubled rows
+#define FBCON_CELL_WIDTH  8
+#define FBCON_CELL_HEIGHT 16
+
+// Largest text grid the console is prepared to drive (2048x2048 pixels)
+#define FBCON_MAX_COLS    256
+#define FBCON_MAX_ROWS    128
+
+// Takes over the linear framebuffer described by the multiboot2 framebuffer
+// tag. 15, 16, 24 and 32-bit direct colour modes are supported (32-bit
+// ones fastest); returns -1 for anything else.
+int fbcon_init(void);
+int fbcon_available(void);
+
+// Text grid and pixel size of the framebuffer
+void fbcon_geometry(size_t *cols, size_t *rows);
+void fbcon_resolution(uint32_t *width, uint32_t *height);
+
+// Draws `count` cells of one text row; cells are VGA style
+// character/attribute byte pairs
+void fbcon_draw_row(size_t row, const uint8_t *cells, size_t count);
+
+// Moves the whole text area up by `rows` text rows; the rows uncovered at
+// the bottom keep stale pixels until they are drawn
+void fbcon_scroll(size_t rows);
+
+#endif // FBCON_H
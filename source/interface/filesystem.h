@@ -9,8 +9,46 @@
 #define ATA_CMD_READ_SECTORS   0x20
 #define SECTOR_SIZE            512
 
+// Status register bits
+#define ATA_STATUS_ERR         0x01
+#define ATA_STATUS_DRQ         0x08
+#define ATA_STATUS_DF          0x20
+#define ATA_STATUS_BSY         0x80
+
+// Positions probed: controller * 2 + drive
+#define ATA_MAX_DEVICES        4
+
+// Longest a single device may take to answer IDENTIFY during probing
+#define ATA_PROBE_TIMEOUT_MS   1000
+
+typedef enum {
+    ATA_DEVICE_NONE,
+    ATA_DEVICE_ATA,              // Disk usable through the PIO commands
+    ATA_DEVICE_ATAPI,            // Packet device (CD/DVD)
+    ATA_DEVICE_UNKNOWN           // Answered, but with an unexpected signature or error
+} AtaDeviceType;
+
+typedef struct {
+    int controller;              // 0 = primary, 1 = secondary
+    int drive;                   // 0 = master, 1 = slave
+    AtaDeviceType type;
+    int lba48;
+    int timed_out;               // BSY/DRQ never settled within the probe timeout
+    uint64_t sector_count;
+    uint32_t probe_us;           // From drive select to IDENTIFY data (or giving up)
+    char model[41];
+    uint16_t identify[256];      // Raw IDENTIFY (PACKET) DEVICE data
+} AtaDevice;
+
 // Function declarations
 void init_filesystem();
+void display_available_disks();
+void read_string_from_identify(uint16_t *identify_buffer, int start, int end, char *output);
+
+// Probe engine: both channels at once, every wait bounded by a TSC deadline
+int ata_probe_devices(void);
+const AtaDevice *ata_get_device(int index);
+uint32_t ata_probe_time_us(void);
 void check_filesystem();
 int ata_read_sector(uint32_t lba, uint8_t* buffer);
 int ata_write_sector(uint32_t lba, const uint8_t *buffer);
@@ -18,4 +56,25 @@ int ata_write_sector(uint32_t lba, const uint8_t *buffer);
 int ata_read_sector_disk(int controller, int drive, uint32_t lba, uint8_t *buffer) ;
 int ata_write_sector_disk(int controller, int drive, uint32_t lba, const uint8_t *buffer);
 
+// Multi-sector transfers and cache flush
+int ata_read_sectors_disk(int controller, int drive, uint32_t lba, uint32_t count, uint8_t *buffer);
+int ata_write_sectors_disk(int controller, int drive, uint32_t lba, uint32_t count, const uint8_t *buffer);
+int ata_flush_disk(int controller, int drive);
+
+// Bus master DMA through the PCI IDE function, and TRIM via DATA SET MANAGEMENT
+int ata_dma_available(int controller);
+// DMA completion raises IRQ 14/15 (legacy-mode controller), so waiters may sleep
+int ata_dma_irq_available(int controller);
+
+// Asynchronous READ/WRITE DMA EXT, one command in flight per channel
+#define ATA_DMA_MAX_SECTORS    2048
+int ata_dma_rw_supported(int controller, int drive);
+int ata_dma_start_rw(int controller, int drive, uint64_t lba, uint32_t count, uint8_t *buffer, int write);
+int ata_dma_poll(int controller);   // 1 = running, 0 = done, -1 = error
+int ata_dma_wait(int controller);
+
+int ata_trim_supported(int controller, int drive);
+int ata_trim_disk(int controller, int drive, uint64_t lba, uint64_t count);
+int ata_trim_zeroes(int controller, int drive);
+
 #endif // FILESYSTEM_H
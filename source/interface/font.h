@@ -0,0 +1,14 @@
+// font.h
+#ifndef FONT_H
+#define FONT_H
+
+#include <stdint.h>
+
+#define FONT_WIDTH  8
+#define FONT_HEIGHT 8
+
+// One byte per pixel row; bit 0 is the leftmost pixel. Control characters
+// are blank.
+extern const uint8_t font8x8[128][8];
+
+#endif // FONT_H
@@ -0,0 +1,27 @@
+// histogram.h
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+// Log-linear buckets: 16 linear steps per power of two (error under 6.25%)
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct {
+    uint32_t buckets[HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+} Histogram;
+
+void histogram_reset(Histogram *hist);
+void histogram_record(Histogram *hist, uint64_t value);
+
+// Value at or below which `permille`/1000 of the samples fall
+uint64_t histogram_percentile(const Histogram *hist, uint32_t permille);
+uint64_t histogram_mean(const Histogram *hist);
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,27 @@
+// host.h - Hosted build of the freestanding modules (make build-host)
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdint.h>
+
+// Disk images stand in for the ATA drives; controller and drive select
+// one of four slots just like on the IDE bus
+#define HOST_ATA_SLOTS 4
+
+/**
+ * ata_image_attach - Backs an ATA drive with an image file.
+ *
+ * The file is created if missing and resized to `sectors` 512-byte
+ * sectors when that is nonzero; otherwise its current size is used.
+ * Returns the sector count, or 0 if the file cannot be opened.
+ */
+uint64_t ata_image_attach(int controller, int drive, const char *path, uint64_t sectors);
+void ata_image_detach(int controller, int drive);
+
+// Console output from print_*() and klogf() is dropped unless this is set
+extern int host_verbose;
+
+// Nanoseconds from a monotonic clock
+uint64_t host_time_ns(void);
+
+#endif // HOST_H
@@ -0,0 +1,31 @@
+// idle.h
+#ifndef IDLE_H
+#define IDLE_H
+
+#include <stdint.h>
+
+typedef struct {
+    uint64_t sleeps;         // Times the CPU was put to sleep
+    uint64_t deadline_sleeps;  // Sleeps that armed a timer deadline
+    uint64_t idle_tsc;       // TSC ticks spent asleep
+    uint64_t total_tsc;      // TSC ticks since idle_init()
+    int mwait;               // MONITOR/MWAIT is used instead of HLT
+} IdleStats;
+
+// Picks MONITOR/MWAIT when the CPU offers it, HLT otherwise
+void idle_init(void);
+
+/**
+ * Sleeps until the next interrupt or until `deadline_tsc` (0 = no deadline).
+ *
+ * Call with interrupts disabled right after finding nothing to do, passing
+ * the flags returned by irq_save(); an interrupt that arrives in between
+ * still ends the sleep. Returns with the interrupt state in `flags`. If
+ * interrupts were off to begin with nothing could wake the CPU, so this
+ * only pauses briefly.
+ */
+void idle_wait(uint64_t flags, uint64_t deadline_tsc);
+
+void idle_get_stats(IdleStats *stats);
+
+#endif // IDLE_H
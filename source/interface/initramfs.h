@@ -0,0 +1,9 @@
+// initramfs.h
+#ifndef INITRAMFS_H
+#define INITRAMFS_H
+
+// Turns every multiboot2 module into a RAM disk and mounts the first
+// cpio (newc) or tar archive among them at "/"
+void initramfs_init(void);
+
+#endif // INITRAMFS_H
@@ -0,0 +1,74 @@
+// interrupts.h
+#ifndef INTERRUPTS_H
+#define INTERRUPTS_H
+
+#include <stdint.h>
+
+// Legacy PIC interrupts are remapped above the CPU exceptions
+#define IRQ_BASE_VECTOR 32
+#define IRQ_COUNT       16
+
+#define IRQ_TIMER       0
+#define IRQ_KEYBOARD    1
+#define IRQ_COM1        4
+#define IRQ_ATA_PRIMARY 14
+#define IRQ_ATA_SECONDARY 15
+
+#define EXCEPTION_PAGE_FAULT 14
+
+// Register state saved by the entry stubs in isr.asm
+typedef struct {
+    uint64_t r15, r14, r13, r12, r11, r10, r9, r8;
+    uint64_t rbp, rdi, rsi, rdx, rcx, rbx, rax;
+    uint64_t vector;
+    uint64_t error_code;
+    uint64_t rip, cs, rflags, rsp, ss;
+} InterruptFrame;
+
+#define RFLAGS_IF (1 << 9)
+
+typedef void (*IrqHandler)(InterruptFrame *frame);
+
+// Returns 0 when the exception was dealt with and the instruction can rerun
+typedef int (*ExceptionHandler)(InterruptFrame *frame);
+
+// Loads the IDT and remaps the PICs with every IRQ masked; interrupts
+// stay disabled until interrupts_enable()
+void interrupts_init(void);
+
+// Installs a handler and unmasks the line at the PIC
+void irq_register(uint8_t irq, IrqHandler handler);
+
+// Unhandled exceptions, or ones the handler declines, halt the machine
+void exception_register(uint8_t vector, ExceptionHandler handler);
+
+static inline void interrupts_enable(void) {
+    asm volatile("sti" ::: "memory");
+}
+
+// Enables interrupts and sleeps until the next one arrives. An interrupt
+// that became pending while they were off is taken right after the hlt
+// starts, so checking for work under irq_save() and then calling this
+// cannot miss a wakeup.
+static inline void interrupts_enable_and_halt(void) {
+    asm volatile("sti; hlt" ::: "memory");
+}
+
+static inline void interrupts_disable(void) {
+    asm volatile("cli" ::: "memory");
+}
+
+// Disables interrupts and returns the previous RFLAGS for irq_restore()
+static inline uint64_t irq_save(void) {
+    uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint64_t flags) {
+    if (flags & RFLAGS_IF) {
+        asm volatile("sti" ::: "memory");
+    }
+}
+
+#endif // INTERRUPTS_H
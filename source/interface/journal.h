@@ -0,0 +1,159 @@
+// journal.h
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include "blockdev.h"
+
+// jbd2 on-disk constants (all journal fields are stored big-endian)
+#define JBD2_MAGIC_NUMBER          0xC03B3998
+#define JBD2_DESCRIPTOR_BLOCK      1
+#define JBD2_COMMIT_BLOCK          2
+#define JBD2_SUPERBLOCK_V1         3
+#define JBD2_SUPERBLOCK_V2         4
+#define JBD2_REVOKE_BLOCK          5
+
+#define JBD2_FLAG_ESCAPE           1
+#define JBD2_FLAG_SAME_UUID        2
+#define JBD2_FLAG_DELETED          4
+#define JBD2_FLAG_LAST_TAG         8
+
+#define JBD2_FEATURE_COMPAT_CHECKSUM       0x00000001
+#define JBD2_FEATURE_INCOMPAT_REVOKE       0x00000001
+#define JBD2_FEATURE_INCOMPAT_64BIT        0x00000002
+#define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT 0x00000004
+#define JBD2_FEATURE_INCOMPAT_CSUM_V2      0x00000008
+#define JBD2_FEATURE_INCOMPAT_CSUM_V3      0x00000010
+
+#define JBD2_CRC32_CHKSUM          1
+#define JBD2_CRC32_CHKSUM_SIZE     4
+#define JBD2_MIN_JOURNAL_BLOCKS    1024
+
+// ext4 superblock fields describing the journal
+#define EXT4_FEATURE_COMPAT_HAS_JOURNAL 0x0004
+#define EXT4_JOURNAL_INO           8
+#define EXT3_JNL_BACKUP_BLOCKS     1
+
+// Limits of the in-memory transaction and checkpoint lists
+#define JOURNAL_MAX_TX_BLOCKS      64
+#define JOURNAL_MAX_CHECKPOINT     256
+
+// Extents held inline in the journal inode (depth-0 extent tree)
+#define JOURNAL_MAX_EXTENTS        4
+
+typedef struct {
+    uint32_t h_magic;
+    uint32_t h_blocktype;
+    uint32_t h_sequence;
+} __attribute__((packed)) JournalHeader;
+
+typedef struct {
+    JournalHeader s_header;
+    uint32_t s_blocksize;
+    uint32_t s_maxlen;
+    uint32_t s_first;
+    uint32_t s_sequence;
+    uint32_t s_start;
+    int32_t  s_errno;
+    uint32_t s_feature_compat;
+    uint32_t s_feature_incompat;
+    uint32_t s_feature_ro_compat;
+    uint8_t  s_uuid[16];
+    uint32_t s_nr_users;
+    uint32_t s_dynsuper;
+    uint32_t s_max_transaction;
+    uint32_t s_max_trans_data;
+    uint8_t  s_checksum_type;
+    uint8_t  s_padding2[3];
+    uint32_t s_padding[42];
+    uint32_t s_checksum;
+    uint8_t  s_users[16 * 48];
+} __attribute__((packed)) JournalSuperblock;
+
+typedef struct {
+    JournalHeader h;
+    uint8_t  h_chksum_type;
+    uint8_t  h_chksum_size;
+    uint8_t  h_padding[2];
+    uint32_t h_chksum[8];
+    uint64_t h_commit_sec;
+    uint32_t h_commit_nsec;
+} __attribute__((packed)) JournalCommitBlock;
+
+typedef struct {
+    JournalHeader h;
+    uint32_t r_count;    // Bytes used in this block, header included
+} __attribute__((packed)) JournalRevokeHeader;
+
+typedef struct {
+    uint32_t transactions;   // Transactions committed
+    uint32_t updates;        // journal_dirty_block() calls
+    uint32_t blocks_logged;  // Metadata blocks written to the log
+    uint32_t flushes;        // Cache flushes issued
+    uint32_t checkpoints;    // Checkpoint passes
+    uint32_t replayed;       // Blocks replayed at load
+} JournalStats;
+
+typedef struct {
+    uint32_t logical;            // First journal block covered
+    uint32_t length;
+    uint32_t start;              // Filesystem block of `logical`
+} JournalExtent;
+
+typedef struct {
+    BlockDevice *dev;
+    uint64_t part_lba;           // Partition start sector
+    uint32_t block_size;         // Filesystem / journal block size
+    uint32_t sectors_per_block;
+    uint32_t journal_block;      // Filesystem block holding journal block 0
+    uint32_t extent_count;
+    JournalExtent extents[JOURNAL_MAX_EXTENTS];
+    uint32_t first;              // First log block (journal-relative)
+    uint32_t maxlen;             // Total journal length in blocks
+    uint32_t sequence;           // ID of the next transaction
+    uint32_t head;               // Next free log block
+    uint32_t tail;               // Oldest live log block, 0 when the log is empty
+    uint32_t feature_compat;
+    uint8_t  uuid[16];
+
+    // Running transaction
+    uint32_t tx_count;
+    uint32_t tx_blocknr[JOURNAL_MAX_TX_BLOCKS];
+    uint8_t *tx_data;            // JOURNAL_MAX_TX_BLOCKS * block_size
+    uint8_t *io_buffer;          // Scratch for descriptor/commit/checkpoint I/O
+
+    // Committed blocks not yet written to their home location
+    uint32_t cp_count;
+    uint32_t cp_blocknr[JOURNAL_MAX_CHECKPOINT];
+    uint32_t cp_logblock[JOURNAL_MAX_CHECKPOINT];
+    uint8_t  cp_escaped[JOURNAL_MAX_CHECKPOINT];
+
+    JournalStats stats;
+} Journal;
+
+// Lays out an empty jbd2 journal of `length` blocks at filesystem block `journal_block`
+int journal_format(BlockDevice *dev, uint64_t part_lba, uint32_t journal_block,
+                   uint32_t length, uint32_t block_size);
+
+// Fills the ext4 superblock fields that locate a contiguous journal (s_jnl_blocks backup)
+void journal_describe_in_superblock(void *ext4_sb, uint32_t journal_block, uint32_t length,
+                                    uint32_t block_size);
+
+// Finds the journal of the ext4 filesystem at part_lba and replays any committed transactions
+int journal_load(Journal *j, BlockDevice *dev, uint64_t part_lba);
+
+// Adds a metadata block to the running transaction (last write of a block wins)
+int journal_dirty_block(Journal *j, uint32_t blocknr, const uint8_t *data);
+
+// Writes the running transaction to the log as one sequential write followed by one flush
+int journal_commit(Journal *j);
+
+// Copies committed blocks to their home locations and empties the log
+int journal_checkpoint(Journal *j);
+
+// Commits, checkpoints and releases the journal
+void journal_close(Journal *j);
+
+void journal_print_stats(const Journal *j);
+
+#endif // JOURNAL_H
@@ -0,0 +1,18 @@
+// keyboard.h
+#ifndef KEYBOARD_H
+#define KEYBOARD_H
+
+#include <stdint.h>
+
+// Hands the PS/2 keyboard to IRQ 1; scancodes are queued by the interrupt
+// handler and decoded by keyboard_read_char()
+void keyboard_init(void);
+
+// Next typed character, or -1 if no complete keystroke is waiting.
+// Polls the controller directly until keyboard_init().
+int keyboard_read_char(void);
+
+// Scancodes lost because the ring was full
+uint64_t keyboard_dropped(void);
+
+#endif // KEYBOARD_H
@@ -0,0 +1,55 @@
+// klog.h
+#ifndef KLOG_H
+#define KLOG_H
+
+#include <stdint.h>
+
+// Severity, most severe first
+enum {
+    KLOG_ERROR = 0,
+    KLOG_WARNING = 1,
+    KLOG_INFO = 2,
+    KLOG_DEBUG = 3,
+};
+
+#define KLOG_RECORDS  512 // Power of two; the oldest records are overwritten
+#define KLOG_TEXT_MAX 108 // Keeps a record at 128 bytes
+
+typedef struct {
+    uint64_t sequence; // Record number + 1 once committed, 0 while being written
+    uint64_t tsc;
+    uint8_t cpu;
+    uint8_t level;
+    uint16_t length;
+    char text[KLOG_TEXT_MAX];
+} KlogRecord;
+
+// Records the boot timestamp that log times are relative to
+void klog_init(void);
+
+// Appends a record without touching the console; safe from interrupt
+// handlers. Text beyond KLOG_TEXT_MAX - 1 characters is cut off.
+void klog(int level, const char *message);
+
+// Same, with " <value>" appended in decimal
+void klog_value(int level, const char *message, uint64_t value);
+
+// Formats with kprintf conversions straight into the record
+void klogf(int level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+// Copies the record at *cursor and advances it. Cursors that fell behind
+// the ring skip to the oldest surviving record. Returns 0 when caught up.
+int klog_read(uint64_t *cursor, KlogRecord *record);
+
+// Sequence number of the oldest record still in the ring
+uint64_t klog_oldest(void);
+
+// Prints records at or above the console level that the console has not
+// shown yet; called from the shell loop, never by producers
+void klog_drain_console(void);
+void klog_set_console_level(int level);
+
+const char *klog_level_name(int level);
+uint64_t klog_tsc_to_us(uint64_t tsc);
+
+#endif // KLOG_H
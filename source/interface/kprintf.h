@@ -0,0 +1,21 @@
+// kprintf.h
+#ifndef KPRINTF_H
+#define KPRINTF_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+
+// printf-style formatting; see kvsnprintf() in kprintf.c for the
+// supported conversions
+int kvsnprintf(char *buffer, size_t size, const char *format, va_list args);
+int ksnprintf(char *buffer, size_t size, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+// Formats into a stack buffer and hands it to the console in one write
+int kprintf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+// Writes the decimal digits of `value` ending just before `end`; returns
+// how many were written (at most 20)
+int format_decimal(char *end, uint64_t value);
+
+#endif // KPRINTF_H
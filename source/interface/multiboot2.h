@@ -0,0 +1,103 @@
+// multiboot2.h
+#ifndef MULTIBOOT2_H
+#define MULTIBOOT2_H
+
+#include <stdint.h>
+
+#define MULTIBOOT2_BOOTLOADER_MAGIC 0x36d76289
+
+// Boot information tag types
+#define MULTIBOOT2_TAG_END          0
+#define MULTIBOOT2_TAG_CMDLINE      1
+#define MULTIBOOT2_TAG_MODULE       3
+#define MULTIBOOT2_TAG_MMAP         6
+#define MULTIBOOT2_TAG_FRAMEBUFFER  8
+
+#define MULTIBOOT2_MAX_MODULES      8
+
+// Memory map entry types
+#define MULTIBOOT2_MEMORY_AVAILABLE        1
+#define MULTIBOOT2_MEMORY_ACPI_RECLAIMABLE 3
+#define MULTIBOOT2_MEMORY_NVS              4
+
+#define MULTIBOOT2_FRAMEBUFFER_RGB      1
+#define MULTIBOOT2_FRAMEBUFFER_EGA_TEXT 2
+
+typedef struct {
+    uint32_t type;
+    uint32_t size;
+} __attribute__((packed)) Multiboot2Tag;
+
+typedef struct {
+    uint32_t type;
+    uint32_t size;
+    uint32_t mod_start;
+    uint32_t mod_end;
+    char cmdline[];
+} __attribute__((packed)) Multiboot2ModuleTag;
+
+typedef struct {
+    uint32_t type;
+    uint32_t size;
+    uint32_t entry_size;
+    uint32_t entry_version;
+} __attribute__((packed)) Multiboot2MmapTag;
+
+typedef struct {
+    uint64_t base_addr;
+    uint64_t length;
+    uint32_t type;
+    uint32_t reserved;
+} __attribute__((packed)) Multiboot2MmapEntry;
+
+typedef struct {
+    uint32_t type;
+    uint32_t size;
+    uint64_t framebuffer_addr;
+    uint32_t framebuffer_pitch;
+    uint32_t framebuffer_width;
+    uint32_t framebuffer_height;
+    uint8_t framebuffer_bpp;
+    uint8_t framebuffer_type;
+    uint16_t reserved;
+    // Direct RGB colour layout, valid when framebuffer_type is RGB
+    uint8_t red_field_position;
+    uint8_t red_mask_size;
+    uint8_t green_field_position;
+    uint8_t green_mask_size;
+    uint8_t blue_field_position;
+    uint8_t blue_mask_size;
+} __attribute__((packed)) Multiboot2FramebufferTag;
+
+// A module as loaded by GRUB's module2; the bytes stay where GRUB put them
+typedef struct {
+    uint8_t *start;
+    uint64_t size;
+    const char *cmdline;
+} BootModule;
+
+// Parses the boot information structure handed over in EBX
+void multiboot2_init(uint64_t info_addr);
+
+const char *multiboot2_cmdline(void);
+
+// Copies the value of "key=value" from the kernel command line; a bare
+// "key" yields "". Returns -1 if the option is absent.
+int multiboot2_cmdline_option(const char *key, char *value, int size);
+
+// Physical extent of the boot information, which stays in use after boot
+void multiboot2_info_range(uint64_t *start, uint64_t *size);
+
+// First module whose command line equals `name`, or NULL
+const BootModule *multiboot2_find_module(const char *name);
+int multiboot2_module_count(void);
+const BootModule *multiboot2_module(int index);
+
+// Physical memory map as reported by the firmware; entry NULL past the end
+int multiboot2_mmap_count(void);
+const Multiboot2MmapEntry *multiboot2_mmap_entry(int index);
+
+// First tag of the given type, or NULL
+const Multiboot2Tag *multiboot2_find_tag(uint32_t type);
+
+#endif // MULTIBOOT2_H
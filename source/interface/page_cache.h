@@ -0,0 +1,63 @@
+// page_cache.h
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PAGE_SIZE  4096
+#define PAGE_SHIFT 12
+
+// Upper bound on cached pages before the least recently used are recycled
+#define PAGE_CACHE_MAX_PAGES 4096
+
+typedef struct PageTree PageTree;
+
+typedef struct CachePage {
+    uint8_t *data;               // PAGE_SIZE bytes of file contents
+    int mapped;                  // data points into memory the cache does not own
+    uint64_t index;              // Page offset within the file
+    PageTree *tree;              // Owning per-inode tree
+    uint32_t refcount;           // Users holding the page; pinned while > 0
+    struct CachePage *lru_prev;
+    struct CachePage *lru_next;
+} CachePage;
+
+// Per-inode page index: a radix tree with 64-way nodes
+struct PageTree {
+    void *root;
+    uint32_t height;             // 0 = empty, each level resolves 6 bits of the index
+    uint32_t nr_pages;
+};
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t fill_bytes;         // Bytes read from devices to fill pages
+    uint32_t pages;
+    uint32_t max_pages;
+    uint32_t nodes;              // Radix tree nodes in use
+} PageCacheStats;
+
+// Reads page `index` of the object behind `context` into `data` (PAGE_SIZE bytes)
+typedef int (*PageFiller)(void *context, uint64_t index, uint8_t *data);
+
+// Returns page `index` of a memory-resident object in place, or NULL
+typedef uint8_t *(*PageMapper)(void *context, uint64_t index);
+
+// Returns a referenced page, filling it through `fill` on a miss; NULL on error
+CachePage *page_cache_get(PageTree *tree, uint64_t index, PageFiller fill, void *context);
+
+// Same, but the page borrows the bytes returned by `map` instead of copying them
+CachePage *page_cache_get_mapped(PageTree *tree, uint64_t index, PageMapper map, void *context);
+
+// Drops a reference obtained from page_cache_get()
+void page_cache_put(CachePage *page);
+
+// Removes every page of a tree; pages must not be referenced
+void page_cache_drop_tree(PageTree *tree);
+
+void page_cache_get_stats(PageCacheStats *stats);
+
+#endif // PAGE_CACHE_H
@@ -0,0 +1,66 @@
+// paging.h
+#ifndef PAGING_H
+#define PAGING_H
+
+#include <stdint.h>
+
+// Virtual layout: the low 4 GiB stay identity mapped for boot-time
+// physical pointers; everything else lives in the top half
+#define DIRECT_MAP_BASE 0xFFFF800000000000ULL // RAM ranges only, physical address N at +N
+#define MMIO_BASE       0xFFFFC00000000000ULL // mmio_map() allocations
+#define KERNEL_VMA      0xFFFFFFFF80000000ULL // Kernel image (physical 0-2 GiB)
+
+// Page table entry bits
+#define PTE_PRESENT   0x001
+#define PTE_WRITABLE  0x002
+#define PTE_PWT       0x008
+#define PTE_PCD       0x010
+#define PTE_HUGE      0x080
+#define PTE_GLOBAL    0x100
+#define PTE_ADDRESS   0x000FFFFFFFFFF000ULL
+
+// Cache types for mmio_map()
+enum {
+    MMIO_UNCACHED = 0,        // Device registers
+    MMIO_WRITE_COMBINING = 1, // Framebuffers; falls back to UC without PAT
+};
+
+typedef struct {
+    uint64_t direct_map_bytes;
+    uint64_t direct_map_page_size;
+    uint64_t mmio_bytes;
+    uint32_t tables_used;
+    uint32_t tables_total;
+    int has_1g_pages;
+    int has_pat;
+    int has_global_pages;
+} PagingStats;
+
+/**
+ * paging_init - Builds the direct map and programs the PAT.
+ *
+ * Call after multiboot2_init(): the direct map covers the RAM ranges of the
+ * firmware memory map, write-back, with the largest pages each range's
+ * alignment allows. Holes such as the PCI window stay unmapped there.
+ */
+void paging_init(void);
+
+static inline void *phys_to_virt(uint64_t phys) {
+    return (void *)(DIRECT_MAP_BASE + phys);
+}
+
+// Works for the kernel image, the direct map, identity addresses and
+// anything mapped in the loaded address space (MMIO, VMM memory); 0 if unmapped
+uint64_t virt_to_phys(const void *virt);
+
+// 1 if the range is linearly mapped (kernel image, direct map or identity
+// range) and so is physically contiguous and always present; VMM memory
+// is neither and must not be handed to a DMA engine
+int paging_phys_contiguous(const void *virt, uint64_t size);
+
+// Maps device memory with the given cache type; NULL if out of space
+void *mmio_map(uint64_t phys, uint64_t size, int cache);
+
+void paging_get_stats(PagingStats *stats);
+
+#endif // PAGING_H
@@ -2,6 +2,7 @@
 #define PARTITION_H
 
 #include <stdint.h>
+#include "blockdev.h"
 
 #define MBR_SIZE 512
 #define PARTITION_TABLE_OFFSET 0x1BE
@@ -145,12 +146,103 @@ typedef struct
 } __attribute__((packed)) Ext4GroupDesc;
 
 
+#define MBR_TYPE_GPT_PROTECTIVE 0xEE
+#define MBR_TYPE_EFI_SYSTEM     0xEF
+
+// GPT constants
+#define GPT_SIGNATURE          0x5452415020494645ULL // "EFI PART"
+#define GPT_REVISION           0x00010000
+#define GPT_HEADER_SIZE        92
+#define GPT_ENTRY_SIZE         128
+#define GPT_MAX_ENTRIES        128
+#define GPT_ENTRY_SECTORS      (GPT_MAX_ENTRIES * GPT_ENTRY_SIZE / 512)
+#define GPT_NAME_CHARS         36
+
+// GPT header, found at LBA 1 and (as a backup) on the last sector
+typedef struct __attribute__((packed)) {
+    uint64_t signature;
+    uint32_t revision;
+    uint32_t header_size;
+    uint32_t header_crc32;     // CRC32 of header_size bytes with this field zeroed
+    uint32_t reserved;
+    uint64_t my_lba;
+    uint64_t alternate_lba;
+    uint64_t first_usable_lba;
+    uint64_t last_usable_lba;
+    uint8_t  disk_guid[16];
+    uint64_t entries_lba;
+    uint32_t num_entries;
+    uint32_t entry_size;
+    uint32_t entries_crc32;    // CRC32 of num_entries * entry_size bytes
+} GptHeader;
+
+typedef struct __attribute__((packed)) {
+    uint8_t  type_guid[16];    // All zero for an unused entry
+    uint8_t  unique_guid[16];
+    uint64_t first_lba;
+    uint64_t last_lba;         // Inclusive
+    uint64_t attributes;
+    uint16_t name[GPT_NAME_CHARS]; // UTF-16LE
+} GptEntry;
+
+typedef enum {
+    PARTITION_SCHEME_NONE,
+    PARTITION_SCHEME_MBR,
+    PARTITION_SCHEME_GPT
+} PartitionScheme;
+
+// One partition of a disk, independent of the table it came from
+typedef struct {
+    uint64_t lba_first;
+    uint64_t sector_count;
+    uint32_t slot;             // MBR table slot or GPT entry index
+    uint8_t  type;             // MBR type code; GPT types map to the closest code
+    uint8_t  bootable;
+    uint8_t  type_guid[16];    // GPT only
+    uint8_t  unique_guid[16];  // GPT only
+    uint64_t attributes;       // GPT only
+    uint16_t name[GPT_NAME_CHARS]; // GPT only
+} Partition;
+
+/**
+ * In-memory copy of a disk's partition table. It is built when disks are
+ * scanned and rebuilt only after something writes to the table areas at
+ * either end of the disk (tracked through BlockDevice.label_generation).
+ */
+typedef struct PartitionMap {
+    int valid;
+    uint32_t generation;       // dev->label_generation the map was built from
+    PartitionScheme scheme;
+    int gpt_from_backup;       // Primary GPT was damaged, the backup was used
+    uint64_t first_usable;
+    uint64_t last_usable;
+    uint8_t disk_guid[16];     // GPT only
+    uint32_t count;
+    Partition entries[GPT_MAX_ENTRIES]; // Ordered by slot
+} PartitionMap;
+
 // Function declarations
 
+// The formatters use 32-bit sector numbers; partitions must end at or below this
+#define FORMAT_MAX_SECTOR 0xFFFFFFFFULL
+
 void select_partition(int partition_number);
-int format_fat32(int controller, int drive, uint32_t start_lba, uint32_t total_sectors);
-int format_ext4(int controller, int drive, uint32_t start_lba, uint32_t total_sectors);
-// Function declaration to display partition information
+int partition_check_format_range(uint64_t start_lba, uint64_t sector_count);
+int format_fat32(BlockDevice *dev, uint64_t start_lba, uint64_t total_sectors);
+int format_ext4(BlockDevice *dev, uint64_t start_lba, uint64_t total_sectors);
+int create_fat32_partition(BlockDevice *dev, PartitionMap *map, uint64_t start_lba, uint64_t sector_count);
+int create_ext4_partition(BlockDevice *dev, PartitionMap *map, uint64_t start_lba, uint64_t sector_count);
+
+// Partition map (partition_map.c)
+int partition_map_load(BlockDevice *dev, PartitionMap *map);
+int partition_map_refresh(BlockDevice *dev, PartitionMap *map);
+int partition_map_find_free(const PartitionMap *map, uint64_t sector_count, uint64_t *start_lba);
+int partition_map_add(BlockDevice *dev, PartitionMap *map, uint64_t start_lba, uint64_t sector_count, uint8_t type);
+int partition_map_delete(BlockDevice *dev, PartitionMap *map, uint32_t index);
+int partition_map_init_gpt(BlockDevice *dev, PartitionMap *map);
+void display_partition_map(BlockDevice *dev, const PartitionMap *map);
+
+// Shows the partitions of every detected disk
 void display_partitions();
 
 #endif
@@ -0,0 +1,44 @@
+// pci.h
+#ifndef PCI_H
+#define PCI_H
+
+#include <stdint.h>
+
+// Configuration space offsets
+#define PCI_VENDOR_ID          0x00
+#define PCI_COMMAND            0x04
+#define PCI_CLASS_REVISION     0x08
+#define PCI_HEADER_TYPE        0x0C
+#define PCI_BAR0               0x10
+#define PCI_BAR4               0x20
+
+// Command register bits
+#define PCI_COMMAND_IO         0x0001
+#define PCI_COMMAND_MEMORY     0x0002
+#define PCI_COMMAND_MASTER     0x0004
+
+#define PCI_CLASS_STORAGE      0x01
+#define PCI_SUBCLASS_IDE       0x01
+
+typedef struct {
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t function;
+    uint16_t vendor_id;
+    uint16_t device_id;
+    uint8_t class_code;
+    uint8_t subclass;
+    uint8_t prog_if;
+} PciDevice;
+
+// Configuration mechanism #1 (ports 0xCF8/0xCFC); offset must be dword aligned
+uint32_t pci_config_read32(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset);
+void pci_config_write32(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset, uint32_t value);
+
+// Finds the first function with the given class/subclass; returns 0 on success
+int pci_find_class(uint8_t class_code, uint8_t subclass, PciDevice *out);
+
+// Sets bits in the command register (e.g. PCI_COMMAND_MASTER)
+void pci_enable(const PciDevice *dev, uint16_t command_bits);
+
+#endif // PCI_H
@@ -0,0 +1,50 @@
+// pmm.h
+#ifndef PMM_H
+#define PMM_H
+
+#include <stdint.h>
+
+#define PMM_FRAME_SIZE 4096
+
+// Frames above this are left unused; it bounds the reference count table
+#define PMM_MAX_FRAMES (8ULL * 1024 * 1024 * 1024 / PMM_FRAME_SIZE)
+
+typedef struct {
+    uint64_t total_frames;
+    uint64_t free_frames;
+    uint64_t ignored_frames; // Usable RAM beyond PMM_MAX_FRAMES
+    uint32_t regions;
+} PmmStats;
+
+/**
+ * pmm_init - Hands every free RAM frame to the frame allocator.
+ *
+ * Call after paging_init(): frames come from the firmware memory map minus
+ * low memory, the kernel image and whatever GRUB loaded, and are reached
+ * through the direct map.
+ */
+void pmm_init(void);
+
+// Returns the physical address of a frame with one reference, or 0
+uint64_t pmm_alloc(void);
+uint64_t pmm_alloc_zeroed(void);
+
+// Physically contiguous frames ending at or below `limit`, never freed;
+// 0 if no free range is large enough
+uint64_t pmm_alloc_contiguous(uint64_t frames, uint64_t limit);
+
+// Adds a reference for another mapping of the frame; -1 when the count
+// would overflow and the caller has to copy instead
+int pmm_ref(uint64_t frame);
+
+// Drops a reference and frees the frame with the last one
+void pmm_put(uint64_t frame);
+
+uint32_t pmm_refcount(uint64_t frame);
+
+// Makes a frame permanent, e.g. the shared zero page; puts are ignored
+void pmm_pin(uint64_t frame);
+
+void pmm_get_stats(PmmStats *stats);
+
+#endif // PMM_H
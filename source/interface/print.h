@@ -23,12 +23,33 @@ enum {
     PRINT_COLOR_WHITE = 15,
 };
 
+// Display the console is drawn on
+enum {
+    PRINT_BACKEND_VGA_TEXT = 0,
+    PRINT_BACKEND_FRAMEBUFFER = 1,
+};
+
 // Core printing functions
 void print_clear();
 void print_char(char character);
+void print_newline();
 void print_str(char* string);
 void print_set_color(uint8_t foreground, uint8_t background);
-void print_int(uint32_t num);
+void print_int(uint64_t num);
+void print_dec(uint64_t number); // Same as print_int
+
+// Writes `length` bytes (newlines included) as a single console update
+void print_write(const char* text, size_t length);
+
+// Writes pending console output to the screen; print_str() only does so
+// once per frame interval, leaving the rest to a one-shot timer, and
+// get_char() always does before waiting for a key
+void print_flush();
+
+// Switches display and clears the screen; the framebuffer is only
+// available once fbcon_init() succeeded
+int print_set_backend(int backend);
+int print_get_backend();
 
 // Input functions
 char get_char();
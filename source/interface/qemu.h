@@ -0,0 +1,19 @@
+// qemu.h
+#ifndef QEMU_H
+#define QEMU_H
+
+#include <stdint.h>
+
+// Port of QEMU's isa-debug-exit device (-device isa-debug-exit,iobase=0xf4,iosize=0x04)
+#define QEMU_DEBUG_EXIT_PORT 0xF4
+
+/**
+ * qemu_exit - Ends the virtual machine with a status for the host.
+ *
+ * Pending console and serial output is flushed first. QEMU exits with
+ * (status << 1) | 1, so 0 becomes 1 and 1 becomes 3. Without the device
+ * the write is ignored and the CPU halts instead.
+ */
+void qemu_exit(uint8_t status) __attribute__((noreturn));
+
+#endif // QEMU_H
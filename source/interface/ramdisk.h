@@ -0,0 +1,28 @@
+// ramdisk.h
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+#include <stdint.h>
+#include "blockdev.h"
+
+#define RAMDISK_MAX 4
+
+// Creates a zero-filled disk of `sector_count` 512-byte sectors whose
+// memory is allocated as it is written
+BlockDevice *ramdisk_create(uint64_t sector_count);
+
+// Copy-on-write duplicate of a disk from ramdisk_create(); NULL for others
+BlockDevice *ramdisk_snapshot(BlockDevice *source);
+
+// Wraps existing memory (e.g. a boot module) without copying; a partial last
+// sector is ignored. The disk is read-only, since whoever owns the memory
+// (the initramfs mounts it in place) expects it to stay as it is.
+BlockDevice *ramdisk_create_from(void *data, uint64_t bytes);
+
+// Backing memory of a RAM disk and its exact size in bytes; NULL for other devices
+uint8_t *ramdisk_memory(BlockDevice *dev, uint64_t *bytes);
+
+int ramdisk_count(void);
+BlockDevice *ramdisk_get(int index);
+
+#endif // RAMDISK_H
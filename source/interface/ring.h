@@ -0,0 +1,50 @@
+// ring.h
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+
+/*
+ * Lock-free ring of fixed-size records shared by any number of producers,
+ * interrupt handlers included. Producers claim a record number with one
+ * atomic add and fill the slot it maps to; the oldest records are
+ * overwritten. Each record starts with a uint64_t sequence word that
+ * works like a seqlock: it is cleared before the slot is rewritten and
+ * set to the record number + 1 when the record is complete, so readers
+ * can tell a finished record from one in progress or already overwritten.
+ */
+typedef struct {
+    void *slots;
+    uint32_t slot_size;
+    uint32_t capacity;         // Power of two
+    uint64_t head;             // Next record number to hand out
+} Ring;
+
+#define RING_INIT(array) {(array), sizeof((array)[0]), sizeof(array) / sizeof((array)[0]), 0}
+
+// Single processor for now; records already carry the field for SMP
+static inline uint8_t ring_cpu(void) {
+    return 0;
+}
+
+// Claims the next slot and marks it as being written
+void *ring_claim(Ring *ring, uint64_t *number);
+
+// Makes a claimed slot visible to readers
+void ring_publish(void *slot, uint64_t number);
+
+// Copies the record at *cursor and advances it. Cursors that fell behind
+// the ring skip to the oldest surviving record. Returns 0 when caught up
+// or when the next record is still being written.
+int ring_read(Ring *ring, uint64_t *cursor, void *record);
+
+// Record number of the oldest record still in the ring
+uint64_t ring_oldest(Ring *ring);
+
+// Records written so far, overwritten ones included
+uint64_t ring_count(Ring *ring);
+
+// Drops every record; producers must be stopped
+void ring_reset(Ring *ring);
+
+#endif // RING_H
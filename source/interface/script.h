@@ -0,0 +1,30 @@
+// script.h
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <stdint.h>
+
+#define SCRIPT_LINE_MAX 256
+
+/**
+ * Runs shell commands from `text`, one per line. Blank lines and lines
+ * starting with '#' are skipped. Each command is echoed with its run time
+ * and a summary closes the run; the text itself is not modified.
+ *
+ * @return: number of lines that named no known command.
+ */
+int script_run(const char *text, uint64_t length);
+
+// Reads a script from the VFS and runs it; -1 if it cannot be read
+int script_run_file(const char *path);
+
+/**
+ * Batch mode: runs the boot script, if any, and ends the VM through
+ * isa-debug-exit with status 0 (all commands ran) or 1. The script is a
+ * multiboot2 module named "script", or the file named by "script=<path>"
+ * on the kernel command line. "batch=shell" returns to the interactive
+ * shell afterwards instead of exiting.
+ */
+void script_run_boot(void);
+
+#endif // SCRIPT_H
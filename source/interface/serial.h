@@ -0,0 +1,30 @@
+// serial.h
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <stdint.h>
+
+#define SERIAL_COM1 0x3F8
+
+// Programs COM1 for 115200 8N1; output is dropped if no UART answers
+void serial_init(void);
+int serial_present(void);
+
+// Hands COM1 to IRQ 4: output is queued in a ring and drained by the
+// THRE interrupt, input is buffered by the RX interrupt
+void serial_enable_interrupts(void);
+
+// '\n' is sent as "\r\n". Polled until serial_enable_interrupts(); after
+// that callers only block when the output ring is full.
+void serial_write_char(char c);
+void serial_write_str(const char *str);
+void serial_write(const char *data, uint64_t length);
+void serial_write_dec(uint64_t value);
+
+// Next received byte, or -1 if none is waiting
+int serial_read_char(void);
+
+// Waits until all queued output has left the UART
+void serial_flush(void);
+
+#endif // SERIAL_H
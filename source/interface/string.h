@@ -8,7 +8,6 @@ int strlen(const char* str);
 
 void print_hex_digit(unsigned char digit);
 void print_hex(unsigned int number);
-void print_dec(unsigned int number);
 char *strchr(const char *str, int c);
 uint32_t strtoul(const char *str, char **endptr, int base);
 
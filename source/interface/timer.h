@@ -0,0 +1,44 @@
+// timer.h
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+// Calibrates the TSC against PIT channel 2 and takes over channel 0 for
+// one-shot deadlines; call once before any timing. There is no periodic
+// tick afterwards.
+void timer_init(void);
+
+// Raises IRQ 0 at (or, for far deadlines, before) the given TSC value;
+// 0 cancels. Used to wake an idle CPU.
+void timer_set_deadline(uint64_t deadline_tsc);
+
+// Runs `function` once from IRQ 0 at or after `deadline_tsc`, replacing
+// any callback armed before; a NULL function cancels. Shares channel 0
+// with timer_set_deadline().
+void timer_set_callback(uint64_t deadline_tsc, void (*function)(void));
+
+// Deadline interrupts taken since boot
+uint64_t timer_deadline_irqs(void);
+
+// Reads the CPU time-stamp counter
+static inline uint64_t timer_tsc(void) {
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// TSC frequency in kHz as measured by timer_init()
+uint64_t timer_tsc_khz(void);
+
+// Converts a TSC delta to microseconds / nanoseconds
+uint64_t timer_tsc_to_us(uint64_t ticks);
+uint64_t timer_tsc_to_ns(uint64_t ticks);
+
+// Microseconds elapsed since a timer_tsc() reading
+uint64_t timer_elapsed_us(uint64_t start_tsc);
+
+// Busy-waits for the given number of microseconds
+void timer_delay_us(uint64_t us);
+
+#endif // TIMER_H
@@ -0,0 +1,69 @@
+// tlb.h
+#ifndef TLB_H
+#define TLB_H
+
+#include <stdint.h>
+
+#define TLB_PCID_COUNT   4096
+#define TLB_BATCH_RANGES 8
+
+// Beyond this many pages one full flush is cheaper than a flush per page
+#define TLB_FLUSH_CEILING 33
+
+// Set in a CR3 value to keep the new PCID's cached translations
+#define CR3_NOFLUSH (1ULL << 63)
+
+// Invalidations gathered while page tables are edited, issued in one go;
+// neighbouring pages merge into ranges
+typedef struct {
+    uint64_t start[TLB_BATCH_RANGES];
+    uint64_t end[TLB_BATCH_RANGES];
+    int ranges;
+    int overflow; // Ran out of ranges; everything gets flushed
+} TlbBatch;
+
+typedef struct {
+    uint64_t page_flushes;  // Single pages invalidated
+    uint64_t full_flushes;
+    uint64_t batches;
+    uint64_t deferred;      // Batches for inactive contexts, flushed when next loaded
+    int has_pcid;
+    int has_invpcid;
+    int pcid_enabled;
+} TlbStats;
+
+// Turns on PCIDs when the CPU has them and global pages are in use.
+// Call after paging_init() while CR3 still uses PCID 0.
+void tlb_init(void);
+
+int tlb_pcid_supported(void);
+int tlb_pcid_enabled(void);
+
+// Switches PCIDs on or off; -1 if unsupported or CR3 is not on PCID 0.
+// Every cached translation is dropped either way.
+int tlb_set_pcid(int enabled);
+
+// Current context, plus the global entry for the page
+void tlb_flush_page(uint64_t address);
+
+// Every non-global entry of the current context; `global` also drops
+// global entries and other contexts
+void tlb_flush_all(int global);
+
+static inline void tlb_batch_init(TlbBatch *batch) {
+    batch->ranges = 0;
+    batch->overflow = 0;
+}
+
+void tlb_batch_add(TlbBatch *batch, uint64_t address);
+
+// Issues a batch for the current context (`global` for global pages)
+void tlb_batch_flush(TlbBatch *batch, int global);
+
+// Drops a batch whose context is not loaded; returns 1 if it held
+// anything, so the context must be flushed before its next use
+int tlb_batch_defer(TlbBatch *batch);
+
+void tlb_get_stats(TlbStats *stats);
+
+#endif // TLB_H
@@ -0,0 +1,82 @@
+// trace.h
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_CPUS    1    // One ring per CPU; only the boot CPU runs so far
+#define TRACE_RECORDS 8192 // Per CPU, power of two; the oldest are overwritten
+
+// Chrome trace-event phases
+#define TRACE_PHASE_BEGIN   'B'
+#define TRACE_PHASE_END     'E'
+#define TRACE_PHASE_INSTANT 'i'
+
+typedef struct {
+    uint64_t sequence; // Record number + 1 once committed, 0 while being written
+    uint64_t tsc;
+    const char *name;  // "category:event", a string literal at the tracepoint
+    uint64_t arg;
+    uint8_t phase;
+    uint8_t cpu;
+} TraceRecord;
+
+// Checked inline by every tracepoint; set through trace_set_enabled()
+extern int trace_enabled;
+
+void trace_set_enabled(int enabled);
+
+// Drops every record and makes now the trace's time zero
+void trace_clear(void);
+uint64_t trace_start_tsc(void);
+
+// Appends a record to this CPU's ring; safe from interrupt handlers
+void trace_record(const char *name, uint8_t phase, uint64_t arg);
+
+// Records a begin event and returns `name` for the matching end
+const char *trace_begin(const char *name, uint64_t arg);
+
+// Copies the record at *cursor of a CPU's ring and advances it, oldest
+// surviving record first; returns 0 when caught up
+int trace_read(int cpu, uint64_t *cursor, TraceRecord *record);
+
+// Records written since the last clear, overwritten ones included
+uint64_t trace_count(int cpu);
+
+typedef struct {
+    const char *name;
+} TraceScope;
+
+static inline void trace_scope_end(TraceScope *scope) {
+    if (scope->name != 0) {
+        trace_record(scope->name, TRACE_PHASE_END, 0);
+    }
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+/*
+ * Tracepoints cost one predicted-not-taken branch on a global flag while
+ * tracing is off. Building with -DTRACE_DISABLE removes them entirely.
+ *
+ * TRACE_SCOPE() records a begin event and the matching end event when the
+ * enclosing block is left, on every return path. An end is only recorded
+ * if its begin was, so turning tracing on or off mid-call stays balanced.
+ */
+#ifndef TRACE_DISABLE
+#define TRACE_SCOPE(name, arg)                                                                    \
+    TraceScope TRACE_CONCAT(trace_scope_, __LINE__) __attribute__((cleanup(trace_scope_end))) = { \
+        __builtin_expect(trace_enabled, 0) ? trace_begin(name, arg) : 0}
+#define TRACE_INSTANT(name, arg)                                 \
+    do {                                                         \
+        if (__builtin_expect(trace_enabled, 0)) {                \
+            trace_record(name, TRACE_PHASE_INSTANT, arg);        \
+        }                                                        \
+    } while (0)
+#else
+#define TRACE_SCOPE(name, arg) ((void)0)
+#define TRACE_INSTANT(name, arg) ((void)0)
+#endif
+
+#endif // TRACE_H
@@ -0,0 +1,110 @@
+// vfs.h
+#ifndef VFS_H
+#define VFS_H
+
+#include <stdint.h>
+#include "blockdev.h"
+#include "page_cache.h"
+
+#define VFS_NAME_MAX     255
+#define VFS_PATH_MAX     256
+#define VFS_MAX_MOUNTS   8
+
+// Mode bits (same values as ext4 i_mode)
+#define VFS_S_IFMT       0xF000
+#define VFS_S_IFLNK      0xA000
+#define VFS_S_IFREG      0x8000
+#define VFS_S_IFDIR      0x4000
+
+#define VFS_ISDIR(mode)  (((mode) & VFS_S_IFMT) == VFS_S_IFDIR)
+#define VFS_ISREG(mode)  (((mode) & VFS_S_IFMT) == VFS_S_IFREG)
+
+typedef struct VfsInode VfsInode;
+typedef struct VfsSuperblock VfsSuperblock;
+
+typedef struct {
+    uint64_t ino;
+    uint32_t mode;               // File type bits only, 0 if unknown
+    char name[VFS_NAME_MAX + 1];
+} VfsDirEntry;
+
+typedef struct {
+    // Next entry at *cookie; returns 1 with an entry, 0 at the end, -1 on error
+    int (*readdir)(VfsInode *dir, uint64_t *cookie, VfsDirEntry *entry);
+    // Reads page `index` of the file straight into the page cache page
+    int (*readpage)(VfsInode *inode, uint64_t index, uint8_t *data);
+    // Optional, for memory-resident files: page `index` in place, used instead of readpage
+    uint8_t *(*mappage)(VfsInode *inode, uint64_t index);
+} VfsInodeOps;
+
+typedef struct {
+    int (*read_inode)(VfsSuperblock *sb, uint64_t ino, VfsInode *inode);
+    void (*release_inode)(VfsInode *inode);
+    void (*put_super)(VfsSuperblock *sb);
+} VfsSuperOps;
+
+struct VfsInode {
+    uint64_t ino;
+    uint32_t mode;
+    uint32_t links;
+    uint64_t size;
+    uint64_t blocks;             // 512-byte sectors allocated
+    uint32_t mtime;              // Seconds since the epoch
+    uint32_t refcount;
+    VfsSuperblock *sb;
+    const VfsInodeOps *ops;
+    PageTree pages;              // Cached file contents
+    void *fs_private;
+    VfsInode *next;              // Superblock inode cache chain
+};
+
+struct VfsSuperblock {
+    const char *fs_name;
+    BlockDevice *dev;
+    uint64_t start_lba;          // First sector of the volume
+    uint64_t sector_count;
+    uint32_t block_size;
+    uint64_t root_ino;
+    const VfsSuperOps *ops;
+    void *fs_private;
+    VfsInode *inodes;            // Inode cache
+};
+
+// A filesystem driver: mount fills sb (ops, root_ino, block_size, fs_private)
+typedef struct {
+    const char *name;
+    int (*mount)(VfsSuperblock *sb);
+} VfsFilesystemType;
+
+typedef struct {
+    VfsInode *inode;
+    uint64_t position;
+} VfsFile;
+
+// Mounts the first filesystem that recognises the sector range at `path`
+int vfs_mount(BlockDevice *dev, uint64_t start_lba, uint64_t sector_count, const char *path);
+int vfs_umount(const char *path);
+void vfs_list_mounts(void);
+
+int vfs_open(const char *path, VfsFile *file);
+void vfs_close(VfsFile *file);
+
+// Returns a pinned page of the file (release with page_cache_put), NULL past EOF or on error
+CachePage *vfs_get_page(VfsInode *inode, uint64_t index);
+
+// Copies up to `length` bytes from the current position; returns bytes read or -1
+int64_t vfs_read(VfsFile *file, void *buffer, uint64_t length);
+
+// Directory iteration; same return convention as VfsInodeOps.readdir
+int vfs_readdir(VfsFile *dir, VfsDirEntry *entry);
+
+// Helpers for drivers
+VfsInode *vfs_iget(VfsSuperblock *sb, uint64_t ino);
+void vfs_iput(VfsInode *inode);
+
+// Filesystem drivers
+int ext4_mount(VfsSuperblock *sb);
+int fat32_mount(VfsSuperblock *sb);
+int initramfs_mount(VfsSuperblock *sb);
+
+#endif // VFS_H
@@ -0,0 +1,88 @@
+// vmm.h
+#ifndef VMM_H
+#define VMM_H
+
+#include <stdint.h>
+#include "vfs.h"
+
+// Demand-paged kernel memory, one top-level slot shared by every address
+// space; other address spaces also get a private range in the low half
+#define VMM_KERNEL_BASE  0xFFFFA00000000000ULL
+#define VMM_KERNEL_END   0xFFFFA08000000000ULL
+#define VMM_PRIVATE_BASE 0x0000008000000000ULL
+#define VMM_PRIVATE_END  0x0000800000000000ULL
+
+// Mapping flags
+#define VMM_WRITE 0x01
+#define VMM_FILE  0x02 // Private copy of a file, filled from the page cache
+
+typedef struct Vma {
+    uint64_t start;
+    uint64_t end;
+    uint32_t flags;
+    VfsInode *inode;
+    uint64_t file_offset;
+    struct Vma *next;                // Sorted by address
+} Vma;
+
+typedef struct AddressSpace {
+    char name[16];
+    uint64_t pml4;                   // Physical address loaded into CR3
+    uint16_t pcid;                   // TLB tag while PCIDs are on; 0 for the kernel
+    int tlb_stale;                   // Tables changed while not loaded
+    Vma *vmas;
+    uint64_t base;                   // Range handed out by the vmm_map_*() calls
+    uint64_t limit;
+    uint64_t mapped_bytes;
+    uint64_t resident_pages;         // Frames mapped, shared ones in each space
+    uint64_t minor_faults;           // Resolved without I/O
+    uint64_t major_faults;           // Had to read a file from its device
+    uint64_t cow_faults;             // Minor faults that copied a shared frame
+    struct AddressSpace *next;
+} AddressSpace;
+
+/**
+ * vmm_init - Sets up the kernel address space and the page fault handler.
+ *
+ * Call after pmm_init(). Pages of a mapping get frames on first touch:
+ * reads of untouched anonymous memory share one zero frame, and writes to
+ * shared frames copy them, so large sparse buffers cost only what is used.
+ */
+void vmm_init(void);
+
+AddressSpace *vmm_kernel_space(void);
+AddressSpace *vmm_current(void);
+
+// A new space with the kernel half shared and an empty private range
+AddressSpace *vmm_create(const char *name);
+
+// Unmaps everything and frees the page tables; not the kernel or current space
+int vmm_destroy(AddressSpace *space);
+
+// Loads a space; with PCIDs on its cached translations survive unless
+// its tables changed while another space was loaded
+void vmm_switch(AddressSpace *space);
+
+// Turns PCIDs on or off from the kernel space; -1 if the CPU lacks them
+int vmm_set_pcid(int enabled);
+
+// Reserves zero-filled memory; nothing is allocated until it is touched
+void *vmm_map_anonymous(AddressSpace *space, uint64_t size, uint32_t flags);
+
+// Maps a private copy of `size` bytes of a file from `offset` (page aligned);
+// the mapping holds an inode reference until it is unmapped
+void *vmm_map_file(AddressSpace *space, VfsInode *inode, uint64_t offset, uint64_t size, uint32_t flags);
+
+// Maps a copy-on-write duplicate of the anonymous mapping starting at `source`
+void *vmm_map_copy(AddressSpace *space, const void *source);
+
+int vmm_unmap(AddressSpace *space, void *address);
+
+// Returns the whole pages of a range to zero-fill-on-demand; -1 if the
+// range is not inside one anonymous mapping
+int vmm_discard(AddressSpace *space, void *address, uint64_t size);
+
+int vmm_count(void);
+AddressSpace *vmm_get(int index);
+
+#endif // VMM_H
@@ -0,0 +1,13 @@
+# Benchmark sweep for headless runs; boot with "script=/etc/bench.sh"
+about
+boottime
+benchsuite 0
+cachestat
+conbench
+ctxbench 2000
+disktool listdisks
+disktool selectdisk 0
+disktool bench read bs=4k qd=1 runtime=2
+disktool bench randread bs=4k qd=4 runtime=2
+idlestat
+dmesg warn